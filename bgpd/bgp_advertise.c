@@ -36,6 +36,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_packet.h"
 #include "bgpd/bgp_fsm.h"
 #include "bgpd/bgp_mplsvpn.h"
+#include "bgpd/bgp_pool.h"
 
 /* BGP advertise attribute is used for pack same attribute update into
    one packet.  To do that we maintain attribute hash in struct
@@ -245,6 +246,8 @@ bgp_adj_out_set (struct bgp_node *rn, struct peer *peer, struct prefix *p,
         {
           BGP_ADJ_OUT_ADD (rn, adj);
           bgp_lock_node (rn);
+          adj->rn = rn;
+          LIST_INSERT_HEAD (&peer->adj_out[afi][safi], adj, peer_thread);
         }
     }
 
@@ -311,6 +314,7 @@ bgp_adj_out_unset (struct bgp_node *rn, struct peer *peer, struct prefix *p,
     {
       /* Remove myself from adjacency. */
       BGP_ADJ_OUT_DEL (rn, adj);
+      LIST_REMOVE (adj, peer_thread);
       
       /* Free allocated information.  */
       bgp_adj_out_free (adj);
@@ -330,9 +334,14 @@ bgp_adj_out_remove (struct bgp_node *rn, struct bgp_adj_out *adj,
     bgp_advertise_clean (peer, adj, afi, safi);
 
   BGP_ADJ_OUT_DEL (rn, adj);
+  LIST_REMOVE (adj, peer_thread);
   bgp_adj_out_free (adj);
 }
 
+/* Every bgp_adj_in comes from here. */
+struct bgp_pool bgp_adj_in_pool = BGP_POOL_INIT (MTYPE_BGP_ADJ_IN,
+                                                 struct bgp_adj_in);
+
 void
 bgp_adj_in_set (struct bgp_node *rn, struct peer *peer, struct attr *attr)
 {
@@ -350,11 +359,15 @@ bgp_adj_in_set (struct bgp_node *rn, struct peer *peer, struct attr *attr)
 	  return;
 	}
     }
-  adj = XCALLOC (MTYPE_BGP_ADJ_IN, sizeof (struct bgp_adj_in));
+  adj = bgp_pool_get (&bgp_adj_in_pool);
   adj->peer = peer_lock (peer); /* adj_in peer reference */
   adj->attr = bgp_attr_intern (attr);
   BGP_ADJ_IN_ADD (rn, adj);
   bgp_lock_node (rn);
+  adj->rn = rn;
+  LIST_INSERT_HEAD (&peer->adj_in[bgp_node_table (rn)->afi]
+                                 [bgp_node_table (rn)->safi],
+                    adj, peer_thread);
 }
 
 void
@@ -362,8 +375,9 @@ bgp_adj_in_remove (struct bgp_node *rn, struct bgp_adj_in *bai)
 {
   bgp_attr_unintern (&bai->attr);
   BGP_ADJ_IN_DEL (rn, bai);
+  LIST_REMOVE (bai, peer_thread);
   peer_unlock (bai->peer); /* adj_in peer reference */
-  XFREE (MTYPE_BGP_ADJ_IN, bai);
+  bgp_pool_put (&bgp_adj_in_pool, bai);
 }
 
 int
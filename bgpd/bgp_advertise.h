@@ -22,6 +22,9 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #define _QUAGGA_BGP_ADVERTISE_H
 
 #include <lib/fifo.h>
+#include <lib/queue.h>
+
+struct bgp_pool;
 
 /* BGP advertise FIFO.  */
 struct bgp_advertise_fifo
@@ -73,6 +76,10 @@ struct bgp_adj_out
   struct bgp_adj_out *next;
   struct bgp_adj_out *prev;
 
+  /* For the list of adjacencies of the peer.  */
+  LIST_ENTRY(bgp_adj_out) peer_thread;
+  struct bgp_node *rn;
+
   /* Advertised peer.  */
   struct peer *peer;
 
@@ -90,6 +97,10 @@ struct bgp_adj_in
   struct bgp_adj_in *next;
   struct bgp_adj_in *prev;
 
+  /* For the list of adjacencies of the peer.  */
+  LIST_ENTRY(bgp_adj_in) peer_thread;
+  struct bgp_node *rn;
+
   /* Received peer.  */
   struct peer *peer;
 
@@ -160,6 +171,8 @@ extern void bgp_adj_out_remove (struct bgp_node *, struct bgp_adj_out *,
 extern int bgp_adj_out_lookup (struct peer *, struct prefix *, afi_t, safi_t,
 			struct bgp_node *);
 
+extern struct bgp_pool bgp_adj_in_pool;
+
 extern void bgp_adj_in_set (struct bgp_node *, struct peer *, struct attr *);
 extern int bgp_adj_in_unset (struct bgp_node *, struct peer *);
 extern void bgp_adj_in_remove (struct bgp_node *, struct bgp_adj_in *);
@@ -628,6 +628,16 @@ aspath_str_update (struct aspath *as)
   aspath_make_str_count (as);
 }
 
+/* AS path AS has just gone into the hash. */
+static void
+aspath_hashed (struct aspath *as)
+{
+  static unsigned long aspath_id;
+
+  as->key = aspath_key_make (as);
+  as->id = ++aspath_id;
+}
+
 /* Intern allocated AS path. */
 struct aspath *
 aspath_intern (struct aspath *aspath)
@@ -643,6 +653,8 @@ aspath_intern (struct aspath *aspath)
   find = hash_get (ashash, aspath, hash_alloc_intern);
   if (find != aspath)
     aspath_free (aspath);
+  else
+    aspath_hashed (find);
 
   find->refcnt++;
 
@@ -835,6 +847,8 @@ aspath_parse (struct stream *s, size_t length, int use32bit)
       /* aspath_key_make() always updates the string */
       XFREE (MTYPE_AS_STR, as.str);
     }
+  else
+    aspath_hashed (find);
 
   find->refcnt++;
 
@@ -1601,6 +1615,33 @@ aspath_cmp_left (const struct aspath *aspath1, const struct aspath *aspath2)
   return 0;
 }
 
+/* What aspath_cmp_left compares a path by, so that paths can be
+   grouped by it without comparing them in pairs.  A path whose first
+   segment past any confederation segments is an AS_SEQUENCE gives
+   ASPATH_LEFT_AS, with its leftmost AS in AS.  A path without segments
+   gives ASPATH_LEFT_LOCAL, and compares equal to another such.  Any
+   other path gives ASPATH_LEFT_NONE and compares equal to none. */
+int
+aspath_left_key (const struct aspath *aspath, as_t *as)
+{
+  const struct assegment *seg;
+
+  *as = 0;
+  if (! aspath)
+    return ASPATH_LEFT_NONE;
+  if (! aspath->segments)
+    return ASPATH_LEFT_LOCAL;
+
+  for (seg = aspath->segments; seg; seg = seg->next)
+    if (seg->type != AS_CONFED_SEQUENCE && seg->type != AS_CONFED_SET)
+      break;
+  if (! seg || seg->type != AS_SEQUENCE)
+    return ASPATH_LEFT_NONE;
+
+  *as = seg->as[0];
+  return ASPATH_LEFT_AS;
+}
+
 /* Truncate an aspath after a number of hops, and put the hops remaining
  * at the front of another aspath.  Needed for AS4 compat.
  *
@@ -1725,6 +1766,14 @@ aspath_cmp_left_confed (const struct aspath *aspath1, const struct aspath *aspat
   return 0;
 }
 
+/* Whether aspath_cmp_left_confed could find the path equal to another. */
+int
+aspath_left_confed (const struct aspath *aspath)
+{
+  return (aspath && aspath->segments
+          && aspath->segments->type == AS_CONFED_SEQUENCE);
+}
+
 /* Delete all leading AS_CONFED_SEQUENCE/SET segments from aspath.
  * See RFC3065, 6.1 c1 */
 struct aspath *
@@ -1982,6 +2031,9 @@ aspath_key_make (void *p)
   struct aspath *aspath = (struct aspath *) p;
   unsigned int key = 0;
 
+  if (aspath->refcnt)
+    return aspath->key;
+
   if (!aspath->str)
     aspath_str_update (aspath);
 
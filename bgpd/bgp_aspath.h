@@ -27,6 +27,11 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #define AS_CONFED_SEQUENCE           3
 #define AS_CONFED_SET                4
 
+/* What aspath_left_key finds in a path.  */
+#define ASPATH_LEFT_NONE             0
+#define ASPATH_LEFT_LOCAL            1
+#define ASPATH_LEFT_AS               2
+
 /* Private AS range defined in RFC2270.  */
 #define BGP_PRIVATE_AS_MIN       64512U
 #define BGP_PRIVATE_AS_MAX       65535U
@@ -67,6 +72,13 @@ struct aspath
      and AS path regular expression match.  */
   char *str;
   unsigned short str_len;
+
+  /* Hash key, kept once interned.  An interned AS path never changes. */
+  unsigned int key;
+
+  /* Serial number given at interning, so that a result remembered for
+     an AS path is not taken for one that later has the same address. */
+  unsigned long id;
 };
 
 #define ASPATH_STR_DEFAULT_LEN 32
@@ -86,6 +98,8 @@ extern struct aspath *aspath_add_confed_seq (struct aspath *, as_t);
 extern int aspath_cmp (const void *, const void *);
 extern int aspath_cmp_left (const struct aspath *, const struct aspath *);
 extern int aspath_cmp_left_confed (const struct aspath *, const struct aspath *);
+extern int aspath_left_key (const struct aspath *, as_t *);
+extern int aspath_left_confed (const struct aspath *);
 extern struct aspath *aspath_delete_confed_seq (struct aspath *);
 extern struct aspath *aspath_empty (void);
 extern struct aspath *aspath_empty_get (void);
@@ -92,6 +92,18 @@ static const struct message attr_flag_str[] =
 
 static struct hash *cluster_hash;
 
+static unsigned int
+cluster_hash_key_make (void *p)
+{
+  const struct cluster_list *cluster = p;
+
+  /* Interned lists never change, the key is kept from interning. */
+  if (cluster->refcnt)
+    return cluster->key;
+
+  return jhash(cluster->list, cluster->length, 0);
+}
+
 static void *
 cluster_hash_alloc (void *p)
 {
@@ -121,10 +133,13 @@ cluster_parse (struct in_addr * pnt, int length)
   struct cluster_list tmp;
   struct cluster_list *cluster;
 
+  tmp.refcnt = 0;
   tmp.length = length;
   tmp.list = pnt;
 
   cluster = hash_get (cluster_hash, &tmp, cluster_hash_alloc);
+  if (! cluster->refcnt)
+    cluster->key = cluster_hash_key_make (cluster);
   cluster->refcnt++;
   return cluster;
 }
@@ -140,14 +155,6 @@ cluster_loop_check (struct cluster_list *cluster, struct in_addr originator)
   return 0;
 }
 
-static unsigned int
-cluster_hash_key_make (void *p)
-{
-  const struct cluster_list *cluster = p;
-
-  return jhash(cluster->list, cluster->length, 0);
-}
-
 static int
 cluster_hash_cmp (const void *p1, const void *p2)
 {
@@ -193,6 +200,8 @@ cluster_intern (struct cluster_list *cluster)
   struct cluster_list *find;
 
   find = hash_get (cluster_hash, cluster, cluster_hash_alloc);
+  if (! find->refcnt)
+    find->key = cluster_hash_key_make (find);
   find->refcnt++;
 
   return find;
@@ -336,6 +345,17 @@ transit_free (struct transit *transit)
 }
 
 
+static unsigned int
+transit_hash_key_make (void *p)
+{
+  const struct transit * transit = p;
+
+  if (transit->refcnt)
+    return transit->key;
+
+  return jhash(transit->val, transit->length, 0);
+}
+
 static void *
 transit_hash_alloc (void *p)
 {
@@ -351,6 +371,8 @@ transit_intern (struct transit *transit)
   find = hash_get (transit_hash, transit, transit_hash_alloc);
   if (find != transit)
     transit_free (transit);
+  else
+    find->key = transit_hash_key_make (find);
   find->refcnt++;
 
   return find;
@@ -369,14 +391,6 @@ transit_unintern (struct transit *transit)
     }
 }
 
-static unsigned int
-transit_hash_key_make (void *p)
-{
-  const struct transit * transit = p;
-
-  return jhash(transit->val, transit->length, 0);
-}
-
 static int
 transit_hash_cmp (const void *p1, const void *p2)
 {
@@ -703,6 +717,42 @@ bgp_attr_intern (struct attr *attr)
   return find;
 }
 
+/* One more reference to each interned part of ATTR. */
+static void
+bgp_attr_ref_sub (struct attr *attr)
+{
+  if (attr->aspath)
+    attr->aspath->refcnt++;
+  if (attr->community)
+    attr->community->refcnt++;
+  if (attr->extra)
+    {
+      struct attr_extra *attre = attr->extra;
+
+      if (attre->ecommunity)
+        attre->ecommunity->refcnt++;
+      if (attre->lcommunity)
+        attre->lcommunity->refcnt++;
+      if (attre->cluster)
+        attre->cluster->refcnt++;
+      if (attre->transit)
+        attre->transit->refcnt++;
+    }
+}
+
+/* One more reference to an interned attribute, the same as interning
+   an equal one again would give, but without looking it up. */
+struct attr *
+bgp_attr_intern_ref (struct attr *attr)
+{
+  assert (attr->refcnt);
+
+  bgp_attr_ref_sub (attr);
+  attr->refcnt++;
+
+  return attr;
+}
+
 
 /* Make network statement's attribute. */
 struct attr *
@@ -2446,6 +2496,112 @@ bgp_attr_parse (struct peer *peer, struct attr *attr, bgp_size_t size,
   return BGP_ATTR_PARSE_PROCEED;
 }
 
+/* A peer sending a table typically repeats the path attributes of one
+   UPDATE in the next, with only the NLRI different.  The raw attributes
+   of the last UPDATE parsed from a peer are kept along with what
+   bgp_attr_parse made of them, so that the same bytes again need not be
+   parsed, nor their parts looked up in the attribute hashes.  Only
+   attributes without MP_REACH_NLRI and MP_UNREACH_NLRI are kept, those
+   carry NLRI of their own. */
+struct bgp_attr_cache
+{
+  u_char *raw;
+  bgp_size_t length;
+  bgp_size_t size;
+
+  /* Holds a reference to each interned part. */
+  struct attr attr;
+  struct attr_extra extra;
+
+  /* Configuration bgp_attr_parse went by that can change without the
+     session being reset. */
+  int enforce_first_as;
+};
+
+static int
+bgp_attr_cache_enforce_first_as (struct peer *peer)
+{
+  return peer->bgp && bgp_flag_check (peer->bgp, BGP_FLAG_ENFORCE_FIRST_AS);
+}
+
+/* If the LENGTH bytes of attributes at the current position of the
+   input buffer of PEER are those of the last UPDATE parsed, fill in
+   ATTR as bgp_attr_parse would, step over them and return 1.
+   Otherwise return 0 and leave them to be parsed. */
+int
+bgp_attr_cache_lookup (struct peer *peer, bgp_size_t length,
+                       struct attr *attr)
+{
+  struct bgp_attr_cache *cache = peer->attr_cache;
+  struct attr_extra *extra = attr->extra;
+
+  if (! cache || ! extra
+      || cache->length != length
+      || cache->enforce_first_as != bgp_attr_cache_enforce_first_as (peer)
+      || memcmp (cache->raw, BGP_INPUT_PNT (peer), length) != 0)
+    return 0;
+
+  *attr = cache->attr;
+  *extra = cache->extra;
+  attr->extra = extra;
+  bgp_attr_ref_sub (attr);
+
+  stream_forward_getp (BGP_INPUT (peer), length);
+  peer->update_attr_reused++;
+  return 1;
+}
+
+/* Keep ATTR, just parsed from the LENGTH bytes at RAW, for
+   bgp_attr_cache_lookup. */
+void
+bgp_attr_cache_update (struct peer *peer, const u_char *raw,
+                       bgp_size_t length, struct attr *attr)
+{
+  struct bgp_attr_cache *cache = peer->attr_cache;
+
+  if (! attr->extra
+      || attr->extra->encap_subtlvs
+      || CHECK_FLAG (attr->flag, ATTR_FLAG_BIT (BGP_ATTR_MP_REACH_NLRI))
+      || CHECK_FLAG (attr->flag, ATTR_FLAG_BIT (BGP_ATTR_MP_UNREACH_NLRI)))
+    return;
+
+  if (cache)
+    bgp_attr_unintern_sub (&cache->attr);
+  else
+    cache = peer->attr_cache = XCALLOC (MTYPE_BGP_ATTR_CACHE,
+                                        sizeof (struct bgp_attr_cache));
+
+  if (cache->size < length)
+    {
+      cache->raw = XREALLOC (MTYPE_BGP_ATTR_CACHE, cache->raw, length);
+      cache->size = length;
+    }
+  memcpy (cache->raw, raw, length);
+  cache->length = length;
+
+  cache->attr = *attr;
+  cache->extra = *attr->extra;
+  cache->attr.extra = &cache->extra;
+  bgp_attr_ref_sub (&cache->attr);
+
+  cache->enforce_first_as = bgp_attr_cache_enforce_first_as (peer);
+}
+
+void
+bgp_attr_cache_free (struct peer *peer)
+{
+  struct bgp_attr_cache *cache = peer->attr_cache;
+
+  if (! cache)
+    return;
+
+  bgp_attr_unintern_sub (&cache->attr);
+  if (cache->raw)
+    XFREE (MTYPE_BGP_ATTR_CACHE, cache->raw);
+  XFREE (MTYPE_BGP_ATTR_CACHE, cache);
+  peer->attr_cache = NULL;
+}
+
 int stream_put_prefix (struct stream *, struct prefix *);
 
 size_t
@@ -133,6 +133,7 @@ struct cluster_list
   unsigned long refcnt;
   int length;
   struct in_addr *list;
+  unsigned int key;
 };
 
 /* Unknown transit attribute. */
@@ -141,6 +142,7 @@ struct transit
   unsigned long refcnt;
   int length;
   u_char *val;
+  unsigned int key;
 };
 
 #define ATTR_FLAG_BIT(X)  (1 << ((X) - 1))
@@ -164,6 +166,11 @@ extern struct attr_extra *bgp_attr_extra_get (struct attr *);
 extern void bgp_attr_extra_free (struct attr *);
 extern void bgp_attr_dup (struct attr *, struct attr *);
 extern struct attr *bgp_attr_intern (struct attr *attr);
+extern struct attr *bgp_attr_intern_ref (struct attr *attr);
+extern int bgp_attr_cache_lookup (struct peer *, bgp_size_t, struct attr *);
+extern void bgp_attr_cache_update (struct peer *, const u_char *, bgp_size_t,
+                                   struct attr *);
+extern void bgp_attr_cache_free (struct peer *);
 extern void bgp_attr_unintern_sub (struct attr *);
 extern void bgp_attr_unintern (struct attr **);
 extern void bgp_attr_flush (struct attr *);
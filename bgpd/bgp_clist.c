@@ -93,6 +93,22 @@ community_entry_free (struct community_entry *entry)
   XFREE (MTYPE_COMMUNITY_LIST_ENTRY, entry);
 }
 
+/* What the community-list made of an interned community, extended
+   community or large community value, by its hash key.  Whose result
+   it is goes by the serial number of the value.  */
+#define COMMUNITY_LIST_CACHE_SIZE 1024
+
+struct community_list_cache
+{
+  unsigned long id;
+
+  /* Which results are known, and what they are.  */
+  u_char known;
+  u_char result;
+#define COMMUNITY_LIST_CACHE_MATCH     0x01
+#define COMMUNITY_LIST_CACHE_EXACT     0x02
+};
+
 /* Allocate a new community-list.  */
 static struct community_list *
 community_list_new (void)
@@ -106,6 +122,8 @@ community_list_free (struct community_list *list)
 {
   if (list->name)
     XFREE (MTYPE_COMMUNITY_LIST_NAME, list->name);
+  if (list->cache)
+    XFREE (MTYPE_COMMUNITY_LIST_CACHE, list->cache);
   XFREE (MTYPE_COMMUNITY_LIST, list);
 }
 
@@ -272,11 +290,56 @@ community_list_empty_p (struct community_list *list)
   return (list->head == NULL && list->tail == NULL) ? 1 : 0;
 }
 
+static void
+community_list_cache_flush (struct community_list *list)
+{
+  if (list->cache)
+    memset (list->cache, 0,
+            COMMUNITY_LIST_CACHE_SIZE * sizeof (struct community_list_cache));
+}
+
+/* The cache entry for the value with KEY and ID, which may hold the
+   result for another value until it is given one.  */
+static struct community_list_cache *
+community_list_cache_get (struct community_list *list, unsigned int key,
+                          unsigned long id)
+{
+  struct community_list_cache *cache;
+
+  if (! list->cache)
+    list->cache = XCALLOC (MTYPE_COMMUNITY_LIST_CACHE,
+                           COMMUNITY_LIST_CACHE_SIZE
+                           * sizeof (struct community_list_cache));
+
+  cache = &list->cache[key % COMMUNITY_LIST_CACHE_SIZE];
+  if (cache->id != id)
+    {
+      cache->id = id;
+      cache->known = 0;
+      cache->result = 0;
+    }
+  return cache;
+}
+
+static int
+community_list_cache_set (struct community_list_cache *cache, u_char which,
+                          int result)
+{
+  cache->known |= which;
+  if (result)
+    cache->result |= which;
+  else
+    cache->result &= ~which;
+  return result;
+}
+
 /* Add community-list entry to the list.  */
 static void
 community_list_entry_add (struct community_list *list,
                           struct community_entry *entry)
 {
+  community_list_cache_flush (list);
+
   entry->next = NULL;
   entry->prev = list->tail;
 
@@ -292,6 +355,8 @@ static void
 community_list_entry_delete (struct community_list *list,
                              struct community_entry *entry, int style)
 {
+  community_list_cache_flush (list);
+
   if (entry->next)
     entry->next->prev = entry->prev;
   else
@@ -564,10 +629,9 @@ ecommunity_regexp_match (struct ecommunity *ecom, regex_t * reg)
   return 0;
 }
 
-/* When given community attribute matches to the community-list return
-   1 else return 0.  */
-int
-community_list_match (struct community *com, struct community_list *list)
+static int
+community_list_match_entries (struct community *com,
+                              struct community_list *list)
 {
   struct community_entry *entry;
 
@@ -593,8 +657,9 @@ community_list_match (struct community *com, struct community_list *list)
   return 0;
 }
 
-int
-lcommunity_list_match (struct lcommunity *lcom, struct community_list *list)
+static int
+lcommunity_list_match_entries (struct lcommunity *lcom,
+                               struct community_list *list)
 {
   struct community_entry *entry;
 
@@ -617,8 +682,9 @@ lcommunity_list_match (struct lcommunity *lcom, struct community_list *list)
   return 0;
 }
 
-int
-ecommunity_list_match (struct ecommunity *ecom, struct community_list *list)
+static int
+ecommunity_list_match_entries (struct ecommunity *ecom,
+                               struct community_list *list)
 {
   struct community_entry *entry;
 
@@ -643,9 +709,9 @@ ecommunity_list_match (struct ecommunity *ecom, struct community_list *list)
 
 /* Perform exact matching.  In case of expanded community-list, do
    same thing as community_list_match().  */
-int
-community_list_exact_match (struct community *com,
-                            struct community_list *list)
+static int
+community_list_exact_match_entries (struct community *com,
+                                    struct community_list *list)
 {
   struct community_entry *entry;
 
@@ -671,6 +737,70 @@ community_list_exact_match (struct community *com,
   return 0;
 }
 
+/* When given community attribute matches to the community-list return
+   1 else return 0.  */
+int
+community_list_match (struct community *com, struct community_list *list)
+{
+  struct community_list_cache *cache;
+
+  if (! com || ! com->refcnt)
+    return community_list_match_entries (com, list);
+
+  cache = community_list_cache_get (list, com->key, com->id);
+  if (cache->known & COMMUNITY_LIST_CACHE_MATCH)
+    return (cache->result & COMMUNITY_LIST_CACHE_MATCH) ? 1 : 0;
+  return community_list_cache_set (cache, COMMUNITY_LIST_CACHE_MATCH,
+                                   community_list_match_entries (com, list));
+}
+
+int
+community_list_exact_match (struct community *com,
+                            struct community_list *list)
+{
+  struct community_list_cache *cache;
+
+  if (! com || ! com->refcnt)
+    return community_list_exact_match_entries (com, list);
+
+  cache = community_list_cache_get (list, com->key, com->id);
+  if (cache->known & COMMUNITY_LIST_CACHE_EXACT)
+    return (cache->result & COMMUNITY_LIST_CACHE_EXACT) ? 1 : 0;
+  return community_list_cache_set (cache, COMMUNITY_LIST_CACHE_EXACT,
+                                   community_list_exact_match_entries (com,
+                                                                       list));
+}
+
+int
+lcommunity_list_match (struct lcommunity *lcom, struct community_list *list)
+{
+  struct community_list_cache *cache;
+
+  if (! lcom || ! lcom->refcnt)
+    return lcommunity_list_match_entries (lcom, list);
+
+  cache = community_list_cache_get (list, lcom->key, lcom->id);
+  if (cache->known & COMMUNITY_LIST_CACHE_MATCH)
+    return (cache->result & COMMUNITY_LIST_CACHE_MATCH) ? 1 : 0;
+  return community_list_cache_set (cache, COMMUNITY_LIST_CACHE_MATCH,
+                                   lcommunity_list_match_entries (lcom, list));
+}
+
+int
+ecommunity_list_match (struct ecommunity *ecom, struct community_list *list)
+{
+  struct community_list_cache *cache;
+
+  if (! ecom || ! ecom->refcnt)
+    return ecommunity_list_match_entries (ecom, list);
+
+  cache = community_list_cache_get (list, ecom->key, ecom->id);
+  if (cache->known & COMMUNITY_LIST_CACHE_MATCH)
+    return (cache->result & COMMUNITY_LIST_CACHE_MATCH) ? 1 : 0;
+  return community_list_cache_set (cache, COMMUNITY_LIST_CACHE_MATCH,
+                                   ecommunity_list_match_entries (ecom, list));
+}
+
 /* Delete all permitted communities in the list from com.  */
 struct community *
 community_list_match_delete (struct community *com,
@@ -61,6 +61,10 @@ struct community_list
   /* Community-list entry in this community-list.  */
   struct community_entry *head;
   struct community_entry *tail;
+
+  /* Results for interned values matched lately.  Allocated on first
+     use and emptied whenever an entry is added or deleted.  */
+  struct community_list_cache *cache;
 };
 
 /* Each entry in community-list.  */
@@ -21,6 +21,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include <zebra.h>
 
 #include "hash.h"
+#include "jhash.h"
 #include "memory.h"
 
 #include "bgpd/bgp_community.h"
@@ -28,6 +29,9 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 /* Hash of community attribute. */
 static struct hash *comhash;
 
+/* Last serial number given to an interned community attribute. */
+static unsigned long community_id;
+
 /* Allocate a new communities value.  */
 static struct community *
 community_new (void)
@@ -308,6 +312,11 @@ community_intern (struct community *com)
      hash, it should be freed.  */
   if (find != com)
     community_free (com);
+  else
+    {
+      find->key = community_hash_make (find);
+      find->id = ++community_id;
+    }
 
   /* Increment refrence counter.  */
   find->refcnt++;
@@ -394,20 +403,11 @@ community_str (struct community *com)
 unsigned int
 community_hash_make (struct community *com)
 {
-  unsigned char *pnt = (unsigned char *)com->val;
-  int size = com->size * 4;
-  unsigned int key = 0;
-  int c;
-
-  for (c = 0; c < size; c += 4)
-    {
-      key += pnt[c];
-      key += pnt[c + 1];
-      key += pnt[c + 2];
-      key += pnt[c + 3];
-    }
+  /* An interned community never changes, its key is made once. */
+  if (com->refcnt)
+    return com->key;
 
-  return key;
+  return jhash (com->val, com->size * 4, 0);
 }
 
 int
@@ -36,6 +36,12 @@ struct community
   /* String of community attribute.  This sring is used by vty output
      and expanded community-list for regular expression match.  */
   char *str;
+
+  /* Hash key, kept once interned. */
+  unsigned int key;
+
+  /* Serial number, given when interned. */
+  unsigned long id;
 };
 
 /* Well-known communities value.  */
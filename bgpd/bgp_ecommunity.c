@@ -21,6 +21,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include <zebra.h>
 
 #include "hash.h"
+#include "jhash.h"
 #include "memory.h"
 #include "prefix.h"
 #include "command.h"
@@ -32,6 +33,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 
 /* Hash of community attribute. */
 static struct hash *ecomhash;
+static unsigned long ecommunity_id;
 
 /* Allocate a new ecommunities.  */
 static struct ecommunity *
@@ -200,6 +202,11 @@ ecommunity_intern (struct ecommunity *ecom)
 
   if (find != ecom)
     ecommunity_free (&ecom);
+  else
+    {
+      find->key = ecommunity_hash_make (find);
+      find->id = ++ecommunity_id;
+    }
 
   find->refcnt++;
 
@@ -233,25 +240,12 @@ ecommunity_unintern (struct ecommunity **ecom)
 unsigned int
 ecommunity_hash_make (void *arg)
 {
-  const struct ecommunity *ecom = arg;
-  int size = ecom->size * ECOMMUNITY_SIZE;
-  u_int8_t *pnt = ecom->val;
-  unsigned int key = 0;
-  int c;
+  struct ecommunity *ecom = arg;
 
-  for (c = 0; c < size; c += ECOMMUNITY_SIZE)
-    {
-      key += pnt[c];
-      key += pnt[c + 1];
-      key += pnt[c + 2];
-      key += pnt[c + 3];
-      key += pnt[c + 4];
-      key += pnt[c + 5];
-      key += pnt[c + 6];
-      key += pnt[c + 7];
-    }
+  if (ecom->refcnt)
+    return ecom->key;
 
-  return key;
+  return jhash (ecom->val, ecom->size * ECOMMUNITY_SIZE, 0);
 }
 
 /* Compare two Extended Communities Attribute structure.  */
@@ -59,6 +59,12 @@ struct ecommunity
 
   /* Human readable format string.  */
   char *str;
+
+  /* Hash key, kept once interned. */
+  unsigned int key;
+
+  /* Serial number, given when interned. */
+  unsigned long id;
 };
 
 /* Extended community value is eight octet.  */
@@ -64,6 +64,20 @@ struct as_filter
 
   regex_t *reg;
   char *reg_str;
+
+  /* The same expression compiled for AS paths, NULL if it could not
+     be, in which case reg is used. */
+  struct bgp_aspath_re *re;
+};
+
+/* What an AS list made of AS paths seen lately, by hash key.  Entries
+   are told apart by the serial number of the AS path. */
+#define AS_LIST_CACHE_SIZE 1024
+
+struct as_list_cache
+{
+  unsigned long id;
+  enum as_filter_type type;
 };
 
 /* AS path filter list. */
@@ -78,6 +92,9 @@ struct as_list
 
   struct as_filter *head;
   struct as_filter *tail;
+
+  /* Made on first use, emptied whenever the list changes. */
+  struct as_list_cache *cache;
 };
 
 /* ip as-path access-list 10 permit AS1. */
@@ -103,6 +120,8 @@ as_filter_free (struct as_filter *asfilter)
 {
   if (asfilter->reg)
     bgp_regex_free (asfilter->reg);
+  if (asfilter->re)
+    bgp_aspath_re_free (asfilter->re);
   if (asfilter->reg_str)
     XFREE (MTYPE_AS_FILTER_STR, asfilter->reg_str);
   XFREE (MTYPE_AS_FILTER, asfilter);
@@ -116,6 +135,7 @@ as_filter_make (regex_t *reg, const char *reg_str, enum as_filter_type type)
 
   asfilter = as_filter_new ();
   asfilter->reg = reg;
+  asfilter->re = bgp_aspath_re_compile (reg_str);
   asfilter->type = type;
   asfilter->reg_str = XSTRDUP (MTYPE_AS_FILTER_STR, reg_str);
 
@@ -134,9 +154,19 @@ as_filter_lookup (struct as_list *aslist, const char *reg_str,
   return NULL;
 }
 
+static void
+as_list_cache_flush (struct as_list *aslist)
+{
+  if (aslist->cache)
+    memset (aslist->cache, 0,
+            AS_LIST_CACHE_SIZE * sizeof (struct as_list_cache));
+}
+
 static void
 as_list_filter_add (struct as_list *aslist, struct as_filter *asfilter)
 {
+  as_list_cache_flush (aslist);
+
   asfilter->next = NULL;
   asfilter->prev = aslist->tail;
 
@@ -181,6 +211,8 @@ as_list_free (struct as_list *aslist)
       free (aslist->name);
       aslist->name = NULL;
     }
+  if (aslist->cache)
+    XFREE (MTYPE_AS_LIST_CACHE, aslist->cache);
   XFREE (MTYPE_AS_LIST, aslist);
 }
 
@@ -345,6 +377,8 @@ as_list_empty (struct as_list *aslist)
 static void
 as_list_filter_delete (struct as_list *aslist, struct as_filter *asfilter)
 {
+  as_list_cache_flush (aslist);
+
   if (asfilter->next)
     asfilter->next->prev = asfilter->prev;
   else
@@ -369,16 +403,31 @@ as_list_filter_delete (struct as_list *aslist, struct as_filter *asfilter)
 static int
 as_filter_match (struct as_filter *asfilter, struct aspath *aspath)
 {
+  if (asfilter->re)
+    return bgp_aspath_re_match (asfilter->re, aspath);
   if (bgp_regexec (asfilter->reg, aspath) != REG_NOMATCH)
     return 1;
   return 0;
 }
 
+static enum as_filter_type
+as_list_match (struct as_list *aslist, struct aspath *aspath)
+{
+  struct as_filter *asfilter;
+
+  for (asfilter = aslist->head; asfilter; asfilter = asfilter->next)
+    {
+      if (as_filter_match (asfilter, aspath))
+	return asfilter->type;
+    }
+  return AS_FILTER_DENY;
+}
+
 /* Apply AS path filter to AS. */
 enum as_filter_type
 as_list_apply (struct as_list *aslist, void *object)
 {
-  struct as_filter *asfilter;
+  struct as_list_cache *cache;
   struct aspath *aspath;
 
   aspath = (struct aspath *) object;
@@ -386,12 +435,21 @@ as_list_apply (struct as_list *aslist, void *object)
   if (aslist == NULL)
     return AS_FILTER_DENY;
 
-  for (asfilter = aslist->head; asfilter; asfilter = asfilter->next)
+  /* Only an interned AS path has its key and serial number. */
+  if (! aspath->refcnt)
+    return as_list_match (aslist, aspath);
+
+  if (! aslist->cache)
+    aslist->cache = XCALLOC (MTYPE_AS_LIST_CACHE,
+                             AS_LIST_CACHE_SIZE * sizeof (struct as_list_cache));
+
+  cache = &aslist->cache[aspath->key % AS_LIST_CACHE_SIZE];
+  if (cache->id != aspath->id)
     {
-      if (as_filter_match (asfilter, aspath))
-	return asfilter->type;
+      cache->type = as_list_match (aslist, aspath);
+      cache->id = aspath->id;
     }
-  return AS_FILTER_DENY;
+  return cache->type;
 }
 
 /* Add hook function. */
@@ -43,6 +43,8 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_dump.h"
 #include "bgpd/bgp_open.h"
 #include "bgpd/bgp_nht.h"
+#include "bgpd/bgp_updgrp.h"
+#include "bgpd/bgp_io.h"
 #ifdef HAVE_SNMP
 #include "bgpd/bgp_snmp.h"
 #endif /* HAVE_SNMP */
@@ -257,6 +259,19 @@ bgp_holdtime_timer (struct thread *thread)
   peer = THREAD_ARG (thread);
   peer->t_holdtime = NULL;
 
+  /* Input that is waiting means it is us who were slow, not the peer
+     who went quiet.  Give the main thread the time to get to it. */
+  if (peer->status == Established && bgp_io_input_pending (peer))
+    {
+      if (BGP_DEBUG (fsm, FSM))
+	zlog (peer->log, LOG_DEBUG,
+	      "%s [FSM] Timer (holdtime timer expire, input pending)",
+	      peer->host);
+      peer->holdtime_deferred++;
+      BGP_TIMER_ON (peer->t_holdtime, bgp_holdtime_timer, 1);
+      return 0;
+    }
+
   if (BGP_DEBUG (fsm, FSM))
     zlog (peer->log, LOG_DEBUG,
 	  "%s [FSM] Timer (holdtime timer expire)",
@@ -519,10 +534,24 @@ bgp_stop (struct peer *peer)
   BGP_TIMER_OFF (peer->t_keepalive);
   BGP_TIMER_OFF (peer->t_routeadv);
 
+  /* No longer takes updates. */
+  bgp_updgrp_peer_leave (peer);
+
+  /* Nor keepalives from the I/O thread. */
+  bgp_io_session_stop (peer);
+
+  /* Nor routes announced to it or taken in again. */
+  bgp_walk_cancel_all (peer);
+
+  /* What it sent last no longer goes. */
+  bgp_attr_cache_free (peer);
+
   /* Stream reset. */
   peer->packet_size = 0;
 
   /* Clear input and output buffer.  */
+  if (peer->rbuf)
+    stream_reset (peer->rbuf);
   if (peer->ibuf)
     stream_reset (peer->ibuf);
   if (peer->work)
@@ -876,6 +905,7 @@ bgp_establish (struct peer *peer)
   /* Increment established count. */
   peer->established++;
   bgp_fsm_change_status (peer, Established);
+  bgp_io_session_start (peer);
 
   /* bgp log-neighbor-changes of neighbor Up */
   if (bgp_flag_check (peer->bgp, BGP_FLAG_LOG_NEIGHBOR_CHANGES))
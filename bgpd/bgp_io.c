@@ -0,0 +1,300 @@
+/* BGP session liveness thread
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+#include <pthread.h>
+#include <poll.h>
+
+#include "command.h"
+#include "memory.h"
+#include "stream.h"
+#include "filter.h"
+#include "network.h"
+#include "log.h"
+
+#include "bgpd/bgpd.h"
+#include "bgpd/bgp_io.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+struct bgp_io_session
+{
+  struct bgp_io_session *next;
+  struct bgp_io_session *prev;
+
+  /* Everything below is under mtx. */
+  pthread_mutex_t mtx;
+  int fd;
+  int keepalive;
+
+  /* When the last whole message went out, and whether the main thread
+     left one half written. */
+  time_t last_write;
+  int partial;
+
+  unsigned long keepalives;
+};
+
+/* Sessions the thread looks after, under io_mtx.  Lock order is io_mtx
+   before the mutex of a session. */
+static struct bgp_io_session *io_sessions;
+static pthread_mutex_t io_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t io_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t io_thread;
+static int io_running;
+static int io_stop;
+
+static time_t
+bgp_io_clock (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec;
+}
+
+/* Whether the kernel still holds unsent bytes for the socket.  If so
+   the peer is being fed messages already. */
+static int
+bgp_io_outq (int fd)
+{
+#ifdef TIOCOUTQ
+  int outq = 0;
+
+  if (ioctl (fd, TIOCOUTQ, &outq) == 0)
+    return outq;
+#endif /* TIOCOUTQ */
+  return 0;
+}
+
+static void
+bgp_io_keepalive_send (struct bgp_io_session *io)
+{
+  u_char buf[BGP_HEADER_SIZE];
+  size_t done = 0;
+  ssize_t n;
+
+  memset (buf, 0xff, BGP_MARKER_SIZE);
+  buf[BGP_MARKER_SIZE] = 0;
+  buf[BGP_MARKER_SIZE + 1] = BGP_HEADER_SIZE;
+  buf[BGP_MARKER_SIZE + 2] = BGP_MSG_KEEPALIVE;
+
+  while (done < sizeof (buf))
+    {
+      n = send (io->fd, buf + done, sizeof (buf) - done,
+                MSG_DONTWAIT | MSG_NOSIGNAL);
+      if (n > 0)
+        {
+          done += n;
+          continue;
+        }
+      if (n < 0 && ERRNO_IO_RETRY (errno) && done > 0)
+        {
+          struct pollfd pfd = { .fd = io->fd, .events = POLLOUT };
+
+          /* Half a message is out, the rest has to follow before
+             anything else can. */
+          if (poll (&pfd, 1, 1000) > 0)
+            continue;
+          shutdown (io->fd, SHUT_RDWR);
+        }
+      /* Nothing went out, or the socket is broken.  Either way it is
+         for the main thread to deal with. */
+      return;
+    }
+
+  io->last_write = bgp_io_clock ();
+  io->keepalives++;
+}
+
+static void
+bgp_io_run (void)
+{
+  struct bgp_io_session *io;
+  time_t now = bgp_io_clock ();
+
+  for (io = io_sessions; io; io = io->next)
+    {
+      pthread_mutex_lock (&io->mtx);
+      if (io->keepalive
+          && ! io->partial
+          && now - io->last_write > io->keepalive
+          && bgp_io_outq (io->fd) == 0)
+        bgp_io_keepalive_send (io);
+      pthread_mutex_unlock (&io->mtx);
+    }
+}
+
+static void *
+bgp_io_main (void *arg)
+{
+  sigset_t sigs;
+  struct timespec ts;
+
+  /* Signals are for the main thread. */
+  sigfillset (&sigs);
+  pthread_sigmask (SIG_BLOCK, &sigs, NULL);
+
+  pthread_mutex_lock (&io_mtx);
+  while (! io_stop)
+    {
+      bgp_io_run ();
+
+      clock_gettime (CLOCK_REALTIME, &ts);
+      ts.tv_sec++;
+      pthread_cond_timedwait (&io_cond, &io_mtx, &ts);
+    }
+  pthread_mutex_unlock (&io_mtx);
+
+  return NULL;
+}
+
+/* The session went Established. */
+void
+bgp_io_session_start (struct peer *peer)
+{
+  struct bgp_io_session *io;
+
+  if (peer->io)
+    bgp_io_session_stop (peer);
+
+  io = XCALLOC (MTYPE_BGP_IO_SESSION, sizeof (struct bgp_io_session));
+  pthread_mutex_init (&io->mtx, NULL);
+  io->fd = peer->fd;
+  io->keepalive = peer->v_keepalive;
+  io->last_write = bgp_io_clock ();
+  peer->io = io;
+
+  pthread_mutex_lock (&io_mtx);
+  io->next = io_sessions;
+  if (io_sessions)
+    io_sessions->prev = io;
+  io_sessions = io;
+
+  /* Started on first use, so that it is never forked away from by
+     daemonizing. */
+  if (! io_running)
+    {
+      io_stop = 0;
+      if (pthread_create (&io_thread, NULL, bgp_io_main, NULL) == 0)
+        io_running = 1;
+      else
+        zlog_err ("Can't create BGP I/O thread: %s", safe_strerror (errno));
+    }
+  pthread_mutex_unlock (&io_mtx);
+}
+
+/* The session goes down.  Must be called before its socket is closed. */
+void
+bgp_io_session_stop (struct peer *peer)
+{
+  struct bgp_io_session *io = peer->io;
+
+  if (! io)
+    return;
+
+  /* Once off the list, the thread can not be looking at it. */
+  pthread_mutex_lock (&io_mtx);
+  if (io->next)
+    io->next->prev = io->prev;
+  if (io->prev)
+    io->prev->next = io->next;
+  else
+    io_sessions = io->next;
+  pthread_mutex_unlock (&io_mtx);
+
+  peer->keepalive_out += io->keepalives;
+  peer->keepalive_io += io->keepalives;
+  peer->io = NULL;
+
+  pthread_mutex_destroy (&io->mtx);
+  XFREE (MTYPE_BGP_IO_SESSION, io);
+}
+
+void
+bgp_io_write_begin (struct peer *peer)
+{
+  if (peer->io)
+    pthread_mutex_lock (&peer->io->mtx);
+}
+
+/* WROTE tells whether a whole message went out. */
+void
+bgp_io_write_end (struct peer *peer, int wrote)
+{
+  struct bgp_io_session *io = peer->io;
+  struct stream *s;
+
+  if (! io)
+    return;
+
+  s = stream_fifo_head (peer->obuf);
+  io->partial = (s && stream_get_getp (s) > 0);
+  if (wrote)
+    io->last_write = bgp_io_clock ();
+  pthread_mutex_unlock (&io->mtx);
+}
+
+/* Whether input from the peer is waiting to be looked at.  The main
+   thread may simply not have got to it. */
+int
+bgp_io_input_pending (struct peer *peer)
+{
+  int nbytes = 0;
+
+  if (peer->rbuf && STREAM_READABLE (peer->rbuf))
+    return 1;
+  if (peer->fd >= 0 && ioctl (peer->fd, FIONREAD, &nbytes) == 0)
+    return nbytes > 0;
+  return 0;
+}
+
+unsigned long
+bgp_io_keepalives (struct peer *peer)
+{
+  unsigned long keepalives = 0;
+
+  if (peer->io)
+    {
+      pthread_mutex_lock (&peer->io->mtx);
+      keepalives = peer->io->keepalives;
+      pthread_mutex_unlock (&peer->io->mtx);
+    }
+  return keepalives;
+}
+
+void
+bgp_io_terminate (void)
+{
+  pthread_mutex_lock (&io_mtx);
+  if (! io_running)
+    {
+      pthread_mutex_unlock (&io_mtx);
+      return;
+    }
+  io_stop = 1;
+  pthread_cond_signal (&io_cond);
+  pthread_mutex_unlock (&io_mtx);
+
+  pthread_join (io_thread, NULL);
+  io_running = 0;
+}
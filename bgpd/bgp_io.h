@@ -0,0 +1,48 @@
+/* BGP session liveness thread
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef _QUAGGA_BGP_IO_H
+#define _QUAGGA_BGP_IO_H
+
+/* A thread of its own keeps Established sessions alive while the main
+   thread is busy with something long, like a best path run over a
+   full table.  It sends a KEEPALIVE on a session when nothing has been
+   written to it for the keepalive interval.  It touches nothing but
+   the socket and the bgp_io_session below, so struct peer and the rest
+   of bgpd stay single threaded.
+
+   Writes by the main thread to the socket of a session are made
+   between bgp_io_write_begin and bgp_io_write_end, so that a KEEPALIVE
+   never lands in the middle of another message. */
+
+struct bgp_io_session;
+
+extern void bgp_io_session_start (struct peer *);
+extern void bgp_io_session_stop (struct peer *);
+
+extern void bgp_io_write_begin (struct peer *);
+extern void bgp_io_write_end (struct peer *, int);
+
+extern int bgp_io_input_pending (struct peer *);
+extern unsigned long bgp_io_keepalives (struct peer *);
+
+extern void bgp_io_terminate (void);
+
+#endif /* _QUAGGA_BGP_IO_H */
@@ -22,6 +22,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include <zebra.h>
 
 #include "hash.h"
+#include "jhash.h"
 #include "memory.h"
 #include "prefix.h"
 #include "command.h"
@@ -33,6 +34,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 
 /* Hash of community attribute. */
 static struct hash *lcomhash;
+static unsigned long lcommunity_id;
 
 /* Allocate a new lcommunities.  */
 static struct lcommunity *
@@ -201,6 +203,11 @@ lcommunity_intern (struct lcommunity *lcom)
 
   if (find != lcom)
     lcommunity_free (&lcom);
+  else
+    {
+      find->key = lcommunity_hash_make (find);
+      find->id = ++lcommunity_id;
+    }
 
   find->refcnt++;
 
@@ -234,29 +241,12 @@ lcommunity_unintern (struct lcommunity **lcom)
 unsigned int
 lcommunity_hash_make (void *arg)
 {
-  const struct lcommunity *lcom = arg;
-  int size = lcom->size * LCOMMUNITY_SIZE;
-  u_int8_t *pnt = lcom->val;
-  unsigned int key = 0;
-  int c;
+  struct lcommunity *lcom = arg;
 
-  for (c = 0; c < size; c += LCOMMUNITY_SIZE)
-    {
-      key += pnt[c];
-      key += pnt[c + 1];
-      key += pnt[c + 2];
-      key += pnt[c + 3];
-      key += pnt[c + 4];
-      key += pnt[c + 5];
-      key += pnt[c + 6];
-      key += pnt[c + 7];
-      key += pnt[c + 8];
-      key += pnt[c + 9];
-      key += pnt[c + 10];
-      key += pnt[c + 11];
-    }
+  if (lcom->refcnt)
+    return lcom->key;
 
-  return key;
+  return jhash (lcom->val, lcom->size * LCOMMUNITY_SIZE, 0);
 }
 
 /* Compare two Large Communities Attribute structure.  */
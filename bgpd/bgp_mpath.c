@@ -282,6 +282,18 @@ bgp_info_mpath_free (struct bgp_info_mpath **mpath)
     }
 }
 
+/*
+ * bgp_info_mpath_lookup
+ *
+ * Return the mpath element of the given bgp_info, if it has one. It is
+ * kept with the extra information, most paths are never multipaths.
+ */
+static struct bgp_info_mpath *
+bgp_info_mpath_lookup (struct bgp_info *binfo)
+{
+  return binfo->extra ? binfo->extra->mpath : NULL;
+}
+
 /*
  * bgp_info_mpath_get
  *
@@ -291,16 +303,17 @@ bgp_info_mpath_free (struct bgp_info_mpath **mpath)
 static struct bgp_info_mpath *
 bgp_info_mpath_get (struct bgp_info *binfo)
 {
+  struct bgp_info_extra *extra = bgp_info_extra_get (binfo);
   struct bgp_info_mpath *mpath;
-  if (!binfo->mpath)
+  if (!extra->mpath)
     {
       mpath = bgp_info_mpath_new();
       if (!mpath)
         return NULL;
-      binfo->mpath = mpath;
+      extra->mpath = mpath;
       mpath->mp_info = binfo;
     }
-  return binfo->mpath;
+  return extra->mpath;
 }
 
 /*
@@ -336,7 +349,7 @@ bgp_info_mpath_enqueue (struct bgp_info *prev_info, struct bgp_info *binfo)
 void
 bgp_info_mpath_dequeue (struct bgp_info *binfo)
 {
-  struct bgp_info_mpath *mpath = binfo->mpath;
+  struct bgp_info_mpath *mpath = bgp_info_mpath_lookup (binfo);
   if (!mpath)
     return;
   if (mpath->mp_prev)
@@ -355,9 +368,10 @@ bgp_info_mpath_dequeue (struct bgp_info *binfo)
 struct bgp_info *
 bgp_info_mpath_next (struct bgp_info *binfo)
 {
-  if (!binfo->mpath || !binfo->mpath->mp_next)
+  struct bgp_info_mpath *mpath = bgp_info_mpath_lookup (binfo);
+  if (!mpath || !mpath->mp_next)
     return NULL;
-  return binfo->mpath->mp_next->mp_info;
+  return mpath->mp_next->mp_info;
 }
 
 /*
@@ -379,9 +393,10 @@ bgp_info_mpath_first (struct bgp_info *binfo)
 u_int32_t
 bgp_info_mpath_count (struct bgp_info *binfo)
 {
-  if (!binfo->mpath)
+  struct bgp_info_mpath *mpath = bgp_info_mpath_lookup (binfo);
+  if (!mpath)
     return 0;
-  return binfo->mpath->mp_count;
+  return mpath->mp_count;
 }
 
 /*
@@ -393,7 +408,7 @@ static void
 bgp_info_mpath_count_set (struct bgp_info *binfo, u_int32_t count)
 {
   struct bgp_info_mpath *mpath;
-  if (!count && !binfo->mpath)
+  if (!count && !bgp_info_mpath_lookup (binfo))
     return;
   mpath = bgp_info_mpath_get (binfo);
   if (!mpath)
@@ -410,9 +425,10 @@ bgp_info_mpath_count_set (struct bgp_info *binfo, u_int32_t count)
 struct attr *
 bgp_info_mpath_attr (struct bgp_info *binfo)
 {
-  if (!binfo->mpath)
+  struct bgp_info_mpath *mpath = bgp_info_mpath_lookup (binfo);
+  if (!mpath)
     return NULL;
-  return binfo->mpath->mp_attr;
+  return mpath->mp_attr;
 }
 
 /*
@@ -424,7 +440,7 @@ static void
 bgp_info_mpath_attr_set (struct bgp_info *binfo, struct attr *attr)
 {
   struct bgp_info_mpath *mpath;
-  if (!attr && !binfo->mpath)
+  if (!attr && !bgp_info_mpath_lookup (binfo))
     return;
   mpath = bgp_info_mpath_get (binfo);
   if (!mpath)
@@ -248,8 +248,7 @@ bgp_accept (struct thread *thread)
   {
     char buf[SU_ADDRSTRLEN];
 
-    peer = peer_create_accept (peer1->bgp);
-    peer->su = su;
+    peer = peer_create_accept (peer1->bgp, &su);
     peer->fd = bgp_sock;
     peer->status = Active;
 
@@ -50,9 +50,27 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_encap.h"
 #include "bgpd/bgp_advertise.h"
 #include "bgpd/bgp_vty.h"
+#include "bgpd/bgp_updgrp.h"
+#include "bgpd/bgp_io.h"
 
 int stream_put_prefix (struct stream *, struct prefix *);
 
+/* Wait for more input.  Messages still in the read buffer are handled
+   from a timer that expires at once, since the socket may have nothing
+   more to say.  Not an event: BGP_EVENT_FLUSH would leave t_read
+   dangling, and FSM events a message queued have to run first. */
+static void
+bgp_read_on (struct peer *peer)
+{
+  if (peer->rbuf && STREAM_READABLE (peer->rbuf))
+    {
+      if (! peer->t_read && peer->status != Deleted)
+	peer->t_read = thread_add_timer_msec (bm->master, bgp_read, peer, 0);
+    }
+  else
+    BGP_READ_ON (peer->t_read, bgp_read, peer->fd);
+}
+
 /* Set up BGP packet marker and packet type. */
 static int
 bgp_packet_set_marker (struct stream *s, u_char type)
@@ -216,12 +234,12 @@ bgp_update_packet (struct peer *peer, afi_t afi, safi_t safi)
 	  mpattr_pos = stream_get_endp(s);
 
 	  /* 5: Encode all the attributes, except MP_REACH_NLRI attr. */
-	  total_attr_len = bgp_packet_attribute (NULL, peer, s,
-	                                         adv->baa->attr,
-                                                 ((afi == AFI_IP && safi == SAFI_UNICAST) ?
-                                                  &rn->p : NULL),
-                                                 afi, safi,
-	                                         from, prd, tag);
+	  total_attr_len = bgp_updgrp_packet_attribute (peer, s,
+	                                                adv->baa->attr,
+                                                        ((afi == AFI_IP && safi == SAFI_UNICAST) ?
+                                                         &rn->p : NULL),
+                                                        afi, safi,
+	                                                from, prd, tag);
           space_remaining = STREAM_CONCAT_REMAIN (s, snlri, STREAM_SIZE(s)) -
                             BGP_MAX_PACKET_SIZE_OVERFLOW;
           space_needed = BGP_NLRI_LENGTH + bgp_packet_mpattr_prefix_size (afi, safi, &rn->p);;
@@ -661,6 +679,7 @@ bgp_write_packet (struct peer *peer)
 	  {
 	    if (peer->afc_nego[afi][safi] && peer->synctime
 		&& ! CHECK_FLAG (peer->af_sflags[afi][safi], PEER_STATUS_EOR_SEND)
+		&& ! peer->walk[afi][safi][BGP_WALK_ANNOUNCE]
 		&& safi != SAFI_MPLS_VPN)
 	      {
 		SET_FLAG (peer->af_sflags[afi][safi], PEER_STATUS_EOR_SEND);
@@ -707,6 +726,7 @@ bgp_write (struct thread *thread)
   struct stream *s; 
   int num;
   unsigned int count = 0;
+  int wrote = 0;
 
   /* Yes first of all get peer pointer. */
   peer = THREAD_ARG (thread);
@@ -724,6 +744,7 @@ bgp_write (struct thread *thread)
     return 0;	/* nothing to send */
 
   sockopt_cork (peer->fd, 1);
+  bgp_io_write_begin (peer);
 
   /* Nonblocking write until TCP output buffer is full.  */
   do
@@ -742,6 +763,7 @@ bgp_write (struct thread *thread)
 		break;
 
           BGP_EVENT_ADD (peer, TCP_fatal_error);
+	  bgp_io_write_end (peer, wrote);
 	  return 0;
 	}
 
@@ -751,6 +773,7 @@ bgp_write (struct thread *thread)
 	  stream_forward_getp (s, num);
 	  break;
 	}
+      wrote = 1;
 
       /* Retrieve BGP packet type. */
       stream_set_getp (s, BGP_MARKER_SIZE + 2);
@@ -793,6 +816,7 @@ bgp_write (struct thread *thread)
     BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
 
  done:
+  bgp_io_write_end (peer, wrote);
   sockopt_cork (peer->fd, 0);
   return 0;
 }
@@ -816,6 +840,7 @@ bgp_write_notify (struct peer *peer)
 
   /* socket is in nonblocking mode, if we can't deliver the NOTIFY, well,
    * we only care about getting a clean shutdown at this point. */
+  bgp_io_session_stop (peer);
   ret = write (peer->fd, STREAM_DATA (s), stream_get_endp (s));
 
   /* only connection reset/close gets counted as TCP_fatal_error, failure
@@ -1186,7 +1211,6 @@ static int
 bgp_collision_detect (struct peer *new, struct in_addr remote_id)
 {
   struct peer *peer;
-  struct listnode *node, *nnode;
   struct bgp *bgp;
 
   bgp = bgp_get_default ();
@@ -1202,12 +1226,11 @@ bgp_collision_detect (struct peer *new, struct in_addr remote_id)
      OPEN message, then the local system performs the following
      collision resolution procedure: */
 
-  for (ALL_LIST_ELEMENTS (bgp->peer, node, nnode, peer))
+  for (peer = peer_lookup_next (bgp, &new->su, NULL); peer;
+       peer = peer_lookup_next (bgp, &new->su, peer))
     {
       if (peer == new)
         continue;
-      if (!sockunion_same (&peer->su, &new->su))
-        continue;
       
       /* Unless allowed via configuration, a connection collision with an
          existing BGP connection that is in the Established state causes
@@ -1531,7 +1554,10 @@ bgp_open_receive (struct peer *peer, bgp_size_t size)
       realpeer->fd = peer->fd;
       peer->fd = -1;
 
-      /* Transfer input buffer. */
+      /* Transfer input buffer, along with anything read past the OPEN. */
+      stream_free (realpeer->rbuf);
+      realpeer->rbuf = peer->rbuf;
+      peer->rbuf = NULL;
       stream_free (realpeer->ibuf);
       realpeer->ibuf = peer->ibuf;
       realpeer->packet_size = peer->packet_size;
@@ -1558,7 +1584,7 @@ bgp_open_receive (struct peer *peer, bgp_size_t size)
 		    peer->fd);
 	  return -1;
 	}
-      BGP_READ_ON (peer->t_read, bgp_read, peer->fd);
+      bgp_read_on (peer);
       if (stream_fifo_head (peer->obuf))
         BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
       
@@ -1838,9 +1864,12 @@ bgp_update_receive (struct peer *peer, bgp_size_t size)
    */
 #define NLRI_ATTR_ARG (attr_parse_ret != BGP_ATTR_PARSE_WITHDRAW ? &attr : NULL)
 
-  /* Parse attribute when it exists. */
-  if (attribute_len)
+  /* Parse attribute when it exists, unless it is the same as last
+     time. */
+  if (attribute_len && ! bgp_attr_cache_lookup (peer, attribute_len, &attr))
     {
+      u_char *raw = stream_pnt (s);
+
       attr_parse_ret = bgp_attr_parse (peer, &attr, attribute_len, 
 			    &nlris[NLRI_MP_UPDATE], &nlris[NLRI_MP_WITHDRAW]);
       if (attr_parse_ret == BGP_ATTR_PARSE_ERROR)
@@ -1849,6 +1878,8 @@ bgp_update_receive (struct peer *peer, bgp_size_t size)
           bgp_attr_flush (&attr);
 	  return -1;
 	}
+      if (attr_parse_ret == BGP_ATTR_PARSE_PROCEED)
+        bgp_attr_cache_update (peer, raw, attribute_len, &attr);
     }
   
   /* Logging the attribute. */
@@ -2460,21 +2491,17 @@ bgp_capability_receive (struct peer *peer, bgp_size_t size)
   return bgp_capability_msg_parse (peer, pnt, size);
 }
 
-/* BGP read utility function. */
+/* Fill the read buffer from the socket.  Returns the number of bytes
+   read, or -1 if nothing was read. */
 static int
-bgp_read_packet (struct peer *peer)
+bgp_read_fill (struct peer *peer)
 {
   int nbytes;
-  int readsize;
-
-  readsize = peer->packet_size - stream_get_endp (peer->ibuf);
 
-  /* If size is zero then return. */
-  if (! readsize)
-    return 0;
+  /* Everything buffered has been consumed by now. */
+  stream_reset (peer->rbuf);
 
-  /* Read packet from fd. */
-  nbytes = stream_read_try (peer->ibuf, peer->fd, readsize);
+  nbytes = stream_read_try (peer->rbuf, peer->fd, STREAM_WRITEABLE (peer->rbuf));
 
   /* If read byte is smaller than zero then error occured. */
   if (nbytes < 0) 
@@ -2483,7 +2510,7 @@ bgp_read_packet (struct peer *peer)
       if (nbytes == -2)
 	return -1;
 
-      plog_err (peer->log, "%s [Error] bgp_read_packet error: %s",
+      plog_err (peer->log, "%s [Error] bgp_read_fill error: %s",
 		 peer->host, safe_strerror (errno));
 
       if (peer->status == Established) 
@@ -2523,6 +2550,28 @@ bgp_read_packet (struct peer *peer)
       return -1;
     }
 
+  peer->read_calls++;
+  return nbytes;
+}
+
+/* BGP read utility function.  Move up to packet_size bytes from the
+   read buffer into ibuf. */
+static int
+bgp_read_packet (struct peer *peer)
+{
+  size_t readsize;
+
+  readsize = peer->packet_size - stream_get_endp (peer->ibuf);
+
+  /* If size is zero then return. */
+  if (! readsize)
+    return 0;
+
+  if (readsize > STREAM_READABLE (peer->rbuf))
+    readsize = STREAM_READABLE (peer->rbuf);
+  stream_put (peer->ibuf, stream_pnt (peer->rbuf), readsize);
+  stream_forward_getp (peer->rbuf, readsize);
+
   /* We read partial packet. */
   if (stream_get_endp (peer->ibuf) != peer->packet_size)
     return -1;
@@ -2552,36 +2601,18 @@ bgp_recent_clock (void)
   return recent_relative_time().tv_sec;
 }
 
-/* Starting point of packet process function. */
-int
-bgp_read (struct thread *thread)
+/* Take the next message from the read buffer and process it.  Returns
+   -1 if no whole message is buffered yet, 1 if the message header was
+   bad and a NOTIFICATION went out, and 0 otherwise.  The type of the
+   message is left in *typep. */
+static int
+bgp_read_message (struct peer *peer, u_char *typep)
 {
   int ret;
   u_char type = 0;
-  struct peer *peer;
   bgp_size_t size;
   char notify_data_length[2];
 
-  /* Yes first of all get peer pointer. */
-  peer = THREAD_ARG (thread);
-  peer->t_read = NULL;
-
-  /* For non-blocking IO check. */
-  if (peer->status == Connect)
-    {
-      bgp_connect_check (peer);
-      goto done;
-    }
-  else
-    {
-      if (peer->fd < 0)
-	{
-	  zlog_err ("bgp_read peer's fd is negative value %d", peer->fd);
-	  return -1;
-	}
-      BGP_READ_ON (peer->t_read, bgp_read, peer->fd);
-    }
-
   /* Read packet header to determine type of the packet */
   if (peer->packet_size == 0)
     peer->packet_size = BGP_HEADER_SIZE;
@@ -2590,9 +2621,9 @@ bgp_read (struct thread *thread)
     {
       ret = bgp_read_packet (peer);
 
-      /* Header read error or partial read packet. */
+      /* Partial read packet. */
       if (ret < 0) 
-	goto done;
+	return -1;
 
       /* Get size and type. */
       stream_forward_getp (peer->ibuf, BGP_MARKER_SIZE);
@@ -2611,7 +2642,7 @@ bgp_read (struct thread *thread)
 	  bgp_notify_send (peer,
 			   BGP_NOTIFY_HEADER_ERR, 
 			   BGP_NOTIFY_HEADER_NOT_SYNC);
-	  goto done;
+	  return 1;
 	}
 
       /* BGP type check. */
@@ -2629,7 +2660,7 @@ bgp_read (struct thread *thread)
 				     BGP_NOTIFY_HEADER_ERR,
 			 	     BGP_NOTIFY_HEADER_BAD_MESTYPE,
 				     &type, 1);
-	  goto done;
+	  return 1;
 	}
       /* Mimimum packet length check. */
       if ((size < BGP_HEADER_SIZE)
@@ -2652,7 +2683,7 @@ bgp_read (struct thread *thread)
 				     BGP_NOTIFY_HEADER_ERR,
 			  	     BGP_NOTIFY_HEADER_BAD_MESLEN,
 				     (u_char *) notify_data_length, 2);
-	  goto done;
+	  return 1;
 	}
 
       /* Adjust size to message length. */
@@ -2661,11 +2692,12 @@ bgp_read (struct thread *thread)
 
   ret = bgp_read_packet (peer);
   if (ret < 0) 
-    goto done;
+    return -1;
 
   /* Get size and type again. */
   size = stream_getw_from (peer->ibuf, BGP_MARKER_SIZE);
   type = stream_getc_from (peer->ibuf, BGP_MARKER_SIZE + 2);
+  *typep = type;
 
   /* BGP packet dump function. */
   bgp_dump_packet (peer, type, peer->ibuf);
@@ -2706,6 +2738,80 @@ bgp_read (struct thread *thread)
   if (peer->ibuf)
     stream_reset (peer->ibuf);
 
+  return 0;
+}
+
+/* Starting point of packet process function.  Everything the socket
+   has is read at once, and the messages in it are handled in turn, up
+   to bm->read_quanta of them before other threads get a go. */
+int
+bgp_read (struct thread *thread)
+{
+  int ret;
+  int fd;
+  u_char type;
+  u_int32_t notify_out;
+  unsigned long count;
+  struct peer *peer;
+
+  /* Yes first of all get peer pointer. */
+  peer = THREAD_ARG (thread);
+  peer->t_read = NULL;
+
+  /* For non-blocking IO check. */
+  if (peer->status == Connect)
+    {
+      bgp_connect_check (peer);
+      goto done;
+    }
+
+  if (peer->fd < 0)
+    {
+      zlog_err ("bgp_read peer's fd is negative value %d", peer->fd);
+      return -1;
+    }
+
+  /* Drain what is buffered before reading more. */
+  if (! STREAM_READABLE (peer->rbuf) && bgp_read_fill (peer) < 0)
+    {
+      bgp_read_on (peer);
+      goto done;
+    }
+
+  fd = peer->fd;
+  notify_out = peer->notify_out;
+  ret = -1;
+
+  for (count = 0; count < bm->read_quanta; )
+    {
+      type = 0;
+      ret = bgp_read_message (peer, &type);
+      if (ret < 0)
+	break;
+      count++;
+
+      /* Stop once the session is on its way down or the connection was
+	 handed to another peer.  Until the session is Established the
+	 FSM events queued by a message have to run before the next
+	 message is looked at. */
+      if (ret > 0
+	  || type == BGP_MSG_NOTIFY
+	  || peer->fd != fd
+	  || peer->notify_out != notify_out
+	  || peer->status != Established)
+	break;
+    }
+
+  peer->read_msgs += count;
+  if (count > peer->read_msgs_max)
+    peer->read_msgs_max = count;
+  if (count == bm->read_quanta && ret == 0
+      && peer->rbuf && STREAM_READABLE (peer->rbuf))
+    peer->read_yields++;
+
+  if (peer->fd == fd)
+    bgp_read_on (peer);
+
  done:
   if (CHECK_FLAG (peer->sflags, PEER_STATUS_ACCEPT_PEER))
     {
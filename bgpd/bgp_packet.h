@@ -26,6 +26,11 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #define BGP_UNFEASIBLE_LEN    2U
 #define BGP_WRITE_PACKET_MAX 10U
 
+/* Size of the per peer read buffer, and the default number of messages
+   bgp_read handles before letting other threads run. */
+#define BGP_READ_BUFSIZ       (16 * BGP_MAX_PACKET_SIZE)
+#define BGP_READ_QUANTA_DEFAULT 64U
+
 /* When to refresh */
 #define REFRESH_IMMEDIATE 1
 #define REFRESH_DEFER     2 
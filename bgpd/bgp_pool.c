@@ -0,0 +1,142 @@
+/* BGP fixed size object pools
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+ * MA 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#include "memory.h"
+
+#include "bgpd/bgp_pool.h"
+
+/* Bytes asked of malloc for a chunk, header included. */
+#define BGP_POOL_CHUNK_SIZE (64 * 1024)
+
+struct bgp_pool_chunk
+{
+  struct bgp_pool_chunk *next;
+
+  /* Keeps the objects after the header as aligned as malloc would. */
+  union
+  {
+    void *p;
+    long l;
+    double d;
+  } data[];
+};
+
+/* A free object holds the link to the next one. */
+struct bgp_pool_free
+{
+  struct bgp_pool_free *next;
+};
+
+static void
+bgp_pool_grow (struct bgp_pool *pool)
+{
+  struct bgp_pool_chunk *chunk;
+
+  if (! pool->per_chunk)
+    {
+      size_t align = sizeof (((struct bgp_pool_chunk *) 0)->data[0]);
+
+      if (pool->size < sizeof (struct bgp_pool_free))
+        pool->size = sizeof (struct bgp_pool_free);
+      pool->size = (pool->size + align - 1) / align * align;
+      pool->per_chunk = (BGP_POOL_CHUNK_SIZE - sizeof (struct bgp_pool_chunk))
+                        / pool->size;
+    }
+
+  chunk = XMALLOC (pool->mtype, sizeof (struct bgp_pool_chunk)
+                                + pool->per_chunk * pool->size);
+  chunk->next = pool->chunks;
+  pool->chunks = chunk;
+  pool->nchunks++;
+
+  pool->carve = (char *) chunk->data;
+  pool->left = pool->per_chunk;
+}
+
+/* A zeroed object, as XCALLOC would give. */
+void *
+bgp_pool_get (struct bgp_pool *pool)
+{
+  void *obj;
+
+  if (pool->free)
+    {
+      obj = pool->free;
+      pool->free = ((struct bgp_pool_free *) obj)->next;
+      pool->nfree--;
+    }
+  else
+    {
+      if (! pool->left)
+        bgp_pool_grow (pool);
+      obj = pool->carve;
+      pool->carve += pool->size;
+      pool->left--;
+    }
+
+  pool->count++;
+  memset (obj, 0, pool->size);
+  return obj;
+}
+
+void
+bgp_pool_put (struct bgp_pool *pool, void *obj)
+{
+  struct bgp_pool_free *f = obj;
+
+  assert (pool->count > 0);
+
+  f->next = pool->free;
+  pool->free = f;
+  pool->nfree++;
+  pool->count--;
+}
+
+/* Gives the chunks back, unless objects are still out.  Those may yet be
+   referenced, so then the chunks stay for the exit to reclaim. */
+void
+bgp_pool_finish (struct bgp_pool *pool)
+{
+  struct bgp_pool_chunk *chunk, *next;
+
+  if (pool->count)
+    return;
+
+  for (chunk = pool->chunks; chunk; chunk = next)
+    {
+      next = chunk->next;
+      XFREE (pool->mtype, chunk);
+    }
+  pool->chunks = NULL;
+  pool->free = NULL;
+  pool->carve = NULL;
+  pool->left = 0;
+  pool->nfree = 0;
+  pool->nchunks = 0;
+}
+
+size_t
+bgp_pool_memory (const struct bgp_pool *pool)
+{
+  return pool->nchunks * (sizeof (struct bgp_pool_chunk)
+                          + pool->per_chunk * pool->size);
+}
@@ -0,0 +1,64 @@
+/* BGP fixed size object pools
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+ * MA 02111-1307, USA.
+ */
+
+#ifndef _QUAGGA_BGP_POOL_H
+#define _QUAGGA_BGP_POOL_H
+
+/* There is one bgp_info for every path in every table, and one
+   bgp_adj_in for every prefix a soft-reconfiguration peer sent, so with
+   full tables there are millions of each.  Taking them one at a time
+   from malloc costs a chunk header apiece and rounds every object up to
+   the next malloc size class.  A pool carves them out of large chunks
+   instead, at their exact size, and keeps freed objects on a list for
+   reuse.  Chunks are allocated under the memory type of the objects, so
+   "show memory" counts chunks there; the objects themselves are counted
+   by the pool. */
+
+struct bgp_pool_chunk;
+
+struct bgp_pool
+{
+  int mtype;
+  size_t size;
+  unsigned int per_chunk;
+
+  struct bgp_pool_chunk *chunks;
+  void *free;
+
+  /* Room in the newest chunk not yet handed out. */
+  char *carve;
+  unsigned int left;
+
+  unsigned long count;
+  unsigned long nfree;
+  unsigned long nchunks;
+};
+
+#define BGP_POOL_INIT(MTYPE, TYPE) \
+  { .mtype = (MTYPE), .size = sizeof (TYPE), .per_chunk = 0 }
+
+extern void *bgp_pool_get (struct bgp_pool *);
+extern void bgp_pool_put (struct bgp_pool *, void *);
+extern void bgp_pool_finish (struct bgp_pool *);
+
+/* Bytes taken from malloc for the pool, free objects included. */
+extern size_t bgp_pool_memory (const struct bgp_pool *);
+
+#endif /* _QUAGGA_BGP_POOL_H */
@@ -92,3 +92,757 @@ bgp_regex_free (regex_t *regex)
   regfree (regex);
   XFREE (MTYPE_BGP_REGEXP, regex);
 }
+
+/* AS path regular expressions, compiled.
+
+   regexec needs the string form of the AS path and, for every path an
+   access-list is tried on, goes over it again.  The expressions people
+   write for AS paths are few and simple, so they are compiled here to
+   an automaton over the characters of the string form instead, which
+   is run over the segments of the path, producing the characters as
+   aspath_make_str_count would.  Its states are built lazily, as paths
+   need them.
+
+   What is compiled is POSIX extended syntax plus the `_' above.
+   Anything else, such as GNU backslash operators or equivalence
+   classes, makes bgp_aspath_re_compile give up, and the caller keeps
+   to regexec.  So does ^, $ or `_' inside a repeat, as in "(_1)+" or
+   "(^2|3)*": glibc does not always agree with POSIX on those, and
+   matching it there keeps what filters do unchanged. */
+
+/* The characters an AS path string is made of. */
+#define RE_SYM_SPACE  10
+#define RE_SYM_COMMA  11
+#define RE_NSYM       18
+#define RE_SYM_ALL    ((1 << RE_NSYM) - 1)
+
+static const char re_sym_char[RE_NSYM + 1] = "0123456789 ,{}()[]";
+
+/* Limits, beyond which the expression is left to regexec. */
+#define RE_NODE_MAX   512
+#define RE_NFA_MAX    256
+#define RE_DFA_MAX    512
+#define RE_REPEAT_MAX 32
+
+#define RE_SET_WORDS  (RE_NFA_MAX / 64)
+
+enum re_node_type
+{
+  RE_EMPTY,
+  RE_SET,
+  RE_BOL,
+  RE_EOL,
+  RE_CAT,
+  RE_ALT,
+  RE_REPEAT,
+};
+
+struct re_node
+{
+  enum re_node_type type;
+  u_int32_t set;
+  struct re_node *left;
+  struct re_node *right;
+  int min;
+  int max;			/* -1 for no limit */
+
+  /* Whether there is a ^ or $ in it.  regexec does not always go by
+     the book with those repeated, so such expressions are left to it. */
+  int anchored;
+};
+
+struct re_parse
+{
+  const char *p;
+  int error;
+  int nnodes;
+  struct re_node nodes[RE_NODE_MAX];
+};
+
+enum re_nfa_type
+{
+  RE_NFA_SET,
+  RE_NFA_SPLIT,
+  RE_NFA_BOL,
+  RE_NFA_EOL,
+  RE_NFA_MATCH,
+};
+
+struct re_nfa
+{
+  u_char type;
+  u_int32_t set;
+  short out;
+  short out1;
+};
+
+struct re_dfa
+{
+  u_int64_t nfa[RE_SET_WORDS];
+  short next[RE_NSYM];
+  u_char at_start;
+  u_char match;
+  u_char match_end;
+  u_char dead;
+};
+
+struct bgp_aspath_re
+{
+  int nnfa;
+  short start;
+  struct re_nfa nfa[RE_NFA_MAX];
+
+  int ndfa;
+  struct re_dfa *dfa;
+};
+
+static int
+re_sym (int c)
+{
+  const char *s;
+
+  if (c == '\0')
+    return -1;
+  s = strchr (re_sym_char, c);
+  return s ? s - re_sym_char : -1;
+}
+
+static struct re_node *
+re_node (struct re_parse *rp, enum re_node_type type,
+         struct re_node *left, struct re_node *right)
+{
+  struct re_node *n;
+
+  if (rp->nnodes == RE_NODE_MAX)
+    {
+      rp->error = 1;
+      return &rp->nodes[0];
+    }
+  n = &rp->nodes[rp->nnodes++];
+  memset (n, 0, sizeof (*n));
+  n->type = type;
+  n->left = left;
+  n->right = right;
+  n->anchored = (left && left->anchored) || (right && right->anchored);
+  return n;
+}
+
+static struct re_node *
+re_set (struct re_parse *rp, u_int32_t set)
+{
+  struct re_node *n = re_node (rp, RE_SET, NULL, NULL);
+
+  n->set = set;
+  return n;
+}
+
+/* Symbols of the characters in the ASCII range FROM to TO. */
+static u_int32_t
+re_range (int from, int to)
+{
+  u_int32_t set = 0;
+  int i;
+
+  for (i = 0; i < RE_NSYM; i++)
+    if (re_sym_char[i] >= from && re_sym_char[i] <= to)
+      set |= 1 << i;
+  return set;
+}
+
+static u_int32_t
+re_class (const char *name, size_t len)
+{
+  static const struct
+  {
+    const char *name;
+    int (*is) (int);
+  } classes[] =
+  {
+    { "alnum", isalnum }, { "alpha", isalpha }, { "blank", isblank },
+    { "cntrl", iscntrl }, { "digit", isdigit }, { "graph", isgraph },
+    { "lower", islower }, { "print", isprint }, { "punct", ispunct },
+    { "space", isspace }, { "upper", isupper }, { "xdigit", isxdigit },
+  };
+  u_int32_t set = 0;
+  unsigned int i;
+  int j;
+
+  for (i = 0; i < array_size (classes); i++)
+    if (strlen (classes[i].name) == len
+        && strncmp (classes[i].name, name, len) == 0)
+      {
+        for (j = 0; j < RE_NSYM; j++)
+          if (classes[i].is ((unsigned char) re_sym_char[j]))
+            set |= 1 << j;
+        return set;
+      }
+  return (u_int32_t) -1;
+}
+
+/* A bracket expression, P just past the `['. */
+static struct re_node *
+re_parse_bracket (struct re_parse *rp)
+{
+  const char *p = rp->p;
+  u_int32_t set = 0;
+  int negate = 0;
+  int first = 1;
+
+  if (*p == '^')
+    {
+      negate = 1;
+      p++;
+    }
+
+  while (*p && (*p != ']' || first))
+    {
+      int from = (unsigned char) *p;
+
+      first = 0;
+      if (p[0] == '[' && (p[1] == '.' || p[1] == '='))
+        {
+          rp->error = 1;
+          return NULL;
+        }
+      if (p[0] == '[' && p[1] == ':')
+        {
+          const char *end = strstr (p + 2, ":]");
+          u_int32_t cls;
+
+          if (! end
+              || (cls = re_class (p + 2, end - (p + 2))) == (u_int32_t) -1)
+            {
+              rp->error = 1;
+              return NULL;
+            }
+          set |= cls;
+          p = end + 2;
+          continue;
+        }
+      if (p[1] == '-' && p[2] && p[2] != ']')
+        {
+          int to = (unsigned char) p[2];
+
+          if (to < from)
+            {
+              rp->error = 1;
+              return NULL;
+            }
+          set |= re_range (from, to);
+          p += 3;
+          continue;
+        }
+      set |= re_range (from, from);
+      p++;
+    }
+  if (*p != ']')
+    {
+      rp->error = 1;
+      return NULL;
+    }
+  rp->p = p + 1;
+
+  return re_set (rp, negate ? ~set & RE_SYM_ALL : set);
+}
+
+static struct re_node *re_parse_alt (struct re_parse *);
+
+static struct re_node *
+re_parse_atom (struct re_parse *rp)
+{
+  struct re_node *n;
+  int c = *rp->p;
+
+  switch (c)
+    {
+    case '(':
+      rp->p++;
+      n = re_parse_alt (rp);
+      if (*rp->p != ')')
+        {
+          rp->error = 1;
+          return NULL;
+        }
+      rp->p++;
+      return n;
+    case '^':
+    case '$':
+      rp->p++;
+      n = re_node (rp, c == '^' ? RE_BOL : RE_EOL, NULL, NULL);
+      n->anchored = 1;
+      return n;
+    case '.':
+      rp->p++;
+      return re_set (rp, RE_SYM_ALL);
+    case '[':
+      rp->p++;
+      return re_parse_bracket (rp);
+    case '_':
+      /* (^|[,{}() ]|$), so anchored as well. */
+      rp->p++;
+      n = re_node (rp, RE_ALT, re_node (rp, RE_BOL, NULL, NULL),
+                   re_node (rp, RE_ALT,
+                            re_set (rp, re_range (',', ',')
+                                        | re_range ('{', '{')
+                                        | re_range ('}', '}')
+                                        | re_range ('(', ')')
+                                        | re_range (' ', ' ')),
+                            re_node (rp, RE_EOL, NULL, NULL)));
+      n->anchored = 1;
+      return n;
+    case '\\':
+      c = (unsigned char) rp->p[1];
+      if (c == '\0' || isalnum (c))
+        {
+          rp->error = 1;
+          return NULL;
+        }
+      rp->p += 2;
+      return re_set (rp, re_range (c, c));
+    case '*':
+    case '+':
+    case '?':
+    case '{':
+    case ')':
+    case '|':
+    case '\0':
+      rp->error = 1;
+      return NULL;
+    default:
+      rp->p++;
+      return re_set (rp, re_range (c, c));
+    }
+}
+
+/* The number at P, or -1. */
+static int
+re_parse_int (struct re_parse *rp)
+{
+  int n = 0;
+
+  if (! isdigit ((unsigned char) *rp->p))
+    return -1;
+  while (isdigit ((unsigned char) *rp->p))
+    {
+      n = n * 10 + (*rp->p++ - '0');
+      if (n > RE_REPEAT_MAX)
+        return -1;
+    }
+  return n;
+}
+
+static struct re_node *
+re_parse_repeat (struct re_parse *rp)
+{
+  struct re_node *n, *atom;
+  int c;
+
+  atom = n = re_parse_atom (rp);
+  while (! rp->error && (c = *rp->p) && strchr ("*+?{", c))
+    {
+      int min, max;
+
+      if (atom->anchored)
+        {
+          rp->error = 1;
+          return NULL;
+        }
+      rp->p++;
+      switch (c)
+        {
+        case '*':
+          min = 0, max = -1;
+          break;
+        case '+':
+          min = 1, max = -1;
+          break;
+        case '?':
+          min = 0, max = 1;
+          break;
+        default:
+          /* {n}, {n,}, {n,m} and {,m}. */
+          min = max = re_parse_int (rp);
+          if (*rp->p == ',')
+            {
+              rp->p++;
+              if (min < 0)
+                min = 0;
+              max = (*rp->p == '}') ? -1 : re_parse_int (rp);
+              if (max < 0 && *rp->p != '}')
+                min = -1;
+            }
+          if (min < 0 || *rp->p != '}' || (max >= 0 && max < min))
+            {
+              rp->error = 1;
+              return NULL;
+            }
+          rp->p++;
+          break;
+        }
+      n = re_node (rp, RE_REPEAT, n, NULL);
+      n->min = min;
+      n->max = max;
+    }
+  return n;
+}
+
+static struct re_node *
+re_parse_cat (struct re_parse *rp)
+{
+  struct re_node *n = re_node (rp, RE_EMPTY, NULL, NULL);
+
+  while (! rp->error && *rp->p && *rp->p != '|' && *rp->p != ')')
+    n = re_node (rp, RE_CAT, n, re_parse_repeat (rp));
+  return n;
+}
+
+static struct re_node *
+re_parse_alt (struct re_parse *rp)
+{
+  struct re_node *n = re_parse_cat (rp);
+
+  while (! rp->error && *rp->p == '|')
+    {
+      rp->p++;
+      n = re_node (rp, RE_ALT, n, re_parse_cat (rp));
+    }
+  return n;
+}
+
+static int
+re_nfa_new (struct bgp_aspath_re *re, u_char type, int out, int out1)
+{
+  struct re_nfa *s;
+
+  if (re->nnfa == RE_NFA_MAX)
+    return -1;
+  s = &re->nfa[re->nnfa];
+  s->type = type;
+  s->set = 0;
+  s->out = out;
+  s->out1 = out1;
+  return re->nnfa++;
+}
+
+/* NFA states for N, going on to state NEXT.  The start state, or -1 if
+   there are too many. */
+static int
+re_nfa_build (struct bgp_aspath_re *re, struct re_node *n, int next)
+{
+  int s, split, i;
+
+  if (next < 0)
+    return -1;
+
+  switch (n->type)
+    {
+    case RE_EMPTY:
+      return next;
+    case RE_SET:
+      s = re_nfa_new (re, RE_NFA_SET, next, -1);
+      if (s >= 0)
+        re->nfa[s].set = n->set;
+      return s;
+    case RE_BOL:
+      return re_nfa_new (re, RE_NFA_BOL, next, -1);
+    case RE_EOL:
+      return re_nfa_new (re, RE_NFA_EOL, next, -1);
+    case RE_CAT:
+      return re_nfa_build (re, n->left, re_nfa_build (re, n->right, next));
+    case RE_ALT:
+      s = re_nfa_build (re, n->left, next);
+      if (s < 0)
+        return -1;
+      return re_nfa_new (re, RE_NFA_SPLIT, s,
+                         re_nfa_build (re, n->right, next));
+    case RE_REPEAT:
+      s = next;
+      if (n->max < 0)
+        {
+          /* A loop: the split goes round again or on. */
+          split = re_nfa_new (re, RE_NFA_SPLIT, -1, next);
+          if (split < 0)
+            return -1;
+          s = re_nfa_build (re, n->left, split);
+          if (s < 0)
+            return -1;
+          re->nfa[split].out = s;
+          s = split;
+        }
+      else
+        for (i = n->min; i < n->max; i++)
+          {
+            s = re_nfa_build (re, n->left, s);
+            if (s < 0)
+              return -1;
+            s = re_nfa_new (re, RE_NFA_SPLIT, s, next);
+          }
+      for (i = 0; i < n->min && s >= 0; i++)
+        s = re_nfa_build (re, n->left, s);
+      return s;
+    }
+  return -1;
+}
+
+#define RE_SET_HAS(set, s)  ((set)[(s) / 64] & ((u_int64_t) 1 << ((s) % 64)))
+#define RE_SET_ADD(set, s)  ((set)[(s) / 64] |= ((u_int64_t) 1 << ((s) % 64)))
+
+/* Add state S of RE to SET, and all it leads to without a character.
+   The anchors are passed when BOL or EOL is true. */
+static void
+re_closure (struct bgp_aspath_re *re, u_int64_t *set, int s, int bol, int eol)
+{
+  while (s >= 0 && ! RE_SET_HAS (set, s))
+    {
+      RE_SET_ADD (set, s);
+      switch (re->nfa[s].type)
+        {
+        case RE_NFA_SPLIT:
+          re_closure (re, set, re->nfa[s].out1, bol, eol);
+          s = re->nfa[s].out;
+          break;
+        case RE_NFA_BOL:
+          s = bol ? re->nfa[s].out : -1;
+          break;
+        case RE_NFA_EOL:
+          s = eol ? re->nfa[s].out : -1;
+          break;
+        default:
+          s = -1;
+          break;
+        }
+    }
+}
+
+/* The DFA state for the NFA states in SET, made if need be.  -1 if
+   there are too many already. */
+static int
+re_dfa_get (struct bgp_aspath_re *re, u_int64_t *set, int at_start)
+{
+  struct re_dfa *d;
+  u_int64_t end[RE_SET_WORDS];
+  int i, s;
+
+  for (i = 0; i < re->ndfa; i++)
+    if (re->dfa[i].at_start == at_start
+        && memcmp (re->dfa[i].nfa, set, sizeof (re->dfa[i].nfa)) == 0)
+      return i;
+
+  if (re->ndfa == RE_DFA_MAX)
+    return -1;
+  if (! re->dfa)
+    re->dfa = XCALLOC (MTYPE_BGP_REGEXP, RE_DFA_MAX * sizeof (struct re_dfa));
+
+  d = &re->dfa[re->ndfa];
+  memcpy (d->nfa, set, sizeof (d->nfa));
+  for (i = 0; i < RE_NSYM; i++)
+    d->next[i] = -1;
+  d->at_start = at_start;
+  d->match = 0;
+  d->dead = 1;
+
+  /* Whether it matches if the string ends here.  Going on to the end
+     passes the $ anchors, and the ^ ones too for an empty string. */
+  memset (end, 0, sizeof (end));
+  for (s = 0; s < re->nnfa; s++)
+    if (RE_SET_HAS (set, s))
+      {
+        re_closure (re, end, s, at_start, 1);
+        if (re->nfa[s].type == RE_NFA_MATCH)
+          d->match = 1;
+        if (re->nfa[s].type == RE_NFA_SET)
+          d->dead = 0;
+      }
+  d->match_end = 0;
+  for (s = 0; s < re->nnfa; s++)
+    if (RE_SET_HAS (end, s) && re->nfa[s].type == RE_NFA_MATCH)
+      d->match_end = 1;
+  if (d->match_end)
+    d->dead = 0;
+
+  return re->ndfa++;
+}
+
+/* Move the NFA states in SET over symbol SYM, into NEXT.  A match may
+   start at any character, so the start state is always added. */
+static void
+re_step (struct bgp_aspath_re *re, const u_int64_t *set, int sym,
+         u_int64_t *next)
+{
+  int s;
+
+  memset (next, 0, RE_SET_WORDS * sizeof (u_int64_t));
+  for (s = 0; s < re->nnfa; s++)
+    if (RE_SET_HAS (set, s)
+        && re->nfa[s].type == RE_NFA_SET
+        && (re->nfa[s].set & (1 << sym)))
+      re_closure (re, next, re->nfa[s].out, 0, 0);
+  re_closure (re, next, re->start, 0, 0);
+}
+
+struct bgp_aspath_re *
+bgp_aspath_re_compile (const char *regstr)
+{
+  struct bgp_aspath_re *re;
+  struct re_parse *rp;
+  struct re_node *n;
+  u_int64_t set[RE_SET_WORDS];
+  int match;
+
+  rp = XCALLOC (MTYPE_TMP, sizeof (struct re_parse));
+  rp->p = regstr;
+  n = re_parse_alt (rp);
+  if (*rp->p != '\0')
+    rp->error = 1;
+
+  re = XCALLOC (MTYPE_BGP_REGEXP, sizeof (struct bgp_aspath_re));
+  if (! rp->error)
+    {
+      match = re_nfa_new (re, RE_NFA_MATCH, -1, -1);
+      re->start = re_nfa_build (re, n, match);
+    }
+  if (rp->error)
+    re->start = -1;
+  XFREE (MTYPE_TMP, rp);
+
+  if (re->start < 0)
+    {
+      XFREE (MTYPE_BGP_REGEXP, re);
+      return NULL;
+    }
+
+  memset (set, 0, sizeof (set));
+  re_closure (re, set, re->start, 1, 0);
+  re_dfa_get (re, set, 1);
+
+  return re;
+}
+
+void
+bgp_aspath_re_free (struct bgp_aspath_re *re)
+{
+  if (re->dfa)
+    XFREE (MTYPE_BGP_REGEXP, re->dfa);
+  XFREE (MTYPE_BGP_REGEXP, re);
+}
+
+/* Run RE over the next symbol from state D.  With no DFA state to be
+   had, SET holds the NFA states instead and -1 is returned. */
+static int
+re_feed (struct bgp_aspath_re *re, int d, u_int64_t *set, int sym)
+{
+  u_int64_t next[RE_SET_WORDS];
+  int n;
+
+  if (d >= 0 && re->dfa[d].next[sym] >= 0)
+    return re->dfa[d].next[sym];
+
+  re_step (re, d >= 0 ? re->dfa[d].nfa : set, sym, next);
+  n = re_dfa_get (re, next, 0);
+  if (n >= 0 && d >= 0)
+    re->dfa[d].next[sym] = n;
+  if (n < 0)
+    memcpy (set, next, sizeof (next));
+  return n;
+}
+
+static int
+re_matched (struct bgp_aspath_re *re, int d, const u_int64_t *set, int end)
+{
+  u_int64_t eol[RE_SET_WORDS];
+  int s;
+
+  if (d >= 0)
+    return end ? re->dfa[d].match_end : re->dfa[d].match;
+
+  memset (eol, 0, sizeof (eol));
+  for (s = 0; s < re->nnfa; s++)
+    if (RE_SET_HAS (set, s))
+      {
+        if (re->nfa[s].type == RE_NFA_MATCH)
+          return 1;
+        if (end)
+          re_closure (re, eol, s, 0, 1);
+      }
+  for (s = 0; s < re->nnfa; s++)
+    if (RE_SET_HAS (eol, s) && re->nfa[s].type == RE_NFA_MATCH)
+      return 1;
+  return 0;
+}
+
+/* Whether RE matches the string form of ASPATH, which need not have
+   been made. */
+int
+bgp_aspath_re_match (struct bgp_aspath_re *re, struct aspath *aspath)
+{
+  struct assegment *seg;
+  u_int64_t set[RE_SET_WORDS];
+  char digits[10];
+  int d = 0;
+  int i, n;
+
+#define RE_FEED(sym) \
+  do { \
+    if (d >= 0 && re->dfa[d].next[(sym)] >= 0) \
+      d = re->dfa[d].next[(sym)]; \
+    else \
+      d = re_feed (re, d, set, (sym)); \
+    if (d >= 0) \
+      { \
+        if (re->dfa[d].match) \
+          return 1; \
+        if (re->dfa[d].dead) \
+          return 0; \
+      } \
+    else if (re_matched (re, d, set, 0)) \
+      return 1; \
+  } while (0)
+
+  if (re->dfa[0].match)
+    return 1;
+
+  for (seg = aspath->segments; seg; seg = seg->next)
+    {
+      int open = -1, close = -1, sep = RE_SYM_SPACE;
+
+      switch (seg->type)
+        {
+        case AS_SEQUENCE:
+          break;
+        case AS_SET:
+          open = re_sym ('{'), close = re_sym ('}'), sep = RE_SYM_COMMA;
+          break;
+        case AS_CONFED_SEQUENCE:
+          open = re_sym ('('), close = re_sym (')');
+          break;
+        case AS_CONFED_SET:
+          open = re_sym ('['), close = re_sym (']'), sep = RE_SYM_COMMA;
+          break;
+        default:
+          return 0;
+        }
+
+      if (open >= 0)
+        RE_FEED (open);
+      for (i = 0; i < seg->length; i++)
+        {
+          as_t as = seg->as[i];
+
+          if (i)
+            RE_FEED (sep);
+          n = 0;
+          do
+            digits[n++] = as % 10;
+          while ((as /= 10) != 0);
+          while (n--)
+            RE_FEED (digits[n]);
+        }
+      if (close >= 0)
+        RE_FEED (close);
+      if (seg->next)
+        RE_FEED (RE_SYM_SPACE);
+    }
+#undef RE_FEED
+
+  return re_matched (re, d, set, 1);
+}
@@ -37,4 +37,10 @@ extern void bgp_regex_free (regex_t *regex);
 extern regex_t *bgp_regcomp (const char *str);
 extern int bgp_regexec (regex_t *regex, struct aspath *aspath);
 
+struct bgp_aspath_re;
+
+extern struct bgp_aspath_re *bgp_aspath_re_compile (const char *);
+extern int bgp_aspath_re_match (struct bgp_aspath_re *, struct aspath *);
+extern void bgp_aspath_re_free (struct bgp_aspath_re *);
+
 #endif /* _QUAGGA_BGP_REGEX_H */
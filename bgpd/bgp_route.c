@@ -28,6 +28,8 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "stream.h"
 #include "filter.h"
 #include "str.h"
+#include "hash.h"
+#include "jhash.h"
 #include "log.h"
 #include "routemap.h"
 #include "buffer.h"
@@ -58,6 +60,12 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_vty.h"
 #include "bgpd/bgp_mpath.h"
 #include "bgpd/bgp_nht.h"
+#include "bgpd/bgp_updgrp.h"
+#include "bgpd/bgp_pool.h"
+
+/* Every bgp_info comes from here. */
+struct bgp_pool bgp_info_pool = BGP_POOL_INIT (MTYPE_BGP_ROUTE,
+                                               struct bgp_info);
 
 /* Extern from bgp_dump.c */
 extern const char *bgp_origin_str[];
@@ -112,6 +120,8 @@ bgp_info_extra_free (struct bgp_info_extra **extra)
       
       (*extra)->damp_info = NULL;
       
+      bgp_info_mpath_free (&(*extra)->mpath);
+
       XFREE (MTYPE_BGP_ROUTE_EXTRA, *extra);
       
       *extra = NULL;
@@ -138,11 +148,10 @@ bgp_info_free (struct bgp_info *binfo)
 
   bgp_unlink_nexthop (binfo);
   bgp_info_extra_free (&binfo->extra);
-  bgp_info_mpath_free (&binfo->mpath);
 
   peer_unlock (binfo->peer); /* bgp_info peer reference */
 
-  XFREE (MTYPE_BGP_ROUTE, binfo);
+  bgp_pool_put (&bgp_info_pool, binfo);
 }
 
 struct bgp_info *
@@ -182,19 +191,16 @@ bgp_info_unlock (struct bgp_info *binfo)
 void
 bgp_info_add (struct bgp_node *rn, struct bgp_info *ri)
 {
-  struct bgp_info *top;
-
-  top = rn->info;
-  
   ri->next = rn->info;
-  ri->prev = NULL;
-  if (top)
-    top->prev = ri;
   rn->info = ri;
   
   bgp_info_lock (ri);
   bgp_lock_node (rn);
   peer_lock (ri->peer); /* bgp_info peer reference */
+
+  LIST_INSERT_HEAD (&ri->peer->paths[bgp_node_table (rn)->afi]
+                                    [bgp_node_table (rn)->safi],
+                    ri, peer_thread);
 }
 
 /* Do the actual removal of info from RIB, for use by bgp_process 
@@ -202,12 +208,19 @@ bgp_info_add (struct bgp_node *rn, struct bgp_info *ri)
 static void
 bgp_info_reap (struct bgp_node *rn, struct bgp_info *ri)
 {
-  if (ri->next)
-    ri->next->prev = ri->prev;
-  if (ri->prev)
-    ri->prev->next = ri->next;
+  struct bgp_info *prev = NULL, *cur;
+
+  /* Paths of a node are few, not worth a back pointer in every one. */
+  for (cur = rn->info; cur != ri; cur = cur->next)
+    {
+      assert (cur);
+      prev = cur;
+    }
+  if (prev)
+    prev->next = ri->next;
   else
     rn->info = ri->next;
+  LIST_REMOVE (ri, peer_thread);
   
   bgp_info_mpath_dequeue (ri);
   bgp_info_unlock (ri);
@@ -796,40 +809,24 @@ bgp_import_modifier (struct peer *rsclient, struct peer *peer,
   return RMAP_PERMIT;
 }
 
+/* The checks on an announcement that depend on the peer itself rather
+   than on its outbound configuration. */
 static int
-bgp_announce_check (struct bgp_info *ri, struct peer *peer, struct prefix *p,
-		    struct attr *attr, afi_t afi, safi_t safi)
+bgp_announce_check_peer (struct bgp_info *ri, struct peer *peer,
+			 struct prefix *p, afi_t afi, safi_t safi)
 {
-  int ret;
   char buf[SU_ADDRSTRLEN];
-  struct bgp_filter *filter;
-  struct peer *from;
-  struct bgp *bgp;
-  int transparent;
-  int reflect;
   struct attr *riattr;
 
-  from = ri->peer;
-  filter = &peer->filter[afi][safi];
-  bgp = peer->bgp;
   riattr = bgp_info_mpath_count (ri) ? bgp_info_mpath_attr (ri) : ri->attr;
-  
-  if (DISABLE_BGP_ANNOUNCE)
-    return 0;
 
-  /* Do not send announces to RS-clients from the 'normal' bgp_table. */
-  if (CHECK_FLAG(peer->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT))
+  if (DISABLE_BGP_ANNOUNCE)
     return 0;
 
   /* Do not send back route to sender. */
-  if (from == peer)
+  if (ri->peer == peer)
     return 0;
 
-  /* Aggregate-address suppress check. */
-  if (ri->extra && ri->extra->suppress)
-    if (! UNSUPPRESS_MAP_NAME (filter))
-      return 0;
-
   /* Default route check.  */
   if (CHECK_FLAG (peer->af_sflags[afi][safi], PEER_STATUS_DEFAULT_ORIGINATE))
     {
@@ -839,17 +836,6 @@ bgp_announce_check (struct bgp_info *ri, struct peer *peer, struct prefix *p,
 	return 0;
     }
 
-  /* Transparency check. */
-  if (CHECK_FLAG (peer->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT)
-      && CHECK_FLAG (from->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT))
-    transparent = 1;
-  else
-    transparent = 0;
-
-  /* If community is not disabled check the no-export and local. */
-  if (! transparent && bgp_community_filter (peer, riattr))
-    return 0;
-
   /* If the attribute has originator-id and it is same as remote
      peer's id. */
   if (riattr->flag & ATTR_FLAG_BIT (BGP_ATTR_ORIGINATOR_ID))
@@ -876,6 +862,50 @@ bgp_announce_check (struct bgp_info *ri, struct peer *peer, struct prefix *p,
           return 0;
       }
 
+  return 1;
+}
+
+/* The outbound policy of the peer, which is the same for every member
+   of its update group. */
+static int
+bgp_announce_check_policy (struct bgp_info *ri, struct peer *peer,
+			   struct prefix *p, struct attr *attr,
+			   afi_t afi, safi_t safi)
+{
+  int ret;
+  char buf[SU_ADDRSTRLEN];
+  struct bgp_filter *filter;
+  struct peer *from;
+  struct bgp *bgp;
+  int transparent;
+  int reflect;
+  struct attr *riattr;
+
+  from = ri->peer;
+  filter = &peer->filter[afi][safi];
+  bgp = peer->bgp;
+  riattr = bgp_info_mpath_count (ri) ? bgp_info_mpath_attr (ri) : ri->attr;
+  
+  /* Do not send announces to RS-clients from the 'normal' bgp_table. */
+  if (CHECK_FLAG(peer->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT))
+    return 0;
+
+  /* Aggregate-address suppress check. */
+  if (ri->extra && ri->extra->suppress)
+    if (! UNSUPPRESS_MAP_NAME (filter))
+      return 0;
+
+  /* Transparency check. */
+  if (CHECK_FLAG (peer->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT)
+      && CHECK_FLAG (from->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT))
+    transparent = 1;
+  else
+    transparent = 0;
+
+  /* If community is not disabled check the no-export and local. */
+  if (! transparent && bgp_community_filter (peer, riattr))
+    return 0;
+
   /* Output filter check. */
   if (bgp_output_filter (peer, p, riattr, afi, safi) == FILTER_DENY)
     {
@@ -1097,6 +1127,11 @@ bgp_announce_check (struct bgp_info *ri, struct peer *peer, struct prefix *p,
 
       peer->rmap_type = 0;
 
+      /* Whatever the route-map set on the reflected route's copy is
+	 thrown away. */
+      if (info.attr == &dummy_attr)
+	bgp_attr_flush (&dummy_attr);
+
       if (ret == RMAP_DENYMATCH)
 	{
 	  bgp_attr_flush (attr);
@@ -1106,6 +1141,38 @@ bgp_announce_check (struct bgp_info *ri, struct peer *peer, struct prefix *p,
   return 1;
 }
 
+static int
+bgp_announce_check (struct bgp_info *ri, struct peer *peer, struct prefix *p,
+		    struct attr *attr, afi_t afi, safi_t safi)
+{
+  return bgp_announce_check_peer (ri, peer, p, afi, safi)
+    && bgp_announce_check_policy (ri, peer, p, attr, afi, safi);
+}
+
+/* Run the outbound policy of the peer's update group on the route, or
+   reuse the result of another member.  Returns the attribute to
+   announce, NULL if the route is filtered. */
+static struct attr *
+bgp_announce_check_group (struct bgp_info *ri, struct peer *peer,
+			  struct bgp_node *rn, struct attr *attr,
+			  afi_t afi, safi_t safi)
+{
+  struct update_group *group;
+
+  group = bgp_updgrp_lookup (peer, afi, safi);
+  if (! group)
+    return bgp_announce_check_policy (ri, peer, &rn->p, attr, afi, safi)
+      ? attr : NULL;
+
+  if (! bgp_updgrp_policy_cached (group, rn, ri))
+    bgp_updgrp_policy_store (group, rn, ri,
+			     bgp_announce_check_policy (ri, peer, &rn->p,
+						bgp_updgrp_policy_attr (group),
+						afi, safi));
+
+  return group->permit ? &group->attr : NULL;
+}
+
 static int
 bgp_announce_check_rsclient (struct bgp_info *ri, struct peer *rsclient,
         struct prefix *p, struct attr *attr, afi_t afi, safi_t safi)
@@ -1301,6 +1368,229 @@ struct bgp_info_pair
   struct bgp_info *new;
 };
 
+/* A path of a node and what deterministic-MED groups it by.  The paths
+   of a group are chained by NEXT in the order they are on the node. */
+struct bgp_dmed_path
+{
+  struct bgp_info *ri;
+  int key;
+  as_t as;
+  int next;
+  int first;
+};
+
+/* A slot of the hash of groups by neighboring AS, the first and last
+   path of the group. */
+struct bgp_dmed_slot
+{
+  int first;
+  int last;
+};
+
+/* Room for the paths of the node being selected for, and for the slots,
+   which are at least twice as many and a power of two. */
+static struct bgp_dmed_path *bgp_dmed_paths;
+static struct bgp_dmed_slot *bgp_dmed_slots;
+static unsigned int bgp_dmed_size;
+
+/* Whether a path can lead a deterministic-MED group, and whether it can
+   be in one led by another. */
+static int
+bgp_dmed_leader_ok (struct bgp *bgp, struct bgp_info *ri)
+{
+  if (CHECK_FLAG (ri->flags, BGP_INFO_DMED_CHECK) || BGP_INFO_HOLDDOWN (ri))
+    return 0;
+  if (ri->peer && ri->peer != bgp->peer_self)
+    if (ri->peer->status != Established)
+      return 0;
+  return 1;
+}
+
+static int
+bgp_dmed_member_ok (struct bgp *bgp, struct bgp_info *ri)
+{
+  if (CHECK_FLAG (ri->flags, BGP_INFO_DMED_CHECK) || BGP_INFO_HOLDDOWN (ri))
+    return 0;
+  if (ri->peer &&
+      ri->peer != bgp->peer_self &&
+      !CHECK_FLAG (ri->peer->sflags, PEER_STATUS_NSF_WAIT))
+    if (ri->peer->status != Established)
+      return 0;
+  return 1;
+}
+
+/* Select the best of a group of paths of the same neighboring AS, the
+   chain of them from FIRST. */
+static void
+bgp_dmed_group_select (struct bgp *bgp, struct bgp_node *rn,
+                       struct bgp_dmed_path *paths, int first,
+                       afi_t afi, safi_t safi, int do_mpath)
+{
+  struct bgp_info *new_select;
+  struct bgp_info *old_select;
+  struct bgp_info *ri2;
+  struct list mp_list;
+  int cmpret;
+  int i;
+
+  bgp_mp_list_init (&mp_list);
+
+  new_select = paths[first].ri;
+  if (do_mpath)
+    bgp_mp_list_add (&mp_list, new_select);
+  old_select = CHECK_FLAG (new_select->flags, BGP_INFO_SELECTED)
+               ? new_select : NULL;
+
+  for (i = paths[first].next; i >= 0; i = paths[i].next)
+    {
+      ri2 = paths[i].ri;
+
+      if (CHECK_FLAG (ri2->flags, BGP_INFO_SELECTED))
+        old_select = ri2;
+      if ((cmpret = bgp_info_cmp (bgp, ri2, new_select, afi, safi)) == -1)
+        {
+          bgp_info_unset_flag (rn, new_select, BGP_INFO_DMED_SELECTED);
+          new_select = ri2;
+        }
+
+      if (do_mpath)
+        {
+          if (cmpret != 0)
+            bgp_mp_list_clear (&mp_list);
+
+          if (cmpret == 0 || cmpret == -1)
+            bgp_mp_list_add (&mp_list, ri2);
+        }
+
+      bgp_info_set_flag (rn, ri2, BGP_INFO_DMED_CHECK);
+    }
+  bgp_info_set_flag (rn, new_select, BGP_INFO_DMED_CHECK);
+  bgp_info_set_flag (rn, new_select, BGP_INFO_DMED_SELECTED);
+
+  bgp_info_mpath_update (rn, new_select, old_select, &mp_list, afi, safi);
+  bgp_mp_list_clear (&mp_list);
+}
+
+/* Deterministic-MED: the paths of a node from the same neighboring AS
+   are compared among themselves first, the best of each group then goes
+   on to the selection proper.  The groups are found by hashing the
+   paths by their neighboring AS, rather than by comparing each path
+   with every other.  Confederation paths can be found equal by either
+   of two ASes, which does not make groups, they are compared in pairs
+   as ever.  So are all paths if PAIRWISE is set, which is for the
+   tests. */
+void
+bgp_dmed_select (struct bgp *bgp, struct bgp_node *rn, afi_t afi,
+                 safi_t safi, int pairwise)
+{
+  struct bgp_dmed_path *paths;
+  struct bgp_dmed_slot *slot;
+  struct bgp_info *ri1;
+  struct bgp_info *ri2;
+  unsigned int count = 0;
+  unsigned int confeds = 0;
+  unsigned int mask;
+  unsigned int h;
+  int i, j, n;
+  int do_mpath;
+
+  for (ri1 = rn->info; ri1; ri1 = ri1->next)
+    count++;
+  if (count > bgp_dmed_size)
+    {
+      bgp_dmed_size = MAX (count, bgp_dmed_size * 2);
+      bgp_dmed_paths = XREALLOC (MTYPE_BGP_DMED, bgp_dmed_paths,
+                                 bgp_dmed_size * sizeof (*paths));
+      bgp_dmed_slots = XREALLOC (MTYPE_BGP_DMED, bgp_dmed_slots,
+                                 4 * bgp_dmed_size * sizeof (*slot));
+    }
+  paths = bgp_dmed_paths;
+  do_mpath = bgp_mpath_is_configured (bgp, afi, safi);
+
+  if (! pairwise)
+    for (ri1 = rn->info; ri1; ri1 = ri1->next)
+      if (aspath_left_confed (ri1->attr->aspath))
+        confeds++;
+
+  if (pairwise || confeds > 1)
+    {
+      for (ri1 = rn->info; ri1; ri1 = ri1->next)
+        {
+          if (! bgp_dmed_leader_ok (bgp, ri1))
+            continue;
+
+          n = 0;
+          paths[n++].ri = ri1;
+          for (ri2 = ri1->next; ri2; ri2 = ri2->next)
+            if (bgp_dmed_member_ok (bgp, ri2)
+                && (aspath_cmp_left (ri1->attr->aspath, ri2->attr->aspath)
+                    || aspath_cmp_left_confed (ri1->attr->aspath,
+                                               ri2->attr->aspath)))
+              paths[n++].ri = ri2;
+          for (i = 0; i < n; i++)
+            paths[i].next = i + 1 < n ? i + 1 : -1;
+
+          bgp_dmed_group_select (bgp, rn, paths, 0, afi, safi, do_mpath);
+        }
+      return;
+    }
+
+  /* At least twice as many slots as paths, a power of two. */
+  for (mask = 1; mask < 2 * count; mask <<= 1)
+    ;
+  mask--;
+  for (h = 0; h <= mask; h++)
+    bgp_dmed_slots[h].first = -1;
+
+  n = 0;
+  for (ri1 = rn->info; ri1; ri1 = ri1->next)
+    {
+      /* A path that can not be in a group can not lead one either. */
+      if (! bgp_dmed_member_ok (bgp, ri1))
+        continue;
+
+      paths[n].ri = ri1;
+      paths[n].key = aspath_left_key (ri1->attr->aspath, &paths[n].as);
+      paths[n].next = -1;
+      paths[n].first = 1;
+
+      /* One that does not match any other is a group of its own. */
+      if (paths[n].key != ASPATH_LEFT_NONE)
+        {
+          h = (paths[n].as + paths[n].key) * 2654435761U;
+          for (slot = &bgp_dmed_slots[h & mask]; slot->first >= 0;
+               slot = &bgp_dmed_slots[++h & mask])
+            if (paths[slot->first].key == paths[n].key
+                && paths[slot->first].as == paths[n].as)
+              break;
+
+          if (slot->first < 0)
+            slot->first = n;
+          else
+            {
+              paths[slot->last].next = n;
+              paths[n].first = 0;
+            }
+          slot->last = n;
+        }
+      n++;
+    }
+
+  for (i = 0; i < n; i++)
+    {
+      if (! paths[i].first)
+        continue;
+
+      /* Those before the first that can lead are left out, as they are
+         by comparing in pairs. */
+      for (j = i; j >= 0; j = paths[j].next)
+        if (bgp_dmed_leader_ok (bgp, paths[j].ri))
+          break;
+      if (j >= 0)
+        bgp_dmed_group_select (bgp, rn, paths, j, afi, safi, do_mpath);
+    }
+}
+
 static void
 bgp_best_selection (struct bgp *bgp, struct bgp_node *rn,
 		    struct bgp_info_pair *result,
@@ -1309,8 +1599,6 @@ bgp_best_selection (struct bgp *bgp, struct bgp_node *rn,
   struct bgp_info *new_select;
   struct bgp_info *old_select;
   struct bgp_info *ri;
-  struct bgp_info *ri1;
-  struct bgp_info *ri2;
   struct bgp_info *nextri = NULL;
   int cmpret, do_mpath;
   struct list mp_list;
@@ -1330,66 +1618,8 @@ bgp_best_selection (struct bgp *bgp, struct bgp_node *rn,
   do_mpath = bgp_mpath_is_configured (bgp, afi, safi);
 
   /* bgp deterministic-med */
-  new_select = NULL;
   if (bgp_flag_check (bgp, BGP_FLAG_DETERMINISTIC_MED))
-    for (ri1 = rn->info; ri1; ri1 = ri1->next)
-      {
-	if (CHECK_FLAG (ri1->flags, BGP_INFO_DMED_CHECK))
-	  continue;
-	if (BGP_INFO_HOLDDOWN (ri1))
-	  continue;
-        if (ri1->peer && ri1->peer != bgp->peer_self)
-          if (ri1->peer->status != Established)
-            continue;
-
-	new_select = ri1;
-	if (do_mpath)
-	  bgp_mp_list_add (&mp_list, ri1);
-	old_select = CHECK_FLAG (ri1->flags, BGP_INFO_SELECTED) ? ri1 : NULL;
-	if (ri1->next)
-	  for (ri2 = ri1->next; ri2; ri2 = ri2->next)
-	    {
-	      if (CHECK_FLAG (ri2->flags, BGP_INFO_DMED_CHECK))
-		continue;
-	      if (BGP_INFO_HOLDDOWN (ri2))
-		continue;
-              if (ri2->peer &&
-                  ri2->peer != bgp->peer_self &&
-                  !CHECK_FLAG (ri2->peer->sflags, PEER_STATUS_NSF_WAIT))
-                if (ri2->peer->status != Established)
-                  continue;
-
-	      if (aspath_cmp_left (ri1->attr->aspath, ri2->attr->aspath)
-		  || aspath_cmp_left_confed (ri1->attr->aspath,
-					     ri2->attr->aspath))
-		{
-		  if (CHECK_FLAG (ri2->flags, BGP_INFO_SELECTED))
-		    old_select = ri2;
-		  if ((cmpret = bgp_info_cmp (bgp, ri2, new_select, afi, safi))
-		       == -1)
-		    {
-		      bgp_info_unset_flag (rn, new_select, BGP_INFO_DMED_SELECTED);
-		      new_select = ri2;
-		    }
-
-		  if (do_mpath)
-		    {
-                      if (cmpret != 0)
-                        bgp_mp_list_clear (&mp_list);
-
-                      if (cmpret == 0 || cmpret == -1)
-                        bgp_mp_list_add (&mp_list, ri2);
-                    }
-
-		  bgp_info_set_flag (rn, ri2, BGP_INFO_DMED_CHECK);
-		}
-	    }
-	bgp_info_set_flag (rn, new_select, BGP_INFO_DMED_CHECK);
-	bgp_info_set_flag (rn, new_select, BGP_INFO_DMED_SELECTED);
-
-	bgp_info_mpath_update (rn, new_select, old_select, &mp_list, afi, safi);
-	bgp_mp_list_clear (&mp_list);
-      }
+    bgp_dmed_select (bgp, rn, afi, safi, 0);
 
   /* Check old selected route and new selected route. */
   old_select = NULL;
@@ -1466,6 +1696,7 @@ bgp_process_announce_selected (struct peer *peer, struct bgp_info *selected,
   struct prefix *p;
   struct attr attr;
   struct attr_extra extra;
+  struct attr *announce;
 
   memset (&attr, 0, sizeof(struct attr));
   memset (&extra, 0, sizeof(struct attr_extra));
@@ -1493,8 +1724,11 @@ bgp_process_announce_selected (struct peer *peer, struct bgp_info *selected,
       case BGP_TABLE_MAIN:
       /* Announcement to peer->conf.  If the route is filtered,
          withdraw it. */
-        if (selected && bgp_announce_check (selected, peer, p, &attr, afi, safi))
-          bgp_adj_out_set (rn, peer, p, &attr, afi, safi, selected);
+        if (selected
+            && bgp_announce_check_peer (selected, peer, p, afi, safi)
+            && (announce = bgp_announce_check_group (selected, peer, rn,
+                                                     &attr, afi, safi)))
+          bgp_adj_out_set (rn, peer, p, announce, afi, safi, selected);
         else
           bgp_adj_out_unset (rn, peer, p, afi, safi);
         break;
@@ -1521,6 +1755,42 @@ struct bgp_process_queue
   safi_t safi;
 };
 
+/* What bgp_process and the process queues have been up to, for "show
+   bgp process-queue". */
+static struct
+{
+  /* Calls of bgp_process, and those for a node already queued. */
+  unsigned long requests;
+  unsigned long coalesced;
+
+  /* Best path runs, those that changed the best path, and the rate of
+     runs over the last second or so. */
+  unsigned long runs;
+  unsigned long changed;
+  time_t rate_time;
+  unsigned long rate_runs;
+  unsigned long rate;
+
+  /* Deepest the main process queue has been. */
+  unsigned long depth_max;
+} bgp_process_stats;
+
+static void
+bgp_process_stats_run (void)
+{
+  time_t now = bgp_clock ();
+
+  bgp_process_stats.runs++;
+  if (now != bgp_process_stats.rate_time)
+    {
+      bgp_process_stats.rate
+        = (bgp_process_stats.runs - bgp_process_stats.rate_runs)
+          / (now - bgp_process_stats.rate_time);
+      bgp_process_stats.rate_time = now;
+      bgp_process_stats.rate_runs = bgp_process_stats.runs;
+    }
+}
+
 static wq_item_status
 bgp_process_rsclient (struct work_queue *wq, void *data)
 {
@@ -1539,6 +1809,9 @@ bgp_process_rsclient (struct work_queue *wq, void *data)
   bgp_best_selection (bgp, rn, &old_and_new, afi, safi);
   new_select = old_and_new.new;
   old_select = old_and_new.old;
+  bgp_process_stats_run ();
+  if (old_select != new_select)
+    bgp_process_stats.changed++;
 
   if (CHECK_FLAG (rsclient->sflags, PEER_STATUS_GROUP))
     {
@@ -1602,6 +1875,9 @@ bgp_process_main (struct work_queue *wq, void *data)
   bgp_best_selection (bgp, rn, &old_and_new, afi, safi);
   old_select = old_and_new.old;
   new_select = old_and_new.new;
+  bgp_process_stats_run ();
+  if (old_select != new_select)
+    bgp_process_stats.changed++;
 
   /* Nothing to do. */
   if (old_select && old_select == new_select 
@@ -1632,7 +1908,9 @@ bgp_process_main (struct work_queue *wq, void *data)
     }
 
 
-  /* Check each BGP peer. */
+  /* Check each BGP peer, the members of an update group share the
+     outbound policy run. */
+  bgp_updgrp_pass_start ();
   for (ALL_LIST_ELEMENTS (bgp->peer, node, nnode, peer))
     {
       bgp_process_announce_selected (peer, new_select, rn, afi, safi);
@@ -1694,11 +1972,13 @@ bgp_process_queue_init (void)
   bm->process_main_queue->spec.del_item_data = &bgp_processq_del;
   bm->process_main_queue->spec.max_retries = 0;
   bm->process_main_queue->spec.hold = 50;
+  bm->process_main_queue->spec.adaptive = 1;
   
   bm->process_rsclient_queue->spec.workfunc = &bgp_process_rsclient;
   bm->process_rsclient_queue->spec.del_item_data = &bgp_processq_del;
   bm->process_rsclient_queue->spec.max_retries = 0;
   bm->process_rsclient_queue->spec.hold = 50;
+  bm->process_rsclient_queue->spec.adaptive = 1;
 }
 
 void
@@ -1706,9 +1986,15 @@ bgp_process (struct bgp *bgp, struct bgp_node *rn, afi_t afi, safi_t safi)
 {
   struct bgp_process_queue *pqnode;
   
-  /* already scheduled for processing? */
+  bgp_process_stats.requests++;
+
+  /* already scheduled for processing?  The run to come will see this
+     change too. */
   if (CHECK_FLAG (rn->flags, BGP_NODE_PROCESS_SCHEDULED))
-    return;
+    {
+      bgp_process_stats.coalesced++;
+      return;
+    }
   
   if (rn->info == NULL)
     {
@@ -1744,6 +2030,10 @@ bgp_process (struct bgp *bgp, struct bgp_node *rn, afi_t afi, safi_t safi)
     {
       case BGP_TABLE_MAIN:
         work_queue_add (bm->process_main_queue, pqnode);
+        if (listcount (bm->process_main_queue->items)
+            > bgp_process_stats.depth_max)
+          bgp_process_stats.depth_max
+            = listcount (bm->process_main_queue->items);
         break;
       case BGP_TABLE_RSCLIENT:
         work_queue_add (bm->process_rsclient_queue, pqnode);
@@ -1754,6 +2044,44 @@ bgp_process (struct bgp *bgp, struct bgp_node *rn, afi_t afi, safi_t safi)
   return;
 }
 
+static void
+bgp_show_process_queue (struct vty *vty, const char *name,
+                        struct work_queue *wq)
+{
+  if (! wq)
+    return;
+  vty_out (vty, "%s: %u queued, %u per yield check, %lu ns an item%s",
+           name, listcount (wq->items), wq->cycles.granularity,
+           wq->cycles.item_nsec, VTY_NEWLINE);
+}
+
+DEFUN (show_bgp_process_queue,
+       show_bgp_process_queue_cmd,
+       "show bgp process-queue",
+       SHOW_STR
+       BGP_STR
+       "Best path selection queues\n")
+{
+  unsigned long rate = 0;
+
+  /* No run in the last second or more, none to count either. */
+  if (bgp_clock () - bgp_process_stats.rate_time <= 1)
+    rate = bgp_process_stats.rate;
+
+  vty_out (vty, "Requests %lu, for nodes already queued %lu%s",
+           bgp_process_stats.requests, bgp_process_stats.coalesced,
+           VTY_NEWLINE);
+  vty_out (vty, "Best path runs %lu, changing the best path %lu, "
+           "%lu a second lately%s",
+           bgp_process_stats.runs, bgp_process_stats.changed, rate,
+           VTY_NEWLINE);
+  vty_out (vty, "Main queue depth at most %lu%s",
+           bgp_process_stats.depth_max, VTY_NEWLINE);
+  bgp_show_process_queue (vty, "Main queue", bm->process_main_queue);
+  bgp_show_process_queue (vty, "RS-client queue", bm->process_rsclient_queue);
+  return CMD_SUCCESS;
+}
+
 static int
 bgp_maximum_prefix_restart_timer (struct thread *thread)
 {
@@ -1890,7 +2218,7 @@ info_make (int type, int sub_type, struct peer *peer, struct attr *attr,
   struct bgp_info *new;
 
   /* Make new BGP info. */
-  new = XCALLOC (MTYPE_BGP_ROUTE, sizeof (struct bgp_info));
+  new = bgp_pool_get (&bgp_info_pool);
   new->type = type;
   new->sub_type = sub_type;
   new->peer = peer;
@@ -2115,14 +2443,23 @@ bgp_withdraw_rsclient (struct peer *rsclient, afi_t afi, safi_t safi,
   bgp_unlock_node (rn);
 }
 
+/* What the prefixes of one NLRI field have in common, see
+   bgp_nlri_parse_ip. */
+struct bgp_nlri_batch
+{
+  /* The attribute interned for the first prefix let in, with a
+     reference held, when letting it in did not depend on the prefix. */
+  struct attr *attr;
+};
+
 static int
 bgp_update_main (struct peer *peer, struct prefix *p, struct attr *attr,
 	    afi_t afi, safi_t safi, int type, int sub_type,
-	    struct prefix_rd *prd, u_char *tag, int soft_reconfig)
+	    struct prefix_rd *prd, u_char *tag, int soft_reconfig,
+	    struct bgp_node *rn, struct bgp_nlri_batch *batch)
 {
   int ret;
   int aspath_loop_count = 0;
-  struct bgp_node *rn;
   struct bgp *bgp;
   struct attr new_attr;
   struct attr_extra new_extra;
@@ -2137,7 +2474,8 @@ bgp_update_main (struct peer *peer, struct prefix *p, struct attr *attr,
   memset (&new_extra, 0, sizeof(struct attr_extra));
 
   bgp = peer->bgp;
-  rn = bgp_afi_node_get (bgp->rib[afi][safi], afi, safi, p, prd);
+  if (! rn)
+    rn = bgp_afi_node_get (bgp->rib[afi][safi], afi, safi, p, prd);
   
   /* When peer's soft reconfiguration enabled.  Record input packet in
      Adj-RIBs-In.  */
@@ -2195,6 +2533,14 @@ bgp_update_main (struct peer *peer, struct prefix *p, struct attr *attr,
       goto filtered;
     }
 
+  /* The rest of the way in is the same for all prefixes of the batch,
+     when it does not go through a route-map. */
+  if (batch && batch->attr)
+    {
+      attr_new = bgp_attr_intern_ref (batch->attr);
+      goto interned;
+    }
+
   new_attr.extra = &new_extra;
   bgp_attr_dup (&new_attr, attr);
 
@@ -2225,7 +2571,10 @@ bgp_update_main (struct peer *peer, struct prefix *p, struct attr *attr,
     }
 
   attr_new = bgp_attr_intern (&new_attr);
+  if (batch && ! ROUTE_MAP_IN_NAME (&peer->filter[afi][safi]))
+    batch->attr = bgp_attr_intern_ref (attr_new);
 
+ interned:
   /* If the update is implicit withdraw. */
   if (ri)
     {
@@ -2455,10 +2804,12 @@ bgp_update_main (struct peer *peer, struct prefix *p, struct attr *attr,
   return 0;
 }
 
-int
-bgp_update (struct peer *peer, struct prefix *p, struct attr *attr,
-            afi_t afi, safi_t safi, int type, int sub_type,
-            struct prefix_rd *prd, u_char *tag, int soft_reconfig)
+/* RN, if given, is the locked node for P, whose lock is handed over. */
+static int
+bgp_update_node (struct peer *peer, struct prefix *p, struct attr *attr,
+                 afi_t afi, safi_t safi, int type, int sub_type,
+                 struct prefix_rd *prd, u_char *tag, int soft_reconfig,
+                 struct bgp_node *rn, struct bgp_nlri_batch *batch)
 {
   struct peer *rsclient;
   struct listnode *node, *nnode;
@@ -2466,7 +2817,7 @@ bgp_update (struct peer *peer, struct prefix *p, struct attr *attr,
   int ret;
 
   ret = bgp_update_main (peer, p, attr, afi, safi, type, sub_type, prd, tag,
-          soft_reconfig);
+          soft_reconfig, rn, batch);
 
   bgp = peer->bgp;
 
@@ -2482,13 +2833,22 @@ bgp_update (struct peer *peer, struct prefix *p, struct attr *attr,
 }
 
 int
-bgp_withdraw (struct peer *peer, struct prefix *p, struct attr *attr, 
-	     afi_t afi, safi_t safi, int type, int sub_type, 
-	     struct prefix_rd *prd, u_char *tag)
+bgp_update (struct peer *peer, struct prefix *p, struct attr *attr,
+            afi_t afi, safi_t safi, int type, int sub_type,
+            struct prefix_rd *prd, u_char *tag, int soft_reconfig)
+{
+  return bgp_update_node (peer, p, attr, afi, safi, type, sub_type, prd, tag,
+                          soft_reconfig, NULL, NULL);
+}
+
+/* RN, if given, is the locked node for P, whose lock is handed over. */
+static int
+bgp_withdraw_node (struct peer *peer, struct prefix *p, struct attr *attr,
+                   afi_t afi, safi_t safi, int type, int sub_type,
+                   struct prefix_rd *prd, u_char *tag, struct bgp_node *rn)
 {
   struct bgp *bgp;
   char buf[SU_ADDRSTRLEN];
-  struct bgp_node *rn;
   struct bgp_info *ri;
   struct peer *rsclient;
   struct listnode *node, *nnode;
@@ -2496,7 +2856,8 @@ bgp_withdraw (struct peer *peer, struct prefix *p, struct attr *attr,
   bgp = peer->bgp;
 
   /* Lookup node. */
-  rn = bgp_afi_node_get (bgp->rib[afi][safi], afi, safi, p, prd);
+  if (! rn)
+    rn = bgp_afi_node_get (bgp->rib[afi][safi], afi, safi, p, prd);
 
   /* Cisco IOS 12.4(24)T4 on session establishment sends withdraws for all
    * routes that are filtered.  This tanks out Quagga RS pretty badly due to
@@ -2550,6 +2911,15 @@ bgp_withdraw (struct peer *peer, struct prefix *p, struct attr *attr,
   return 0;
 }
 
+int
+bgp_withdraw (struct peer *peer, struct prefix *p, struct attr *attr, 
+	     afi_t afi, safi_t safi, int type, int sub_type, 
+	     struct prefix_rd *prd, u_char *tag)
+{
+  return bgp_withdraw_node (peer, p, attr, afi, safi, type, sub_type, prd, tag,
+                            NULL);
+}
+
 void
 bgp_default_originate (struct peer *peer, afi_t afi, safi_t safi, int withdraw)
 {
@@ -2651,12 +3021,39 @@ bgp_default_originate (struct peer *peer, afi_t afi, safi_t safi, int withdraw)
   aspath_unintern (&aspath);
 }
 
+/* Nodes a walk goes through before looking at the clock. */
+#define BGP_WALK_SLICE 256
+
+static void bgp_walk_free (struct bgp_walk *);
+static int bgp_walk_step (struct bgp_walk *);
+static void bgp_walk_cancel (struct peer *, afi_t, safi_t,
+                             enum bgp_walk_type);
+static struct bgp_walk *bgp_walk_start (struct peer *, afi_t, safi_t,
+                                        enum bgp_walk_type);
+
+static void
+bgp_announce_node (struct peer *peer, afi_t afi, safi_t safi,
+                   struct bgp_node *rn, struct attr *attr, int rsclient)
+{
+  struct bgp_info *ri;
+
+  for (ri = rn->info; ri; ri = ri->next)
+    if (CHECK_FLAG (ri->flags, BGP_INFO_SELECTED) && ri->peer != peer)
+      {
+        if ( (rsclient) ?
+             (bgp_announce_check_rsclient (ri, peer, &rn->p, attr, afi, safi))
+             : (bgp_announce_check (ri, peer, &rn->p, attr, afi, safi)))
+          bgp_adj_out_set (rn, peer, &rn->p, attr, afi, safi, ri);
+        else
+          bgp_adj_out_unset (rn, peer, &rn->p, afi, safi);
+      }
+}
+
 static void
 bgp_announce_table (struct peer *peer, afi_t afi, safi_t safi,
                    struct bgp_table *table, int rsclient)
 {
   struct bgp_node *rn;
-  struct bgp_info *ri;
   struct attr attr;
   struct attr_extra extra;
 
@@ -2673,16 +3070,7 @@ bgp_announce_table (struct peer *peer, afi_t afi, safi_t safi,
   attr.extra = &extra;
 
   for (rn = bgp_table_top (table); rn; rn = bgp_route_next(rn))
-    for (ri = rn->info; ri; ri = ri->next)
-      if (CHECK_FLAG (ri->flags, BGP_INFO_SELECTED) && ri->peer != peer)
-	{
-         if ( (rsclient) ?
-              (bgp_announce_check_rsclient (ri, peer, &rn->p, &attr, afi, safi))
-              : (bgp_announce_check (ri, peer, &rn->p, &attr, afi, safi)))
-	    bgp_adj_out_set (rn, peer, &rn->p, &attr, afi, safi, ri);
-	  else
-	    bgp_adj_out_unset (rn, peer, &rn->p, afi, safi);
-	}
+    bgp_announce_node (peer, afi, safi, rn, &attr, rsclient);
 
   bgp_attr_flush_encap(&attr);
 }
@@ -2704,7 +3092,11 @@ bgp_announce_route (struct peer *peer, afi_t afi, safi_t safi)
     return;
 
   if ((safi != SAFI_MPLS_VPN) && (safi != SAFI_ENCAP))
-    bgp_announce_table (peer, afi, safi, NULL, 0);
+    {
+      if (CHECK_FLAG (peer->af_flags[afi][safi], PEER_FLAG_DEFAULT_ORIGINATE))
+        bgp_default_originate (peer, afi, safi, 0);
+      bgp_walk_start (peer, afi, safi, BGP_WALK_ANNOUNCE);
+    }
   else
     for (rn = bgp_table_top (peer->bgp->rib[afi][safi]); rn;
 	 rn = bgp_route_next(rn))
@@ -2770,36 +3162,39 @@ bgp_soft_reconfig_rsclient (struct peer *rsclient, afi_t afi, safi_t safi)
         }
 }
 
+static int
+bgp_soft_reconfig_node (struct peer *peer, afi_t afi, safi_t safi,
+                        struct bgp_node *rn, struct prefix_rd *prd)
+{
+  struct bgp_adj_in *ain;
+
+  for (ain = rn->adj_in; ain; ain = ain->next)
+    if (ain->peer == peer)
+      {
+        struct bgp_info *ri = rn->info;
+        u_char *tag = (ri && ri->extra) ? ri->extra->tag : NULL;
+
+        return bgp_update (peer, &rn->p, ain->attr, afi, safi,
+                           ZEBRA_ROUTE_BGP, BGP_ROUTE_NORMAL,
+                           prd, tag, 1);
+      }
+  return 0;
+}
+
 static void
 bgp_soft_reconfig_table (struct peer *peer, afi_t afi, safi_t safi,
 			 struct bgp_table *table, struct prefix_rd *prd)
 {
-  int ret;
   struct bgp_node *rn;
-  struct bgp_adj_in *ain;
 
   if (! table)
     table = peer->bgp->rib[afi][safi];
 
   for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
-    for (ain = rn->adj_in; ain; ain = ain->next)
+    if (bgp_soft_reconfig_node (peer, afi, safi, rn, prd) < 0)
       {
-	if (ain->peer == peer)
-	  {
-	    struct bgp_info *ri = rn->info;
-	    u_char *tag = (ri && ri->extra) ? ri->extra->tag : NULL;
-
-	    ret = bgp_update (peer, &rn->p, ain->attr, afi, safi,
-			      ZEBRA_ROUTE_BGP, BGP_ROUTE_NORMAL,
-			      prd, tag, 1);
-
-	    if (ret < 0)
-	      {
-		bgp_unlock_node (rn);
-		return;
-	      }
-	    continue;
-	  }
+        bgp_unlock_node (rn);
+        return;
       }
 }
 
@@ -2813,7 +3208,7 @@ bgp_soft_reconfig_in (struct peer *peer, afi_t afi, safi_t safi)
     return;
 
   if ((safi != SAFI_MPLS_VPN) && (safi != SAFI_ENCAP))
-    bgp_soft_reconfig_table (peer, afi, safi, NULL, NULL);
+    bgp_walk_start (peer, afi, safi, BGP_WALK_SOFT_IN);
   else
     for (rn = bgp_table_top (peer->bgp->rib[afi][safi]); rn;
 	 rn = bgp_route_next (rn))
@@ -2842,10 +3237,12 @@ bgp_clear_route_node (struct work_queue *wq, void *data)
   struct bgp_node *rn = cnq->rn;
   struct peer *peer = wq->spec.data;
   struct bgp_info *ri;
-  afi_t afi = bgp_node_table (rn)->afi;
-  safi_t safi = bgp_node_table (rn)->safi;
+  afi_t afi;
+  safi_t safi;
   
   assert (rn && peer);
+  afi = bgp_node_table (rn)->afi;
+  safi = bgp_node_table (rn)->safi;
   
   for (ri = rn->info; ri; ri = ri->next)
     if (ri->peer == peer || cnq->purpose == BGP_CLEAR_ROUTE_MY_RSCLIENT)
@@ -2909,101 +3306,279 @@ bgp_clear_node_queue_init (struct peer *peer)
   peer->clear_node_queue->spec.data = peer;
 }
 
+static void
+bgp_clear_node_queue_add (struct peer *peer, struct bgp_node *rn,
+                          enum bgp_clear_route_type purpose)
+{
+  struct bgp_clear_node_queue *cnq;
+
+  /* both unlocked in bgp_clear_node_queue_del */
+  bgp_table_lock (bgp_node_table (rn));
+  bgp_lock_node (rn);
+  cnq = XCALLOC (MTYPE_BGP_CLEAR_NODE_QUEUE,
+                 sizeof (struct bgp_clear_node_queue));
+  cnq->rn = rn;
+  cnq->purpose = purpose;
+  work_queue_add (peer->clear_node_queue, cnq);
+}
+
+/* Clear what the RS-client table of the peer holds of everybody.  The
+   table is the peer's own, so the whole of it is gone through. */
+static void
+bgp_clear_node (struct peer *peer, afi_t afi, safi_t safi,
+                struct bgp_node *rn, enum bgp_clear_route_type purpose)
+{
+  struct bgp_info *ri;
+  struct bgp_adj_in *ain;
+  struct bgp_adj_out *aout;
+
+  for (ain = rn->adj_in; ain; ain = ain->next)
+    if (ain->peer == peer || purpose == BGP_CLEAR_ROUTE_MY_RSCLIENT)
+      {
+        bgp_adj_in_remove (rn, ain);
+        bgp_unlock_node (rn);
+        break;
+      }
+  for (aout = rn->adj_out; aout; aout = aout->next)
+    if (aout->peer == peer || purpose == BGP_CLEAR_ROUTE_MY_RSCLIENT)
+      {
+        bgp_adj_out_remove (rn, aout, peer, afi, safi);
+        bgp_unlock_node (rn);
+        break;
+      }
+
+  for (ri = rn->info; ri; ri = ri->next)
+    if (ri->peer == peer || purpose == BGP_CLEAR_ROUTE_MY_RSCLIENT)
+      {
+        bgp_clear_node_queue_add (peer, rn, purpose);
+        break;
+      }
+}
+
 static void
 bgp_clear_route_table (struct peer *peer, afi_t afi, safi_t safi,
-                       struct bgp_table *table, struct peer *rsclient,
+                       struct bgp_table *table,
                        enum bgp_clear_route_type purpose)
 {
   struct bgp_node *rn;
   
-  
-  if (! table)
-    table = (rsclient) ? rsclient->rib[afi][safi] : peer->bgp->rib[afi][safi];
-  
-  /* If still no table => afi/safi isn't configured at all or smth. */
+  /* afi/safi isn't configured at all or smth. */
   if (! table)
     return;
   
   for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
+    bgp_clear_node (peer, afi, safi, rn, purpose);
+}
+
+/* Clear the routes of the peer and what was announced to it, going by
+   its own lists rather than through the tables.  The lists take in the
+   VPN and ENCAP tables and the RS-client tables of others alike.
+   Adjacencies go at once, the routes are queued and only go once the
+   nodes are processed. */
+static void
+bgp_clear_route_peer (struct peer *peer, afi_t afi, safi_t safi)
+{
+  struct bgp_adj_in *ain;
+  struct bgp_adj_out *aout;
+  struct bgp_info *ri;
+  struct bgp_node *rn;
+
+  while ((ain = LIST_FIRST (&peer->adj_in[afi][safi])) != NULL)
     {
-      struct bgp_info *ri;
-      struct bgp_adj_in *ain;
-      struct bgp_adj_out *aout;
-
-      /* XXX:TODO: This is suboptimal, every non-empty route_node is
-       * queued for every clearing peer, regardless of whether it is
-       * relevant to the peer at hand.
-       *
-       * Overview: There are 3 different indices which need to be
-       * scrubbed, potentially, when a peer is removed:
-       *
-       * 1 peer's routes visible via the RIB (ie accepted routes)
-       * 2 peer's routes visible by the (optional) peer's adj-in index
-       * 3 other routes visible by the peer's adj-out index
-       *
-       * 3 there is no hurry in scrubbing, once the struct peer is
-       * removed from bgp->peer, we could just GC such deleted peer's
-       * adj-outs at our leisure.
-       *
-       * 1 and 2 must be 'scrubbed' in some way, at least made
-       * invisible via RIB index before peer session is allowed to be
-       * brought back up. So one needs to know when such a 'search' is
-       * complete.
-       *
-       * Ideally:
-       *
-       * - there'd be a single global queue or a single RIB walker
-       * - rather than tracking which route_nodes still need to be
-       *   examined on a peer basis, we'd track which peers still
-       *   aren't cleared
-       *
-       * Given that our per-peer prefix-counts now should be reliable,
-       * this may actually be achievable. It doesn't seem to be a huge
-       * problem at this time,
-       */
-      for (ain = rn->adj_in; ain; ain = ain->next)
-        if (ain->peer == peer || purpose == BGP_CLEAR_ROUTE_MY_RSCLIENT)
-          {
-            bgp_adj_in_remove (rn, ain);
-            bgp_unlock_node (rn);
-            break;
-          }
-      for (aout = rn->adj_out; aout; aout = aout->next)
-        if (aout->peer == peer || purpose == BGP_CLEAR_ROUTE_MY_RSCLIENT)
-          {
-            bgp_adj_out_remove (rn, aout, peer, afi, safi);
-            bgp_unlock_node (rn);
-            break;
-          }
+      rn = ain->rn;
+      bgp_adj_in_remove (rn, ain);
+      bgp_unlock_node (rn);
+    }
+  while ((aout = LIST_FIRST (&peer->adj_out[afi][safi])) != NULL)
+    {
+      rn = aout->rn;
+      bgp_adj_out_remove (rn, aout, peer, afi, safi);
+      bgp_unlock_node (rn);
+    }
 
-      for (ri = rn->info; ri; ri = ri->next)
-        if (ri->peer == peer || purpose == BGP_CLEAR_ROUTE_MY_RSCLIENT)
-          {
-            struct bgp_clear_node_queue *cnq;
-
-            /* both unlocked in bgp_clear_node_queue_del */
-            bgp_table_lock (bgp_node_table (rn));
-            bgp_lock_node (rn);
-            cnq = XCALLOC (MTYPE_BGP_CLEAR_NODE_QUEUE,
-                           sizeof (struct bgp_clear_node_queue));
-            cnq->rn = rn;
-            cnq->purpose = purpose;
-            work_queue_add (peer->clear_node_queue, cnq);
-            break;
-          }
+  LIST_FOREACH (ri, &peer->paths[afi][safi], peer_thread)
+    bgp_clear_node_queue_add (peer, ri->net, BGP_CLEAR_ROUTE_NORMAL);
+}
+
+/* Go through the next slice of the table.  Returns 1 once the walk is
+   done. */
+static int
+bgp_walk_step (struct bgp_walk *walk)
+{
+  struct peer *peer = walk->peer;
+  struct bgp_node *rn;
+  struct attr attr;
+  struct attr_extra extra;
+  int count;
+  int done = 0;
+
+  memset (&extra, 0, sizeof (extra));
+  attr.extra = &extra;
+
+  for (count = 0; count < BGP_WALK_SLICE; count++)
+    {
+      rn = bgp_table_iter_next (&walk->iter);
+      if (! rn)
+        {
+          done = 1;
+          break;
+        }
+
+      switch (walk->type)
+        {
+        case BGP_WALK_ANNOUNCE:
+          bgp_announce_node (peer, walk->afi, walk->safi, rn, &attr, 0);
+          break;
+        case BGP_WALK_SOFT_IN:
+          /* Maximum prefix count overflow, the session is going down. */
+          if (bgp_soft_reconfig_node (peer, walk->afi, walk->safi, rn,
+                                      NULL) < 0)
+            done = 1;
+          break;
+        default:
+          assert (0);
+        }
+      if (done)
+        break;
+    }
+  walk->done += count;
+
+  if (walk->type == BGP_WALK_ANNOUNCE)
+    bgp_attr_flush_encap (&attr);
+
+  if (! done)
+    bgp_table_iter_pause (&walk->iter);
+  return done;
+}
+
+static void
+bgp_walk_free (struct bgp_walk *walk)
+{
+  struct peer *peer = walk->peer;
+
+  bgp_table_iter_cleanup (&walk->iter);
+  peer->walk[walk->afi][walk->safi][walk->type] = NULL;
+  XFREE (MTYPE_BGP_WALK, walk);
+}
+
+/* Walks of the peer, a slice of each in turn until the time for the
+   thread is up. */
+static int
+bgp_walk_run (struct thread *thread)
+{
+  struct peer *peer = THREAD_ARG (thread);
+  struct bgp_walk *walk;
+  afi_t afi;
+  safi_t safi;
+  int type;
+  int pending;
+
+  peer->t_walk = NULL;
+
+  do
+    {
+      pending = 0;
+      for (afi = AFI_IP; afi < AFI_MAX; afi++)
+        for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
+          for (type = 0; type < BGP_WALK_MAX; type++)
+            {
+              if (! (walk = peer->walk[afi][safi][type]))
+                continue;
+              if (! bgp_walk_step (walk))
+                {
+                  pending = 1;
+                  continue;
+                }
+
+              bgp_walk_free (walk);
+
+              /* With the table gone through, End-of-RIB may follow. */
+              if (type == BGP_WALK_ANNOUNCE && peer->status == Established)
+                BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
+            }
+    }
+  while (pending && ! thread_should_yield (thread));
+
+  if (pending)
+    peer->t_walk = thread_add_background (bm->master, bgp_walk_run, peer, 0);
+  return 0;
+}
+
+static void
+bgp_walk_cancel (struct peer *peer, afi_t afi, safi_t safi,
+                 enum bgp_walk_type type)
+{
+  if (peer->walk[afi][safi][type])
+    bgp_walk_free (peer->walk[afi][safi][type]);
+}
+
+/* The session goes down, what is left to announce or take in again
+   does not matter any more. */
+void
+bgp_walk_cancel_all (struct peer *peer)
+{
+  afi_t afi;
+  safi_t safi;
+  int type;
+
+  for (afi = AFI_IP; afi < AFI_MAX; afi++)
+    for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
+      for (type = 0; type < BGP_WALK_MAX; type++)
+        bgp_walk_cancel (peer, afi, safi, type);
+  THREAD_OFF (peer->t_walk);
+}
+
+/* Start a walk of the RIB of AFI/SAFI for the peer.  One already under
+   way starts again from the top, as what it went through so far may
+   have changed meanwhile. */
+static struct bgp_walk *
+bgp_walk_start (struct peer *peer, afi_t afi, safi_t safi,
+                enum bgp_walk_type type)
+{
+  struct bgp_table *table = peer->bgp->rib[afi][safi];
+  struct bgp_walk *walk;
+
+  walk = peer->walk[afi][safi][type];
+  if (walk)
+    bgp_table_iter_cleanup (&walk->iter);
+  else
+    {
+      walk = XCALLOC (MTYPE_BGP_WALK, sizeof (struct bgp_walk));
+      walk->peer = peer;
+      walk->afi = afi;
+      walk->safi = safi;
+      walk->type = type;
+      peer->walk[afi][safi][type] = walk;
+
+      if (! peer->t_walk)
+        peer->t_walk = thread_add_background (bm->master, bgp_walk_run,
+                                              peer, 0);
+    }
+
+  bgp_table_iter_init (&walk->iter, table);
+  walk->done = 0;
+  walk->total = bgp_table_count (table);
+  return walk;
+}
+
+const char *
+bgp_walk_type_str (enum bgp_walk_type type)
+{
+  switch (type)
+    {
+    case BGP_WALK_ANNOUNCE:
+      return "announce";
+    case BGP_WALK_SOFT_IN:
+      return "soft reconfiguration";
+    default:
+      return "unknown";
     }
-  return;
 }
 
 void
 bgp_clear_route (struct peer *peer, afi_t afi, safi_t safi,
                  enum bgp_clear_route_type purpose)
 {
-  struct bgp_node *rn;
-  struct bgp_table *table;
-  struct peer *rsclient;
-  struct listnode *node, *nnode;
-
   if (peer->clear_node_queue == NULL)
     bgp_clear_node_queue_init (peer);
   
@@ -3029,18 +3604,11 @@ bgp_clear_route (struct peer *peer, afi_t afi, safi_t safi,
   switch (purpose)
     {
     case BGP_CLEAR_ROUTE_NORMAL:
-      if ((safi != SAFI_MPLS_VPN) && (safi != SAFI_ENCAP))
-        bgp_clear_route_table (peer, afi, safi, NULL, NULL, purpose);
-      else
-        for (rn = bgp_table_top (peer->bgp->rib[afi][safi]); rn;
-             rn = bgp_route_next (rn))
-          if ((table = rn->info) != NULL)
-            bgp_clear_route_table (peer, afi, safi, table, NULL, purpose);
-
-      for (ALL_LIST_ELEMENTS (peer->bgp->rsclient, node, nnode, rsclient))
-        if (CHECK_FLAG(rsclient->af_flags[afi][safi],
-                       PEER_FLAG_RSERVER_CLIENT))
-          bgp_clear_route_table (peer, afi, safi, NULL, rsclient, purpose);
+      /* Nothing is to be announced or taken in again before the routes
+         are cleared. */
+      bgp_walk_cancel (peer, afi, safi, BGP_WALK_ANNOUNCE);
+      bgp_walk_cancel (peer, afi, safi, BGP_WALK_SOFT_IN);
+      bgp_clear_route_peer (peer, afi, safi);
       break;
 
     case BGP_CLEAR_ROUTE_MY_RSCLIENT:
@@ -3049,7 +3617,7 @@ bgp_clear_route (struct peer *peer, afi_t afi, safi_t safi,
        * SAFI_MPLS_VPN here in the original quagga code?
        * (and, by extension, for SAFI_ENCAP)
        */
-      bgp_clear_route_table (peer, afi, safi, NULL, peer, purpose);
+      bgp_clear_route_table (peer, afi, safi, peer->rib[afi][safi], purpose);
       break;
 
     default:
@@ -3128,41 +3696,26 @@ bgp_process_queues_drain_immediate(void)
 void
 bgp_clear_adj_in (struct peer *peer, afi_t afi, safi_t safi)
 {
-  struct bgp_table *table;
   struct bgp_node *rn;
   struct bgp_adj_in *ain;
 
-  table = peer->bgp->rib[afi][safi];
-
-  for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
-    for (ain = rn->adj_in; ain ; ain = ain->next)
-      if (ain->peer == peer)
-	{
-          bgp_adj_in_remove (rn, ain);
-          bgp_unlock_node (rn);
-          break;
-	}
+  while ((ain = LIST_FIRST (&peer->adj_in[afi][safi])) != NULL)
+    {
+      rn = ain->rn;
+      bgp_adj_in_remove (rn, ain);
+      bgp_unlock_node (rn);
+    }
 }
 
 void
 bgp_clear_stale_route (struct peer *peer, afi_t afi, safi_t safi)
 {
-  struct bgp_node *rn;
   struct bgp_info *ri;
-  struct bgp_table *table;
-
-  table = peer->bgp->rib[afi][safi];
+  struct bgp_info *next;
 
-  for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
-    {
-      for (ri = rn->info; ri; ri = ri->next)
-	if (ri->peer == peer)
-	  {
-	    if (CHECK_FLAG (ri->flags, BGP_INFO_STALE))
-	      bgp_rib_remove (rn, ri, peer, afi, safi);
-	    break;
-	  }
-    }
+  LIST_FOREACH_SAFE (ri, &peer->paths[afi][safi], peer_thread, next)
+    if (CHECK_FLAG (ri->flags, BGP_INFO_STALE))
+      bgp_rib_remove (ri->net, ri, peer, afi, safi);
 }
 
 static void
@@ -3238,8 +3791,31 @@ bgp_reset (void)
   prefix_list_reset ();
 }
 
+/* The prefixes of the NLRI field being applied.  Each takes a byte of
+   the message at least. */
+static struct prefix bgp_nlri_prefixes[BGP_MAX_PACKET_SIZE];
+
+/* Table order: by address, covering prefixes first. */
+static int
+bgp_nlri_prefix_cmp (const void *arg1, const void *arg2)
+{
+  const struct prefix *p1 = arg1;
+  const struct prefix *p2 = arg2;
+  int ret;
+
+  ret = memcmp (&p1->u.prefix, &p2->u.prefix, prefix_blen (p1));
+  if (ret)
+    return ret;
+  return p1->prefixlen - p2->prefixlen;
+}
+
 /* Parse NLRI stream.  Withdraw NLRI is recognized by NULL attr
-   value. */
+   value.
+
+   The whole field is checked and decoded first, then applied in table
+   order.  Each prefix goes down the table from the node of the one
+   before instead of from the top, and when the way in does not depend
+   on the prefix, the attribute interned for the first serves them all. */
 int
 bgp_nlri_parse_ip (struct peer *peer, struct attr *attr,
                    struct bgp_nlri *packet)
@@ -3247,8 +3823,14 @@ bgp_nlri_parse_ip (struct peer *peer, struct attr *attr,
   u_char *pnt;
   u_char *lim;
   struct prefix p;
+  struct bgp_nlri_batch batch;
+  struct bgp_table *table;
+  struct bgp_node *rn;
+  struct bgp_node *hint;
+  int count;
   int psize;
   int ret;
+  int i;
 
   /* Check peer status. */
   if (peer->status != Established)
@@ -3256,6 +3838,7 @@ bgp_nlri_parse_ip (struct peer *peer, struct attr *attr,
   
   pnt = packet->nlri;
   lim = pnt + packet->length;
+  count = 0;
 
   /* RFC4771 6.3 The NLRI field in the UPDATE message is checked for
      syntactic validity.  If the field is syntactically incorrect,
@@ -3350,18 +3933,7 @@ bgp_nlri_parse_ip (struct peer *peer, struct attr *attr,
 	    }
         }
 
-      /* Normal process. */
-      if (attr)
-	ret = bgp_update (peer, &p, attr, packet->afi, packet->safi, 
-			  ZEBRA_ROUTE_BGP, BGP_ROUTE_NORMAL, NULL, NULL, 0);
-      else
-	ret = bgp_withdraw (peer, &p, attr, packet->afi, packet->safi, 
-			    ZEBRA_ROUTE_BGP, BGP_ROUTE_NORMAL, NULL, NULL);
-
-      /* Address family configuration mismatch or maximum-prefix count
-         overflow. */
-      if (ret < 0)
-	return -1;
+      bgp_nlri_prefixes[count++] = p;
     }
 
   /* Packet length consistency check. */
@@ -3373,8 +3945,46 @@ bgp_nlri_parse_ip (struct peer *peer, struct attr *attr,
                 peer->host);
       return -1;
     }
-  
-  return 0;
+
+  qsort (bgp_nlri_prefixes, count, sizeof (struct prefix),
+         bgp_nlri_prefix_cmp);
+
+  table = peer->bgp->rib[packet->afi][packet->safi];
+  memset (&batch, 0, sizeof (struct bgp_nlri_batch));
+  hint = NULL;
+  ret = 0;
+
+  for (i = 0; i < count; i++)
+    {
+      /* The node is kept locked as the hint for the next. */
+      rn = bgp_node_get_hint (table, &bgp_nlri_prefixes[i], hint);
+      bgp_lock_node (rn);
+      if (hint)
+        bgp_unlock_node (hint);
+      hint = rn;
+
+      /* Normal process. */
+      if (attr)
+	ret = bgp_update_node (peer, &bgp_nlri_prefixes[i], attr,
+			       packet->afi, packet->safi, ZEBRA_ROUTE_BGP,
+			       BGP_ROUTE_NORMAL, NULL, NULL, 0, rn, &batch);
+      else
+	ret = bgp_withdraw_node (peer, &bgp_nlri_prefixes[i], attr,
+				 packet->afi, packet->safi, ZEBRA_ROUTE_BGP,
+				 BGP_ROUTE_NORMAL, NULL, NULL, rn);
+
+      /* Address family configuration mismatch or maximum-prefix count
+         overflow. */
+      if (ret < 0)
+	break;
+    }
+
+  if (hint)
+    bgp_unlock_node (hint);
+  if (batch.attr)
+    bgp_attr_unintern (&batch.attr);
+
+  return ret < 0 ? -1 : 0;
 }
 
 static struct bgp_static *
@@ -4763,217 +5373,470 @@ ALIAS_DEPRECATED (no_ipv6_bgp_network,
        "AS-Path hopcount limit attribute\n"
        "AS-Pathlimit TTL, in number of AS-Path hops\n")
 
-/* Aggreagete address:
+/* Aggreagete address:
+
+  advertise-map  Set condition to advertise attribute
+  as-set         Generate AS set path information
+  attribute-map  Set attributes of aggregate
+  route-map      Set parameters of aggregate
+  summary-only   Filter more specific routes from updates
+  suppress-map   Conditionally filter more specific routes from updates
+  <cr>
+ */
+struct bgp_aggregate
+{
+  /* Summary-only flag. */
+  u_char summary_only;
+
+  /* AS set generation. */
+  u_char as_set;
+
+  /* Route-map for aggregated route. */
+  struct route_map *map;
+
+  /* Number of routes aggregated. */
+  unsigned long count;
+
+  /* SAFI configuration. */
+  safi_t safi;
+
+  /* The routes aggregated, struct bgp_aggregate_path by bgp_info.  The
+     attributes of the aggregate are kept up to date from what they
+     bring as they come and go, without looking at the rest. */
+  struct hash *paths;
+
+  /* How many of them have each ORIGIN, and ATOMIC_AGGREGATE. */
+  unsigned long origin_count[BGP_ORIGIN_INCOMPLETE + 1];
+  unsigned long atomic_count;
+
+  /* For as-set, the AS paths and communities among them, and these
+     merged.  Merging can not be undone, so when one goes the merge is
+     made again from those left, once the aggregate is next put in the
+     table. */
+  struct hash *aspaths;
+  struct hash *communities;
+  struct aspath *aspath;
+  struct community *community;
+  u_char aspath_stale;
+  u_char community_stale;
+};
+
+/* An interned AS path or community, and how many routes of an
+   aggregate have it. */
+struct bgp_aggregate_ref
+{
+  void *value;
+  unsigned long count;
+};
+
+/* A route counted in an aggregate, and what it brought to it. */
+struct bgp_aggregate_path
+{
+  struct bgp_info *ri;
+  u_char origin;
+  u_char atomic;
+  struct bgp_aggregate_ref *aspath;
+  struct bgp_aggregate_ref *community;
+};
+
+static unsigned int
+bgp_aggregate_path_key (void *p)
+{
+  struct bgp_aggregate_path *path = p;
+  u_int64_t ri = (uintptr_t) path->ri;
+
+  return jhash_2words (ri, ri >> 32, 0);
+}
+
+static int
+bgp_aggregate_path_cmp (const void *p1, const void *p2)
+{
+  const struct bgp_aggregate_path *path1 = p1;
+  const struct bgp_aggregate_path *path2 = p2;
+
+  return path1->ri == path2->ri;
+}
+
+static unsigned int
+bgp_aggregate_aspath_key (void *p)
+{
+  struct bgp_aggregate_ref *ref = p;
+
+  return aspath_key_make (ref->value);
+}
+
+static unsigned int
+bgp_aggregate_community_key (void *p)
+{
+  struct bgp_aggregate_ref *ref = p;
+
+  return community_hash_make (ref->value);
+}
+
+static int
+bgp_aggregate_ref_cmp (const void *p1, const void *p2)
+{
+  const struct bgp_aggregate_ref *ref1 = p1;
+  const struct bgp_aggregate_ref *ref2 = p2;
+
+  return ref1->value == ref2->value;
+}
+
+static void *
+bgp_aggregate_ref_alloc (void *p)
+{
+  struct bgp_aggregate_ref *ref;
+
+  ref = XCALLOC (MTYPE_BGP_AGGREGATE_REF, sizeof (struct bgp_aggregate_ref));
+  ref->value = ((struct bgp_aggregate_ref *) p)->value;
+  return ref;
+}
+
+static struct bgp_aggregate *
+bgp_aggregate_new (void)
+{
+  struct bgp_aggregate *aggregate;
+
+  aggregate = XCALLOC (MTYPE_BGP_AGGREGATE, sizeof (struct bgp_aggregate));
+  aggregate->paths = hash_create (bgp_aggregate_path_key,
+                                  bgp_aggregate_path_cmp);
+  aggregate->aspaths = hash_create (bgp_aggregate_aspath_key,
+                                    bgp_aggregate_ref_cmp);
+  aggregate->communities = hash_create (bgp_aggregate_community_key,
+                                        bgp_aggregate_ref_cmp);
+  return aggregate;
+}
+
+static void
+bgp_aggregate_free (struct bgp_aggregate *aggregate)
+{
+  hash_free (aggregate->paths);
+  hash_free (aggregate->aspaths);
+  hash_free (aggregate->communities);
+  XFREE (MTYPE_BGP_AGGREGATE, aggregate);
+}
+
+static struct bgp_aggregate_ref *
+bgp_aggregate_aspath_add (struct bgp_aggregate *aggregate,
+                          struct aspath *aspath)
+{
+  struct bgp_aggregate_ref tmp;
+  struct bgp_aggregate_ref *ref;
+  struct aspath *asmerge;
+
+  tmp.value = aspath;
+  ref = hash_get (aggregate->aspaths, &tmp, bgp_aggregate_ref_alloc);
+  if (ref->count++)
+    return ref;
+
+  aspath->refcnt++;
+  if (aggregate->aspath)
+    {
+      asmerge = aspath_aggregate (aggregate->aspath, aspath);
+      aspath_free (aggregate->aspath);
+      aggregate->aspath = asmerge;
+    }
+  else if (! aggregate->aspath_stale)
+    aggregate->aspath = aspath_dup (aspath);
+  return ref;
+}
+
+static void
+bgp_aggregate_aspath_del (struct bgp_aggregate *aggregate,
+                          struct bgp_aggregate_ref *ref)
+{
+  struct aspath *aspath = ref->value;
+
+  if (--ref->count)
+    return;
+
+  hash_release (aggregate->aspaths, ref);
+  aspath_unintern (&aspath);
+  XFREE (MTYPE_BGP_AGGREGATE_REF, ref);
 
-  advertise-map  Set condition to advertise attribute
-  as-set         Generate AS set path information
-  attribute-map  Set attributes of aggregate
-  route-map      Set parameters of aggregate
-  summary-only   Filter more specific routes from updates
-  suppress-map   Conditionally filter more specific routes from updates
-  <cr>
- */
-struct bgp_aggregate
+  if (aggregate->aspath)
+    {
+      aspath_free (aggregate->aspath);
+      aggregate->aspath = NULL;
+    }
+  aggregate->aspath_stale = (aggregate->aspaths->count > 0);
+}
+
+static struct bgp_aggregate_ref *
+bgp_aggregate_community_add (struct bgp_aggregate *aggregate,
+                             struct community *community)
 {
-  /* Summary-only flag. */
-  u_char summary_only;
+  struct bgp_aggregate_ref tmp;
+  struct bgp_aggregate_ref *ref;
+  struct community *commerge;
 
-  /* AS set generation. */
-  u_char as_set;
+  tmp.value = community;
+  ref = hash_get (aggregate->communities, &tmp, bgp_aggregate_ref_alloc);
+  if (ref->count++)
+    return ref;
 
-  /* Route-map for aggregated route. */
-  struct route_map *map;
+  community->refcnt++;
+  if (aggregate->community)
+    {
+      commerge = community_merge (aggregate->community, community);
+      aggregate->community = community_uniq_sort (commerge);
+      community_free (commerge);
+    }
+  else if (! aggregate->community_stale)
+    aggregate->community = community_dup (community);
+  return ref;
+}
 
-  /* Suppress-count. */
-  unsigned long count;
+static void
+bgp_aggregate_community_del (struct bgp_aggregate *aggregate,
+                             struct bgp_aggregate_ref *ref)
+{
+  struct community *community = ref->value;
 
-  /* SAFI configuration. */
-  safi_t safi;
-};
+  if (--ref->count)
+    return;
 
-static struct bgp_aggregate *
-bgp_aggregate_new (void)
+  hash_release (aggregate->communities, ref);
+  community_unintern (&community);
+  XFREE (MTYPE_BGP_AGGREGATE_REF, ref);
+
+  if (aggregate->community)
+    {
+      community_free (aggregate->community);
+      aggregate->community = NULL;
+    }
+  aggregate->community_stale = (aggregate->communities->count > 0);
+}
+
+static void
+bgp_aggregate_aspath_collect (struct hash_backet *backet, void *arg)
 {
-  return XCALLOC (MTYPE_BGP_AGGREGATE, sizeof (struct bgp_aggregate));
+  struct bgp_aggregate_ref ***refs = arg;
+
+  *(*refs)++ = backet->data;
+}
+
+static int
+bgp_aggregate_aspath_order (const void *p1, const void *p2)
+{
+  const struct bgp_aggregate_ref *ref1 = *(struct bgp_aggregate_ref * const *) p1;
+  const struct bgp_aggregate_ref *ref2 = *(struct bgp_aggregate_ref * const *) p2;
+
+  return strcmp (aspath_print (ref1->value), aspath_print (ref2->value));
 }
 
+/* Merge the AS paths left again.  They are taken in the order of
+   their text and not the hash's, so that the same paths always give
+   the same AS_SET and nothing is announced again for it. */
 static void
-bgp_aggregate_free (struct bgp_aggregate *aggregate)
+bgp_aggregate_aspath_rebuild (struct bgp_aggregate *aggregate)
 {
-  XFREE (MTYPE_BGP_AGGREGATE, aggregate);
-}     
+  struct bgp_aggregate_ref **refs;
+  struct bgp_aggregate_ref **end;
+  struct aspath *asmerge;
+  unsigned long i, count;
+
+  refs = XMALLOC (MTYPE_TMP, aggregate->aspaths->count * sizeof (*refs));
+  end = refs;
+  hash_iterate (aggregate->aspaths, bgp_aggregate_aspath_collect, &end);
+  count = end - refs;
+  qsort (refs, count, sizeof (*refs), bgp_aggregate_aspath_order);
+
+  for (i = 0; i < count; i++)
+    if (aggregate->aspath)
+      {
+        asmerge = aspath_aggregate (aggregate->aspath, refs[i]->value);
+        aspath_free (aggregate->aspath);
+        aggregate->aspath = asmerge;
+      }
+    else
+      aggregate->aspath = aspath_dup (refs[i]->value);
+
+  XFREE (MTYPE_TMP, refs);
+}
 
-/* Update an aggregate as routes are added/removed from the BGP table */
 static void
-bgp_aggregate_route (struct bgp *bgp, struct prefix *p, struct bgp_info *rinew,
-		     afi_t afi, safi_t safi, struct bgp_info *del, 
-		     struct bgp_aggregate *aggregate)
+bgp_aggregate_community_merge (struct hash_backet *backet, void *arg)
 {
-  struct bgp_table *table;
-  struct bgp_node *top;
-  struct bgp_node *rn;
-  u_char origin;
-  struct aspath *aspath = NULL;
-  struct aspath *asmerge = NULL;
-  struct community *community = NULL;
-  struct community *commerge = NULL;
-  struct bgp_info *ri;
-  struct bgp_info *new;
-  int first = 1;
-  unsigned long match = 0;
-  u_char atomic_aggregate = 0;
+  struct bgp_aggregate *aggregate = arg;
+  struct bgp_aggregate_ref *ref = backet->data;
+  struct community *commerge;
 
-  /* ORIGIN attribute: If at least one route among routes that are
-     aggregated has ORIGIN with the value INCOMPLETE, then the
-     aggregated route must have the ORIGIN attribute with the value
-     INCOMPLETE. Otherwise, if at least one route among routes that
-     are aggregated has ORIGIN with the value EGP, then the aggregated
-     route must have the origin attribute with the value EGP. In all
-     other case the value of the ORIGIN attribute of the aggregated
-     route is INTERNAL. */
-  origin = BGP_ORIGIN_IGP;
+  if (aggregate->community)
+    {
+      commerge = community_merge (aggregate->community, ref->value);
+      aggregate->community = community_uniq_sort (commerge);
+      community_free (commerge);
+    }
+  else
+    aggregate->community = community_dup (ref->value);
+}
 
-  table = bgp->rib[afi][safi];
+/* Count route RI in the aggregate. */
+static void
+bgp_aggregate_path_add (struct bgp_aggregate *aggregate, struct bgp_info *ri)
+{
+  struct bgp_aggregate_path *path;
 
-  top = bgp_node_get (table, p);
-  for (rn = bgp_node_get (table, p); rn; rn = bgp_route_next_until (rn, top))
-    if (rn->p.prefixlen > p->prefixlen)
-      {
-	match = 0;
+  path = XCALLOC (MTYPE_BGP_AGGREGATE_PATH, sizeof (struct bgp_aggregate_path));
+  path->ri = bgp_info_lock (ri);
+  path->origin = MIN (ri->attr->origin, BGP_ORIGIN_INCOMPLETE);
+  path->atomic = CHECK_FLAG (ri->attr->flag,
+                             ATTR_FLAG_BIT (BGP_ATTR_ATOMIC_AGGREGATE)) ? 1 : 0;
 
-	for (ri = rn->info; ri; ri = ri->next)
-	  {
-	    if (BGP_INFO_HOLDDOWN (ri))
-	      continue;
+  aggregate->count++;
+  aggregate->origin_count[path->origin]++;
+  aggregate->atomic_count += path->atomic;
 
-	    if (del && ri == del)
-	      continue;
+  if (aggregate->as_set)
+    {
+      path->aspath = bgp_aggregate_aspath_add (aggregate, ri->attr->aspath);
+      if (ri->attr->community)
+        path->community = bgp_aggregate_community_add (aggregate,
+                                                       ri->attr->community);
+    }
 
-	    if (! rinew && first)
-              first = 0;
+  /* summary-only aggregate route suppress aggregated route
+     announcement.  */
+  if (aggregate->summary_only)
+    (bgp_info_extra_get (ri))->suppress++;
 
-#ifdef AGGREGATE_NEXTHOP_CHECK
-	    if (! IPV4_ADDR_SAME (&ri->attr->nexthop, &nexthop)
-		|| ri->attr->med != med)
-	      {
-		if (aspath)
-		  aspath_free (aspath);
-		if (community)
-		  community_free (community);
-		bgp_unlock_node (rn);
-		bgp_unlock_node (top);
-		return;
-	      }
-#endif /* AGGREGATE_NEXTHOP_CHECK */
+  hash_get (aggregate->paths, path, hash_alloc_intern);
+}
 
-            if (ri->attr->flag & ATTR_FLAG_BIT(BGP_ATTR_ATOMIC_AGGREGATE))
-              atomic_aggregate = 1;
+/* Take back what PATH brought to the aggregate.  It is released from
+   the hash by the caller. */
+static void
+bgp_aggregate_path_free (struct bgp_aggregate *aggregate,
+                         struct bgp_aggregate_path *path)
+{
+  aggregate->count--;
+  aggregate->origin_count[path->origin]--;
+  aggregate->atomic_count -= path->atomic;
 
-	    if (ri->sub_type != BGP_ROUTE_AGGREGATE)
-	      {
-		if (aggregate->summary_only)
-		  {
-		    (bgp_info_extra_get (ri))->suppress++;
-		    bgp_info_set_flag (rn, ri, BGP_INFO_ATTR_CHANGED);
-		    match++;
-		  }
+  if (path->aspath)
+    bgp_aggregate_aspath_del (aggregate, path->aspath);
+  if (path->community)
+    bgp_aggregate_community_del (aggregate, path->community);
 
-		aggregate->count++;
+  if (aggregate->summary_only && path->ri->extra)
+    path->ri->extra->suppress--;
 
-		if (origin < ri->attr->origin)
-		  origin = ri->attr->origin;
+  bgp_info_unlock (path->ri);
+  XFREE (MTYPE_BGP_AGGREGATE_PATH, path);
+}
 
-		if (aggregate->as_set)
-		  {
-		    if (aspath)
-		      {
-			asmerge = aspath_aggregate (aspath, ri->attr->aspath);
-			aspath_free (aspath);
-			aspath = asmerge;
-		      }
-		    else
-		      aspath = aspath_dup (ri->attr->aspath);
-
-		    if (ri->attr->community)
-		      {
-			if (community)
-			  {
-			    commerge = community_merge (community,
-							ri->attr->community);
-			    community = community_uniq_sort (commerge);
-			    community_free (commerge);
-			  }
-			else
-			  community = community_dup (ri->attr->community);
-		      }
-		  }
-	      }
-	  }
-	if (match)
-	  bgp_process (bgp, rn, afi, safi);
-      }
-  bgp_unlock_node (top);
+static void
+bgp_aggregate_path_del (struct bgp_aggregate *aggregate, struct bgp_info *ri)
+{
+  struct bgp_aggregate_path tmp;
+  struct bgp_aggregate_path *path;
 
-  if (rinew)
-    {
-      aggregate->count++;
-      
-      if (aggregate->summary_only)
-        (bgp_info_extra_get (rinew))->suppress++;
+  tmp.ri = ri;
+  path = hash_release (aggregate->paths, &tmp);
+  if (path)
+    bgp_aggregate_path_free (aggregate, path);
+}
 
-      if (origin < rinew->attr->origin)
-        origin = rinew->attr->origin;
+/* Put the aggregate route in the table as it now is, or take it out
+   if nothing is aggregated any more. */
+static void
+bgp_aggregate_install (struct bgp *bgp, struct prefix *p, afi_t afi,
+                       safi_t safi, struct bgp_aggregate *aggregate)
+{
+  struct bgp_node *rn;
+  struct bgp_info *ri;
+  struct attr *attr;
+  struct aspath *aspath = NULL;
+  struct community *community = NULL;
+  u_char origin;
 
-      if (aggregate->as_set)
-	{
-	  if (aspath)
-	    {
-	      asmerge = aspath_aggregate (aspath, rinew->attr->aspath);
-	      aspath_free (aspath);
-	      aspath = asmerge;
-	    }
-	  else
-	    aspath = aspath_dup (rinew->attr->aspath);
+  rn = bgp_node_get (bgp->rib[afi][safi], p);
 
-	  if (rinew->attr->community)
-	    {
-	      if (community)
-		{
-		  commerge = community_merge (community,
-					      rinew->attr->community);
-		  community = community_uniq_sort (commerge);
-		  community_free (commerge);
-		}
-	      else
-		community = community_dup (rinew->attr->community);
-	    }
-	}
+  for (ri = rn->info; ri; ri = ri->next)
+    if (ri->peer == bgp->peer_self
+	&& ri->type == ZEBRA_ROUTE_BGP
+	&& ri->sub_type == BGP_ROUTE_AGGREGATE)
+      break;
+
+  if (! aggregate->count)
+    {
+      if (ri && ! CHECK_FLAG (ri->flags, BGP_INFO_REMOVED))
+        {
+          bgp_info_delete (rn, ri);
+          bgp_process (bgp, rn, afi, safi);
+        }
+      bgp_unlock_node (rn);
+      return;
+    }
+
+  /* ORIGIN attribute: If at least one route among routes that are
+     aggregated has ORIGIN with the value INCOMPLETE, then the
+     aggregated route must have the ORIGIN attribute with the value
+     INCOMPLETE. Otherwise, if at least one route among routes that
+     are aggregated has ORIGIN with the value EGP, then the aggregated
+     route must have the origin attribute with the value EGP. In all
+     other case the value of the ORIGIN attribute of the aggregated
+     route is INTERNAL. */
+  for (origin = BGP_ORIGIN_INCOMPLETE; origin > BGP_ORIGIN_IGP; origin--)
+    if (aggregate->origin_count[origin])
+      break;
+
+  /* as-set aggregate route generate origin, as path, community
+     aggregation.  */
+  if (aggregate->as_set)
+    {
+      if (aggregate->aspath_stale)
+        {
+          bgp_aggregate_aspath_rebuild (aggregate);
+          aggregate->aspath_stale = 0;
+        }
+      /* The communities merged are sorted, whatever the order they
+         come in here. */
+      if (aggregate->community_stale)
+        {
+          hash_iterate (aggregate->communities, bgp_aggregate_community_merge,
+                        aggregate);
+          aggregate->community_stale = 0;
+        }
+      if (aggregate->aspath)
+        aspath = aspath_dup (aggregate->aspath);
+      if (aggregate->community)
+        community = community_dup (aggregate->community);
     }
 
-  if (aggregate->count > 0)
+  attr = bgp_attr_aggregate_intern (bgp, origin, aspath, community,
+                                    aggregate->as_set,
+                                    aggregate->atomic_count > 0);
+
+  if (ri)
     {
-      rn = bgp_node_get (table, p);
-      new = info_make(ZEBRA_ROUTE_BGP, BGP_ROUTE_AGGREGATE, bgp->peer_self,
-		      bgp_attr_aggregate_intern(bgp, origin, aspath, community,
-						aggregate->as_set,
-                                                atomic_aggregate), rn);
-      SET_FLAG (new->flags, BGP_INFO_VALID);
+      if (attrhash_cmp (ri->attr, attr)
+          && ! CHECK_FLAG (ri->flags, BGP_INFO_REMOVED))
+        {
+          bgp_attr_unintern (&attr);
+          bgp_unlock_node (rn);
+          return;
+        }
 
-      bgp_info_add (rn, new);
-      bgp_unlock_node (rn);
-      bgp_process (bgp, rn, afi, safi);
+      bgp_info_set_flag (rn, ri, BGP_INFO_ATTR_CHANGED);
+      if (CHECK_FLAG (ri->flags, BGP_INFO_REMOVED))
+        bgp_info_restore (rn, ri);
+      bgp_attr_unintern (&ri->attr);
+      ri->attr = attr;
+      ri->uptime = bgp_clock ();
     }
   else
     {
-      if (aspath)
-	aspath_free (aspath);
-      if (community)
-	community_free (community);
+      ri = info_make (ZEBRA_ROUTE_BGP, BGP_ROUTE_AGGREGATE, bgp->peer_self,
+                      attr, rn);
+      SET_FLAG (ri->flags, BGP_INFO_VALID);
+      bgp_info_add (rn, ri);
     }
-}
 
-void bgp_aggregate_delete (struct bgp *, struct prefix *, afi_t, safi_t,
-			   struct bgp_aggregate *);
+  bgp_process (bgp, rn, afi, safi);
+  bgp_unlock_node (rn);
+}
 
 void
 bgp_aggregate_increment (struct bgp *bgp, struct prefix *p,
@@ -4997,7 +5860,7 @@ bgp_aggregate_increment (struct bgp *bgp, struct prefix *p,
   if (p->prefixlen == 0)
     return;
 
-  if (BGP_INFO_HOLDDOWN (ri))
+  if (BGP_INFO_HOLDDOWN (ri) || ri->sub_type == BGP_ROUTE_AGGREGATE)
     return;
 
   child = bgp_node_get (table, p);
@@ -5006,8 +5869,10 @@ bgp_aggregate_increment (struct bgp *bgp, struct prefix *p,
   for (rn = child; rn; rn = bgp_node_parent_nolock (rn))
     if ((aggregate = rn->info) != NULL && rn->p.prefixlen < p->prefixlen)
       {
-	bgp_aggregate_delete (bgp, &rn->p, afi, safi, aggregate);
-	bgp_aggregate_route (bgp, &rn->p, ri, afi, safi, NULL, aggregate);
+        /* Counted already, should the route have changed unseen. */
+	bgp_aggregate_path_del (aggregate, ri);
+	bgp_aggregate_path_add (aggregate, ri);
+	bgp_aggregate_install (bgp, &rn->p, afi, safi, aggregate);
       }
   bgp_unlock_node (child);
 }
@@ -5020,6 +5885,8 @@ bgp_aggregate_decrement (struct bgp *bgp, struct prefix *p,
   struct bgp_node *rn;
   struct bgp_aggregate *aggregate;
   struct bgp_table *table;
+  struct bgp_aggregate_path tmp;
+  struct bgp_aggregate_path *path;
 
   /* MPLS-VPN aggregation is not yet supported. */
   if ((safi == SAFI_MPLS_VPN) || (safi == SAFI_ENCAP))
@@ -5037,11 +5904,13 @@ bgp_aggregate_decrement (struct bgp *bgp, struct prefix *p,
   child = bgp_node_get (table, p);
 
   /* Aggregate address configuration check. */
+  tmp.ri = del;
   for (rn = child; rn; rn = bgp_node_parent_nolock (rn))
-    if ((aggregate = rn->info) != NULL && rn->p.prefixlen < p->prefixlen)
+    if ((aggregate = rn->info) != NULL && rn->p.prefixlen < p->prefixlen
+        && (path = hash_release (aggregate->paths, &tmp)) != NULL)
       {
-	bgp_aggregate_delete (bgp, &rn->p, afi, safi, aggregate);
-	bgp_aggregate_route (bgp, &rn->p, NULL, afi, safi, del, aggregate);
+	bgp_aggregate_path_free (aggregate, path);
+	bgp_aggregate_install (bgp, &rn->p, afi, safi, aggregate);
       }
   bgp_unlock_node (child);
 }
@@ -5054,15 +5923,8 @@ bgp_aggregate_add (struct bgp *bgp, struct prefix *p, afi_t afi, safi_t safi,
   struct bgp_table *table;
   struct bgp_node *top;
   struct bgp_node *rn;
-  struct bgp_info *new;
   struct bgp_info *ri;
   unsigned long match;
-  u_char origin = BGP_ORIGIN_IGP;
-  struct aspath *aspath = NULL;
-  struct aspath *asmerge = NULL;
-  struct community *community = NULL;
-  struct community *commerge = NULL;
-  u_char atomic_aggregate = 0;
 
   table = bgp->rib[afi][safi];
 
@@ -5084,57 +5946,15 @@ bgp_aggregate_add (struct bgp *bgp, struct prefix *p, afi_t afi, safi_t safi,
 	    if (BGP_INFO_HOLDDOWN (ri))
 	      continue;
 
-            if (ri->attr->flag & ATTR_FLAG_BIT(BGP_ATTR_ATOMIC_AGGREGATE))
-              atomic_aggregate = 1;
-
 	    if (ri->sub_type != BGP_ROUTE_AGGREGATE)
 	      {
-		/* summary-only aggregate route suppress aggregated
-		   route announcement.  */
+		bgp_aggregate_path_add (aggregate, ri);
+
 		if (aggregate->summary_only)
 		  {
-		    (bgp_info_extra_get (ri))->suppress++;
 		    bgp_info_set_flag (rn, ri, BGP_INFO_ATTR_CHANGED);
 		    match++;
 		  }
-
-                /* If at least one route among routes that are aggregated has
-                 * ORIGIN with the value INCOMPLETE, then the aggregated route
-                 * MUST have the ORIGIN attribute with the value INCOMPLETE.
-                 * Otherwise, if at least one route among routes that are
-                 * aggregated has ORIGIN with the value EGP, then the aggregated
-                 * route MUST have the ORIGIN attribute with the value EGP.
-                 */
-                if (origin < ri->attr->origin)
-                    origin = ri->attr->origin;
-
-		/* as-set aggregate route generate origin, as path,
-		   community aggregation.  */
-		if (aggregate->as_set)
-		  {
-		    if (aspath)
-		      {
-			asmerge = aspath_aggregate (aspath, ri->attr->aspath);
-			aspath_free (aspath);
-			aspath = asmerge;
-		      }
-		    else
-		      aspath = aspath_dup (ri->attr->aspath);
-
-		    if (ri->attr->community)
-		      {
-			if (community)
-			  {
-			    commerge = community_merge (community,
-							ri->attr->community);
-			    community = community_uniq_sort (commerge);
-			    community_free (commerge);
-			  }
-			else
-			  community = community_dup (ri->attr->community);
-		      }
-		  }
-		aggregate->count++;
 	      }
 	  }
 	
@@ -5145,99 +5965,44 @@ bgp_aggregate_add (struct bgp *bgp, struct prefix *p, afi_t afi, safi_t safi,
   bgp_unlock_node (top);
 
   /* Add aggregate route to BGP table. */
-  if (aggregate->count)
-    {
-      rn = bgp_node_get (table, p);
-      new = info_make(ZEBRA_ROUTE_BGP, BGP_ROUTE_AGGREGATE, bgp->peer_self,
-		      bgp_attr_aggregate_intern(bgp, origin, aspath, community,
-						aggregate->as_set,
-                                                atomic_aggregate), rn);
-      SET_FLAG (new->flags, BGP_INFO_VALID);
+  bgp_aggregate_install (bgp, p, afi, safi, aggregate);
+}
 
-      bgp_info_add (rn, new);
-      bgp_unlock_node (rn);
-      
-      /* Process change. */
-      bgp_process (bgp, rn, afi, safi);
-    }
-  else
+/* Stop counting a route in the aggregate, which is being deleted.  A
+   route no longer suppressed is announced again. */
+static void
+bgp_aggregate_path_clear (struct hash_backet *backet, void *arg)
+{
+  struct bgp_aggregate *aggregate = arg;
+  struct bgp_aggregate_path *path = backet->data;
+  struct bgp_info *ri = path->ri;
+  struct bgp_node *rn = ri->net;
+
+  if (aggregate->summary_only && ri->extra && ri->extra->suppress == 1
+      && ! CHECK_FLAG (ri->flags, BGP_INFO_REMOVED))
     {
-      if (aspath)
-	aspath_free (aspath);
-      if (community)
-	community_free (community);
+      bgp_info_set_flag (rn, ri, BGP_INFO_ATTR_CHANGED);
+      bgp_process (ri->peer->bgp, rn, bgp_node_table (rn)->afi,
+                   bgp_node_table (rn)->safi);
     }
+
+  hash_release (aggregate->paths, path);
+  bgp_aggregate_path_free (aggregate, path);
 }
 
-void
+static void
 bgp_aggregate_delete (struct bgp *bgp, struct prefix *p, afi_t afi, 
 		      safi_t safi, struct bgp_aggregate *aggregate)
 {
-  struct bgp_table *table;
-  struct bgp_node *top;
-  struct bgp_node *rn;
-  struct bgp_info *ri;
-  unsigned long match;
-
-  table = bgp->rib[afi][safi];
-
   if (afi == AFI_IP && p->prefixlen == IPV4_MAX_BITLEN)
     return;
   if (afi == AFI_IP6 && p->prefixlen == IPV6_MAX_BITLEN)
     return;
 
-  /* If routes exists below this node, generate aggregate routes. */
-  top = bgp_node_get (table, p);
-  for (rn = bgp_node_get (table, p); rn; rn = bgp_route_next_until (rn, top))
-    if (rn->p.prefixlen > p->prefixlen)
-      {
-	match = 0;
-
-	for (ri = rn->info; ri; ri = ri->next)
-	  {
-	    if (BGP_INFO_HOLDDOWN (ri))
-	      continue;
-
-	    if (ri->sub_type != BGP_ROUTE_AGGREGATE)
-	      {
-		if (aggregate->summary_only && ri->extra)
-		  {
-		    ri->extra->suppress--;
-
-		    if (ri->extra->suppress == 0)
-		      {
-			bgp_info_set_flag (rn, ri, BGP_INFO_ATTR_CHANGED);
-			match++;
-		      }
-		  }
-		aggregate->count--;
-	      }
-	  }
-
-	/* If this node was suppressed, process the change. */
-	if (match)
-	  bgp_process (bgp, rn, afi, safi);
-      }
-  bgp_unlock_node (top);
-
-  /* Delete aggregate route from BGP table. */
-  rn = bgp_node_get (table, p);
-
-  for (ri = rn->info; ri; ri = ri->next)
-    if (ri->peer == bgp->peer_self 
-	&& ri->type == ZEBRA_ROUTE_BGP
-	&& ri->sub_type == BGP_ROUTE_AGGREGATE)
-      break;
-
-  /* Withdraw static BGP route from routing table. */
-  if (ri)
-    {
-      bgp_info_delete (rn, ri);
-      bgp_process (bgp, rn, afi, safi);
-    }
+  hash_iterate (aggregate->paths, bgp_aggregate_path_clear, aggregate);
 
-  /* Unlock bgp_node_lookup. */
-  bgp_unlock_node (rn);
+  /* Withdraw the aggregate route from routing table. */
+  bgp_aggregate_install (bgp, p, afi, safi, aggregate);
 }
 
 /* Aggregate route attribute. */
@@ -17822,6 +18587,7 @@ bgp_route_init (void)
   install_element (VIEW_NODE, &show_bgp_community_all_cmd);
   install_element (VIEW_NODE, &show_bgp_ipv6_community_all_cmd);
   install_element (VIEW_NODE, &show_bgp_community_cmd);
+  install_element (VIEW_NODE, &show_bgp_process_queue_cmd);
   install_element (VIEW_NODE, &show_bgp_community2_cmd);
   install_element (VIEW_NODE, &show_bgp_community3_cmd);
   install_element (VIEW_NODE, &show_bgp_community4_cmd);
@@ -17986,4 +18752,11 @@ bgp_route_finish (void)
 {
   bgp_table_unlock (bgp_distance_table);
   bgp_distance_table = NULL;
+
+  XFREE (MTYPE_BGP_DMED, bgp_dmed_paths);
+  XFREE (MTYPE_BGP_DMED, bgp_dmed_slots);
+  bgp_dmed_size = 0;
+
+  bgp_pool_finish (&bgp_info_pool);
+  bgp_pool_finish (&bgp_adj_in_pool);
 }
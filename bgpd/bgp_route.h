@@ -25,6 +25,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgp_table.h"
 
 struct bgp_nexthop_cache;
+struct bgp_pool;
 
 /* Ancillary information to struct bgp_info, 
  * used for uncommonly used data (aggregation, MPLS, etc.)
@@ -35,6 +36,9 @@ struct bgp_info_extra
   /* Pointer to dampening structure.  */
   struct bgp_damp_info *damp_info;
 
+  /* Multipath information */
+  struct bgp_info_mpath *mpath;
+
   /* This route is suppressed with aggregation.  */
   int suppress;
 
@@ -45,36 +49,20 @@ struct bgp_info_extra
   u_char tag[3];  
 };
 
+/* There is one of these for every path in every table, so the layout
+   is kept tight: what best path selection reads comes first, and what
+   few paths need lives in bgp_info_extra.  Paths come from a pool, see
+   bgp_pool.h. */
 struct bgp_info
 {
   /* For linked list. */
   struct bgp_info *next;
-  struct bgp_info *prev;
-
-  /* For nexthop linked list */
-  LIST_ENTRY(bgp_info) nh_thread;
-
-  /* Back pointer to the prefix node */
-  struct bgp_node *net;
-
-  /* Back pointer to the nexthop structure */
-  struct bgp_nexthop_cache *nexthop;
 
   /* Peer structure.  */
   struct peer *peer;
 
   /* Attribute structure.  */
   struct attr *attr;
-  
-  /* Extra information */
-  struct bgp_info_extra *extra;
-  
-
-  /* Multipath information */
-  struct bgp_info_mpath *mpath;
-
-  /* Uptime.  */
-  time_t uptime;
 
   /* reference count */
   int lock;
@@ -105,6 +93,24 @@ struct bgp_info
 #define BGP_ROUTE_STATIC       1
 #define BGP_ROUTE_AGGREGATE    2
 #define BGP_ROUTE_REDISTRIBUTE 3 
+
+  /* Uptime.  */
+  time_t uptime;
+
+  /* Extra information */
+  struct bgp_info_extra *extra;
+
+  /* Back pointer to the prefix node */
+  struct bgp_node *net;
+
+  /* Back pointer to the nexthop structure */
+  struct bgp_nexthop_cache *nexthop;
+
+  /* For nexthop linked list */
+  LIST_ENTRY(bgp_info) nh_thread;
+
+  /* For the list of paths of the peer */
+  LIST_ENTRY(bgp_info) peer_thread;
 };
 
 /* BGP static route configuration. */
@@ -188,6 +194,25 @@ enum bgp_clear_route_type
   BGP_CLEAR_ROUTE_MY_RSCLIENT
 };
 
+/* A walk over the RIB for a peer.  Rather than all in one go, the
+   table is gone through a slice at a time, pausing in between so that
+   other work, keepalives say, gets a turn.  The walks are run by the
+   t_walk thread of the peer.  Clearing a peer needs no walk, it goes
+   by the lists of the peer. */
+struct bgp_walk
+{
+  struct peer *peer;
+  afi_t afi;
+  safi_t safi;
+  enum bgp_walk_type type;
+
+  bgp_table_iter_t iter;
+
+  /* Nodes gone through, and in the table when the walk started. */
+  unsigned long done;
+  unsigned long total;
+};
+
 enum bgp_path_type
 {
   BGP_PATH_ALL,
@@ -195,6 +220,8 @@ enum bgp_path_type
   BGP_PATH_MULTIPATH
 };
 
+extern struct bgp_pool bgp_info_pool;
+
 /* Prototypes. */
 extern void bgp_route_init (void);
 extern void bgp_route_finish (void);
@@ -205,9 +232,13 @@ extern void bgp_default_originate (struct peer *, afi_t, safi_t, int);
 extern void bgp_soft_reconfig_in (struct peer *, afi_t, safi_t);
 extern void bgp_soft_reconfig_rsclient (struct peer *, afi_t, safi_t);
 extern void bgp_check_local_routes_rsclient (struct peer *rsclient, afi_t afi, safi_t safi);
+extern void bgp_dmed_select (struct bgp *, struct bgp_node *, afi_t, safi_t,
+                             int);
 extern void bgp_clear_route (struct peer *, afi_t, safi_t,
                              enum bgp_clear_route_type);
 extern void bgp_clear_route_all (struct peer *);
+extern void bgp_walk_cancel_all (struct peer *);
+extern const char *bgp_walk_type_str (enum bgp_walk_type);
 extern void bgp_clear_adj_in (struct peer *, afi_t, safi_t);
 extern void bgp_clear_stale_route (struct peer *, afi_t, safi_t);
 
@@ -53,6 +53,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_ecommunity.h"
 #include "bgpd/bgp_lcommunity.h"
 #include "bgpd/bgp_vty.h"
+#include "bgpd/bgp_updgrp.h"
 
 /* Memo of route-map commands.
 
@@ -2696,6 +2697,21 @@ bgp_route_set_delete (struct vty *vty, struct route_map_index *index,
   return CMD_SUCCESS;
 }
 
+/* Hook function for changes to the rules of a route_map, which may
+   change whether the outbound policy of a peer depends on the peer. */
+static void
+bgp_route_map_event (route_map_event_t event, const char *unused)
+{
+  struct listnode *node, *nnode;
+  struct bgp *bgp;
+
+  if (bm->bgp == NULL)
+    return;
+
+  for (ALL_LIST_ELEMENTS (bm->bgp, node, nnode, bgp))
+    bgp_updgrp_invalidate (bgp);
+}
+
 /* Hook function for updating route_map assignment. */
 static void
 bgp_route_map_update (const char *unused)
@@ -2719,6 +2735,8 @@ bgp_route_map_update (const char *unused)
   /* For neighbor route-map updates. */
   for (ALL_LIST_ELEMENTS (bm->bgp, mnode, mnnode, bgp))
     {
+      bgp_updgrp_invalidate (bgp);
+
       for (ALL_LIST_ELEMENTS (bgp->peer, node, nnode, peer))
 	{
 	  for (afi = AFI_IP; afi < AFI_MAX; afi++)
@@ -4503,6 +4521,7 @@ bgp_route_map_init (void)
   route_map_init_vty ();
   route_map_add_hook (bgp_route_map_update);
   route_map_delete_hook (bgp_route_map_update);
+  route_map_event_hook (bgp_route_map_event);
 
   route_map_install_match (&route_match_peer_cmd);
   route_map_install_match (&route_match_local_pref_cmd);
@@ -191,6 +191,17 @@ bgp_node_get (struct bgp_table *const table, struct prefix *p)
   return bgp_node_from_rnode (route_node_get (table->route_table, p));
 }
 
+/*
+ * bgp_node_get_hint
+ */
+static inline struct bgp_node *
+bgp_node_get_hint (struct bgp_table *const table, struct prefix *p,
+                   struct bgp_node *hint)
+{
+  return bgp_node_from_rnode (route_node_get_hint (table->route_table, p,
+                                                   bgp_node_to_rnode (hint)));
+}
+
 /*
  * bgp_node_lookup
  */
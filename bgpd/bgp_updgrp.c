@@ -0,0 +1,580 @@
+/* BGP update groups
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#include "command.h"
+#include "prefix.h"
+#include "linklist.h"
+#include "memory.h"
+#include "hash.h"
+#include "jhash.h"
+#include "stream.h"
+#include "routemap.h"
+#include "filter.h"
+#include "sockunion.h"
+
+#include "bgpd/bgpd.h"
+#include "bgpd/bgp_table.h"
+#include "bgpd/bgp_route.h"
+#include "bgpd/bgp_attr.h"
+#include "bgpd/bgp_vty.h"
+#include "bgpd/bgp_updgrp.h"
+
+/* Bumped for every route processed, tells apart the policy results
+   cached in the groups. */
+static u_int32_t updgrp_pass;
+
+/* Rules whose result depends on the peer the route is sent to. */
+static int
+updgrp_rmap_peer_rule (const char *name, const char *arg, void *unused)
+{
+  if (strcmp (name, "peer") == 0)
+    return 1;
+  if (strstr (name, "peer-address"))
+    return 1;
+  if (arg && (strstr (arg, "peer-address") || strstr (arg, "rtt")))
+    return 1;
+  return 0;
+}
+
+static void
+updgrp_key_make (struct peer *peer, afi_t afi, safi_t safi,
+                 struct updgrp_key *key)
+{
+  struct bgp_filter *filter = &peer->filter[afi][safi];
+
+  memset (key, 0, sizeof (struct updgrp_key));
+  key->afi = afi;
+  key->safi = safi;
+  key->af_flags = peer->af_flags[afi][safi] & UPDGRP_AF_FLAGS;
+  key->flags = peer->flags & (PEER_FLAG_LOCAL_AS_NO_PREPEND
+                              | PEER_FLAG_LOCAL_AS_REPLACE_AS);
+  key->sort = peer->sort;
+  key->as = peer->as;
+  key->local_as = peer->local_as;
+  key->change_local_as = peer->change_local_as;
+  key->as4 = CHECK_FLAG (peer->cap, PEER_CAP_AS4_RCV) ? 1 : 0;
+  key->shared_network = peer->shared_network;
+  key->nexthop = peer->nexthop.v4;
+  key->nexthop_global = peer->nexthop.v6_global;
+  key->nexthop_local = peer->nexthop.v6_local;
+
+  key->dlist = DISTRIBUTE_OUT_NAME (filter);
+  key->plist = PREFIX_LIST_OUT_NAME (filter);
+  key->aslist = FILTER_LIST_OUT_NAME (filter);
+  key->rmap = ROUTE_MAP_OUT_NAME (filter);
+  key->usmap = UNSUPPRESS_MAP_NAME (filter);
+
+  /* Whether an EBGP nexthop is left alone depends on the network the
+     peer sits on. */
+  if (peer->sort == BGP_PEER_EBGP
+      && ! CHECK_FLAG (peer->af_flags[afi][safi], PEER_FLAG_NEXTHOP_SELF))
+    key->peer = peer;
+
+  if (route_map_rule_walk (ROUTE_MAP_OUT (filter),
+                           updgrp_rmap_peer_rule, NULL)
+      || route_map_rule_walk (UNSUPPRESS_MAP (filter),
+                              updgrp_rmap_peer_rule, NULL))
+    key->peer = peer;
+}
+
+static int
+updgrp_str_same (const char *a, const char *b)
+{
+  if (a == NULL || b == NULL)
+    return a == b;
+  return strcmp (a, b) == 0;
+}
+
+static int
+updgrp_key_same (const struct updgrp_key *a, const struct updgrp_key *b)
+{
+  return a->afi == b->afi
+    && a->safi == b->safi
+    && a->af_flags == b->af_flags
+    && a->flags == b->flags
+    && a->sort == b->sort
+    && a->as == b->as
+    && a->local_as == b->local_as
+    && a->change_local_as == b->change_local_as
+    && a->as4 == b->as4
+    && a->shared_network == b->shared_network
+    && IPV4_ADDR_SAME (&a->nexthop, &b->nexthop)
+    && IPV6_ADDR_SAME (&a->nexthop_global, &b->nexthop_global)
+    && IPV6_ADDR_SAME (&a->nexthop_local, &b->nexthop_local)
+    && updgrp_str_same (a->dlist, b->dlist)
+    && updgrp_str_same (a->plist, b->plist)
+    && updgrp_str_same (a->aslist, b->aslist)
+    && updgrp_str_same (a->rmap, b->rmap)
+    && updgrp_str_same (a->usmap, b->usmap)
+    && a->peer == b->peer;
+}
+
+static unsigned int
+updgrp_hash_key (void *p)
+{
+  struct updgrp_key *key = &((struct update_group *) p)->key;
+  unsigned int hash;
+
+  hash = jhash_3words ((key->afi << 8) | key->safi, key->af_flags, key->as, 0);
+  hash = jhash_3words (key->local_as, key->sort, key->nexthop.s_addr, hash);
+  hash = jhash_1word ((u_int32_t) (uintptr_t) key->peer, hash);
+  if (key->rmap)
+    hash = jhash_1word (string_hash_make (key->rmap), hash);
+  return hash;
+}
+
+static int
+updgrp_hash_cmp (const void *p1, const void *p2)
+{
+  return updgrp_key_same (&((const struct update_group *) p1)->key,
+                          &((const struct update_group *) p2)->key);
+}
+
+static char *
+updgrp_strdup (const char *str)
+{
+  return str ? XSTRDUP (MTYPE_BGP_UPDGRP, str) : NULL;
+}
+
+static void
+updgrp_strfree (char *str)
+{
+  if (str)
+    XFREE (MTYPE_BGP_UPDGRP, str);
+}
+
+static void *
+updgrp_alloc (void *p)
+{
+  struct update_group *ref = p;
+  struct update_group *group;
+
+  group = XCALLOC (MTYPE_BGP_UPDGRP, sizeof (struct update_group));
+  group->bgp = ref->bgp;
+  group->id = ++group->bgp->updgrp_next_id;
+  group->key = ref->key;
+  group->key.dlist = updgrp_strdup (ref->key.dlist);
+  group->key.plist = updgrp_strdup (ref->key.plist);
+  group->key.aslist = updgrp_strdup (ref->key.aslist);
+  group->key.rmap = updgrp_strdup (ref->key.rmap);
+  group->key.usmap = updgrp_strdup (ref->key.usmap);
+  group->peers = list_new ();
+  group->attr.extra = &group->extra;
+  group->uptime = bgp_clock ();
+  return group;
+}
+
+static void
+updgrp_enc_flush (struct update_group *group)
+{
+  int i;
+
+  if (! group->enc)
+    return;
+
+  for (i = 0; i < UPDGRP_ENC_SLOTS; i++)
+    {
+      struct updgrp_enc *enc = &group->enc[i];
+
+      if (enc->attr)
+        bgp_attr_unintern (&enc->attr);
+      if (enc->data)
+        XFREE (MTYPE_BGP_UPDGRP_ENC, enc->data);
+    }
+  XFREE (MTYPE_BGP_UPDGRP_ENC, group->enc);
+  group->enc = NULL;
+}
+
+/* Let go of the stored policy result.  A permitted route's policy
+   leaves what it made, such as route-map "set" values, in the group's
+   attribute, and the parts it took from the route may be gone by now,
+   so they are interned when the result is stored, see
+   bgp_updgrp_policy_store (), and released here.  A denied one has been
+   flushed already. */
+static void
+updgrp_policy_attr_flush (struct update_group *group)
+{
+  if (! group->interned)
+    return;
+
+  bgp_attr_flush (&group->attr);
+  bgp_attr_unintern (&group->interned);
+  group->interned = NULL;
+}
+
+static void
+updgrp_free (struct update_group *group)
+{
+  updgrp_policy_attr_flush (group);
+  updgrp_enc_flush (group);
+  updgrp_strfree (group->key.dlist);
+  updgrp_strfree (group->key.plist);
+  updgrp_strfree (group->key.aslist);
+  updgrp_strfree (group->key.rmap);
+  updgrp_strfree (group->key.usmap);
+  list_delete (group->peers);
+  XFREE (MTYPE_BGP_UPDGRP, group);
+}
+
+static void
+updgrp_leave (struct peer *peer, afi_t afi, safi_t safi)
+{
+  struct update_group *group = peer->updgrp[afi][safi];
+
+  if (! group)
+    return;
+
+  peer->updgrp[afi][safi] = NULL;
+  listnode_delete (group->peers, peer);
+  group->leaves++;
+
+  if (list_isempty (group->peers))
+    {
+      hash_release (group->bgp->updgrp_hash, group);
+      updgrp_free (group);
+    }
+}
+
+/* The update group of the peer for the address family, or NULL when
+   the peer is not taking updates for it.  Membership is worked out
+   again when the outbound configuration changed since last time. */
+struct update_group *
+bgp_updgrp_lookup (struct peer *peer, afi_t afi, safi_t safi)
+{
+  struct bgp *bgp = peer->bgp;
+  struct update_group *group = peer->updgrp[afi][safi];
+  struct update_group ref;
+
+  if (peer->status != Established || ! peer->afc_nego[afi][safi]
+      || ! bgp->updgrp_hash)
+    {
+      updgrp_leave (peer, afi, safi);
+      return NULL;
+    }
+
+  if (group && peer->updgrp_gen[afi][safi] == bgp->updgrp_gen)
+    return group;
+
+  peer->updgrp_gen[afi][safi] = bgp->updgrp_gen;
+  ref.bgp = bgp;
+  updgrp_key_make (peer, afi, safi, &ref.key);
+
+  if (group && updgrp_key_same (&group->key, &ref.key))
+    return group;
+
+  updgrp_leave (peer, afi, safi);
+  group = hash_get (bgp->updgrp_hash, &ref, updgrp_alloc);
+  listnode_add (group->peers, peer);
+  group->joins++;
+  peer->updgrp[afi][safi] = group;
+
+  return group;
+}
+
+void
+bgp_updgrp_peer_leave (struct peer *peer)
+{
+  afi_t afi;
+  safi_t safi;
+
+  for (afi = AFI_IP; afi < AFI_MAX; afi++)
+    for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
+      updgrp_leave (peer, afi, safi);
+}
+
+static void
+updgrp_invalidate_iter (struct hash_backet *backet, void *unused)
+{
+  struct update_group *group = backet->data;
+
+  group->rn = NULL;
+  updgrp_enc_flush (group);
+}
+
+/* Outbound configuration changed somewhere in the instance, have the
+   peers find their group again when next used. */
+void
+bgp_updgrp_invalidate (struct bgp *bgp)
+{
+  bgp->updgrp_gen++;
+  if (bgp->updgrp_hash)
+    hash_iterate (bgp->updgrp_hash, updgrp_invalidate_iter, NULL);
+}
+
+void
+bgp_updgrp_pass_start (void)
+{
+  if (++updgrp_pass == 0)
+    updgrp_pass++;
+}
+
+/* Whether the group already ran its outbound policy on the route in
+   this pass, the result is in group->permit and group->attr. */
+int
+bgp_updgrp_policy_cached (struct update_group *group, struct bgp_node *rn,
+                          struct bgp_info *ri)
+{
+  if (group->pass != updgrp_pass || group->rn != rn || group->ri != ri)
+    return 0;
+
+  group->policy_shared++;
+  return 1;
+}
+
+/* Attribute for the group to run its outbound policy into. */
+struct attr *
+bgp_updgrp_policy_attr (struct update_group *group)
+{
+  updgrp_policy_attr_flush (group);
+  memset (&group->attr, 0, sizeof (struct attr));
+  memset (&group->extra, 0, sizeof (struct attr_extra));
+  group->attr.extra = &group->extra;
+  return &group->attr;
+}
+
+void
+bgp_updgrp_policy_store (struct update_group *group, struct bgp_node *rn,
+                         struct bgp_info *ri, int permit)
+{
+  group->pass = updgrp_pass;
+  group->rn = rn;
+  group->ri = ri;
+  group->permit = permit;
+  if (permit)
+    group->interned = bgp_attr_intern (&group->attr);
+  group->policy_run++;
+}
+
+/* bgp_packet_attribute () for UPDATE messages, reusing the encoding
+   made for another member of the peer's group when there is one. */
+bgp_size_t
+bgp_updgrp_packet_attribute (struct peer *peer, struct stream *s,
+                             struct attr *attr, struct prefix *p,
+                             afi_t afi, safi_t safi, struct peer *from,
+                             struct prefix_rd *prd, u_char *tag)
+{
+  struct update_group *group;
+  struct updgrp_enc *enc;
+  struct in_addr originator;
+  int reflected;
+  size_t cp;
+  bgp_size_t len;
+
+  group = bgp_updgrp_lookup (peer, afi, safi);
+
+  /* The prefix is only encoded along with the attributes for
+     MP_REACH_NLRI, which is not per group. */
+  if (! group || ! attr || (p && ! (afi == AFI_IP && safi == SAFI_UNICAST)))
+    return bgp_packet_attribute (NULL, peer, s, attr, p, afi, safi,
+                                 from, prd, tag);
+
+  reflected = (from && from->sort == BGP_PEER_IBGP);
+  originator.s_addr = reflected ? from->remote_id.s_addr : 0;
+
+  if (! group->enc)
+    group->enc = XCALLOC (MTYPE_BGP_UPDGRP_ENC,
+                          UPDGRP_ENC_SLOTS * sizeof (struct updgrp_enc));
+  enc = &group->enc[jhash_2words ((u_int32_t) (uintptr_t) attr,
+                                  originator.s_addr, reflected)
+                    % UPDGRP_ENC_SLOTS];
+
+  if (enc->attr == attr && enc->reflected == reflected
+      && enc->originator.s_addr == originator.s_addr
+      && STREAM_WRITEABLE (s) >= enc->len)
+    {
+      stream_put (s, enc->data, enc->len);
+      group->encode_shared++;
+      return enc->len;
+    }
+
+  cp = stream_get_endp (s);
+  len = bgp_packet_attribute (NULL, peer, s, attr, p, afi, safi,
+                              from, prd, tag);
+
+  if (enc->attr)
+    bgp_attr_unintern (&enc->attr);
+  enc->attr = bgp_attr_intern (attr);
+  enc->reflected = reflected;
+  enc->originator = originator;
+  enc->data = XREALLOC (MTYPE_BGP_UPDGRP_ENC, enc->data, len);
+  memcpy (enc->data, STREAM_DATA (s) + cp, len);
+  enc->len = len;
+  group->encode_run++;
+
+  return len;
+}
+
+void
+bgp_updgrp_bgp_init (struct bgp *bgp)
+{
+  bgp->updgrp_hash = hash_create (updgrp_hash_key, updgrp_hash_cmp);
+}
+
+static void
+updgrp_hash_free (void *p)
+{
+  struct update_group *group = p;
+  struct listnode *node, *nnode;
+  struct peer *peer;
+
+  for (ALL_LIST_ELEMENTS (group->peers, node, nnode, peer))
+    peer->updgrp[group->key.afi][group->key.safi] = NULL;
+  updgrp_free (group);
+}
+
+void
+bgp_updgrp_bgp_finish (struct bgp *bgp)
+{
+  if (! bgp->updgrp_hash)
+    return;
+
+  hash_clean (bgp->updgrp_hash, updgrp_hash_free);
+  hash_free (bgp->updgrp_hash);
+  bgp->updgrp_hash = NULL;
+}
+
+static void
+updgrp_show_name (struct vty *vty, const char *what, const char *name)
+{
+  if (name)
+    vty_out (vty, "    %s %s%s", what, name, VTY_NEWLINE);
+}
+
+static void
+updgrp_show_group (struct vty *vty, struct update_group *group)
+{
+  struct updgrp_key *key = &group->key;
+  struct listnode *node;
+  struct peer *peer;
+  char timebuf[BGP_UPTIME_LEN];
+
+  vty_out (vty, "Update group %u, %s, up for %8s%s", group->id,
+           afi_safi_print (key->afi, key->safi),
+           peer_uptime (group->uptime, timebuf, BGP_UPTIME_LEN), VTY_NEWLINE);
+
+  vty_out (vty, "  Outbound policy:%s", VTY_NEWLINE);
+  vty_out (vty, "    %s, remote AS %u, local AS %u%s%s",
+           key->sort == BGP_PEER_IBGP ? "internal"
+             : key->sort == BGP_PEER_CONFED ? "confederation" : "external",
+           key->as, key->change_local_as ? key->change_local_as : key->local_as,
+           key->as4 ? ", 4-octet AS" : "", VTY_NEWLINE);
+  if (CHECK_FLAG (key->af_flags, PEER_FLAG_REFLECTOR_CLIENT))
+    vty_out (vty, "    route-reflector-client%s", VTY_NEWLINE);
+  if (CHECK_FLAG (key->af_flags, PEER_FLAG_NEXTHOP_SELF))
+    vty_out (vty, "    next-hop-self%s%s",
+             CHECK_FLAG (key->af_flags, PEER_FLAG_NEXTHOP_SELF_ALL)
+               ? " all" : "", VTY_NEWLINE);
+  if (CHECK_FLAG (key->af_flags, PEER_FLAG_SEND_COMMUNITY))
+    vty_out (vty, "    send-community%s", VTY_NEWLINE);
+  if (CHECK_FLAG (key->af_flags, PEER_FLAG_SEND_EXT_COMMUNITY))
+    vty_out (vty, "    send-community extended%s", VTY_NEWLINE);
+  if (CHECK_FLAG (key->af_flags, PEER_FLAG_SEND_LARGE_COMMUNITY))
+    vty_out (vty, "    send-community large%s", VTY_NEWLINE);
+  if (CHECK_FLAG (key->af_flags, PEER_FLAG_REMOVE_PRIVATE_AS))
+    vty_out (vty, "    remove-private-AS%s", VTY_NEWLINE);
+  updgrp_show_name (vty, "distribute-list", key->dlist);
+  updgrp_show_name (vty, "prefix-list", key->plist);
+  updgrp_show_name (vty, "filter-list", key->aslist);
+  updgrp_show_name (vty, "route-map", key->rmap);
+  updgrp_show_name (vty, "unsuppress-map", key->usmap);
+  if (key->peer)
+    vty_out (vty, "    depends on the peer%s", VTY_NEWLINE);
+
+  vty_out (vty, "  Members: %u%s", listcount (group->peers), VTY_NEWLINE);
+  for (ALL_LIST_ELEMENTS_RO (group->peers, node, peer))
+    vty_out (vty, "    %s%s", peer->host, VTY_NEWLINE);
+
+  vty_out (vty, "  Policy runs %lu, shared %lu%s",
+           group->policy_run, group->policy_shared, VTY_NEWLINE);
+  vty_out (vty, "  Attribute encodings %lu, shared %lu%s",
+           group->encode_run, group->encode_shared, VTY_NEWLINE);
+  vty_out (vty, "  Joins %lu, leaves %lu%s",
+           group->joins, group->leaves, VTY_NEWLINE);
+  vty_out (vty, "%s", VTY_NEWLINE);
+}
+
+static void
+updgrp_show_iter (struct hash_backet *backet, void *arg)
+{
+  updgrp_show_group (arg, backet->data);
+}
+
+static int
+bgp_show_update_groups (struct vty *vty, const char *name)
+{
+  struct bgp *bgp;
+
+  if (name)
+    bgp = bgp_lookup_by_name (name);
+  else
+    bgp = bgp_get_default ();
+
+  if (! bgp)
+    {
+      vty_out (vty, "%% No such BGP instance exist%s", VTY_NEWLINE);
+      return CMD_WARNING;
+    }
+
+  vty_out (vty, "%lu update groups%s", bgp->updgrp_hash->count, VTY_NEWLINE);
+  hash_iterate (bgp->updgrp_hash, updgrp_show_iter, vty);
+
+  return CMD_SUCCESS;
+}
+
+DEFUN (show_ip_bgp_update_groups,
+       show_ip_bgp_update_groups_cmd,
+       "show ip bgp update-groups",
+       SHOW_STR
+       IP_STR
+       BGP_STR
+       "Peers sharing outbound policy\n")
+{
+  return bgp_show_update_groups (vty, NULL);
+}
+
+DEFUN (show_ip_bgp_instance_update_groups,
+       show_ip_bgp_instance_update_groups_cmd,
+       "show ip bgp view WORD update-groups",
+       SHOW_STR
+       IP_STR
+       BGP_STR
+       "BGP view\n"
+       "View name\n"
+       "Peers sharing outbound policy\n")
+{
+  return bgp_show_update_groups (vty, argv[0]);
+}
+
+ALIAS (show_ip_bgp_update_groups,
+       show_bgp_update_groups_cmd,
+       "show bgp update-groups",
+       SHOW_STR
+       BGP_STR
+       "Peers sharing outbound policy\n")
+
+void
+bgp_updgrp_init (void)
+{
+  install_element (VIEW_NODE, &show_ip_bgp_update_groups_cmd);
+  install_element (VIEW_NODE, &show_ip_bgp_instance_update_groups_cmd);
+  install_element (VIEW_NODE, &show_bgp_update_groups_cmd);
+}
@@ -0,0 +1,143 @@
+/* BGP update groups
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef _QUAGGA_BGP_UPDGRP_H
+#define _QUAGGA_BGP_UPDGRP_H
+
+/* Established peers of an instance whose outbound configuration for
+   an address family is the same are put in one update group.  What
+   the outbound policy makes of a route, and the encoding of the path
+   attributes of an UPDATE, are then worked out once for the group
+   and reused for the other members.  Adj-RIB-Out and the packet
+   queues stay per peer. */
+
+/* Per address family peer flags that change what is sent. */
+#define UPDGRP_AF_FLAGS \
+  (PEER_FLAG_SEND_COMMUNITY | PEER_FLAG_SEND_EXT_COMMUNITY \
+   | PEER_FLAG_SEND_LARGE_COMMUNITY | PEER_FLAG_NEXTHOP_SELF \
+   | PEER_FLAG_NEXTHOP_SELF_ALL | PEER_FLAG_NEXTHOP_UNCHANGED \
+   | PEER_FLAG_NEXTHOP_LOCAL_UNCHANGED | PEER_FLAG_REFLECTOR_CLIENT \
+   | PEER_FLAG_RSERVER_CLIENT | PEER_FLAG_AS_PATH_UNCHANGED \
+   | PEER_FLAG_MED_UNCHANGED | PEER_FLAG_REMOVE_PRIVATE_AS)
+
+/* Everything about a peer the outbound policy and the attribute
+   encoding look at. */
+struct updgrp_key
+{
+  afi_t afi;
+  safi_t safi;
+
+  u_int32_t af_flags;
+  u_int32_t flags;
+  bgp_peer_sort_t sort;
+  as_t as;
+  as_t local_as;
+  as_t change_local_as;
+  int as4;
+  int shared_network;
+  struct in_addr nexthop;
+  struct in6_addr nexthop_global;
+  struct in6_addr nexthop_local;
+
+  /* Outbound filter names. */
+  char *dlist;
+  char *plist;
+  char *aslist;
+  char *rmap;
+  char *usmap;
+
+  /* Set when the result depends on the peer itself, which puts it in
+     a group of its own. */
+  struct peer *peer;
+};
+
+/* Number of attribute encodings remembered per group. */
+#define UPDGRP_ENC_SLOTS 256
+
+/* The path attributes of an UPDATE as encoded for the group. */
+struct updgrp_enc
+{
+  /* Interned attribute, locked while it is here. */
+  struct attr *attr;
+
+  /* Whether the route is reflected, and the Originator-ID added if
+     the attribute does not carry one. */
+  int reflected;
+  struct in_addr originator;
+
+  size_t len;
+  u_char *data;
+};
+
+struct update_group
+{
+  struct bgp *bgp;
+  u_int32_t id;
+  struct updgrp_key key;
+
+  /* Member peers. */
+  struct list *peers;
+
+  /* Outbound policy result for the route being processed. */
+  u_int32_t pass;
+  struct bgp_node *rn;
+  struct bgp_info *ri;
+  int permit;
+  struct attr attr;
+  struct attr_extra extra;
+
+  /* While a permit is stored, the interned copy of attr, which keeps
+     the parts attr points to alive. */
+  struct attr *interned;
+
+  struct updgrp_enc *enc;
+
+  /* Statistics. */
+  time_t uptime;
+  unsigned long policy_run;
+  unsigned long policy_shared;
+  unsigned long encode_run;
+  unsigned long encode_shared;
+  unsigned long joins;
+  unsigned long leaves;
+};
+
+extern void bgp_updgrp_init (void);
+extern void bgp_updgrp_bgp_init (struct bgp *);
+extern void bgp_updgrp_bgp_finish (struct bgp *);
+
+extern void bgp_updgrp_invalidate (struct bgp *);
+extern struct update_group *bgp_updgrp_lookup (struct peer *, afi_t, safi_t);
+extern void bgp_updgrp_peer_leave (struct peer *);
+
+extern void bgp_updgrp_pass_start (void);
+extern int bgp_updgrp_policy_cached (struct update_group *,
+                                     struct bgp_node *, struct bgp_info *);
+extern struct attr *bgp_updgrp_policy_attr (struct update_group *);
+extern void bgp_updgrp_policy_store (struct update_group *,
+                                     struct bgp_node *, struct bgp_info *,
+                                     int);
+
+extern bgp_size_t bgp_updgrp_packet_attribute (struct peer *, struct stream *,
+                                               struct attr *, struct prefix *,
+                                               afi_t, safi_t, struct peer *,
+                                               struct prefix_rd *, u_char *);
+
+#endif /* _QUAGGA_BGP_UPDGRP_H */
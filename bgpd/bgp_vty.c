@@ -45,12 +45,15 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_mplsvpn.h"
 #include "bgpd/bgp_nexthop.h"
 #include "bgpd/bgp_open.h"
+#include "bgpd/bgp_packet.h"
+#include "bgpd/bgp_io.h"
 #include "bgpd/bgp_regex.h"
 #include "bgpd/bgp_route.h"
 #include "bgpd/bgp_zebra.h"
 #include "bgpd/bgp_table.h"
 #include "bgpd/bgp_vty.h"
 #include "bgpd/bgp_mpath.h"
+#include "bgpd/bgp_pool.h"
 
 /* Utility function to get address family from current node.  */
 afi_t
@@ -346,6 +349,39 @@ DEFUN (no_bgp_config_type,
   return CMD_SUCCESS;
 }
 
+DEFUN (bgp_read_quanta,
+       bgp_read_quanta_cmd,
+       "bgp read-quanta <1-10000>",
+       BGP_STR
+       "How many messages from one peer are handled before yielding\n"
+       "Number of messages\n")
+{
+  u_int32_t quanta;
+
+  VTY_GET_INTEGER_RANGE ("read-quanta", quanta, argv[0], 1, 10000);
+  bm->read_quanta = quanta;
+  return CMD_SUCCESS;
+}
+
+DEFUN (no_bgp_read_quanta,
+       no_bgp_read_quanta_cmd,
+       "no bgp read-quanta",
+       NO_STR
+       BGP_STR
+       "How many messages from one peer are handled before yielding\n")
+{
+  bm->read_quanta = BGP_READ_QUANTA_DEFAULT;
+  return CMD_SUCCESS;
+}
+
+ALIAS (no_bgp_read_quanta,
+       no_bgp_read_quanta_val_cmd,
+       "no bgp read-quanta <1-10000>",
+       NO_STR
+       BGP_STR
+       "How many messages from one peer are handled before yielding\n"
+       "Number of messages\n")
+
 DEFUN (no_synchronization,
        no_synchronization_cmd,
        "no synchronization",
@@ -7352,6 +7388,22 @@ DEFUN (show_bgp_views,
   return CMD_SUCCESS;
 }
 
+/* What a pool took from malloc beyond the objects in use: those freed
+   and waiting for reuse, and the rest of its newest chunk. */
+static void
+bgp_show_pool (struct vty *vty, const char *name, struct bgp_pool *pool)
+{
+  char memstrbuf[MTYPE_MEMSTR_LEN];
+
+  if (! pool->nchunks)
+    return;
+  vty_out (vty, "  %s pool: %lu chunks, %s, %lu free entries%s", name,
+           pool->nchunks,
+           mtype_memstr (memstrbuf, sizeof (memstrbuf),
+                         bgp_pool_memory (pool)),
+           pool->nfree + pool->left, VTY_NEWLINE);
+}
+
 DEFUN (show_bgp_memory, 
        show_bgp_memory_cmd,
        "show bgp memory",
@@ -7369,11 +7421,12 @@ DEFUN (show_bgp_memory,
                          count * sizeof (struct bgp_node)),
            VTY_NEWLINE);
   
-  count = mtype_stats_alloc (MTYPE_BGP_ROUTE);
+  count = bgp_info_pool.count;
   vty_out (vty, "%ld BGP routes, using %s of memory%s", count,
            mtype_memstr (memstrbuf, sizeof (memstrbuf),
                          count * sizeof (struct bgp_info)),
            VTY_NEWLINE);
+  bgp_show_pool (vty, "BGP route", &bgp_info_pool);
   if ((count = mtype_stats_alloc (MTYPE_BGP_ROUTE_EXTRA)))
     vty_out (vty, "%ld BGP route ancillaries, using %s of memory%s", count,
              mtype_memstr (memstrbuf, sizeof (memstrbuf),
@@ -7387,11 +7440,14 @@ DEFUN (show_bgp_memory,
              VTY_NEWLINE);
   
   /* Adj-In/Out */
-  if ((count = mtype_stats_alloc (MTYPE_BGP_ADJ_IN)))
-    vty_out (vty, "%ld Adj-In entries, using %s of memory%s", count,
-             mtype_memstr (memstrbuf, sizeof (memstrbuf),
-                           count * sizeof (struct bgp_adj_in)),
-             VTY_NEWLINE);
+  if ((count = bgp_adj_in_pool.count))
+    {
+      vty_out (vty, "%ld Adj-In entries, using %s of memory%s", count,
+               mtype_memstr (memstrbuf, sizeof (memstrbuf),
+                             count * sizeof (struct bgp_adj_in)),
+               VTY_NEWLINE);
+      bgp_show_pool (vty, "Adj-In", &bgp_adj_in_pool);
+    }
   if ((count = mtype_stats_alloc (MTYPE_BGP_ADJ_OUT)))
     vty_out (vty, "%ld Adj-Out entries, using %s of memory%s", count,
              mtype_memstr (memstrbuf, sizeof (memstrbuf),
@@ -8185,6 +8241,8 @@ bgp_show_peer_afi (struct vty *vty, struct peer *p, afi_t afi, safi_t safi)
   struct bgp_filter *filter;
   char orf_pfx_name[BUFSIZ];
   int orf_pfx_count;
+  struct bgp_walk *walk;
+  int type;
 
   filter = &p->filter[afi][safi];
 
@@ -8374,6 +8432,13 @@ bgp_show_peer_afi (struct vty *vty, struct peer *p, afi_t afi, safi_t safi)
   /* Receive prefix count */
   vty_out (vty, "  %ld accepted prefixes%s", p->pcount[afi][safi], VTY_NEWLINE);
 
+  /* Table walks under way */
+  for (type = 0; type < BGP_WALK_MAX; type++)
+    if ((walk = p->walk[afi][safi][type]) != NULL)
+      vty_out (vty, "  Table walk for %s, %lu of %lu nodes done%s",
+               bgp_walk_type_str (type), walk->done, walk->total,
+               VTY_NEWLINE);
+
   /* Maximum prefix */
   if (CHECK_FLAG (p->af_flags[afi][safi], PEER_FLAG_MAX_PREFIX))
     {
@@ -8630,19 +8695,31 @@ bgp_show_peer (struct vty *vty, struct peer *p)
 
   /* Packet counts. */
   vty_out (vty, "  Message statistics:%s", VTY_NEWLINE);
-  vty_out (vty, "    Inq depth is 0%s", VTY_NEWLINE);
+  vty_out (vty, "    Inq depth is %lu bytes%s",
+	   (unsigned long) STREAM_READABLE (p->rbuf), VTY_NEWLINE);
   vty_out (vty, "    Outq depth is %lu%s", (unsigned long) p->obuf->count, VTY_NEWLINE);
   vty_out (vty, "                         Sent       Rcvd%s", VTY_NEWLINE);
   vty_out (vty, "    Opens:         %10d %10d%s", p->open_out, p->open_in, VTY_NEWLINE);
   vty_out (vty, "    Notifications: %10d %10d%s", p->notify_out, p->notify_in, VTY_NEWLINE);
   vty_out (vty, "    Updates:       %10d %10d%s", p->update_out, p->update_in, VTY_NEWLINE);
-  vty_out (vty, "    Keepalives:    %10d %10d%s", p->keepalive_out, p->keepalive_in, VTY_NEWLINE);
+  vty_out (vty, "    Keepalives:    %10lu %10d%s",
+	   p->keepalive_out + bgp_io_keepalives (p), p->keepalive_in, VTY_NEWLINE);
   vty_out (vty, "    Route Refresh: %10d %10d%s", p->refresh_out, p->refresh_in, VTY_NEWLINE);
   vty_out (vty, "    Capability:    %10d %10d%s", p->dynamic_cap_out, p->dynamic_cap_in, VTY_NEWLINE);
   vty_out (vty, "    Total:         %10d %10d%s", p->open_out + p->notify_out +
 	   p->update_out + p->keepalive_out + p->refresh_out + p->dynamic_cap_out,
 	   p->open_in + p->notify_in + p->update_in + p->keepalive_in + p->refresh_in +
 	   p->dynamic_cap_in, VTY_NEWLINE);
+  vty_out (vty, "    Reads: %lu, messages per read %lu average, %lu max per wakeup,"
+	   " %lu yields%s", p->read_calls,
+	   p->read_calls ? p->read_msgs / p->read_calls : 0,
+	   p->read_msgs_max, p->read_yields, VTY_NEWLINE);
+  vty_out (vty, "    Keepalives sent by the I/O thread: %lu,"
+	   " hold timer expiries with input pending: %lu%s",
+	   p->keepalive_io + bgp_io_keepalives (p), p->holdtime_deferred,
+	   VTY_NEWLINE);
+  vty_out (vty, "    Updates with the attributes of the one before: %lu%s",
+	   p->update_attr_reused, VTY_NEWLINE);
 
   /* advertisement-interval */
   vty_out (vty, "  Minimum time between advertisement runs is %d seconds%s",
@@ -10041,6 +10118,11 @@ bgp_vty_init (void)
   install_element (CONFIG_NODE, &bgp_multiple_instance_cmd);
   install_element (CONFIG_NODE, &no_bgp_multiple_instance_cmd);
 
+  /* "bgp read-quanta" commands. */
+  install_element (CONFIG_NODE, &bgp_read_quanta_cmd);
+  install_element (CONFIG_NODE, &no_bgp_read_quanta_cmd);
+  install_element (CONFIG_NODE, &no_bgp_read_quanta_val_cmd);
+
   /* "bgp config-type" commands. */
   install_element (CONFIG_NODE, &bgp_config_type_cmd);
   install_element (CONFIG_NODE, &no_bgp_config_type_cmd);
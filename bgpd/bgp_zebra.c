@@ -110,7 +110,7 @@ bgp_interface_delete (int command, struct zclient *zclient,
   if (! ifp)
     return 0;
 
-  ifp->ifindex = IFINDEX_INTERNAL;
+  if_set_index (ifp, IFINDEX_INTERNAL);
 
   if (BGP_DEBUG(zebra, ZEBRA))
     zlog_debug("Zebra rcvd: interface delete %s", ifp->name);
@@ -794,8 +794,8 @@ bgp_zebra_announce (struct prefix *p, struct bgp_info *info, struct bgp *bgp, sa
 				    sizeof(buf[1])));
 	}
 
-      zapi_ipv4_route (ZEBRA_IPV4_ROUTE_ADD, zclient, 
-                       (struct prefix_ipv4 *) p, &api);
+      zapi_ipv4_route_batch (ZEBRA_IPV4_ROUTE_ADD, zclient,
+                             (struct prefix_ipv4 *) p, &api);
     }
 
   /* We have to think about a IPv6 link-local address curse. */
@@ -967,8 +967,8 @@ bgp_zebra_announce (struct prefix *p, struct bgp_info *info, struct bgp *bgp, sa
 		     api.metric, api.tag);
 	}
 
-      zapi_ipv6_route (ZEBRA_IPV6_ROUTE_ADD, zclient, 
-                       (struct prefix_ipv6 *) p, &api);
+      zapi_ipv6_route_batch (ZEBRA_IPV6_ROUTE_ADD, zclient,
+                             (struct prefix_ipv6 *) p, &api);
     }
 }
 
@@ -1172,11 +1172,50 @@ bgp_zclient_reset (void)
   zclient_reset (zclient);
 }
 
+/* Announce all our best routes to zebra again, after it dropped them
+   with the connection, then tell it we are done.  A zebra which went
+   through a warm restart removes what it kept of ours that is not in
+   the list. */
+static void
+bgp_zebra_announce_all (void)
+{
+  struct listnode *node;
+  struct bgp *bgp;
+  struct bgp_node *rn;
+  struct bgp_info *ri;
+  afi_t afi;
+  safi_t safi;
+
+  if (bgp_option_check (BGP_OPT_NO_FIB))
+    return;
+
+  for (ALL_LIST_ELEMENTS_RO (bm->bgp, node, bgp))
+    {
+      if (bgp->name)
+	continue;
+
+      for (afi = AFI_IP; afi <= AFI_IP6; afi++)
+	for (safi = SAFI_UNICAST; safi <= SAFI_MULTICAST; safi++)
+	  for (rn = bgp_table_top (bgp->rib[afi][safi]); rn;
+	       rn = bgp_route_next (rn))
+	    for (ri = rn->info; ri; ri = ri->next)
+	      if (CHECK_FLAG (ri->flags, BGP_INFO_SELECTED)
+		  && ri->type == ZEBRA_ROUTE_BGP
+		  && ri->sub_type == BGP_ROUTE_NORMAL)
+		bgp_zebra_announce (&rn->p, ri, bgp, safi);
+    }
+
+  zclient_send_end_of_rib (zclient);
+}
+
 static void
 bgp_zebra_connected (struct zclient *zclient)
 {
   zclient_num_connects++;
   zclient_send_requests (zclient, VRF_DEFAULT);
+
+  if (zclient_num_connects > 1)
+    bgp_zebra_announce_all ();
 }
 
 void
@@ -37,6 +37,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "linklist.h"
 #include "workqueue.h"
 #include "table.h"
+#include "hash.h"
 
 #include "bgpd/bgpd.h"
 #include "bgpd/bgp_table.h"
@@ -62,6 +63,8 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_vty.h"
 #include "bgpd/bgp_mpath.h"
 #include "bgpd/bgp_nht.h"
+#include "bgpd/bgp_updgrp.h"
+#include "bgpd/bgp_io.h"
 #ifdef HAVE_SNMP
 #include "bgpd/bgp_snmp.h"
 #endif /* HAVE_SNMP */
@@ -780,6 +783,7 @@ peer_free (struct peer *peer)
   if (peer->notify.data)
     XFREE(MTYPE_TMP, peer->notify.data);
   
+  bgp_attr_cache_free (peer);
   bgp_sync_delete (peer);
 
   bgp_unlock(peer->bgp);
@@ -871,6 +875,7 @@ peer_new (struct bgp *bgp)
   SET_FLAG (peer->sflags, PEER_STATUS_CAPABILITY_OPEN);
 
   /* Create buffers.  */
+  peer->rbuf = stream_new (BGP_READ_BUFSIZ);
   peer->ibuf = stream_new (BGP_MAX_PACKET_SIZE);
   peer->obuf = stream_fifo_new ();
 
@@ -897,6 +902,30 @@ peer_new (struct bgp *bgp)
   return peer;
 }
 
+static unsigned int
+peer_hash_key (void *p)
+{
+  struct peer *peer = p;
+
+  return sockunion_hash (&peer->su);
+}
+
+/* Peers are told apart by themselves, as more than one can have the
+   same address. */
+static int
+peer_hash_cmp (const void *p1, const void *p2)
+{
+  return p1 == p2;
+}
+
+static int
+peer_hash_su_cmp (const void *p, const void *su)
+{
+  const struct peer *peer = p;
+
+  return sockunion_same (&peer->su, su);
+}
+
 /* Create new BGP peer.  */
 static struct peer *
 peer_create (union sockunion *su, struct bgp *bgp, as_t local_as,
@@ -920,6 +949,7 @@ peer_create (union sockunion *su, struct bgp *bgp, as_t local_as,
     
   peer = peer_lock (peer); /* bgp peer list reference */
   listnode_add_sort (bgp->peer, peer);
+  hash_get (bgp->peerhash, peer, hash_alloc_intern);
 
   active = peer_active (peer);
 
@@ -942,14 +972,16 @@ peer_create (union sockunion *su, struct bgp *bgp, as_t local_as,
 
 /* Make accept BGP peer.  Called from bgp_accept (). */
 struct peer *
-peer_create_accept (struct bgp *bgp)
+peer_create_accept (struct bgp *bgp, union sockunion *su)
 {
   struct peer *peer;
 
   peer = peer_new (bgp);
+  peer->su = *su;
   
   peer = peer_lock (peer); /* bgp peer list reference */
   listnode_add_sort (bgp->peer, peer);
+  hash_get (bgp->peerhash, peer, hash_alloc_intern);
 
   return peer;
 }
@@ -960,6 +992,8 @@ peer_as_change (struct peer *peer, as_t as)
 {
   struct peer *conf;
 
+  bgp_updgrp_invalidate (peer->bgp);
+
   /* Stop peer. */
   if (! CHECK_FLAG (peer->sflags, PEER_STATUS_GROUP))
     {
@@ -1310,6 +1344,7 @@ peer_delete (struct peer *peer)
   if (! CHECK_FLAG (peer->sflags, PEER_STATUS_GROUP)
       && (pn = listnode_lookup (bgp->peer, peer)))
     {
+      hash_release (bgp->peerhash, peer);
       peer_unlock (peer); /* bgp peer list reference */
       list_delete_node (bgp->peer, pn);
     }
@@ -1336,6 +1371,12 @@ peer_delete (struct peer *peer)
         bgp_table_finish (&peer->rib[afi][safi]);
 
   /* Buffers.  */
+  if (peer->rbuf)
+    {
+      stream_free (peer->rbuf);
+      peer->rbuf = NULL;
+    }
+
   if (peer->ibuf)
     {
       stream_free (peer->ibuf);
@@ -1866,6 +1907,8 @@ peer_group_bind (struct bgp *bgp, union sockunion *su,
   struct peer *peer;
   int first_member = 0;
 
+  bgp_updgrp_invalidate (bgp);
+
   /* Check peer group's address family.  */
   if (! group->conf->afc[afi][safi])
     return BGP_ERR_PEER_GROUP_AF_UNCONFIGURED;
@@ -2005,6 +2048,8 @@ int
 peer_group_unbind (struct bgp *bgp, struct peer *peer,
 		   struct peer_group *group, afi_t afi, safi_t safi)
 {
+  bgp_updgrp_invalidate (bgp);
+
   if (! peer->af_group[afi][safi])
       return 0;
 
@@ -2073,6 +2118,7 @@ bgp_create (as_t *as, const char *name)
 
   bgp->peer = list_new ();
   bgp->peer->cmp = (int (*)(void *, void *)) peer_cmp;
+  bgp->peerhash = hash_create (peer_hash_key, peer_hash_cmp);
 
   bgp->group = list_new ();
   bgp->group->cmp = (int (*)(void *, void *)) peer_group_cmp;
@@ -2096,6 +2142,7 @@ bgp_create (as_t *as, const char *name)
   bgp->restart_time = BGP_DEFAULT_RESTART_TIME;
   bgp->stalepath_time = BGP_DEFAULT_STALEPATH_TIME;
   bgp_flag_set (bgp, BGP_FLAG_LOG_NEIGHBOR_CHANGES);
+  bgp_updgrp_bgp_init (bgp);
 
   bgp->as = *as;
 
@@ -2321,7 +2368,13 @@ bgp_free (struct bgp *bgp)
 
   list_delete (bgp->group);
   list_delete (bgp->peer);
+  if (bgp->peerhash)
+    {
+      hash_clean (bgp->peerhash, NULL);
+      hash_free (bgp->peerhash);
+    }
   list_delete (bgp->rsclient);
+  bgp_updgrp_bgp_finish (bgp);
 
   if (bgp->name)
     free (bgp->name);
@@ -2339,28 +2392,42 @@ bgp_free (struct bgp *bgp)
   XFREE (MTYPE_BGP, bgp);
 }
 
+/* The peers of BGP with address SU one after the other, accept peers
+   included: the first if PREV is NULL, else the one after PREV. */
+struct peer *
+peer_lookup_next (struct bgp *bgp, union sockunion *su, struct peer *prev)
+{
+  return hash_lookup_key_next (bgp->peerhash, sockunion_hash (su),
+                               peer_hash_su_cmp, su, prev);
+}
+
+/* The configured peer of BGP with address SU. */
+static struct peer *
+peer_lookup_bgp (struct bgp *bgp, union sockunion *su)
+{
+  struct peer *peer;
+
+  for (peer = peer_lookup_next (bgp, su, NULL); peer;
+       peer = peer_lookup_next (bgp, su, peer))
+    if (! CHECK_FLAG (peer->sflags, PEER_STATUS_ACCEPT_PEER))
+      return peer;
+  return NULL;
+}
+
 struct peer *
 peer_lookup (struct bgp *bgp, union sockunion *su)
 {
   struct peer *peer;
-  struct listnode *node, *nnode;
 
   if (bgp != NULL)
-    {
-      for (ALL_LIST_ELEMENTS (bgp->peer, node, nnode, peer))
-        if (sockunion_same (&peer->su, su)
-            && ! CHECK_FLAG (peer->sflags, PEER_STATUS_ACCEPT_PEER))
-          return peer;
-    }
+    return peer_lookup_bgp (bgp, su);
   else if (bm->bgp != NULL)
     {
       struct listnode *bgpnode, *nbgpnode;
   
       for (ALL_LIST_ELEMENTS (bm->bgp, bgpnode, nbgpnode, bgp))
-        for (ALL_LIST_ELEMENTS (bgp->peer, node, nnode, peer))
-          if (sockunion_same (&peer->su, su)
-              && ! CHECK_FLAG (peer->sflags, PEER_STATUS_ACCEPT_PEER))
-            return peer;
+        if ((peer = peer_lookup_bgp (bgp, su)) != NULL)
+          return peer;
     }
   return NULL;
 }
@@ -2370,40 +2437,23 @@ peer_lookup_with_open (union sockunion *su, as_t remote_as,
 		       struct in_addr *remote_id, int *as)
 {
   struct peer *peer;
-  struct listnode *node;
   struct listnode *bgpnode;
   struct bgp *bgp;
 
   if (! bm->bgp)
     return NULL;
 
+  /* An instance has one configured peer for an address at most. */
   for (ALL_LIST_ELEMENTS_RO (bm->bgp, bgpnode, bgp))
     {
-      for (ALL_LIST_ELEMENTS_RO (bgp->peer, node, peer))
-        {
-          if (sockunion_same (&peer->su, su)
-              && ! CHECK_FLAG (peer->sflags, PEER_STATUS_ACCEPT_PEER))
-            {
-              if (peer->as == remote_as
-                  && peer->remote_id.s_addr == remote_id->s_addr)
-                return peer;
-              if (peer->as == remote_as)
-                *as = 1;
-            }
-        }
+      peer = peer_lookup_bgp (bgp, su);
+      if (! peer || peer->as != remote_as)
+        continue;
 
-      for (ALL_LIST_ELEMENTS_RO (bgp->peer, node, peer))
-        {
-          if (sockunion_same (&peer->su, su)
-              &&  ! CHECK_FLAG (peer->sflags, PEER_STATUS_ACCEPT_PEER))
-            {
-              if (peer->as == remote_as
-                  && peer->remote_id.s_addr == 0)
-                return peer;
-              if (peer->as == remote_as)
-                *as = 1;
-            }
-        }
+      *as = 1;
+      if (peer->remote_id.s_addr == remote_id->s_addr
+          || peer->remote_id.s_addr == 0)
+        return peer;
     }
   return NULL;
 }
@@ -2633,6 +2683,8 @@ peer_flag_modify (struct peer *peer, u_int32_t flag, int set)
   struct listnode *node, *nnode;
   struct peer_flag_action action;
 
+  bgp_updgrp_invalidate (peer->bgp);
+
   memset (&action, 0, sizeof (struct peer_flag_action));
   size = sizeof peer_flag_action_list / sizeof (struct peer_flag_action);
 
@@ -2736,6 +2788,8 @@ peer_af_flag_modify (struct peer *peer, afi_t afi, safi_t safi, u_int32_t flag,
   struct peer_group *group;
   struct peer_flag_action action;
 
+  bgp_updgrp_invalidate (peer->bgp);
+
   memset (&action, 0, sizeof (struct peer_flag_action));
   size = sizeof peer_af_flag_action_list / sizeof (struct peer_flag_action);
   
@@ -3603,6 +3657,8 @@ peer_local_as_set (struct peer *peer, as_t as, int no_prepend, int replace_as)
   struct peer_group *group;
   struct listnode *node, *nnode;
 
+  bgp_updgrp_invalidate (peer->bgp);
+
   if (peer_sort (peer) != BGP_PEER_EBGP
       && peer_sort (peer) != BGP_PEER_INTERNAL)
     return BGP_ERR_LOCAL_AS_ALLOWED_ONLY_FOR_EBGP;
@@ -3681,6 +3737,8 @@ peer_local_as_unset (struct peer *peer)
   struct peer_group *group;
   struct listnode *node, *nnode;
 
+  bgp_updgrp_invalidate (peer->bgp);
+
   if (peer_group_active (peer))
     return BGP_ERR_INVALID_FOR_PEER_GROUP_MEMBER;
 
@@ -3838,6 +3896,8 @@ peer_distribute_set (struct peer *peer, afi_t afi, safi_t safi, int direct,
   struct peer_group *group;
   struct listnode *node, *nnode;
 
+  bgp_updgrp_invalidate (peer->bgp);
+
   if (! peer->afc[afi][safi])
     return BGP_ERR_PEER_INACTIVE;
 
@@ -3885,6 +3945,8 @@ peer_distribute_unset (struct peer *peer, afi_t afi, safi_t safi, int direct)
   struct peer_group *group;
   struct listnode *node, *nnode;
 
+  bgp_updgrp_invalidate (peer->bgp);
+
   if (! peer->afc[afi][safi])
     return BGP_ERR_PEER_INACTIVE;
 
@@ -3998,6 +4060,8 @@ peer_prefix_list_set (struct peer *peer, afi_t afi, safi_t safi, int direct,
   struct peer_group *group;
   struct listnode *node, *nnode;
 
+  bgp_updgrp_invalidate (peer->bgp);
+
   if (! peer->afc[afi][safi])
     return BGP_ERR_PEER_INACTIVE;
 
@@ -4044,6 +4108,8 @@ peer_prefix_list_unset (struct peer *peer, afi_t afi, safi_t safi, int direct)
   struct peer_group *group;
   struct listnode *node, *nnode;
 
+  bgp_updgrp_invalidate (peer->bgp);
+
   if (! peer->afc[afi][safi])
     return BGP_ERR_PEER_INACTIVE;
 
@@ -4156,6 +4222,8 @@ peer_aslist_set (struct peer *peer, afi_t afi, safi_t safi, int direct,
   struct peer_group *group;
   struct listnode *node, *nnode;
 
+  bgp_updgrp_invalidate (peer->bgp);
+
   if (! peer->afc[afi][safi])
     return BGP_ERR_PEER_INACTIVE;
 
@@ -4199,6 +4267,8 @@ peer_aslist_unset (struct peer *peer,afi_t afi, safi_t safi, int direct)
   struct peer_group *group;
   struct listnode *node, *nnode;
 
+  bgp_updgrp_invalidate (peer->bgp);
+
   if (! peer->afc[afi][safi])
     return BGP_ERR_PEER_INACTIVE;
 
@@ -4311,6 +4381,8 @@ peer_route_map_set (struct peer *peer, afi_t afi, safi_t safi, int direct,
   struct peer_group *group;
   struct listnode *node, *nnode;
 
+  bgp_updgrp_invalidate (peer->bgp);
+
   if (! peer->afc[afi][safi])
     return BGP_ERR_PEER_INACTIVE;
 
@@ -4358,6 +4430,8 @@ peer_route_map_unset (struct peer *peer, afi_t afi, safi_t safi, int direct)
   struct peer_group *group;
   struct listnode *node, *nnode;
 
+  bgp_updgrp_invalidate (peer->bgp);
+
   if (! peer->afc[afi][safi])
     return BGP_ERR_PEER_INACTIVE;
 
@@ -4419,6 +4493,8 @@ peer_unsuppress_map_set (struct peer *peer, afi_t afi, safi_t safi,
   struct peer_group *group;
   struct listnode *node, *nnode;
 
+  bgp_updgrp_invalidate (peer->bgp);
+
   if (! peer->afc[afi][safi])
     return BGP_ERR_PEER_INACTIVE;
 
@@ -4460,6 +4536,8 @@ peer_unsuppress_map_unset (struct peer *peer, afi_t afi, safi_t safi)
   struct peer_group *group;
   struct listnode *node, *nnode;
 
+  bgp_updgrp_invalidate (peer->bgp);
+
   if (! peer->afc[afi][safi])
     return BGP_ERR_PEER_INACTIVE;
   
@@ -5336,6 +5414,13 @@ bgp_config_write (struct vty *vty)
       write++;
     }
 
+  /* BGP read quanta. */
+  if (bm->read_quanta != BGP_READ_QUANTA_DEFAULT)
+    {
+      vty_out (vty, "bgp read-quanta %u%s", bm->read_quanta, VTY_NEWLINE);
+      write++;
+    }
+
   /* BGP configuration. */
   for (ALL_LIST_ELEMENTS (bm->bgp, mnode, mnnode, bgp))
     {
@@ -5535,6 +5620,7 @@ bgp_master_init (void)
   bm->port = BGP_PORT_DEFAULT;
   bm->master = thread_master_create ();
   bm->start_time = bgp_clock ();
+  bm->read_quanta = BGP_READ_QUANTA_DEFAULT;
 }
 
 
@@ -5559,6 +5645,7 @@ bgp_init (void)
   bgp_route_map_init ();
   bgp_address_init ();
   bgp_scan_vty_init();
+  bgp_updgrp_init ();
   bgp_mplsvpn_init ();
   bgp_encap_init ();
 
@@ -5593,6 +5680,8 @@ bgp_terminate (void)
   struct listnode *node, *nnode;
   struct listnode *mnode, *mnnode;
 
+  bgp_io_terminate ();
+
   for (ALL_LIST_ELEMENTS (bm->bgp, mnode, mnnode, bgp))
     for (ALL_LIST_ELEMENTS (bgp->peer, node, nnode, peer))
       if (peer->status == Established)
@@ -23,6 +23,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 
 /* For union sockunion.  */
 #include "sockunion.h"
+#include "queue.h"
 
 /* Typedef BGP specific types.  */
 typedef u_int32_t as_t;
@@ -54,6 +55,9 @@ struct bgp_master
   /* BGP start time.  */
   time_t start_time;
 
+  /* Messages handled per peer before bgp_read yields.  */
+  u_int32_t read_quanta;
+
   /* Various BGP global configuration.  */
   u_char options;
 #define BGP_OPT_NO_FIB                   (1 << 0)
@@ -80,6 +84,9 @@ struct bgp
   /* BGP peer. */
   struct list *peer;
 
+  /* The same peers by address, accept peers included. */
+  struct hash *peerhash;
+
   /* BGP peer group.  */
   struct list *group;
 
@@ -179,6 +186,12 @@ struct bgp
     u_int16_t maxpaths_ebgp;
     u_int16_t maxpaths_ibgp;
   } maxpaths[AFI_MAX][SAFI_MAX];
+
+  /* Update groups, and the generation of the outbound configuration
+     they were worked out from. */
+  struct hash *updgrp_hash;
+  u_int32_t updgrp_gen;
+  u_int32_t updgrp_next_id;
 };
 
 /* BGP peer-group support. */
@@ -280,6 +293,14 @@ typedef enum
 
 #define BGP_MAX_PACKET_SIZE_OVERFLOW          1024
 
+/* What a walk over the RIB for a peer is for, see bgp_route.c. */
+enum bgp_walk_type
+{
+  BGP_WALK_ANNOUNCE,
+  BGP_WALK_SOFT_IN,
+  BGP_WALK_MAX
+};
+
 /* BGP neighbor structure. */
 struct peer
 {
@@ -317,11 +338,17 @@ struct peer
   /* Peer specific RIB when configured as route-server-client. */
   struct bgp_table *rib[AFI_MAX][SAFI_MAX];
 
-  /* Packet receive and send buffer. */
+  /* Packet receive and send buffer.  Bytes are read from the socket
+     into rbuf in large chunks, and each message is taken from there
+     into ibuf to be parsed. */
+  struct stream *rbuf;
   struct stream *ibuf;
   struct stream_fifo *obuf;
   struct stream *work;
 
+  /* The path attributes of the last UPDATE parsed. */
+  struct bgp_attr_cache *attr_cache;
+
   /* We use a separate stream to encode MP_REACH_NLRI for efficient
    * NLRI packing. peer->work stores all the other attributes. The
    * actual packet is then constructed by concatenating the two.
@@ -492,6 +519,16 @@ struct peer
   
   /* workqueues */
   struct work_queue *clear_node_queue;
+
+  /* Paths and adjacencies of the peer, wherever they are in the RIB,
+     so that clearing it does not have to look through whole tables. */
+  LIST_HEAD(, bgp_info) paths[AFI_MAX][SAFI_MAX];
+  LIST_HEAD(, bgp_adj_in) adj_in[AFI_MAX][SAFI_MAX];
+  LIST_HEAD(, bgp_adj_out) adj_out[AFI_MAX][SAFI_MAX];
+
+  /* Walks over the RIB done for this peer a bit at a time. */
+  struct bgp_walk *walk[AFI_MAX][SAFI_MAX][BGP_WALK_MAX];
+  struct thread *t_walk;
   
   /* Statistics field */
   u_int32_t open_in;		/* Open message input count */
@@ -507,6 +544,13 @@ struct peer
   u_int32_t refresh_out;	/* Route Refresh output count */
   u_int32_t dynamic_cap_in;	/* Dynamic Capability input count.  */
   u_int32_t dynamic_cap_out;	/* Dynamic Capability output count.  */
+  unsigned long read_calls;	/* Socket reads that returned data. */
+  unsigned long read_msgs;	/* Messages taken from the read buffer. */
+  unsigned long read_msgs_max;	/* Most messages handled in one wakeup. */
+  unsigned long read_yields;	/* Wakeups cut short by the read quanta. */
+  unsigned long holdtime_deferred; /* Hold timer expiries with input pending. */
+  unsigned long keepalive_io;	/* Keepalives sent by the I/O thread. */
+  unsigned long update_attr_reused; /* Updates with the last attributes. */
 
   /* BGP state count */
   u_int32_t established;	/* Established */
@@ -522,6 +566,13 @@ struct peer
   /* Announcement attribute hash.  */
   struct hash *hash[AFI_MAX][SAFI_MAX];
 
+  /* Session state shared with the I/O thread while Established. */
+  struct bgp_io_session *io;
+
+  /* Update group membership. */
+  struct update_group *updgrp[AFI_MAX][SAFI_MAX];
+  u_int32_t updgrp_gen[AFI_MAX][SAFI_MAX];
+
   /* Notify data. */
   struct bgp_notify notify;
 
@@ -849,6 +900,8 @@ extern struct bgp *bgp_get_default (void);
 extern struct bgp *bgp_lookup (as_t, const char *);
 extern struct bgp *bgp_lookup_by_name (const char *);
 extern struct peer *peer_lookup (struct bgp *, union sockunion *);
+extern struct peer *peer_lookup_next (struct bgp *, union sockunion *,
+                                      struct peer *);
 extern struct peer_group *peer_group_lookup (struct bgp *, const char *);
 extern struct peer_group *peer_group_get (struct bgp *, const char *);
 extern struct peer *peer_lookup_with_open (union sockunion *, as_t, struct in_addr *,
@@ -867,7 +920,7 @@ extern struct peer *peer_unlock_with_caller(const char *, struct peer *);
 extern bgp_peer_sort_t peer_sort (struct peer *peer);
 extern int peer_active (struct peer *);
 extern int peer_active_nego (struct peer *);
-extern struct peer *peer_create_accept (struct bgp *);
+extern struct peer *peer_create_accept (struct bgp *, union sockunion *);
 extern char *peer_uptime (time_t, char *, size_t);
 extern int bgp_config_write (struct vty *);
 extern void bgp_config_write_family_header (struct vty *, afi_t, safi_t, int *);
@@ -148,9 +148,20 @@ typedef enum fpm_msg_type_e_ {
    * FPM_MSG_TYPE_NETLINK messages are sent over a channel, then all
    * messages should be sized such that netlink alignment is
    * maintained.
+   *
+   * The payload may also hold several netlink messages back to back,
+   * if zebra is configured to batch updates ('fpm batch-updates').
+   * They are to be walked with NLMSG_OK()/NLMSG_NEXT() as usual.
    */
   FPM_MSG_TYPE_NETLINK = 1,
   FPM_MSG_TYPE_PROTOBUF = 2,
+
+  /*
+   * The payload is a protobuf fpm.MessageBatch, carrying several
+   * fpm.Message updates. Sent instead of FPM_MSG_TYPE_PROTOBUF when
+   * zebra is configured to batch updates.
+   */
+  FPM_MSG_TYPE_PROTOBUF_BATCH = 3,
 } fpm_msg_type_e;
 
 /*
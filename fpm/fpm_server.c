@@ -0,0 +1,635 @@
+/*
+ * Reference Forwarding Plane Manager.
+ *
+ * Accepts the connection from zebra, decodes the route updates it
+ * sends (netlink or protobuf, batched or not) into a shadow FIB and
+ * reports throughput.  Updates are grouped into bursts: a burst ends
+ * when nothing has arrived for the idle time, at which point a line
+ * like
+ *
+ *   burst: 311 routes (311 adds, 0 dels) in 4 msgs, 16264 bytes,
+ *   0.004 secs, 77750 routes/s, max gap 0.001 secs, fib 311,
+ *   last at 1476871280.123456
+ *
+ * is printed (on one line).  The max gap is the longest time between
+ * two messages of the burst, not how long an update took to get here:
+ * the FPM does not know when zebra was given a route.  What it gives
+ * instead is the wall clock time the last message arrived at, from
+ * which whoever made the change can work out the delay.  The shadow
+ * FIB can be dumped after each burst as well, which is what
+ * tests/testfpm relies on.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#include <poll.h>
+
+#include "memory.h"
+#include "prefix.h"
+#include "table.h"
+#include "nexthop.h"
+#include "network.h"
+
+#include "fpm/fpm.h"
+
+#ifdef HAVE_PROTOBUF
+#include "fpm/fpm_pb.h"
+#endif
+
+/* Pacify libzebra. */
+struct thread_master *master;
+
+#define FPMS_BUF_SIZE	(64 * 1024)
+
+/* A route in the shadow FIB. */
+struct fpms_route
+{
+  int nexthop_num;
+
+  /* First nexthop. */
+  union g_addr gate;
+  ifindex_t ifindex;
+};
+
+/* Counters for a burst of updates. */
+struct fpms_stats
+{
+  unsigned long msgs;
+  unsigned long bytes;
+  unsigned long adds;
+  unsigned long dels;
+  unsigned long errors;
+};
+
+static struct
+{
+  /* Options. */
+  int idle_msecs;
+  int dump;
+  int once;
+
+  struct route_table *fib[AFI_MAX];
+  unsigned long fib_count;
+
+  struct fpms_stats burst;
+  struct fpms_stats total;
+
+  /* Time of the first and the latest message of the burst, and the
+   * longest silence in between. */
+  struct timeval burst_start;
+  struct timeval burst_last;
+  double burst_max_gap;
+} fpms;
+
+static double
+fpms_elapsed (const struct timeval *from, const struct timeval *to)
+{
+  return (to->tv_sec - from->tv_sec) + (to->tv_usec - from->tv_usec) / 1e6;
+}
+
+static struct route_table *
+fpms_fib (u_char family)
+{
+  switch (family)
+    {
+    case AF_INET:
+      return fpms.fib[AFI_IP];
+    case AF_INET6:
+      return fpms.fib[AFI_IP6];
+    default:
+      return NULL;
+    }
+}
+
+static void
+fpms_route_add (struct prefix *p, int nexthop_num, union g_addr *gate,
+                ifindex_t ifindex)
+{
+  struct route_table *table;
+  struct route_node *rn;
+  struct fpms_route *route;
+
+  if ((table = fpms_fib (p->family)) == NULL)
+    {
+      fpms.burst.errors++;
+      return;
+    }
+
+  /* Replace semantics: an add carries the complete route. */
+  rn = route_node_get (table, p);
+  if ((route = rn->info) == NULL)
+    {
+      route = rn->info = XCALLOC (MTYPE_TMP, sizeof (struct fpms_route));
+      fpms.fib_count++;
+    }
+  else
+    route_unlock_node (rn);
+
+  route->nexthop_num = nexthop_num;
+  route->gate = *gate;
+  route->ifindex = ifindex;
+  fpms.burst.adds++;
+}
+
+static void
+fpms_route_del (struct prefix *p)
+{
+  struct route_table *table;
+  struct route_node *rn;
+
+  fpms.burst.dels++;
+
+  if ((table = fpms_fib (p->family)) == NULL
+      || (rn = route_node_lookup (table, p)) == NULL)
+    {
+      /* zebra only deletes what it has sent before. */
+      fpms.burst.errors++;
+      return;
+    }
+  route_unlock_node (rn);
+
+  if (rn->info)
+    {
+      XFREE (MTYPE_TMP, rn->info);
+      rn->info = NULL;
+      route_unlock_node (rn);
+      fpms.fib_count--;
+    }
+}
+
+#ifdef HAVE_NETLINK
+/* Read the first gateway and count the nexthops of an RTA_MULTIPATH
+ * attribute. */
+static int
+fpms_netlink_multipath (struct rtattr *rta, union g_addr *gate,
+                        ifindex_t *ifindex)
+{
+  struct rtnexthop *rtnh = RTA_DATA (rta);
+  int len = RTA_PAYLOAD (rta);
+  int num = 0;
+
+  while (RTNH_OK (rtnh, len))
+    {
+      if (num++ == 0)
+        {
+          struct rtattr *sub = RTNH_DATA (rtnh);
+          int sublen = rtnh->rtnh_len - sizeof (*rtnh);
+
+          *ifindex = rtnh->rtnh_ifindex;
+          for (; RTA_OK (sub, sublen); sub = RTA_NEXT (sub, sublen))
+            if (sub->rta_type == RTA_GATEWAY)
+              memcpy (gate, RTA_DATA (sub),
+                      MIN (RTA_PAYLOAD (sub), sizeof (*gate)));
+        }
+      len -= NLMSG_ALIGN (rtnh->rtnh_len);
+      rtnh = RTNH_NEXT (rtnh);
+    }
+  return num;
+}
+
+/* An FPM netlink message may hold several netlink messages. */
+static void
+fpms_decode_netlink (u_char *data, size_t len)
+{
+  struct nlmsghdr *n;
+  int nllen = len;
+
+  for (n = (struct nlmsghdr *) data; NLMSG_OK (n, nllen);
+       n = NLMSG_NEXT (n, nllen))
+    {
+      struct rtmsg *rtm = NLMSG_DATA (n);
+      struct rtattr *rta;
+      int rtlen = RTM_PAYLOAD (n);
+      struct prefix p;
+      union g_addr gate;
+      ifindex_t ifindex = 0;
+      int nexthop_num = 0;
+
+      if (n->nlmsg_type != RTM_NEWROUTE && n->nlmsg_type != RTM_DELROUTE)
+        {
+          fpms.burst.errors++;
+          continue;
+        }
+
+      memset (&p, 0, sizeof (p));
+      memset (&gate, 0, sizeof (gate));
+      p.family = rtm->rtm_family;
+      p.prefixlen = rtm->rtm_dst_len;
+
+      for (rta = RTM_RTA (rtm); RTA_OK (rta, rtlen);
+           rta = RTA_NEXT (rta, rtlen))
+        switch (rta->rta_type)
+          {
+          case RTA_DST:
+            memcpy (&p.u.prefix, RTA_DATA (rta),
+                    MIN (RTA_PAYLOAD (rta), sizeof (struct in6_addr)));
+            break;
+          case RTA_GATEWAY:
+            memcpy (&gate, RTA_DATA (rta),
+                    MIN (RTA_PAYLOAD (rta), sizeof (gate)));
+            nexthop_num = 1;
+            break;
+          case RTA_OIF:
+            ifindex = *(int *) RTA_DATA (rta);
+            nexthop_num = 1;
+            break;
+          case RTA_MULTIPATH:
+            nexthop_num = fpms_netlink_multipath (rta, &gate, &ifindex);
+            break;
+          }
+
+      if (n->nlmsg_type == RTM_NEWROUTE)
+        fpms_route_add (&p, nexthop_num, &gate, ifindex);
+      else
+        fpms_route_del (&p);
+    }
+}
+#endif /* HAVE_NETLINK */
+
+#ifdef HAVE_PROTOBUF
+static void
+fpms_decode_pb_message (Fpm__Message *msg)
+{
+  struct prefix p;
+  union g_addr gate;
+  uint ifindex = 0;
+  u_char family;
+
+  memset (&gate, 0, sizeof (gate));
+
+  switch (msg->type)
+    {
+    case FPM__MESSAGE__TYPE__ADD_ROUTE:
+      {
+        Fpm__AddRoute *add = msg->add_route;
+        Fpm__Nexthop *nh;
+
+        if (!add || !add->key || !add->key->prefix
+            || !qpb_address_family_get (add->address_family, &family))
+          break;
+
+        qpb_l3_prefix_get (add->key->prefix, family, &p);
+        if (add->n_nexthops)
+          {
+            nh = add->nexthops[0];
+            if (nh->address)
+              qpb_l3_address_get (nh->address, &family, &gate);
+            if (nh->if_id)
+              qpb_if_identifier_get (nh->if_id, &ifindex, NULL);
+          }
+        fpms_route_add (&p, add->n_nexthops, &gate, ifindex);
+        return;
+      }
+
+    case FPM__MESSAGE__TYPE__DELETE_ROUTE:
+      {
+        Fpm__DeleteRoute *del = msg->delete_route;
+
+        if (!del || !del->key || !del->key->prefix
+            || !qpb_address_family_get (del->address_family, &family))
+          break;
+
+        qpb_l3_prefix_get (del->key->prefix, family, &p);
+        fpms_route_del (&p);
+        return;
+      }
+
+    default:
+      break;
+    }
+
+  fpms.burst.errors++;
+}
+
+static void
+fpms_decode_protobuf (u_char *data, size_t len, int batch)
+{
+  if (batch)
+    {
+      Fpm__MessageBatch *mb;
+      size_t i;
+
+      if ((mb = fpm__message_batch__unpack (NULL, len, data)) == NULL)
+        {
+          fpms.burst.errors++;
+          return;
+        }
+      for (i = 0; i < mb->n_messages; i++)
+        fpms_decode_pb_message (mb->messages[i]);
+      fpm__message_batch__free_unpacked (mb, NULL);
+    }
+  else
+    {
+      Fpm__Message *msg;
+
+      if ((msg = fpm__message__unpack (NULL, len, data)) == NULL)
+        {
+          fpms.burst.errors++;
+          return;
+        }
+      fpms_decode_pb_message (msg);
+      fpm__message__free_unpacked (msg, NULL);
+    }
+}
+#endif /* HAVE_PROTOBUF */
+
+static void
+fpms_decode (fpm_msg_hdr_t *hdr)
+{
+  u_char *data = fpm_msg_data (hdr);
+  size_t len = fpm_msg_data_len (hdr);
+
+  switch (hdr->msg_type)
+    {
+#ifdef HAVE_NETLINK
+    case FPM_MSG_TYPE_NETLINK:
+      fpms_decode_netlink (data, len);
+      return;
+#endif /* HAVE_NETLINK */
+#ifdef HAVE_PROTOBUF
+    case FPM_MSG_TYPE_PROTOBUF:
+      fpms_decode_protobuf (data, len, 0);
+      return;
+    case FPM_MSG_TYPE_PROTOBUF_BATCH:
+      fpms_decode_protobuf (data, len, 1);
+      return;
+#endif /* HAVE_PROTOBUF */
+    default:
+      fpms.burst.errors++;
+      return;
+    }
+}
+
+static void
+fpms_dump (void)
+{
+  char buf[PREFIX_STRLEN], gbuf[INET6_ADDRSTRLEN];
+  struct route_node *rn;
+  struct fpms_route *route;
+  afi_t afi;
+
+  for (afi = AFI_IP; afi <= AFI_IP6; afi++)
+    for (rn = route_top (fpms.fib[afi]); rn; rn = route_next (rn))
+      {
+        if ((route = rn->info) == NULL)
+          continue;
+
+        printf ("route %s nexthops %d", prefix2str (&rn->p, buf, sizeof (buf)),
+                route->nexthop_num);
+        if (route->nexthop_num
+            && ! (rn->p.family == AF_INET ? route->gate.ipv4.s_addr == 0
+                  : IN6_IS_ADDR_UNSPECIFIED (&route->gate.ipv6)))
+          printf (" via %s", inet_ntop (rn->p.family, &route->gate, gbuf,
+                                        sizeof (gbuf)));
+        if (route->ifindex)
+          printf (" dev %u", route->ifindex);
+        printf ("\n");
+      }
+  printf ("end\n");
+}
+
+static void
+fpms_burst_end (void)
+{
+  struct fpms_stats *b = &fpms.burst;
+  double secs;
+
+  if (b->msgs == 0)
+    return;
+
+  secs = fpms_elapsed (&fpms.burst_start, &fpms.burst_last);
+  printf ("burst: %lu routes (%lu adds, %lu dels) in %lu msgs, %lu bytes, "
+          "%.3f secs, %.0f routes/s, max gap %.3f secs, fib %lu, "
+          "last at %ld.%06ld",
+          b->adds + b->dels, b->adds, b->dels, b->msgs, b->bytes, secs,
+          secs > 0 ? (b->adds + b->dels) / secs : 0.0, fpms.burst_max_gap,
+          fpms.fib_count, (long) fpms.burst_last.tv_sec,
+          (long) fpms.burst_last.tv_usec);
+  if (b->errors)
+    printf (", %lu errors", b->errors);
+  printf ("\n");
+
+  if (fpms.dump)
+    fpms_dump ();
+
+  fpms.total.msgs += b->msgs;
+  fpms.total.bytes += b->bytes;
+  fpms.total.adds += b->adds;
+  fpms.total.dels += b->dels;
+  fpms.total.errors += b->errors;
+  memset (b, 0, sizeof (*b));
+}
+
+/* Decode all complete messages in buf, returns the number of bytes
+ * consumed or -1 if the stream is corrupt. */
+static ssize_t
+fpms_read_msgs (u_char *buf, size_t len)
+{
+  size_t used = 0;
+
+  while (len - used >= FPM_MSG_HDR_LEN)
+    {
+      fpm_msg_hdr_t *hdr = (fpm_msg_hdr_t *) (buf + used);
+      size_t msg_len;
+      struct timeval now;
+      double gap;
+
+      if (hdr->version != FPM_PROTO_VERSION || !fpm_msg_hdr_ok (hdr))
+        return -1;
+
+      msg_len = fpm_msg_len (hdr);
+      if (len - used < msg_len)
+        break;
+
+      gettimeofday (&now, NULL);
+      if (fpms.burst.msgs == 0)
+        {
+          fpms.burst_start = now;
+          fpms.burst_max_gap = 0;
+        }
+      else if ((gap = fpms_elapsed (&fpms.burst_last, &now))
+               > fpms.burst_max_gap)
+        fpms.burst_max_gap = gap;
+      fpms.burst_last = now;
+
+      fpms.burst.msgs++;
+      fpms.burst.bytes += msg_len;
+      fpms_decode (hdr);
+      used += msg_len;
+    }
+  return used;
+}
+
+static void
+fpms_serve (int sock)
+{
+  static u_char buf[FPMS_BUF_SIZE];
+  size_t have = 0;
+
+  while (1)
+    {
+      struct pollfd pfd;
+      ssize_t n, used;
+
+      pfd.fd = sock;
+      pfd.events = POLLIN;
+      n = poll (&pfd, 1, fpms.burst.msgs ? fpms.idle_msecs : -1);
+      if (n < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          perror ("poll");
+          break;
+        }
+      if (n == 0)
+        {
+          fpms_burst_end ();
+          continue;
+        }
+
+      n = read (sock, buf + have, sizeof (buf) - have);
+      if (n < 0 && ERRNO_IO_RETRY (errno))
+        continue;
+      if (n <= 0)
+        break;
+      have += n;
+
+      if ((used = fpms_read_msgs (buf, have)) < 0)
+        {
+          printf ("malformed message, closing connection\n");
+          break;
+        }
+      memmove (buf, buf + used, have - used);
+      have -= used;
+    }
+  fpms_burst_end ();
+}
+
+static void
+fpms_clear_fib (void)
+{
+  struct route_node *rn;
+  afi_t afi;
+
+  for (afi = AFI_IP; afi <= AFI_IP6; afi++)
+    for (rn = route_top (fpms.fib[afi]); rn; rn = route_next (rn))
+      if (rn->info)
+        {
+          XFREE (MTYPE_TMP, rn->info);
+          rn->info = NULL;
+          route_unlock_node (rn);
+        }
+  fpms.fib_count = 0;
+}
+
+static void
+usage (const char *progname, int status)
+{
+  fprintf (status ? stderr : stdout,
+           "Usage: %s [-p port] [-i msecs] [-d] [-o]\n\n"
+           "Reference FPM: keeps a shadow FIB of the routes zebra sends.\n\n"
+           "-p  TCP port to listen on, 0 picks one (default %d)\n"
+           "-i  Idle time that ends a burst of updates (default 500ms)\n"
+           "-d  Dump the shadow FIB after each burst\n"
+           "-o  Exit when the first connection closes\n",
+           progname, FPM_DEFAULT_PORT);
+  exit (status);
+}
+
+int
+main (int argc, char **argv)
+{
+  struct sockaddr_in sin;
+  socklen_t sinlen = sizeof (sin);
+  int port = FPM_DEFAULT_PORT;
+  int lsock, sock, opt, on = 1;
+
+  fpms.idle_msecs = 500;
+
+  while ((opt = getopt (argc, argv, "p:i:doh")) != -1)
+    switch (opt)
+      {
+      case 'p':
+        port = atoi (optarg);
+        break;
+      case 'i':
+        fpms.idle_msecs = atoi (optarg);
+        break;
+      case 'd':
+        fpms.dump = 1;
+        break;
+      case 'o':
+        fpms.once = 1;
+        break;
+      case 'h':
+        usage (argv[0], 0);
+        break;
+      default:
+        usage (argv[0], 1);
+        break;
+      }
+
+  /* Output is often read by another program. */
+  setvbuf (stdout, NULL, _IOLBF, 0);
+
+  fpms.fib[AFI_IP] = route_table_init ();
+  fpms.fib[AFI_IP6] = route_table_init ();
+
+  if ((lsock = socket (AF_INET, SOCK_STREAM, 0)) < 0)
+    {
+      perror ("socket");
+      return 1;
+    }
+  setsockopt (lsock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof (on));
+
+  memset (&sin, 0, sizeof (sin));
+  sin.sin_family = AF_INET;
+  sin.sin_addr.s_addr = htonl (INADDR_ANY);
+  sin.sin_port = htons (port);
+  if (bind (lsock, (struct sockaddr *) &sin, sizeof (sin)) < 0
+      || listen (lsock, 1) < 0
+      || getsockname (lsock, (struct sockaddr *) &sin, &sinlen) < 0)
+    {
+      perror ("bind");
+      return 1;
+    }
+  printf ("listening on port %d\n", ntohs (sin.sin_port));
+
+  while ((sock = accept (lsock, NULL, NULL)) >= 0)
+    {
+      printf ("connected\n");
+      fpms_serve (sock);
+      close (sock);
+
+      printf ("disconnected: %lu routes (%lu adds, %lu dels) in %lu msgs, "
+              "%lu bytes, %lu errors\n", fpms.total.adds + fpms.total.dels,
+              fpms.total.adds, fpms.total.dels, fpms.total.msgs,
+              fpms.total.bytes, fpms.total.errors);
+      memset (&fpms.total, 0, sizeof (fpms.total));
+
+      /* zebra sends everything again when it reconnects. */
+      fpms_clear_fib ();
+
+      if (fpms.once)
+        break;
+    }
+
+  return 0;
+}
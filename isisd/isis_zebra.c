@@ -30,6 +30,7 @@
 #include "if.h"
 #include "network.h"
 #include "prefix.h"
+#include "table.h"
 #include "zclient.h"
 #include "stream.h"
 #include "linklist.h"
@@ -125,7 +126,7 @@ isis_zebra_if_del (int command, struct zclient *zclient, zebra_size_t length,
      in case there is configuration info attached to it. */
   if_delete_retain(ifp);
 
-  ifp->ifindex = IFINDEX_INTERNAL;
+  if_set_index (ifp, IFINDEX_INTERNAL);
 
   return 0;
 }
@@ -684,10 +685,56 @@ isis_zebra_redistribute_unset(int type)
     zclient_redistribute(ZEBRA_REDISTRIBUTE_DELETE, zclient, type, VRF_DEFAULT);
 }
 
+static void
+isis_zebra_unsync_table (struct route_table *table)
+{
+  struct route_node *rnode;
+  struct isis_route_info *rinfo;
+
+  if (! table)
+    return;
+
+  for (rnode = route_top (table); rnode; rnode = route_next (rnode))
+    if ((rinfo = rnode->info) != NULL)
+      UNSET_FLAG (rinfo->flag, ISIS_ROUTE_FLAG_ZEBRA_SYNCED);
+}
+
+/* Zebra lost our routes with the connection.  Mark them all unsynced
+ * and validate the areas again, which installs them, then tell zebra
+ * we are done, so that after a warm restart it can remove the IS-IS
+ * routes it kept and we no longer have. */
+static void
+isis_zebra_announce_all (void)
+{
+  struct listnode *node;
+  struct isis_area *area;
+  int level;
+
+  if (isis)
+    for (ALL_LIST_ELEMENTS_RO (isis->area_list, node, area))
+      {
+	for (level = 0; level < ISIS_LEVELS; level++)
+	  {
+	    isis_zebra_unsync_table (area->route_table[level]);
+#ifdef HAVE_IPV6
+	    isis_zebra_unsync_table (area->route_table6[level]);
+#endif
+	  }
+	isis_route_validate (area);
+      }
+
+  zclient_send_end_of_rib (zclient);
+}
+
 static void
 isis_zebra_connected (struct zclient *zclient)
 {
+  static int num_connects;
+
   zclient_send_requests (zclient, VRF_DEFAULT);
+
+  if (++num_connects > 1)
+    isis_zebra_announce_all ();
 }
 
 void
@@ -160,6 +160,32 @@ hash_lookup (struct hash *hash, void *data)
   return hash_get (hash, data, NULL);
 }
 
+/* Hash lookup by a key worked out elsewhere, for hashes holding
+   several items that CMP finds equal to ARG: the one after PREV, or
+   the first if PREV is NULL.  CMP is called with the hashed data and
+   ARG, which need not be of the same type. */
+void *
+hash_lookup_key_next (struct hash *hash, unsigned int key,
+		      int (*cmp) (const void *, const void *),
+		      const void *arg, const void *prev)
+{
+  struct hash_backet *backet;
+
+  for (backet = hash->index[key & (hash->size - 1)]; backet != NULL;
+       backet = backet->next)
+    {
+      if (prev)
+	{
+	  if (backet->data == prev)
+	    prev = NULL;
+	  continue;
+	}
+      if (backet->key == key && (*cmp) (backet->data, arg))
+	return backet->data;
+    }
+  return NULL;
+}
+
 /* Simple Bernstein hash which is simple and fast for common case */
 unsigned int string_hash_make (const char *str)
 {
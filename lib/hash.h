@@ -66,6 +66,9 @@ extern struct hash *hash_create_size (unsigned int, unsigned int (*) (void *),
 extern void *hash_get (struct hash *, void *, void * (*) (void *));
 extern void *hash_alloc_intern (void *);
 extern void *hash_lookup (struct hash *, void *);
+extern void *hash_lookup_key_next (struct hash *, unsigned int,
+				   int (*) (const void *, const void *),
+				   const void *, const void *);
 extern void *hash_release (struct hash *, void *);
 
 extern void hash_iterate (struct hash *, 
@@ -36,10 +36,77 @@
 #include "buffer.h"
 #include "str.h"
 #include "log.h"
+#include "hash.h"
+#include "jhash.h"
 
 /* List of interfaces in only the default VRF */
 struct list *iflist;
 
+/* Indexes of the interfaces of all VRFs by ifindex and by name, keyed
+ * with the VRF as well.  The VRF lists are kept for ordered walks.  An
+ * interface without an ifindex is only in the name index. */
+static struct hash *if_index_hash;
+static struct hash *if_name_hash;
+
+static unsigned int
+if_index_hash_key (void *arg)
+{
+  struct interface *ifp = arg;
+
+  return jhash_2words (ifp->ifindex, ifp->vrf_id, 0);
+}
+
+static int
+if_index_hash_cmp (const void *a, const void *b)
+{
+  const struct interface *ifp1 = a;
+  const struct interface *ifp2 = b;
+
+  return ifp1->ifindex == ifp2->ifindex && ifp1->vrf_id == ifp2->vrf_id;
+}
+
+static unsigned int
+if_name_hash_key (void *arg)
+{
+  struct interface *ifp = arg;
+
+  return jhash_1word (string_hash_make (ifp->name), ifp->vrf_id);
+}
+
+static int
+if_name_hash_cmp (const void *a, const void *b)
+{
+  const struct interface *ifp1 = a;
+  const struct interface *ifp2 = b;
+
+  return ifp1->vrf_id == ifp2->vrf_id && strcmp (ifp1->name, ifp2->name) == 0;
+}
+
+/* Take ifp out of an index, if it is what the index has for its key.
+ * On exit, the indexes are gone before the interfaces of the VRFs
+ * after the default one are deleted. */
+static void
+if_hash_remove (struct hash *hash, struct interface *ifp)
+{
+  if (hash && hash_lookup (hash, ifp) == ifp)
+    hash_release (hash, ifp);
+}
+
+/* Put ifp in the ifindex index.  Should an interface still hold on to
+ * the same ifindex, the newcomer takes its place. */
+static void
+if_index_hash_add (struct interface *ifp)
+{
+  struct interface *oifp;
+
+  oifp = hash_get (if_index_hash, ifp, hash_alloc_intern);
+  if (oifp != ifp)
+    {
+      hash_release (if_index_hash, oifp);
+      hash_get (if_index_hash, ifp, hash_alloc_intern);
+    }
+}
+
 /* One for each program.  This structure is needed to store hooks. */
 struct if_master
 {
@@ -128,7 +195,10 @@ if_create_vrf (const char *name, int namelen, vrf_id_t vrf_id)
   ifp->name[namelen] = '\0';
   ifp->vrf_id = vrf_id;
   if (if_lookup_by_name_vrf (ifp->name, vrf_id) == NULL)
-    listnode_add_sort (intf_list, ifp);
+    {
+      listnode_add_sort (intf_list, ifp);
+      hash_get (if_name_hash, ifp, hash_alloc_intern);
+    }
   else
     zlog_err("if_create(%s): corruption detected -- interface with this "
              "name exists already in VRF %u!", ifp->name, vrf_id);
@@ -163,6 +233,9 @@ void
 if_delete (struct interface *ifp)
 {
   listnode_delete (vrf_iflist (ifp->vrf_id), ifp);
+  if_hash_remove (if_name_hash, ifp);
+  if (ifp->ifindex != IFINDEX_INTERNAL)
+    if_hash_remove (if_index_hash, ifp);
 
   if_delete_retain(ifp);
 
@@ -173,6 +246,21 @@ if_delete (struct interface *ifp)
   XFREE (MTYPE_IF, ifp);
 }
 
+/* Change the ifindex of an interface, keeping the index in step.  All
+ * changes of ifindex after if_create() must go through here. */
+void
+if_set_index (struct interface *ifp, ifindex_t ifindex)
+{
+  if (ifp->ifindex == ifindex)
+    return;
+
+  if (ifp->ifindex != IFINDEX_INTERNAL)
+    if_hash_remove (if_index_hash, ifp);
+  ifp->ifindex = ifindex;
+  if (ifp->ifindex != IFINDEX_INTERNAL)
+    if_index_hash_add (ifp);
+}
+
 /* Add hook to interface master. */
 void
 if_add_hook (int type, int (*func)(struct interface *ifp))
@@ -193,15 +281,14 @@ if_add_hook (int type, int (*func)(struct interface *ifp))
 struct interface *
 if_lookup_by_index_vrf (ifindex_t ifindex, vrf_id_t vrf_id)
 {
-  struct listnode *node;
-  struct interface *ifp;
+  struct interface key;
 
-  for (ALL_LIST_ELEMENTS_RO (vrf_iflist (vrf_id), node, ifp))
-    {
-      if (ifp->ifindex == ifindex)
-	return ifp;
-    }
-  return NULL;
+  if (ifindex == IFINDEX_INTERNAL || ! if_index_hash)
+    return NULL;
+
+  key.ifindex = ifindex;
+  key.vrf_id = vrf_id;
+  return hash_lookup (if_index_hash, &key);
 }
 
 struct interface *
@@ -244,16 +331,10 @@ ifname2ifindex (const char *name)
 struct interface *
 if_lookup_by_name_vrf (const char *name, vrf_id_t vrf_id)
 {
-  struct listnode *node;
-  struct interface *ifp;
-  
-  if (name)
-    for (ALL_LIST_ELEMENTS_RO (vrf_iflist (vrf_id), node, ifp))
-      {
-        if (strcmp(name, ifp->name) == 0)
-          return ifp;
-      }
-  return NULL;
+  if (! name)
+    return NULL;
+
+  return if_lookup_by_name_len_vrf (name, strlen (name), vrf_id);
 }
 
 struct interface *
@@ -265,18 +346,15 @@ if_lookup_by_name (const char *name)
 struct interface *
 if_lookup_by_name_len_vrf (const char *name, size_t namelen, vrf_id_t vrf_id)
 {
-  struct listnode *node;
-  struct interface *ifp;
+  struct interface key;
 
-  if (namelen > INTERFACE_NAMSIZ)
+  if (namelen > INTERFACE_NAMSIZ || ! if_name_hash)
     return NULL;
 
-  for (ALL_LIST_ELEMENTS_RO (vrf_iflist (vrf_id), node, ifp))
-    {
-      if (!memcmp(name, ifp->name, namelen) && (ifp->name[namelen] == '\0'))
-	return ifp;
-    }
-  return NULL;
+  memcpy (key.name, name, namelen);
+  key.name[namelen] = '\0';
+  key.vrf_id = vrf_id;
+  return hash_lookup (if_name_hash, &key);
 }
 
 struct interface *
@@ -1043,6 +1121,12 @@ if_init (vrf_id_t vrf_id, struct list **intf_list)
 
   (*intf_list)->cmp = (int (*)(void *, void *))if_cmp_func;
 
+  if (! if_index_hash)
+    {
+      if_index_hash = hash_create (if_index_hash_key, if_index_hash_cmp);
+      if_name_hash = hash_create (if_name_hash_key, if_name_hash_cmp);
+    }
+
   if (vrf_id == VRF_DEFAULT)
     iflist = *intf_list;
 }
@@ -1066,6 +1150,18 @@ if_terminate (vrf_id_t vrf_id, struct list **intf_list)
 
   if (vrf_id == VRF_DEFAULT)
     iflist = NULL;
+
+  /* The indexes are shared by all VRFs.  The default VRF is only torn
+   * down on exit, so they go with it. */
+  if (vrf_id == VRF_DEFAULT && if_index_hash)
+    {
+      hash_clean (if_index_hash, NULL);
+      hash_free (if_index_hash);
+      if_index_hash = NULL;
+      hash_clean (if_name_hash, NULL);
+      hash_free (if_name_hash);
+      if_name_hash = NULL;
+    }
 }
 
 const char *
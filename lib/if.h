@@ -267,6 +267,7 @@ struct connected
 #define ZEBRA_IFC_REAL         (1 << 0)
 #define ZEBRA_IFC_CONFIGURED   (1 << 1)
 #define ZEBRA_IFC_QUEUED       (1 << 2)
+#define ZEBRA_IFC_STALE        (1 << 3)
   /*
      The ZEBRA_IFC_REAL flag should be set if and only if this address
      exists in the kernel and is actually usable. (A case where it exists but
@@ -276,6 +277,8 @@ struct connected
      The ZEBRA_IFC_QUEUED flag should be set if and only if the address exists
      in the kernel. It may and should be set although the address might not be
      usable yet. (compare with ZEBRA_IFC_REAL)
+     The ZEBRA_IFC_STALE flag is used by zebra while re-reading the kernel's
+     addresses, it marks addresses not seen again yet.
    */
 
   /* Flags for connected address. */
@@ -412,6 +415,7 @@ extern int if_is_loopback (struct interface *);
 extern int if_is_broadcast (struct interface *);
 extern int if_is_pointopoint (struct interface *);
 extern int if_is_multicast (struct interface *);
+extern void if_set_index (struct interface *, ifindex_t);
 extern void if_add_hook (int, int (*)(struct interface *));
 extern void if_init (vrf_id_t, struct list **);
 extern void if_terminate (vrf_id_t, struct list **);
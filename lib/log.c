@@ -899,6 +899,10 @@ static const struct zebra_desc_table command_types[] = {
   DESC_ENTRY	(ZEBRA_NEXTHOP_REGISTER),
   DESC_ENTRY	(ZEBRA_NEXTHOP_UNREGISTER),
   DESC_ENTRY	(ZEBRA_NEXTHOP_UPDATE),
+  DESC_ENTRY	(ZEBRA_IPV4_ROUTE_ADD_MULTI),
+  DESC_ENTRY	(ZEBRA_IPV6_ROUTE_ADD_MULTI),
+  DESC_ENTRY	(ZEBRA_SHM_RING_SETUP),
+  DESC_ENTRY	(ZEBRA_END_OF_RIB),
 };
 #undef DESC_ENTRY
 
@@ -73,6 +73,7 @@ struct memory_list memory_list_lib[] =
   { MTYPE_VRF_NAME,		"VRF name"			},
   { MTYPE_VRF_BITMAP,		"VRF bit-map"			},
   { MTYPE_IF_LINK_PARAMS,       "Informational Link Parameters" },
+  { MTYPE_ZRING,		"ZAPI shared memory ring"	},
   { -1, NULL },
 };
 
@@ -103,6 +104,7 @@ struct memory_list memory_list_bgp[] =
   { MTYPE_PEER_PASSWORD,	"Peer password string"		},
   { MTYPE_ATTR,			"BGP attribute"			},
   { MTYPE_ATTR_EXTRA,		"BGP extra attributes"		},
+  { MTYPE_BGP_ATTR_CACHE,	"BGP last attributes of a peer"	},
   { MTYPE_AS_PATH,		"BGP aspath"			},
   { MTYPE_AS_SEG,		"BGP aspath seg"		},
   { MTYPE_AS_SEG_DATA,		"BGP aspath segment data"	},
@@ -124,6 +126,7 @@ struct memory_list memory_list_bgp[] =
   { MTYPE_AS_LIST,		"BGP AS list"			},
   { MTYPE_AS_FILTER,		"BGP AS filter"			},
   { MTYPE_AS_FILTER_STR,	"BGP AS filter str"		},
+  { MTYPE_AS_LIST_CACHE,	"BGP AS list cache"		},
   { 0, NULL },
   { MTYPE_COMMUNITY,		"community"			},
   { MTYPE_COMMUNITY_VAL,	"community val"			},
@@ -138,12 +141,15 @@ struct memory_list memory_list_bgp[] =
   { MTYPE_COMMUNITY_LIST_ENTRY,	"community-list entry"		},
   { MTYPE_COMMUNITY_LIST_CONFIG,  "community-list config"	},
   { MTYPE_COMMUNITY_LIST_HANDLER, "community-list handler"	},
+  { MTYPE_COMMUNITY_LIST_CACHE,	"community-list cache"		},
   { 0, NULL },
   { MTYPE_CLUSTER,		"Cluster list"			},
   { MTYPE_CLUSTER_VAL,		"Cluster list val"		},
   { 0, NULL },
   { MTYPE_BGP_PROCESS_QUEUE,	"BGP Process queue"		},
   { MTYPE_BGP_CLEAR_NODE_QUEUE, "BGP node clear queue"		},
+  { MTYPE_BGP_WALK,		"BGP table walk"		},
+  { MTYPE_BGP_DMED,		"BGP deterministic-MED paths"	},
   { 0, NULL },
   { MTYPE_TRANSIT,		"BGP transit attr"		},
   { MTYPE_TRANSIT_VAL,		"BGP transit val"		},
@@ -156,7 +162,12 @@ struct memory_list memory_list_bgp[] =
   { MTYPE_BGP_DAMP_ARRAY,	"BGP Dampening array"		},
   { MTYPE_BGP_REGEXP,		"BGP regexp"			},
   { MTYPE_BGP_AGGREGATE,	"BGP aggregate"			},
+  { MTYPE_BGP_AGGREGATE_PATH,	"BGP aggregated route"		},
+  { MTYPE_BGP_AGGREGATE_REF,	"BGP aggregated attribute"	},
   { MTYPE_BGP_ADDR,		"BGP own address"		},
+  { MTYPE_BGP_UPDGRP,		"BGP update group"		},
+  { MTYPE_BGP_UPDGRP_ENC,	"BGP update group encoding"	},
+  { MTYPE_BGP_IO_SESSION,	"BGP I/O thread session"	},
   { MTYPE_ENCAP_TLV,		"ENCAP TLV",			},
   { MTYPE_LCOMMUNITY,           "Large Community",              },
   { MTYPE_LCOMMUNITY_STR,       "Large Community str",          },
@@ -864,6 +864,42 @@ route_map_apply (struct route_map *map, struct prefix *prefix,
   return RMAP_DENYMATCH;
 }
 
+/* Call func with the name and argument of every match and set rule of
+   the map, following "call" to other route-maps, until it returns
+   non-zero.  Returns the value func returned, or 0.  Lets a daemon
+   find out whether the result of a map depends on things other than
+   the route itself. */
+int
+route_map_rule_walk (struct route_map *map,
+                     int (*func) (const char *, const char *, void *),
+                     void *arg)
+{
+  static int recursion = 0;
+  struct route_map_index *index;
+  struct route_map_rule *rule;
+  int ret = 0;
+
+  if (map == NULL || recursion > RMAP_RECURSION_LIMIT)
+    return 0;
+
+  for (index = map->head; index && ! ret; index = index->next)
+    {
+      for (rule = index->match_list.head; rule && ! ret; rule = rule->next)
+        ret = (*func) (rule->cmd->str, rule->rule_str, arg);
+      for (rule = index->set_list.head; rule && ! ret; rule = rule->next)
+        ret = (*func) (rule->cmd->str, rule->rule_str, arg);
+
+      if (! ret && index->nextrm)
+        {
+          recursion++;
+          ret = route_map_rule_walk (route_map_lookup_by_name (index->nextrm),
+                                     func, arg);
+          recursion--;
+        }
+    }
+  return ret;
+}
+
 void
 route_map_add_hook (void (*func) (const char *))
 {
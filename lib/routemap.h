@@ -194,6 +194,12 @@ extern route_map_result_t route_map_apply (struct route_map *map,
                                            route_map_object_t object_type,
                                            void *object);
 
+/* Walk the match and set rules of a route map. */
+extern int route_map_rule_walk (struct route_map *map,
+                                int (*func) (const char *, const char *,
+                                             void *),
+                                void *arg);
+
 extern void route_map_add_hook (void (*func) (const char *));
 extern void route_map_delete_hook (void (*func) (const char *));
 extern void route_map_event_hook (void (*func) (route_map_event_t, const char *));
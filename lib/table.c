@@ -288,6 +288,17 @@ route_node_lookup (const struct route_table *table, const struct prefix *p)
 /* Add node to routing table. */
 struct route_node *
 route_node_get (struct route_table *const table, const struct prefix *p)
+{
+  return route_node_get_hint (table, p, NULL);
+}
+
+/* As route_node_get, but starting the descent at HINT, a node of the
+   table close to P, such as the one got for the previous of a sorted
+   run of prefixes.  The nodes covering P are all on its path from the
+   top, so the descent may start at the nearest of them above HINT. */
+struct route_node *
+route_node_get_hint (struct route_table *const table, const struct prefix *p,
+                     struct route_node *hint)
 {
   struct route_node *new;
   struct route_node *node;
@@ -295,8 +306,20 @@ route_node_get (struct route_table *const table, const struct prefix *p)
   u_char prefixlen = p->prefixlen;
   const u_char *prefix = &p->u.prefix;
 
-  match = NULL;
-  node = table->top;
+  while (hint && ! (hint->p.prefixlen <= prefixlen
+                    && prefix_match (&hint->p, p)))
+    hint = hint->parent;
+
+  if (hint)
+    {
+      match = hint->parent;
+      node = hint;
+    }
+  else
+    {
+      match = NULL;
+      node = table->top;
+    }
   while (node && node->p.prefixlen <= prefixlen &&
 	 prefix_match (&node->p, p))
     {
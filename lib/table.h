@@ -149,6 +149,9 @@ extern struct route_node *route_next_until (struct route_node *,
                                             struct route_node *);
 extern struct route_node *route_node_get (struct route_table *const,
                                           const struct prefix *);
+extern struct route_node *route_node_get_hint (struct route_table *const,
+                                               const struct prefix *,
+                                               struct route_node *);
 extern struct route_node *route_node_lookup (const struct route_table *,
                                              const struct prefix *);
 extern struct route_node *route_lock_node (struct route_node *node);
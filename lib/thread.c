@@ -1263,11 +1263,18 @@ thread_consumed_time (RUSAGE_T *now, RUSAGE_T *start, unsigned long *cputime)
 int
 thread_should_yield (struct thread *thread)
 {
-  quagga_get_relative (NULL);
-  unsigned long t = timeval_elapsed(relative_time, thread->real);
+  unsigned long t = thread_elapsed (thread);
   return ((t > THREAD_YIELD_TIME_SLOT) ? t : 0);
 }
 
+/* Wall clock time since the thread was called, in microseconds. */
+unsigned long
+thread_elapsed (struct thread *thread)
+{
+  quagga_get_relative (NULL);
+  return timeval_elapsed (relative_time, thread->real);
+}
+
 void
 thread_getrusage (RUSAGE_T *r)
 {
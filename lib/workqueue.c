@@ -38,6 +38,11 @@ static struct list *work_queues = &_work_queues;
 
 #define WORK_QUEUE_MIN_GRANULARITY 1
 
+/* for adaptive queues: checks whether to yield per time slot, and the
+ * weight of the past in the average cost of an item */
+#define WQ_YIELD_CHECKS 4
+#define WQ_COST_WEIGHT 4
+
 static struct work_queue_item *
 work_queue_item_new (struct work_queue *wq)
 {
@@ -254,7 +259,7 @@ work_queue_run (struct thread *thread)
 {
   struct work_queue *wq;
   struct work_queue_item *item;
-  unsigned long took;
+  unsigned long took = 0;
   wq_item_status ret;
   unsigned int cycles = 0;
   struct listnode *node, *nnode;
@@ -367,8 +372,30 @@ stats:
   if (took > wq->worst_usec)
     wq->worst_usec = took;
     
+  /* granularity from the cost of an item: check a few times per time
+   * slot whether to yield.  The cost follows the items the queue gets,
+   * where the yielded counts above only ever go down.
+   */
+  if (wq->spec.adaptive)
+    {
+      if (cycles > 0)
+        {
+          unsigned long cost = thread_elapsed (thread) * 1000 / cycles;
+          unsigned long gran;
+
+          if (wq->cycles.item_nsec)
+            cost = (wq->cycles.item_nsec * (WQ_COST_WEIGHT - 1) + cost)
+                   / WQ_COST_WEIGHT;
+          wq->cycles.item_nsec = cost;
+
+          gran = (THREAD_YIELD_TIME_SLOT * 1000 / WQ_YIELD_CHECKS)
+                 / MAX (cost, 1);
+          wq->cycles.granularity = MIN (MAX (gran, WORK_QUEUE_MIN_GRANULARITY),
+                                        UINT_MAX);
+        }
+    }
   /* we yielded, check whether granularity should be reduced */
-  if (yielded && (cycles < wq->cycles.granularity))
+  else if (yielded && (cycles < wq->cycles.granularity))
     {
       wq->cycles.granularity = ((cycles > 0) ? cycles 
                                              : WORK_QUEUE_MIN_GRANULARITY);
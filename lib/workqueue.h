@@ -84,6 +84,10 @@ struct work_queue
     unsigned int max_retries;	
 
     unsigned int hold;	/* hold time for first run, in ms */
+
+    /* work out the granularity from the measured cost of an item,
+     * rather than from the runs that had to yield, optional */
+    unsigned int adaptive;
   } spec;
   
   /* remaining fields should be opaque to users */
@@ -96,6 +100,7 @@ struct work_queue
     unsigned int worst;
     unsigned int granularity;
     unsigned long total;
+    unsigned long item_nsec;	/* running average cost of an item */
   } cycles;	/* cycle counts */
   
   /* private state */
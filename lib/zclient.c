@@ -32,6 +32,7 @@
 #include "zclient.h"
 #include "memory.h"
 #include "table.h"
+#include "zring.h"
 
 /* Zebra client events. */
 enum event {ZCLIENT_SCHEDULE, ZCLIENT_READ, ZCLIENT_CONNECT};
@@ -53,6 +54,9 @@ zclient_new (struct thread_master *master)
 
   zclient->ibuf = stream_new (ZEBRA_MAX_PACKET_SIZ);
   zclient->obuf = stream_new (ZEBRA_MAX_PACKET_SIZ);
+  zclient->batch = stream_new (ZEBRA_MAX_PACKET_SIZ);
+  zclient->batch_attr = stream_new (ZEBRA_MAX_PACKET_SIZ);
+  zclient->ring_backlog = stream_fifo_new ();
   zclient->wb = buffer_new(0);
   zclient->master = master;
 
@@ -71,6 +75,12 @@ zclient_free (struct zclient *zclient)
     stream_free(zclient->ibuf);
   if (zclient->obuf)
     stream_free(zclient->obuf);
+  if (zclient->batch)
+    stream_free(zclient->batch);
+  if (zclient->batch_attr)
+    stream_free(zclient->batch_attr);
+  if (zclient->ring_backlog)
+    stream_fifo_free(zclient->ring_backlog);
   if (zclient->wb)
     buffer_free(zclient->wb);
 
@@ -121,10 +131,25 @@ zclient_stop (struct zclient *zclient)
   THREAD_OFF(zclient->t_read);
   THREAD_OFF(zclient->t_connect);
   THREAD_OFF(zclient->t_write);
+  THREAD_OFF(zclient->t_batch);
+  THREAD_OFF(zclient->t_ring);
+
+  /* Drop the shared memory ring, zebra unmaps its side on close. */
+  if (zclient->ring)
+    {
+      zring_free (zclient->ring);
+      zclient->ring = NULL;
+    }
+  stream_fifo_clean (zclient->ring_backlog);
 
   /* Reset streams. */
   stream_reset(zclient->ibuf);
   stream_reset(zclient->obuf);
+  stream_reset(zclient->batch);
+  zclient->batch_count = 0;
+
+  /* Whatever zebra we talk to next has to tell us again. */
+  zclient->capabilities = 0;
 
   /* Empty the write buffer. */
   buffer_reset(zclient->wb);
@@ -278,13 +303,146 @@ zclient_flush_data(struct thread *thread)
   return 0;
 }
 
-int
-zclient_send_message(struct zclient *zclient)
+/* Move messages which did not fit into the ring earlier, once zebra
+   signals that it made room. */
+static int
+zclient_ring_flush (struct thread *thread)
 {
-  if (zclient->sock < 0)
-    return -1;
-  switch (buffer_write(zclient->wb, zclient->sock, STREAM_DATA(zclient->obuf),
-		       stream_get_endp(zclient->obuf)))
+  struct zclient *zclient = THREAD_ARG (thread);
+  struct stream *s;
+
+  zclient->t_ring = NULL;
+  zring_eventfd_clear (zclient->ring->efd_space);
+
+  while ((s = stream_fifo_head (zclient->ring_backlog)) != NULL)
+    {
+      if (zring_write (zclient->ring, STREAM_DATA (s),
+		       stream_get_endp (s)) < 0)
+	break;
+      stream_free (stream_fifo_pop (zclient->ring_backlog));
+    }
+  zring_doorbell (zclient->ring);
+
+  if (stream_fifo_head (zclient->ring_backlog))
+    zclient->t_ring = thread_add_read (zclient->master, zclient_ring_flush,
+				       zclient, zclient->ring->efd_space);
+  return 0;
+}
+
+static int
+zclient_ring_write (struct zclient *zclient, struct stream *s)
+{
+  if (stream_fifo_head (zclient->ring_backlog) == NULL
+      && zring_write (zclient->ring, STREAM_DATA (s),
+		      stream_get_endp (s)) == 0)
+    {
+      zring_doorbell (zclient->ring);
+      return 0;
+    }
+
+  /* Ring is full, keep the message until zebra catches up. */
+  stream_fifo_push (zclient->ring_backlog, stream_dup (s));
+  if (! zclient->t_ring)
+    zclient->t_ring = thread_add_read (zclient->master, zclient_ring_flush,
+				       zclient, zclient->ring->efd_space);
+  return 0;
+}
+
+/* Offer zebra a shared memory ring for the messages we send it.  The
+   ring's descriptors travel with the setup message, and everything we
+   write after it goes through the ring instead of the socket.  zebra
+   closes the connection if it cannot use the ring, after which we
+   reconnect and carry on over the socket. */
+static void
+zclient_ring_setup (struct zclient *zclient)
+{
+  struct zring *ring;
+  struct stream *s;
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  union
+  {
+    char buf[CMSG_SPACE (3 * sizeof (int))];
+    struct cmsghdr align;
+  } u;
+  int *fds;
+  ssize_t nbytes;
+  size_t len;
+
+  if (zclient->ring)
+    return;
+
+  /* Data queued on the socket must reach zebra before the ring does. */
+  if (zclient->batch_count && zclient_batch_flush (zclient) < 0)
+    return;
+  if (! buffer_empty (zclient->wb))
+    {
+      if (zclient_debug)
+	zlog_debug ("zclient: socket busy, not setting up ring");
+      return;
+    }
+
+  if ((ring = zring_create (ZRING_SIZE_DEFAULT)) == NULL)
+    return;
+
+  s = zclient->obuf;
+  stream_reset (s);
+  zclient_create_header (s, ZEBRA_SHM_RING_SETUP, VRF_DEFAULT);
+  stream_putl (s, ring->size);
+  stream_putw_at (s, 0, stream_get_endp (s));
+  len = stream_get_endp (s);
+
+  memset (&msg, 0, sizeof (msg));
+  memset (&u, 0, sizeof (u));
+  iov.iov_base = STREAM_DATA (s);
+  iov.iov_len = len;
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = u.buf;
+  msg.msg_controllen = sizeof (u.buf);
+
+  cmsg = CMSG_FIRSTHDR (&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN (3 * sizeof (int));
+  fds = (int *) CMSG_DATA (cmsg);
+  fds[0] = ring->memfd;
+  fds[1] = ring->efd_data;
+  fds[2] = ring->efd_space;
+
+  nbytes = sendmsg (zclient->sock, &msg, 0);
+  if (nbytes < 0)
+    {
+      zlog_warn ("%s: sendmsg failed on zclient fd %d: %s",
+		 __func__, zclient->sock, safe_strerror (errno));
+      zring_free (ring);
+      if (! ERRNO_IO_RETRY (errno))
+	zclient_failed (zclient);
+      return;
+    }
+
+  /* The descriptors went with the first byte, queue whatever is left. */
+  if ((size_t) nbytes < len
+      && buffer_write (zclient->wb, zclient->sock, STREAM_DATA (s) + nbytes,
+		       len - nbytes) == BUFFER_PENDING)
+    THREAD_WRITE_ON (zclient->master, zclient->t_write,
+		     zclient_flush_data, zclient, zclient->sock);
+
+  if (zclient_debug)
+    zlog_debug ("zclient: sending messages through %u byte ring",
+		ring->size);
+  zclient->ring = ring;
+}
+
+static int
+zclient_write (struct zclient *zclient, struct stream *s)
+{
+  if (zclient->ring)
+    return zclient_ring_write (zclient, s);
+
+  switch (buffer_write(zclient->wb, zclient->sock, STREAM_DATA(s),
+		       stream_get_endp(s)))
     {
     case BUFFER_ERROR:
       zlog_warn("%s: buffer_write failed to zclient fd %d, closing",
@@ -302,6 +460,120 @@ zclient_send_message(struct zclient *zclient)
   return 0;
 }
 
+int
+zclient_send_message(struct zclient *zclient)
+{
+  if (zclient->sock < 0)
+    return -1;
+
+  /* Batched routes queued earlier must reach zebra first. */
+  if (zclient->batch_count && zclient_batch_flush (zclient) < 0)
+    return -1;
+
+  return zclient_write (zclient, zclient->obuf);
+}
+
+/* Send the pending batched route message, if any. */
+int
+zclient_batch_flush (struct zclient *zclient)
+{
+  struct stream *s = zclient->batch;
+  int ret;
+
+  if (! zclient->batch_count)
+    return 0;
+
+  THREAD_OFF (zclient->t_batch);
+
+  /* Fill in prefix count and length. */
+  stream_putw_at (s, zclient->batch_attr_len, zclient->batch_count);
+  stream_putw_at (s, 0, stream_get_endp (s));
+  zclient->batch_count = 0;
+
+  if (zclient->sock < 0)
+    ret = -1;
+  else
+    ret = zclient_write (zclient, s);
+
+  stream_reset (s);
+  return ret;
+}
+
+static int
+zclient_batch_flush_event (struct thread *thread)
+{
+  struct zclient *zclient = THREAD_ARG (thread);
+
+  zclient->t_batch = NULL;
+  zclient_batch_flush (zclient);
+  return 0;
+}
+
+/* Start encoding a batched route.  The returned stream holds the header
+   for command; the caller appends the route's shared attributes and
+   then hands the prefix to zclient_batch_add(). */
+struct stream *
+zclient_batch_start (struct zclient *zclient, uint16_t command,
+                     vrf_id_t vrf_id)
+{
+  struct stream *s = zclient->batch_attr;
+
+  stream_reset (s);
+  zclient_create_header (s, command, vrf_id);
+  return s;
+}
+
+/* Queue prefix, sharing the attributes encoded in zclient->batch_attr.
+ *
+ *  0 1 2 3 4 5 6 7 8 9 A B C D E F 0 1 2 3 4 5 6 7 8 9 A B C D E F
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |   Header, shared attributes as per zclient_batch_start()      |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |        Prefix count           | Prefix length |  Prefix ...   |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ */
+int
+zclient_batch_add (struct zclient *zclient, struct prefix *p)
+{
+  struct stream *s = zclient->batch;
+  struct stream *attr = zclient->batch_attr;
+  size_t attr_len = stream_get_endp (attr);
+  size_t psize = PSIZE (p->prefixlen);
+
+  if (zclient->sock < 0)
+    return -1;
+
+  /* Can this prefix join the pending message? */
+  if (zclient->batch_count
+      && (zclient->batch_attr_len != attr_len
+          || memcmp (STREAM_DATA (s), STREAM_DATA (attr), attr_len)
+          || STREAM_WRITEABLE (s) < 1 + psize
+          || zclient->batch_count == UINT16_MAX))
+    if (zclient_batch_flush (zclient) < 0)
+      return -1;
+
+  if (! zclient->batch_count)
+    {
+      if (attr_len + 2 + 1 + psize > STREAM_SIZE (s))
+        return -1;
+
+      stream_reset (s);
+      stream_put (s, STREAM_DATA (attr), attr_len);
+      stream_putw (s, 0);
+      zclient->batch_attr_len = attr_len;
+
+      if (! zclient->t_batch)
+        zclient->t_batch = thread_add_event (zclient->master,
+                                             zclient_batch_flush_event, zclient, 0);
+    }
+
+  stream_putc (s, p->prefixlen);
+  stream_put (s, &p->u.prefix, psize);
+  zclient->batch_count++;
+
+  return 0;
+}
+
 void
 zclient_create_header (struct stream *s, uint16_t command, vrf_id_t vrf_id)
 {
@@ -375,6 +647,14 @@ zebra_hello_send (struct zclient *zclient)
   return 0;
 }
 
+/* Tell zebra that all our routes have been sent, so that after a warm
+   restart it can drop those of its retained routes we did not send. */
+int
+zclient_send_end_of_rib (struct zclient *zclient)
+{
+  return zebra_message_send (zclient, ZEBRA_END_OF_RIB, VRF_DEFAULT);
+}
+
 /* Send requests to zebra daemon for the information in a VRF. */
 void
 zclient_send_requests (struct zclient *zclient, vrf_id_t vrf_id)
@@ -488,6 +768,48 @@ zclient_connect (struct thread *t)
   return zclient_start (zclient);
 }
 
+/* Encode the nexthop, distance, metric, MTU and tag part of a route,
+   as described below. */
+static void
+zapi_ipv4_route_attr_put (struct stream *s, struct zapi_ipv4 *api)
+{
+  int i;
+
+  /* Nexthop, ifindex, distance and metric information. */
+  if (CHECK_FLAG (api->message, ZAPI_MESSAGE_NEXTHOP))
+    {
+      if (CHECK_FLAG (api->flags, ZEBRA_FLAG_BLACKHOLE))
+        {
+          stream_putc (s, 1);
+          stream_putc (s, ZEBRA_NEXTHOP_BLACKHOLE);
+          /* XXX assert(api->nexthop_num == 0); */
+          /* XXX assert(api->ifindex_num == 0); */
+        }
+      else
+        stream_putc (s, api->nexthop_num + api->ifindex_num);
+
+      for (i = 0; i < api->nexthop_num; i++)
+        {
+          stream_putc (s, ZEBRA_NEXTHOP_IPV4);
+          stream_put_in_addr (s, api->nexthop[i]);
+        }
+      for (i = 0; i < api->ifindex_num; i++)
+        {
+          stream_putc (s, ZEBRA_NEXTHOP_IFINDEX);
+          stream_putl (s, api->ifindex[i]);
+        }
+    }
+
+  if (CHECK_FLAG (api->message, ZAPI_MESSAGE_DISTANCE))
+    stream_putc (s, api->distance);
+  if (CHECK_FLAG (api->message, ZAPI_MESSAGE_METRIC))
+    stream_putl (s, api->metric);
+  if (CHECK_FLAG (api->message, ZAPI_MESSAGE_MTU))
+    stream_putl (s, api->mtu);
+  if (CHECK_FLAG (api->message, ZAPI_MESSAGE_TAG))
+    stream_putl (s, api->tag);
+}
+
  /* 
   * "xdr_encode"-like interface that allows daemon (client) to send
   * a message to zebra server for a route that needs to be
@@ -538,7 +860,6 @@ int
 zapi_ipv4_route (u_char cmd, struct zclient *zclient, struct prefix_ipv4 *p,
                  struct zapi_ipv4 *api)
 {
-  int i;
   int psize;
   struct stream *s;
 
@@ -559,39 +880,7 @@ zapi_ipv4_route (u_char cmd, struct zclient *zclient, struct prefix_ipv4 *p,
   stream_putc (s, p->prefixlen);
   stream_write (s, (u_char *) & p->prefix, psize);
 
-  /* Nexthop, ifindex, distance and metric information. */
-  if (CHECK_FLAG (api->message, ZAPI_MESSAGE_NEXTHOP))
-    {
-      if (CHECK_FLAG (api->flags, ZEBRA_FLAG_BLACKHOLE))
-        {
-          stream_putc (s, 1);
-          stream_putc (s, ZEBRA_NEXTHOP_BLACKHOLE);
-          /* XXX assert(api->nexthop_num == 0); */
-          /* XXX assert(api->ifindex_num == 0); */
-        }
-      else
-        stream_putc (s, api->nexthop_num + api->ifindex_num);
-
-      for (i = 0; i < api->nexthop_num; i++)
-        {
-          stream_putc (s, ZEBRA_NEXTHOP_IPV4);
-          stream_put_in_addr (s, api->nexthop[i]);
-        }
-      for (i = 0; i < api->ifindex_num; i++)
-        {
-          stream_putc (s, ZEBRA_NEXTHOP_IFINDEX);
-          stream_putl (s, api->ifindex[i]);
-        }
-    }
-
-  if (CHECK_FLAG (api->message, ZAPI_MESSAGE_DISTANCE))
-    stream_putc (s, api->distance);
-  if (CHECK_FLAG (api->message, ZAPI_MESSAGE_METRIC))
-    stream_putl (s, api->metric);
-  if (CHECK_FLAG (api->message, ZAPI_MESSAGE_MTU))
-    stream_putl (s, api->mtu);
-  if (CHECK_FLAG (api->message, ZAPI_MESSAGE_TAG))
-    stream_putl (s, api->tag);
+  zapi_ipv4_route_attr_put (s, api);
 
   /* Put length at the first point of the stream. */
   stream_putw_at (s, 0, stream_get_endp (s));
@@ -599,31 +888,36 @@ zapi_ipv4_route (u_char cmd, struct zclient *zclient, struct prefix_ipv4 *p,
   return zclient_send_message(zclient);
 }
 
-#ifdef HAVE_IPV6
+/* Like zapi_ipv4_route(), but route adds are packed together with
+ * other adds sharing the same attributes and nexthops into a single
+ * ZEBRA_IPV4_ROUTE_ADD_MULTI message, if zebra supports that.
+ */
 int
-zapi_ipv6_route (u_char cmd, struct zclient *zclient, struct prefix_ipv6 *p,
-	       struct zapi_ipv6 *api)
+zapi_ipv4_route_batch (u_char cmd, struct zclient *zclient,
+                       struct prefix_ipv4 *p, struct zapi_ipv4 *api)
 {
-  int i;
-  int psize;
   struct stream *s;
 
-  /* Reset stream. */
-  s = zclient->obuf;
-  stream_reset (s);
+  if (cmd != ZEBRA_IPV4_ROUTE_ADD
+      || ! CHECK_FLAG (zclient->capabilities, ZAPI_CAPA_ROUTE_MULTI))
+    return zapi_ipv4_route (cmd, zclient, p, api);
 
-  zclient_create_header (s, cmd, api->vrf_id);
+  s = zclient_batch_start (zclient, ZEBRA_IPV4_ROUTE_ADD_MULTI, api->vrf_id);
 
-  /* Put type and nexthop. */
   stream_putc (s, api->type);
   stream_putc (s, api->flags);
   stream_putc (s, api->message);
   stream_putw (s, api->safi);
-  
-  /* Put prefix information. */
-  psize = PSIZE (p->prefixlen);
-  stream_putc (s, p->prefixlen);
-  stream_write (s, (u_char *)&p->prefix, psize);
+  zapi_ipv4_route_attr_put (s, api);
+
+  return zclient_batch_add (zclient, (struct prefix *) p);
+}
+
+#ifdef HAVE_IPV6
+static void
+zapi_ipv6_route_attr_put (struct stream *s, struct zapi_ipv6 *api)
+{
+  int i;
 
   /* Nexthop, ifindex, distance and metric information. */
   if (CHECK_FLAG (api->message, ZAPI_MESSAGE_NEXTHOP))
@@ -650,12 +944,61 @@ zapi_ipv6_route (u_char cmd, struct zclient *zclient, struct prefix_ipv6 *p,
     stream_putl (s, api->mtu);
   if (CHECK_FLAG (api->message, ZAPI_MESSAGE_TAG))
     stream_putl (s, api->tag);
+}
+
+int
+zapi_ipv6_route (u_char cmd, struct zclient *zclient, struct prefix_ipv6 *p,
+	       struct zapi_ipv6 *api)
+{
+  int psize;
+  struct stream *s;
+
+  /* Reset stream. */
+  s = zclient->obuf;
+  stream_reset (s);
+
+  zclient_create_header (s, cmd, api->vrf_id);
+
+  /* Put type and nexthop. */
+  stream_putc (s, api->type);
+  stream_putc (s, api->flags);
+  stream_putc (s, api->message);
+  stream_putw (s, api->safi);
+  
+  /* Put prefix information. */
+  psize = PSIZE (p->prefixlen);
+  stream_putc (s, p->prefixlen);
+  stream_write (s, (u_char *)&p->prefix, psize);
+
+  zapi_ipv6_route_attr_put (s, api);
 
   /* Put length at the first point of the stream. */
   stream_putw_at (s, 0, stream_get_endp (s));
 
   return zclient_send_message(zclient);
 }
+
+/* IPv6 counterpart of zapi_ipv4_route_batch(). */
+int
+zapi_ipv6_route_batch (u_char cmd, struct zclient *zclient,
+                       struct prefix_ipv6 *p, struct zapi_ipv6 *api)
+{
+  struct stream *s;
+
+  if (cmd != ZEBRA_IPV6_ROUTE_ADD
+      || ! CHECK_FLAG (zclient->capabilities, ZAPI_CAPA_ROUTE_MULTI))
+    return zapi_ipv6_route (cmd, zclient, p, api);
+
+  s = zclient_batch_start (zclient, ZEBRA_IPV6_ROUTE_ADD_MULTI, api->vrf_id);
+
+  stream_putc (s, api->type);
+  stream_putc (s, api->flags);
+  stream_putc (s, api->message);
+  stream_putw (s, api->safi);
+  zapi_ipv6_route_attr_put (s, api);
+
+  return zclient_batch_add (zclient, (struct prefix *) p);
+}
 #endif /* HAVE_IPV6 */
 
 /* 
@@ -863,7 +1206,7 @@ zebra_interface_if_set_value (struct stream *s, struct interface *ifp)
   u_char link_params_status = 0;
 
   /* Read interface's index. */
-  ifp->ifindex = stream_getl (s);
+  if_set_index (ifp, stream_getl (s));
   ifp->status = stream_getc (s);
 
   /* Read interface's value. */
@@ -1191,6 +1534,14 @@ zclient_read (struct thread *thread)
       if (zclient->nexthop_update)
 	(*zclient->nexthop_update) (command, zclient, length, vrf_id);
       break;
+    case ZEBRA_HELLO:
+      if (length >= 1)
+	zclient->capabilities = stream_getc (zclient->ibuf);
+      if (zclient_debug)
+	zlog_debug ("zclient: zebra capabilities 0x%x", zclient->capabilities);
+      if (CHECK_FLAG (zclient->capabilities, ZAPI_CAPA_SHM_RING))
+	zclient_ring_setup (zclient);
+      break;
     default:
       break;
     }
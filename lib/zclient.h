@@ -69,6 +69,23 @@ struct zclient
   /* Thread to write buffered data to zebra. */
   struct thread *t_write;
 
+  /* Optional features zebra announced in its HELLO reply. */
+  u_char capabilities;
+
+  /* Pending batched route message, and the shared attribute encoding
+     of the route currently being queued.  See zclient_batch_add(). */
+  struct stream *batch;
+  struct stream *batch_attr;
+  size_t batch_attr_len;
+  u_int16_t batch_count;
+  struct thread *t_batch;
+
+  /* Shared memory ring carrying our messages to zebra, once set up.
+     Messages which do not fit wait in ring_backlog. */
+  struct zring *ring;
+  struct stream_fifo *ring_backlog;
+  struct thread *t_ring;
+
   /* Redistribute information. */
   u_char redist_default;
   vrf_bitmap_t redist[ZEBRA_ROUTE_MAX];
@@ -101,6 +118,10 @@ struct zclient
 #define ZAPI_MESSAGE_MTU      0x10
 #define ZAPI_MESSAGE_TAG      0x20
 
+/* Zebra capabilities, sent in reply to ZEBRA_HELLO. */
+#define ZAPI_CAPA_ROUTE_MULTI 0x01	/* ZEBRA_IPV[46]_ROUTE_ADD_MULTI */
+#define ZAPI_CAPA_SHM_RING    0x02	/* ZEBRA_SHM_RING_SETUP */
+
 /* Zserv protocol message header */
 struct zserv_header
 {
@@ -155,6 +176,7 @@ extern void zclient_serv_path_set  (char *path);
 extern const char *zclient_serv_path_get (void);
 
 extern void zclient_send_requests (struct zclient *, vrf_id_t);
+extern int zclient_send_end_of_rib (struct zclient *);
 
 /* Send redistribute command to zebra daemon. Do not update zclient state. */
 extern int zebra_redistribute_send (int command, struct zclient *, int type,
@@ -174,6 +196,17 @@ extern int zclient_send_message(struct zclient *);
 
 /* create header for command, length to be filled in by user later */
 extern void zclient_create_header (struct stream *, uint16_t, vrf_id_t);
+
+/* Batched route adds.  zclient_batch_start() returns a stream, with the
+   header already in place, into which the caller encodes the attributes
+   and nexthops shared by the route; zclient_batch_add() then queues the
+   prefix, packing it with preceding routes whose shared part is
+   identical.  Pending routes are sent before any other message, or at
+   the latest from an event thread once the caller yields. */
+extern struct stream *zclient_batch_start (struct zclient *, uint16_t,
+                                           vrf_id_t);
+extern int zclient_batch_add (struct zclient *, struct prefix *);
+extern int zclient_batch_flush (struct zclient *);
 extern int zclient_read_header (struct stream *s, int sock, u_int16_t *size,
 				u_char *marker, u_char *version,
 				u_int16_t *vrf_id, u_int16_t *cmd);
@@ -188,6 +221,8 @@ extern void zebra_interface_if_set_value (struct stream *, struct interface *);
 extern void zebra_router_id_update_read (struct stream *s, struct prefix *rid);
 extern int zapi_ipv4_route (u_char, struct zclient *, struct prefix_ipv4 *, 
                             struct zapi_ipv4 *);
+extern int zapi_ipv4_route_batch (u_char, struct zclient *,
+                                  struct prefix_ipv4 *, struct zapi_ipv4 *);
 
 extern struct interface *zebra_interface_link_params_read (struct stream *);
 extern size_t zebra_interface_link_params_write (struct stream *,
@@ -224,6 +259,8 @@ struct zapi_ipv6
 
 extern int zapi_ipv6_route (u_char cmd, struct zclient *zclient, 
                      struct prefix_ipv6 *p, struct zapi_ipv6 *api);
+extern int zapi_ipv6_route_batch (u_char cmd, struct zclient *zclient,
+                     struct prefix_ipv6 *p, struct zapi_ipv6 *api);
 #endif /* HAVE_IPV6 */
 
 #endif /* _ZEBRA_ZCLIENT_H */
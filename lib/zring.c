@@ -0,0 +1,363 @@
+/*
+ * Shared memory ring for ZAPI messages.
+ *
+ * This file is part of GNU Zebra.
+ *
+ * GNU Zebra is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2, or (at your
+ * option) any later version.
+ *
+ * GNU Zebra is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Zebra; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#include "memory.h"
+#include "log.h"
+#include "zclient.h"
+#include "zring.h"
+
+#ifdef HAVE_ZAPI_RING
+
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+
+#define ZRING_MAGIC	0x5a52494e	/* "ZRIN" */
+#define ZRING_CACHELINE	64
+
+/* The producer must not be able to resize the memfd under the
+ * consumer's mapping. */
+#define ZRING_SEALS	(F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)
+
+/* Header at the start of the shared mapping.  Producer and consumer
+ * owned fields live on separate cache lines, so that the two sides do
+ * not keep stealing the line from each other. */
+struct zring_shared
+{
+  u_int32_t magic;
+  u_int32_t size;
+  char pad0[ZRING_CACHELINE - 2 * sizeof (u_int32_t)];
+
+  /* Written by the producer. */
+  u_int32_t head;
+  u_int32_t producer_waiting;
+  char pad1[ZRING_CACHELINE - 2 * sizeof (u_int32_t)];
+
+  /* Written by the consumer. */
+  u_int32_t tail;
+  u_int32_t consumer_sleeping;
+  char pad2[ZRING_CACHELINE - 2 * sizeof (u_int32_t)];
+};
+
+#define ZRING_LOAD(p)		__atomic_load_n ((p), __ATOMIC_ACQUIRE)
+#define ZRING_STORE(p,v)	__atomic_store_n ((p), (v), __ATOMIC_RELEASE)
+#define ZRING_XCHG(p,v)		__atomic_exchange_n ((p), (v), __ATOMIC_SEQ_CST)
+#define ZRING_FENCE()		__atomic_thread_fence (__ATOMIC_SEQ_CST)
+
+static void
+zring_eventfd_ring (int fd)
+{
+  u_int64_t one = 1;
+
+  if (write (fd, &one, sizeof (one)) < 0 && errno != EAGAIN)
+    zlog_warn ("zring: eventfd write failed: %s", safe_strerror (errno));
+}
+
+void
+zring_eventfd_clear (int fd)
+{
+  u_int64_t cnt;
+
+  if (read (fd, &cnt, sizeof (cnt)) < 0 && errno != EAGAIN)
+    zlog_warn ("zring: eventfd read failed: %s", safe_strerror (errno));
+}
+
+static struct zring *
+zring_map (int memfd, int efd_data, int efd_space, u_int32_t size,
+           int create)
+{
+  struct zring *zr;
+  void *p;
+  size_t maplen;
+
+  maplen = sizeof (struct zring_shared) + size;
+  p = mmap (NULL, maplen, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+  if (p == MAP_FAILED)
+    {
+      zlog_warn ("zring: mmap failed: %s", safe_strerror (errno));
+      return NULL;
+    }
+
+  zr = XCALLOC (MTYPE_ZRING, sizeof (struct zring));
+  zr->memfd = memfd;
+  zr->efd_data = efd_data;
+  zr->efd_space = efd_space;
+  zr->size = size;
+  zr->shm = p;
+  zr->data = (u_char *) p + sizeof (struct zring_shared);
+  zr->maplen = maplen;
+
+  if (create)
+    {
+      zr->shm->size = size;
+      ZRING_STORE (&zr->shm->magic, ZRING_MAGIC);
+    }
+  return zr;
+}
+
+struct zring *
+zring_create (u_int32_t size)
+{
+  struct zring *zr;
+  int memfd, efd_data = -1, efd_space = -1;
+
+  if (size < ZEBRA_MAX_PACKET_SIZ || (size & (size - 1)) != 0)
+    return NULL;
+
+  memfd = memfd_create ("zapi-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (memfd < 0)
+    {
+      zlog_warn ("zring: memfd_create failed: %s", safe_strerror (errno));
+      return NULL;
+    }
+  if (ftruncate (memfd, sizeof (struct zring_shared) + size) < 0)
+    {
+      zlog_warn ("zring: ftruncate failed: %s", safe_strerror (errno));
+      goto fail;
+    }
+  if (fcntl (memfd, F_ADD_SEALS, ZRING_SEALS) < 0)
+    {
+      zlog_warn ("zring: sealing failed: %s", safe_strerror (errno));
+      goto fail;
+    }
+
+  efd_data = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+  efd_space = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (efd_data < 0 || efd_space < 0)
+    {
+      zlog_warn ("zring: eventfd failed: %s", safe_strerror (errno));
+      goto fail;
+    }
+
+  zr = zring_map (memfd, efd_data, efd_space, size, 1);
+  if (zr)
+    return zr;
+
+fail:
+  close (memfd);
+  if (efd_data >= 0)
+    close (efd_data);
+  if (efd_space >= 0)
+    close (efd_space);
+  return NULL;
+}
+
+struct zring *
+zring_attach (int memfd, int efd_data, int efd_space)
+{
+  struct zring *zr;
+  struct zring_shared hdr;
+  struct stat st;
+  u_int32_t size;
+  int seals;
+
+  /* Everything in the memfd comes from the client.  Without the seals
+   * it could truncate the file after we mapped it, and we would take a
+   * SIGBUS. */
+  seals = fcntl (memfd, F_GET_SEALS);
+  if (seals < 0 || (seals & ZRING_SEALS) != ZRING_SEALS)
+    goto fail;
+
+  if (fstat (memfd, &st) < 0
+      || st.st_size < (off_t) sizeof (struct zring_shared)
+      || pread (memfd, &hdr, sizeof (hdr), 0) != sizeof (hdr))
+    goto fail;
+
+  size = hdr.size;
+  if (hdr.magic != ZRING_MAGIC
+      || size < ZEBRA_MAX_PACKET_SIZ || (size & (size - 1)) != 0
+      || st.st_size != (off_t) (sizeof (struct zring_shared) + size))
+    goto fail;
+
+  zr = zring_map (memfd, efd_data, efd_space, size, 0);
+  if (zr)
+    return zr;
+
+fail:
+  zlog_warn ("zring: cannot attach to ring");
+  close (memfd);
+  close (efd_data);
+  close (efd_space);
+  return NULL;
+}
+
+void
+zring_free (struct zring *zr)
+{
+  munmap (zr->shm, zr->maplen);
+  close (zr->memfd);
+  close (zr->efd_data);
+  close (zr->efd_space);
+  XFREE (MTYPE_ZRING, zr);
+}
+
+int
+zring_write (struct zring *zr, const void *buf, size_t len)
+{
+  struct zring_shared *shm = zr->shm;
+  u_int32_t head, tail, off, first;
+
+  head = shm->head;
+  tail = ZRING_LOAD (&shm->tail);
+
+  if (zr->size - (head - tail) < len)
+    {
+      /* Ask for a kick once there is room, then check again in case
+       * the consumer caught up before it could see the flag. */
+      ZRING_STORE (&shm->producer_waiting, 1);
+      ZRING_FENCE ();
+      tail = ZRING_LOAD (&shm->tail);
+      if (zr->size - (head - tail) < len)
+        return -1;
+      ZRING_STORE (&shm->producer_waiting, 0);
+    }
+
+  off = head & (zr->size - 1);
+  first = MIN (len, zr->size - off);
+  memcpy (zr->data + off, buf, first);
+  if (first < len)
+    memcpy (zr->data, (const u_char *) buf + first, len - first);
+
+  ZRING_STORE (&shm->head, head + len);
+  return 0;
+}
+
+void
+zring_doorbell (struct zring *zr)
+{
+  ZRING_FENCE ();
+  if (ZRING_LOAD (&zr->shm->consumer_sleeping)
+      && ZRING_XCHG (&zr->shm->consumer_sleeping, 0))
+    zring_eventfd_ring (zr->efd_data);
+}
+
+/* The producer owns head, so whatever it says is clamped to the ring
+ * size before it is used for copying. */
+size_t
+zring_readable (struct zring *zr)
+{
+  u_int32_t avail = ZRING_LOAD (&zr->shm->head) - zr->shm->tail;
+
+  return MIN (avail, zr->size);
+}
+
+size_t
+zring_read (struct zring *zr, void *buf, size_t len)
+{
+  struct zring_shared *shm = zr->shm;
+  u_int32_t head, tail, off, first;
+
+  tail = shm->tail;
+  head = ZRING_LOAD (&shm->head);
+
+  len = MIN (len, MIN (head - tail, zr->size));
+  if (len == 0)
+    return 0;
+
+  off = tail & (zr->size - 1);
+  first = MIN (len, zr->size - off);
+  memcpy (buf, zr->data + off, first);
+  if (first < len)
+    memcpy ((u_char *) buf + first, zr->data, len - first);
+
+  ZRING_STORE (&shm->tail, tail + len);
+
+  ZRING_FENCE ();
+  if (ZRING_LOAD (&shm->producer_waiting)
+      && ZRING_XCHG (&shm->producer_waiting, 0))
+    zring_eventfd_ring (zr->efd_space);
+
+  return len;
+}
+
+int
+zring_consumer_sleep (struct zring *zr)
+{
+  struct zring_shared *shm = zr->shm;
+
+  ZRING_STORE (&shm->consumer_sleeping, 1);
+  ZRING_FENCE ();
+  if (ZRING_LOAD (&shm->head) != shm->tail)
+    {
+      ZRING_STORE (&shm->consumer_sleeping, 0);
+      return -1;
+    }
+  return 0;
+}
+
+#else /* HAVE_ZAPI_RING */
+
+struct zring *
+zring_create (u_int32_t size)
+{
+  return NULL;
+}
+
+struct zring *
+zring_attach (int memfd, int efd_data, int efd_space)
+{
+  close (memfd);
+  close (efd_data);
+  close (efd_space);
+  return NULL;
+}
+
+void
+zring_free (struct zring *zr)
+{
+}
+
+int
+zring_write (struct zring *zr, const void *buf, size_t len)
+{
+  return -1;
+}
+
+void
+zring_doorbell (struct zring *zr)
+{
+}
+
+size_t
+zring_read (struct zring *zr, void *buf, size_t len)
+{
+  return 0;
+}
+
+size_t
+zring_readable (struct zring *zr)
+{
+  return 0;
+}
+
+int
+zring_consumer_sleep (struct zring *zr)
+{
+  return 0;
+}
+
+void
+zring_eventfd_clear (int fd)
+{
+}
+
+#endif /* HAVE_ZAPI_RING */
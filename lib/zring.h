@@ -0,0 +1,91 @@
+/*
+ * Shared memory ring for ZAPI messages.
+ *
+ * This file is part of GNU Zebra.
+ *
+ * GNU Zebra is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2, or (at your
+ * option) any later version.
+ *
+ * GNU Zebra is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Zebra; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _QUAGGA_ZRING_H
+#define _QUAGGA_ZRING_H
+
+/*
+ * A single-producer, single-consumer byte ring living in a memfd which
+ * is shared between a zclient (producer) and zebra (consumer).  It
+ * carries ordinary ZAPI framed messages, so the consumer can feed the
+ * bytes to its usual message parser.
+ *
+ * Two eventfds go along with the ring: the data doorbell is rung by the
+ * producer when the consumer has said it is about to sleep, and the
+ * space doorbell is rung by the consumer when the producer found the
+ * ring full.  Neither side makes a system call while the other is
+ * actively working on the ring.
+ *
+ * Only available where memfd_create() and eventfd() are, see
+ * HAVE_ZAPI_RING.
+ */
+
+/* Default ring size, must be a power of 2. */
+#define ZRING_SIZE_DEFAULT	(4 * 1024 * 1024)
+
+struct zring_shared;
+
+struct zring
+{
+  /* Shared memory and doorbells. */
+  int memfd;
+  int efd_data;
+  int efd_space;
+
+  /* Size of the data area, a power of 2. */
+  u_int32_t size;
+
+  struct zring_shared *shm;
+  u_char *data;
+  size_t maplen;
+};
+
+/* Producer side: create a new ring of the given size. */
+extern struct zring *zring_create (u_int32_t size);
+
+/* Consumer side: map a ring received from the producer.  Takes
+ * ownership of the file descriptors, also on failure. */
+extern struct zring *zring_attach (int memfd, int efd_data, int efd_space);
+
+extern void zring_free (struct zring *);
+
+/* Append len bytes, all or nothing.  Returns 0 on success, or -1 if
+ * there is not enough room, in which case the space doorbell will be
+ * rung once the consumer has made some. */
+extern int zring_write (struct zring *, const void *buf, size_t len);
+
+/* Wake the consumer up if it is waiting for data. */
+extern void zring_doorbell (struct zring *);
+
+/* Copy up to len bytes out of the ring, returns number of bytes. */
+extern size_t zring_read (struct zring *, void *buf, size_t len);
+
+/* Number of bytes waiting to be read. */
+extern size_t zring_readable (struct zring *);
+
+/* Consumer is going to wait on efd_data.  Returns 0 if it may do so,
+ * or -1 if data arrived meanwhile and it should read again instead. */
+extern int zring_consumer_sleep (struct zring *);
+
+/* Drain an eventfd after it polled readable. */
+extern void zring_eventfd_clear (int fd);
+
+#endif /* _QUAGGA_ZRING_H */
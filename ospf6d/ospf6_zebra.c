@@ -120,7 +120,7 @@ ospf6_zebra_if_del (int command, struct zclient *zclient, zebra_size_t length,
     zlog_debug ("Zebra Interface delete: %s index %d mtu %d",
 		ifp->name, ifp->ifindex, ifp->mtu6);
 
-  ifp->ifindex = IFINDEX_INTERNAL;
+  if_set_index (ifp, IFINDEX_INTERNAL);
   return 0;
 }
 
@@ -485,7 +485,7 @@ ospf6_zebra_route_update (int type, struct ospf6_route *request)
   if (type == REM)
     ret = zapi_ipv6_route (ZEBRA_IPV6_ROUTE_DELETE, zclient, dest, &api);
   else
-    ret = zapi_ipv6_route (ZEBRA_IPV6_ROUTE_ADD, zclient, dest, &api);
+    ret = zapi_ipv6_route_batch (ZEBRA_IPV6_ROUTE_ADD, zclient, dest, &api);
 
   if (ret < 0)
     zlog_err ("zapi_ipv6_route() %s failed: %s",
@@ -576,10 +576,31 @@ DEFUN (no_redistribute_ospf6,
   return CMD_SUCCESS;
 }
 
+/* Install the current routing table again after zebra came back, then
+   tell it we are done, so that a zebra which went through a warm
+   restart can remove the OSPF6 routes it kept and we no longer have. */
+static void
+ospf6_zebra_announce_all (void)
+{
+  struct ospf6_route *route;
+
+  if (ospf6)
+    for (route = ospf6_route_head (ospf6->route_table); route;
+         route = ospf6_route_next (route))
+      ospf6_zebra_route_update_add (route);
+
+  zclient_send_end_of_rib (zclient);
+}
+
 static void
 ospf6_zebra_connected (struct zclient *zclient)
 {
+  static int num_connects;
+
   zclient_send_requests (zclient, VRF_DEFAULT);
+
+  if (++num_connects > 1)
+    ospf6_zebra_announce_all ();
 }
 
 static struct ospf6_distance *
@@ -146,7 +146,7 @@ ospf_interface_delete (int command, struct zclient *zclient,
     if (rn->info)
       ospf_if_free ((struct ospf_interface *) rn->info);
 
-  ifp->ifindex = IFINDEX_INTERNAL;
+  if_set_index (ifp, IFINDEX_INTERNAL);
   return 0;
 }
 
@@ -352,6 +352,7 @@ ospf_zebra_add (struct prefix_ipv4 *p, struct ospf_route *or)
   u_char distance;
   u_char flags;
   int psize;
+  int batch;
   struct stream *s;
   struct ospf_path *path;
   struct listnode *node;
@@ -376,21 +377,32 @@ ospf_zebra_add (struct prefix_ipv4 *p, struct ospf_route *or)
            (or->u.ext.tag > 0) && (or->u.ext.tag <= ROUTE_TAG_MAX))
         SET_FLAG (message, ZAPI_MESSAGE_TAG);
 
-      /* Make packet. */
-      s = zclient->obuf;
-      stream_reset (s);
+      /* Make packet.  If zebra takes batched adds, routes sharing the
+         same nexthops and metric go out together after the SPF run. */
+      batch = CHECK_FLAG (zclient->capabilities, ZAPI_CAPA_ROUTE_MULTI);
+      if (batch)
+        s = zclient_batch_start (zclient, ZEBRA_IPV4_ROUTE_ADD_MULTI,
+                                 VRF_DEFAULT);
+      else
+        {
+          s = zclient->obuf;
+          stream_reset (s);
+          zclient_create_header (s, ZEBRA_IPV4_ROUTE_ADD, VRF_DEFAULT);
+        }
 
-      /* Put command, type, flags, message. */
-      zclient_create_header (s, ZEBRA_IPV4_ROUTE_ADD, VRF_DEFAULT);
+      /* Put type, flags, message. */
       stream_putc (s, ZEBRA_ROUTE_OSPF);
       stream_putc (s, flags);
       stream_putc (s, message);
       stream_putw (s, SAFI_UNICAST);
 
       /* Put prefix information. */
-      psize = PSIZE (p->prefixlen);
-      stream_putc (s, p->prefixlen);
-      stream_write (s, (u_char *) & p->prefix, psize);
+      if (! batch)
+        {
+          psize = PSIZE (p->prefixlen);
+          stream_putc (s, p->prefixlen);
+          stream_write (s, (u_char *) & p->prefix, psize);
+        }
 
       /* Nexthop count. */
       stream_putc (s, or->paths->count);
@@ -446,6 +458,12 @@ ospf_zebra_add (struct prefix_ipv4 *p, struct ospf_route *or)
       if (CHECK_FLAG (message, ZAPI_MESSAGE_TAG))
          stream_putl (s, or->u.ext.tag);
 
+      if (batch)
+        {
+          zclient_batch_add (zclient, (struct prefix *) p);
+          return;
+        }
+
       stream_putw_at (s, 0, stream_get_endp (s));
 
       zclient_send_message(zclient);
@@ -556,7 +574,7 @@ ospf_zebra_add_discard (struct prefix_ipv4 *p)
       api.ifindex_num = 0;
       api.tag = 0;
 
-      zapi_ipv4_route (ZEBRA_IPV4_ROUTE_ADD, zclient, p, &api);
+      zapi_ipv4_route_batch (ZEBRA_IPV4_ROUTE_ADD, zclient, p, &api);
 
       if (IS_DEBUG_OSPF (zebra, ZEBRA_REDISTRIBUTE))
         zlog_debug ("Zebra: Route add discard %s/%d",
@@ -1337,10 +1355,44 @@ ospf_distance_apply (struct prefix_ipv4 *p, struct ospf_route *or)
   return 0;
 }
 
+/* Install the current routing table again after zebra came back, then
+   tell it we are done, so that a zebra which went through a warm
+   restart can remove the OSPF routes it kept and we no longer have. */
+static void
+ospf_zebra_announce_all (void)
+{
+  struct ospf *ospf;
+  struct route_node *rn;
+  struct ospf_route *or;
+
+  ospf = ospf_lookup ();
+  if (ospf && ospf->new_table)
+    for (rn = route_top (ospf->new_table); rn; rn = route_next (rn))
+      if ((or = rn->info) != NULL)
+	{
+	  if (or->type == OSPF_DESTINATION_NETWORK)
+	    ospf_zebra_add ((struct prefix_ipv4 *) &rn->p, or);
+	  else if (or->type == OSPF_DESTINATION_DISCARD)
+	    ospf_zebra_add_discard ((struct prefix_ipv4 *) &rn->p);
+	}
+
+  if (ospf && ospf->old_external_route)
+    for (rn = route_top (ospf->old_external_route); rn; rn = route_next (rn))
+      if ((or = rn->info) != NULL)
+	ospf_zebra_add ((struct prefix_ipv4 *) &rn->p, or);
+
+  zclient_send_end_of_rib (zclient);
+}
+
 static void
 ospf_zebra_connected (struct zclient *zclient)
 {
+  static int num_connects;
+
   zclient_send_requests (zclient, VRF_DEFAULT);
+
+  if (++num_connects > 1)
+    ospf_zebra_announce_all ();
 }
 
 void
@@ -716,10 +716,36 @@ static struct cmd_node zebra_node =
   "%s(config-router)# ",
 };
 
+/* Install our routes again after zebra came back, then tell it we
+   are done, so that a zebra which went through a warm restart can
+   remove the RIP routes it kept and we no longer have. */
+static void
+rip_zebra_announce_all (void)
+{
+  struct route_node *rp;
+  struct rip_info *rinfo;
+
+  if (rip)
+    for (rp = route_top (rip->table); rp; rp = route_next (rp))
+      if (rp->info && listcount ((struct list *) rp->info))
+        {
+          rinfo = listgetdata (listhead ((struct list *) rp->info));
+          if (CHECK_FLAG (rinfo->flags, RIP_RTF_FIB))
+            rip_zebra_ipv4_add (rp);
+        }
+
+  zclient_send_end_of_rib (zclient);
+}
+
 static void
 rip_zebra_connected (struct zclient *zclient)
 {
+  static int num_connects;
+
   zclient_send_requests (zclient, VRF_DEFAULT);
+
+  if (++num_connects > 1)
+    rip_zebra_announce_all ();
 }
 
 void
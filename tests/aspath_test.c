@@ -29,6 +29,7 @@
 #include "bgpd/bgpd.h"
 #include "bgpd/bgp_aspath.h"
 #include "bgpd/bgp_attr.h"
+#include "bgpd/bgp_regex.h"
 
 #define VT100_RESET "\x1b[0m"
 #define VT100_RED "\x1b[31m"
@@ -1326,6 +1327,87 @@ attr_test (struct aspath_tests *t)
     printf ("%s\n\n", handle_attr_test (t) ? FAILED : OK);  
 }
 
+/* AS path expressions, which the compiled matcher has to agree with
+   regexec on. */
+static const char *regex_tests[] =
+{
+  "^$", ".*", "_1_", "_3_", "^8466_", "_4096$", "^[0-9]+$",
+  "_(64512|8722)_", "^(8466 )+3", "[{].*[}]", "\\{", "\\(", "\\[",
+  "_1[0-9]*_", "(^| )6[0-9]{3}( |$)", "^8466 3 52737 4096$",
+  "[[:digit:]]+ [[:digit:]]+", "^[^ ]*$", "[]0-9]", "[^0-9 ]",
+  "x", "_8466 3_", "^([0-9]+ ){2,3}[0-9]+$", ",", "^_", "_$",
+  "3|^$", "(_64512_|^)", "5?2{1,}7+", "^.{0,4}$", "^.{,6}$", "[0-4-]+",
+  "1{2}{3}", "(|64)5", "[[:space:],]{2}",
+  NULL,
+};
+
+/* Expressions outside what is compiled, which regexec is left to. */
+static const char *regex_uncompiled[] =
+{
+  "\\w", "[[=a=]]", "\\1", "a{1", "*",
+  /* ^, $ or _ repeated, where glibc and POSIX part ways. */
+  "(_1)+", "(^2|3)*", "$?", "_{1,2}", "(_.|\\}{1,2}\\[)+1[[:digit:]]+",
+  NULL,
+};
+
+static void
+regex_test (void)
+{
+  int i, j;
+  int initfail = failed;
+
+  printf ("AS path regex test\n");
+  for (i = 0; regex_tests[i]; i++)
+    {
+      regex_t *reg = bgp_regcomp (regex_tests[i]);
+      struct bgp_aspath_re *re = bgp_aspath_re_compile (regex_tests[i]);
+
+      if (! reg || ! re)
+        {
+          printf ("%s: not compiled\n", regex_tests[i]);
+          failed++;
+          if (reg)
+            bgp_regex_free (reg);
+          if (re)
+            bgp_aspath_re_free (re);
+          continue;
+        }
+
+      for (j = 0; test_segments[j].name; j++)
+        {
+          struct aspath *as = make_aspath (test_segments[j].asdata,
+                                           test_segments[j].len, 0);
+          int want;
+
+          if (! as)
+            continue;
+          want = (bgp_regexec (reg, as) != REG_NOMATCH);
+          if (bgp_aspath_re_match (re, as) != want)
+            {
+              printf ("%s on \"%s\": should be %d\n",
+                      regex_tests[i], as->str, want);
+              failed++;
+            }
+          aspath_unintern (&as);
+        }
+      bgp_regex_free (reg);
+      bgp_aspath_re_free (re);
+    }
+
+  for (i = 0; regex_uncompiled[i]; i++)
+    {
+      struct bgp_aspath_re *re = bgp_aspath_re_compile (regex_uncompiled[i]);
+
+      if (re)
+        {
+          printf ("%s: compiled\n", regex_uncompiled[i]);
+          failed++;
+          bgp_aspath_re_free (re);
+        }
+    }
+  printf ("%s\n\n", failed - initfail ? FAILED : OK);
+}
+
 int
 main (void)
 {
@@ -1380,6 +1462,8 @@ main (void)
       attr_test (&aspath_tests[i++]);
     }
   
+  regex_test ();
+  
   printf ("failures: %d\n", failed);
   printf ("aspath count: %ld\n", aspath_count());
   
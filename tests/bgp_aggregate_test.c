@@ -0,0 +1,456 @@
+/*
+ * BGP aggregate-address unit test
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* More-specifics are added, changed and withdrawn under two
+ * aggregates, the way bgp_update and bgp_withdraw do it, and after
+ * each step the aggregate routes and the suppress counts of the
+ * more-specifics are checked.  The steps are run twice: the second
+ * time each aggregate is also removed and configured again after each
+ * step, which works it out from the whole subtree, and the aggregate
+ * route must come out with the very same attributes.
+ */
+
+#include <zebra.h>
+
+#include "vty.h"
+#include "stream.h"
+#include "privs.h"
+#include "memory.h"
+#include "command.h"
+#include "prefix.h"
+#include "filter.h"
+
+#include "bgpd/bgpd.h"
+#include "bgpd/bgp_table.h"
+#include "bgpd/bgp_route.h"
+#include "bgpd/bgp_attr.h"
+#include "bgpd/bgp_aspath.h"
+#include "bgpd/bgp_community.h"
+#include "bgpd/bgp_pool.h"
+#include "bgpd/bgp_nexthop.h"
+
+#define VT100_RESET "\x1b[0m"
+#define VT100_RED "\x1b[31m"
+#define VT100_GREEN "\x1b[32m"
+#define OK VT100_GREEN "OK" VT100_RESET
+#define FAILED VT100_RED "failed" VT100_RESET
+
+/* need these to link in libbgp */
+struct zebra_privs_t *bgpd_privs = NULL;
+struct thread_master *master = NULL;
+
+static int failed = 0;
+static int tty = 0;
+
+static as_t asn = 100;
+static struct bgp *bgp;
+static struct peer *peer;
+static struct vty *vty;
+
+/* The aggregates, configured as with the commands below. */
+extern struct cmd_element aggregate_address_as_set_summary_cmd;
+extern struct cmd_element aggregate_address_summary_only_cmd;
+extern struct cmd_element no_aggregate_address_cmd;
+
+#define AS_SET_AGGREGATE "10.0.0.0/8"
+#define PLAIN_AGGREGATE "10.1.0.0/16"
+
+/* What the aggregate route should have, if there should be one. */
+struct aggregate_expect
+{
+  int present;
+  u_char origin;
+  const char *aspath;
+  const char *community;
+  int atomic;
+};
+
+static struct test_step
+{
+  const char *name;
+  int withdraw;
+
+  /* The more-specific, and its attributes if it is not withdrawn. */
+  const char *prefix;
+  u_char origin;
+  const char *aspath;
+  const char *community;
+  int atomic;
+
+  struct aggregate_expect as_set;	/* AS_SET_AGGREGATE */
+  struct aggregate_expect plain;	/* PLAIN_AGGREGATE */
+} test_steps[] =
+{
+  {
+    "add 10.1.1.0/24", 0,
+    "10.1.1.0/24", BGP_ORIGIN_IGP, "200 300", "200:1", 0,
+    { 1, BGP_ORIGIN_IGP, "200 300", "200:1", 0 },
+    { 1, BGP_ORIGIN_IGP, "", NULL, 1 },
+  },
+  {
+    "add 10.2.0.0/16", 0,
+    "10.2.0.0/16", BGP_ORIGIN_EGP, "200 400", "200:2", 0,
+    { 1, BGP_ORIGIN_EGP, "200 {300,400}", "200:1 200:2", 0 },
+    { 1, BGP_ORIGIN_IGP, "", NULL, 1 },
+  },
+  {
+    "add 10.1.2.0/24 atomic", 0,
+    "10.1.2.0/24", BGP_ORIGIN_IGP, "200 300", "200:1", 1,
+    { 1, BGP_ORIGIN_EGP, "200 {300,400}", "200:1 200:2", 1 },
+    { 1, BGP_ORIGIN_IGP, "", NULL, 1 },
+  },
+  {
+    "add 10.3.0.0/16", 0,
+    "10.3.0.0/16", BGP_ORIGIN_IGP, "500 200", "200:1 500:1", 0,
+    { 1, BGP_ORIGIN_EGP, "{200,300,400,500}", "200:1 200:2 500:1", 1 },
+    { 1, BGP_ORIGIN_IGP, "", NULL, 1 },
+  },
+  {
+    "change 10.2.0.0/16", 0,
+    "10.2.0.0/16", BGP_ORIGIN_INCOMPLETE, "600", NULL, 0,
+    { 1, BGP_ORIGIN_INCOMPLETE, "{200,300,500,600}", "200:1 500:1", 1 },
+    { 1, BGP_ORIGIN_IGP, "", NULL, 1 },
+  },
+  {
+    "change 10.1.2.0/24", 0,
+    "10.1.2.0/24", BGP_ORIGIN_EGP, "200 300", "200:1", 0,
+    { 1, BGP_ORIGIN_INCOMPLETE, "{200,300,500,600}", "200:1 500:1", 0 },
+    { 1, BGP_ORIGIN_EGP, "", NULL, 1 },
+  },
+  {
+    "withdraw 10.3.0.0/16", 1,
+    "10.3.0.0/16", 0, NULL, NULL, 0,
+    { 1, BGP_ORIGIN_INCOMPLETE, "{200,300,600}", "200:1", 0 },
+    { 1, BGP_ORIGIN_EGP, "", NULL, 1 },
+  },
+  {
+    "withdraw 10.2.0.0/16", 1,
+    "10.2.0.0/16", 0, NULL, NULL, 0,
+    { 1, BGP_ORIGIN_EGP, "200 300", "200:1", 0 },
+    { 1, BGP_ORIGIN_EGP, "", NULL, 1 },
+  },
+  {
+    "add 10.1.0.0/16", 0,
+    "10.1.0.0/16", BGP_ORIGIN_IGP, "200 300 700", "200:3", 0,
+    { 1, BGP_ORIGIN_EGP, "200 300 {700}", "200:1 200:3", 0 },
+    { 1, BGP_ORIGIN_EGP, "", NULL, 1 },
+  },
+  {
+    "withdraw 10.1.2.0/24", 1,
+    "10.1.2.0/24", 0, NULL, NULL, 0,
+    { 1, BGP_ORIGIN_IGP, "200 300 {700}", "200:1 200:3", 0 },
+    { 1, BGP_ORIGIN_IGP, "", NULL, 1 },
+  },
+  {
+    "withdraw 10.1.1.0/24", 1,
+    "10.1.1.0/24", 0, NULL, NULL, 0,
+    { 1, BGP_ORIGIN_IGP, "200 300 700", "200:3", 0 },
+    { 0 },
+  },
+  {
+    "withdraw 10.1.0.0/16", 1,
+    "10.1.0.0/16", 0, NULL, NULL, 0,
+    { 0 },
+    { 0 },
+  },
+  { NULL },
+};
+
+static void
+aggregate_command (struct cmd_element *cmd, const char *prefix)
+{
+  const char *argv[] = { prefix };
+
+  cmd->func (cmd, vty, 1, argv);
+}
+
+/* The live route at PREFIX of the peer given, or NULL. */
+static struct bgp_info *
+route_lookup (const char *prefix, struct peer *from, u_char sub_type)
+{
+  struct prefix p;
+  struct bgp_node *rn;
+  struct bgp_info *ri;
+
+  str2prefix (prefix, &p);
+  rn = bgp_node_lookup (bgp->rib[AFI_IP][SAFI_UNICAST], &p);
+  if (! rn)
+    return NULL;
+  bgp_unlock_node (rn);
+
+  for (ri = rn->info; ri; ri = ri->next)
+    if (ri->peer == from && ri->sub_type == sub_type
+        && ! CHECK_FLAG (ri->flags, BGP_INFO_REMOVED))
+      return ri;
+  return NULL;
+}
+
+static void
+route_update (struct test_step *t)
+{
+  struct prefix p;
+  struct bgp_node *rn;
+  struct bgp_info *ri;
+  struct attr attr;
+  struct attr *attr_new;
+
+  memset (&attr, 0, sizeof (struct attr));
+  attr.origin = t->origin;
+  attr.aspath = aspath_intern (aspath_str2aspath (t->aspath));
+  attr.flag = ATTR_FLAG_BIT (BGP_ATTR_ORIGIN)
+              | ATTR_FLAG_BIT (BGP_ATTR_AS_PATH)
+              | ATTR_FLAG_BIT (BGP_ATTR_NEXT_HOP);
+  if (t->community)
+    {
+      attr.community = community_intern (community_str2com (t->community));
+      attr.flag |= ATTR_FLAG_BIT (BGP_ATTR_COMMUNITIES);
+    }
+  if (t->atomic)
+    attr.flag |= ATTR_FLAG_BIT (BGP_ATTR_ATOMIC_AGGREGATE);
+  attr_new = bgp_attr_intern (&attr);
+  bgp_attr_unintern_sub (&attr);
+
+  str2prefix (t->prefix, &p);
+  ri = route_lookup (t->prefix, peer, BGP_ROUTE_NORMAL);
+  if (ri)
+    {
+      bgp_aggregate_decrement (bgp, &p, ri, AFI_IP, SAFI_UNICAST);
+      bgp_attr_unintern (&ri->attr);
+      ri->attr = attr_new;
+      bgp_aggregate_increment (bgp, &p, ri, AFI_IP, SAFI_UNICAST);
+      return;
+    }
+
+  rn = bgp_node_get (bgp->rib[AFI_IP][SAFI_UNICAST], &p);
+  ri = bgp_pool_get (&bgp_info_pool);
+  ri->type = ZEBRA_ROUTE_BGP;
+  ri->sub_type = BGP_ROUTE_NORMAL;
+  ri->peer = peer;
+  ri->attr = attr_new;
+  ri->net = rn;
+  SET_FLAG (ri->flags, BGP_INFO_VALID);
+  bgp_aggregate_increment (bgp, &p, ri, AFI_IP, SAFI_UNICAST);
+  bgp_info_add (rn, ri);
+  bgp_unlock_node (rn);
+}
+
+static void
+route_withdraw (struct test_step *t)
+{
+  struct prefix p;
+  struct bgp_info *ri;
+
+  str2prefix (t->prefix, &p);
+  ri = route_lookup (t->prefix, peer, BGP_ROUTE_NORMAL);
+  assert (ri);
+  bgp_aggregate_decrement (bgp, &p, ri, AFI_IP, SAFI_UNICAST);
+  bgp_info_delete (ri->net, ri);
+}
+
+static int
+check_aggregate (const char *prefix, struct aggregate_expect *e)
+{
+  struct bgp_info *ri;
+  struct attr *attr;
+  char *community;
+  int ok = 1;
+
+  ri = route_lookup (prefix, bgp->peer_self, BGP_ROUTE_AGGREGATE);
+  if (! e->present || ! ri)
+    {
+      if (!! e->present != !! ri)
+        {
+          printf ("%s: aggregate route %s\n", prefix,
+                  ri ? "not withdrawn" : "missing");
+          return 0;
+        }
+      return 1;
+    }
+
+  attr = ri->attr;
+  if (attr->origin != e->origin)
+    {
+      printf ("%s: origin %d, expected %d\n", prefix, attr->origin, e->origin);
+      ok = 0;
+    }
+  if (strcmp (aspath_print (attr->aspath), e->aspath))
+    {
+      printf ("%s: as-path \"%s\", expected \"%s\"\n", prefix,
+              aspath_print (attr->aspath), e->aspath);
+      ok = 0;
+    }
+  community = attr->community ? community_str (attr->community) : NULL;
+  if (community && e->community ? strcmp (community, e->community)
+                                : community != e->community)
+    {
+      printf ("%s: community \"%s\", expected \"%s\"\n", prefix,
+              community ? community : "", e->community ? e->community : "");
+      ok = 0;
+    }
+  if (!! CHECK_FLAG (attr->flag, ATTR_FLAG_BIT (BGP_ATTR_ATOMIC_AGGREGATE))
+      != e->atomic)
+    {
+      printf ("%s: atomic-aggregate %s, expected %s\n", prefix,
+              e->atomic ? "not set" : "set", e->atomic ? "set" : "not set");
+      ok = 0;
+    }
+  return ok;
+}
+
+/* Each live more-specific is suppressed once by each aggregate over
+   it, both being summary-only. */
+static int
+check_suppress (void)
+{
+  struct prefix as_set, plain;
+  struct bgp_node *rn;
+  struct bgp_info *ri;
+  unsigned long expect, suppress;
+  char buf[PREFIX_STRLEN];
+  int ok = 1;
+
+  str2prefix (AS_SET_AGGREGATE, &as_set);
+  str2prefix (PLAIN_AGGREGATE, &plain);
+
+  for (rn = bgp_table_top (bgp->rib[AFI_IP][SAFI_UNICAST]); rn;
+       rn = bgp_route_next (rn))
+    for (ri = rn->info; ri; ri = ri->next)
+      {
+        if (ri->peer != peer || CHECK_FLAG (ri->flags, BGP_INFO_REMOVED))
+          continue;
+
+        expect = 0;
+        if (prefix_match (&as_set, &rn->p)
+            && as_set.prefixlen < rn->p.prefixlen)
+          expect++;
+        if (prefix_match (&plain, &rn->p)
+            && plain.prefixlen < rn->p.prefixlen)
+          expect++;
+
+        suppress = ri->extra ? ri->extra->suppress : 0;
+        if (suppress != expect)
+          {
+            printf ("%s: suppressed %lu times, expected %lu\n",
+                    prefix2str (&rn->p, buf, sizeof (buf)), suppress, expect);
+            ok = 0;
+          }
+      }
+  return ok;
+}
+
+/* Configure the aggregate at PREFIX again, so it is worked out from
+   all of its subtree, and check nothing changes in the aggregate
+   route. */
+static int
+check_recompute (struct cmd_element *cmd, const char *prefix)
+{
+  struct bgp_info *ri;
+  struct attr *before;
+  int ok;
+
+  ri = route_lookup (prefix, bgp->peer_self, BGP_ROUTE_AGGREGATE);
+  before = ri ? bgp_attr_intern_ref (ri->attr) : NULL;
+
+  aggregate_command (&no_aggregate_address_cmd, prefix);
+  aggregate_command (cmd, prefix);
+
+  ri = route_lookup (prefix, bgp->peer_self, BGP_ROUTE_AGGREGATE);
+  ok = (ri ? ri->attr : NULL) == before;
+  if (! ok)
+    printf ("%s: aggregate route differs when recomputed\n", prefix);
+
+  if (before)
+    bgp_attr_unintern (&before);
+  return ok;
+}
+
+static void
+run_steps (int recompute)
+{
+  struct test_step *t;
+  int ok;
+
+  for (t = test_steps; t->name; t++)
+    {
+      if (t->withdraw)
+        route_withdraw (t);
+      else
+        route_update (t);
+
+      ok = check_aggregate (AS_SET_AGGREGATE, &t->as_set);
+      ok &= check_aggregate (PLAIN_AGGREGATE, &t->plain);
+      ok &= check_suppress ();
+
+      if (recompute)
+        {
+          ok &= check_recompute (&aggregate_address_as_set_summary_cmd,
+                                 AS_SET_AGGREGATE);
+          ok &= check_recompute (&aggregate_address_summary_only_cmd,
+                                 PLAIN_AGGREGATE);
+          ok &= check_aggregate (AS_SET_AGGREGATE, &t->as_set);
+          ok &= check_aggregate (PLAIN_AGGREGATE, &t->plain);
+          ok &= check_suppress ();
+        }
+
+      printf ("%s%s: %s\n", t->name, recompute ? ", recomputed" : "",
+              ok ? (tty ? OK : "OK") : (tty ? FAILED : "failed"));
+      if (! ok)
+        failed++;
+    }
+}
+
+int
+main (void)
+{
+  union sockunion su;
+
+  master = thread_master_create ();
+  bgp_master_init ();
+  bgp_option_set (BGP_OPT_NO_LISTEN);
+  bgp_attr_init ();
+  bgp_address_init ();
+  bgp_scan_init ();
+
+  if (fileno (stdout) >= 0)
+    tty = isatty (fileno (stdout));
+
+  if (bgp_get (&bgp, &asn, NULL))
+    return -1;
+
+  memset (&su, 0, sizeof (su));
+  su.sa.sa_family = AF_INET;
+  peer = peer_create_accept (bgp, &su);
+  peer->host = (char *)"foo";
+
+  vty = vty_new ();
+  vty->type = VTY_TERM;
+  vty->node = BGP_NODE;
+  vty->index = bgp;
+
+  aggregate_command (&aggregate_address_as_set_summary_cmd, AS_SET_AGGREGATE);
+  aggregate_command (&aggregate_address_summary_only_cmd, PLAIN_AGGREGATE);
+
+  run_steps (0);
+  run_steps (1);
+
+  printf ("failures: %d\n", failed);
+  return failed;
+}
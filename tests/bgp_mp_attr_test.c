@@ -740,6 +740,7 @@ int
 main (void)
 {
   struct peer *peer;
+  union sockunion su;
   int i, j;
   
   conf_bgp_debug_fsm = -1UL;
@@ -766,7 +767,9 @@ main (void)
   if (bgp_get (&bgp, &asn, NULL))
     return -1;
   
-  peer = peer_create_accept (bgp);
+  memset (&su, 0, sizeof (su));
+  su.sa.sa_family = AF_INET;
+  peer = peer_create_accept (bgp, &su);
   peer->host = (char *)"foo";
   peer->status = Established;
   
@@ -35,6 +35,7 @@
 #include "bgpd/bgp_table.h"
 #include "bgpd/bgp_route.h"
 #include "bgpd/bgp_attr.h"
+#include "bgpd/bgp_aspath.h"
 #include "bgpd/bgp_mpath.h"
 
 #define VT100_RESET "\x1b[0m"
@@ -291,12 +292,16 @@ testcase_t test_bgp_mp_list = {
  * Testcase for bgp_info_mpath_update
  */
 
+struct bgp_table *test_table;
 struct bgp_node test_rn;
 
 static int
 setup_bgp_info_mpath_update (testcase_t *t)
 {
   int i;
+  /* Paths go on lists by the afi/safi of the table of their node. */
+  test_table = bgp_table_init (AFI_IP, SAFI_UNICAST);
+  test_rn.table = test_table->route_table;
   str2prefix ("42.1.1.0/24", &test_rn.p);
   setup_bgp_mp_list (t);
   for (i = 0; i < test_mp_list_info_count; i++)
@@ -354,6 +359,7 @@ cleanup_bgp_info_mpath_update (testcase_t *t)
 
   for (i = 0; i < test_mp_list_peer_count; i++)
     sockunion_free (test_mp_list_peer[i].su_remote);
+  bgp_table_unlock (test_table);
 
   return 0;
 }
@@ -365,6 +371,158 @@ testcase_t test_bgp_info_mpath_update = {
   .cleanup = cleanup_bgp_info_mpath_update,
 };
 
+/*=========================================================
+ * Testcase for deterministic-MED selection: grouping the paths by
+ * neighboring AS selects as comparing them in pairs does, and takes
+ * less time about it
+ */
+
+#define TEST_DMED_PATHS 48
+#define TEST_DMED_RUNS 5000
+
+struct bgp test_dmed_bgp;
+struct bgp_table *test_dmed_table;
+struct bgp_node *test_dmed_rn;
+struct peer test_dmed_peer[TEST_DMED_PATHS];
+struct attr test_dmed_attr[TEST_DMED_PATHS];
+struct bgp_info test_dmed_info[TEST_DMED_PATHS];
+
+static int
+setup_bgp_dmed_select (testcase_t *t)
+{
+  struct prefix p;
+  char aspath[64];
+  int i;
+
+  test_dmed_bgp.default_local_pref = BGP_DEFAULT_LOCAL_PREF;
+  bgp_flag_set (&test_dmed_bgp, BGP_FLAG_DETERMINISTIC_MED);
+
+  test_dmed_table = bgp_table_init (AFI_IP, SAFI_UNICAST);
+  str2prefix ("42.2.0.0/16", &p);
+  test_dmed_rn = bgp_node_get (test_dmed_table, &p);
+
+  for (i = 0; i < TEST_DMED_PATHS; i++)
+    {
+      struct peer *peer = &test_dmed_peer[i];
+      struct attr *attr = &test_dmed_attr[i];
+      struct bgp_info *ri = &test_dmed_info[i];
+
+      peer->bgp = &test_dmed_bgp;
+      peer->sort = BGP_PEER_IBGP;
+      peer->status = Established;
+      peer->remote_id.s_addr = htonl (i + 1);
+
+      /* Some sessions down, some of those restarting gracefully. */
+      if (i % 11 == 5)
+        {
+          peer->status = Idle;
+          if (i % 2)
+            SET_FLAG (peer->sflags, PEER_STATUS_NSF_WAIT);
+        }
+
+      /* Mostly from 8 neighboring ASes, some originated in this AS and
+         some matching no other path. */
+      if (i % 13 == 7)
+        attr->aspath = aspath_str2aspath ("");
+      else if (i % 17 == 3)
+        attr->aspath = aspath_str2aspath ("{65001,65002} 100");
+      else
+        {
+          snprintf (aspath, sizeof (aspath), "%u 100", 65000 + i % 8);
+          attr->aspath = aspath_str2aspath (aspath);
+        }
+      if (attr->aspath == NULL)
+        return -1;
+      attr->flag |= ATTR_FLAG_BIT (BGP_ATTR_MULTI_EXIT_DISC);
+      attr->med = (i * 7919) % 50;
+
+      ri->flags = BGP_INFO_VALID;
+      ri->peer = peer;
+      ri->attr = attr;
+      ri->net = test_dmed_rn;
+      ri->next = test_dmed_rn->info;
+      test_dmed_rn->info = ri;
+    }
+  return 0;
+}
+
+/* Select for the node, and note which paths won in their group. */
+static void
+bgp_dmed_select_run (int pairwise, int selected[])
+{
+  int i;
+
+  for (i = 0; i < TEST_DMED_PATHS; i++)
+    UNSET_FLAG (test_dmed_info[i].flags,
+                BGP_INFO_DMED_CHECK | BGP_INFO_DMED_SELECTED);
+  bgp_dmed_select (&test_dmed_bgp, test_dmed_rn, AFI_IP, SAFI_UNICAST,
+                   pairwise);
+  if (selected)
+    for (i = 0; i < TEST_DMED_PATHS; i++)
+      selected[i] = CHECK_FLAG (test_dmed_info[i].flags,
+                                BGP_INFO_DMED_SELECTED) ? 1 : 0;
+}
+
+static unsigned long
+bgp_dmed_select_time (int pairwise)
+{
+  struct timeval start, end;
+  int i;
+
+  gettimeofday (&start, NULL);
+  for (i = 0; i < TEST_DMED_RUNS; i++)
+    bgp_dmed_select_run (pairwise, NULL);
+  gettimeofday (&end, NULL);
+
+  return ((end.tv_sec - start.tv_sec) * 1000000
+          + (end.tv_usec - start.tv_usec)) * 1000 / TEST_DMED_RUNS;
+}
+
+static int
+run_bgp_dmed_select (testcase_t *t)
+{
+  int pairwise[TEST_DMED_PATHS];
+  int grouped[TEST_DMED_PATHS];
+  int i, groups = 0;
+  int test_result = TEST_PASSED;
+
+  bgp_dmed_select_run (1, pairwise);
+  bgp_dmed_select_run (0, grouped);
+  for (i = 0; i < TEST_DMED_PATHS; i++)
+    {
+      EXPECT_TRUE (pairwise[i] == grouped[i], test_result);
+      groups += grouped[i];
+    }
+  /* 8 neighboring ASes, this AS, and the paths matching no other. */
+  EXPECT_TRUE (groups > 9, test_result);
+
+  printf ("%d paths in %d groups: %lu ns compared in pairs, "
+          "%lu ns grouped\n", TEST_DMED_PATHS, groups,
+          bgp_dmed_select_time (1), bgp_dmed_select_time (0));
+
+  return test_result;
+}
+
+static int
+cleanup_bgp_dmed_select (testcase_t *t)
+{
+  int i;
+
+  for (i = 0; i < TEST_DMED_PATHS; i++)
+    aspath_free (test_dmed_attr[i].aspath);
+  test_dmed_rn->info = NULL;
+  bgp_unlock_node (test_dmed_rn);
+  bgp_table_unlock (test_dmed_table);
+  return 0;
+}
+
+testcase_t test_bgp_dmed_select = {
+  .desc = "Test bgp_dmed_select",
+  .setup = setup_bgp_dmed_select,
+  .run = run_bgp_dmed_select,
+  .cleanup = cleanup_bgp_dmed_select,
+};
+
 /*=========================================================
  * Set up testcase vector
  */
@@ -372,6 +530,7 @@ testcase_t *all_tests[] = {
   &test_bgp_cfg_maximum_paths,
   &test_bgp_mp_list,
   &test_bgp_info_mpath_update,
+  &test_bgp_dmed_select,
 };
 
 int all_tests_count = (sizeof(all_tests)/sizeof(testcase_t *));
@@ -534,6 +534,74 @@ test_iter_pause (void)
   route_table_finish (table);
 }
 
+/*
+ * test_get_hint
+ *
+ * Add prefixes, each starting from the node of the one before, and
+ * check that the tree is the same as when they are added from the top.
+ */
+static void
+test_get_hint (void)
+{
+  struct route_table *table, *ref;
+  struct route_node *rn, *hint;
+  struct prefix_ipv4 p;
+  int i, num_prefixes;
+  const char *prefixes[] = {
+    "1.0.1.0/24",
+    "1.0.1.0/25",
+    "1.0.1.128/25",
+    "1.0.0.0/16",
+    "1.0.2.0/24",
+    "1.0.3.0/24",
+    "2.0.0.0/8",
+    "0.0.0.0/0",
+    "1.0.1.192/26",
+    "10.0.0.0/8",
+    "1.0.1.0/24"
+  };
+
+  num_prefixes = sizeof (prefixes) / sizeof (prefixes[0]);
+
+  printf ("\n\nTesting that route_node_get_hint() works as expected\n");
+  table = route_table_init ();
+  ref = route_table_init ();
+  hint = NULL;
+  for (i = 0; i < num_prefixes; i++)
+    {
+      str2prefix_ipv4 (prefixes[i], &p);
+      rn = route_node_get_hint (table, (struct prefix *) &p, hint);
+      assert (prefix_same (&rn->p, (struct prefix *) &p));
+
+      /* Nodes with info stay around, so they can serve as the hint. */
+      if (rn->info)
+        route_unlock_node (rn);
+      else
+        {
+          rn->info = malloc (sizeof (test_node_t));
+          ((test_node_t *) rn->info)->prefix_str = strdup (prefixes[i]);
+          add_node (ref, prefixes[i]);
+        }
+      hint = rn;
+    }
+
+  assert (table->count == ref->count);
+  for (rn = route_top (table), hint = route_top (ref); rn;
+       rn = route_next (rn), hint = route_next (hint))
+    {
+      assert (hint);
+      assert (prefix_same (&rn->p, &hint->p));
+      assert (! rn->info == ! hint->info);
+    }
+  assert (! hint);
+
+  print_table (table);
+  clear_table (table);
+  clear_table (ref);
+  route_table_finish (table);
+  route_table_finish (ref);
+}
+
 /*
  * run_tests
  */
@@ -543,6 +611,7 @@ run_tests (void)
   test_prefix_iter_cmp ();
   test_get_next ();
   test_iter_pause ();
+  test_get_hint ();
 }
 
 /*
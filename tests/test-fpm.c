@@ -0,0 +1,402 @@
+/*
+ * End to end test of the FPM interface: runs zebra with the null
+ * kernel (testzebra) against the reference FPM (fpm_server), adds and
+ * deletes a batch of static routes over the vty and checks that the
+ * shadow FIB kept by the FPM converges to the RIB each time.  With
+ * batching on, the table zebra sends again when the FPM comes back
+ * must take fewer messages than routes.  This is done with each
+ * message format built in.  How long the FPM took to get the last
+ * update of each step after it was started is printed.
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#include <sys/wait.h>
+#include <poll.h>
+
+struct thread_master *master;
+
+#if defined (HAVE_FPM) && defined (HAVE_NETLINK)
+
+#define ROUTES		2000
+#define TIMEOUT_SECS	60
+
+#define FPM_SERVER	"../fpm/fpm_server"
+#define TESTZEBRA	"../zebra/testzebra"
+
+/* The connected route of eth0, all statics point into it. */
+#define CONNECTED	"route 10.0.0.0/24 nexthops 1 dev 1"
+
+#define CONF_FILE	"/tmp/testfpm.XXXXXX"
+
+static pid_t fpm_pid, zebra_pid;
+static FILE *fpm_out;
+static char conf_file[] = CONF_FILE;
+
+/* What the FPM reported for the bursts of a step. */
+struct fpm_bursts
+{
+  unsigned long msgs;
+  unsigned long routes;
+  struct timeval last;
+};
+
+static void
+stop_fpm (void)
+{
+  if (fpm_pid > 0)
+    {
+      kill (fpm_pid, SIGTERM);
+      waitpid (fpm_pid, NULL, 0);
+      fpm_pid = 0;
+    }
+  if (fpm_out)
+    {
+      fclose (fpm_out);
+      fpm_out = NULL;
+    }
+}
+
+static void
+cleanup (void)
+{
+  if (zebra_pid > 0)
+    {
+      kill (zebra_pid, SIGTERM);
+      waitpid (zebra_pid, NULL, 0);
+      zebra_pid = 0;
+    }
+  stop_fpm ();
+  unlink (conf_file);
+}
+
+static void
+fail (const char *what)
+{
+  printf ("FAILED: %s\n", what);
+  cleanup ();
+  exit (1);
+}
+
+static void
+route_prefix (int i, char *buf, size_t len)
+{
+  snprintf (buf, len, "10.%d.%d.0/24", 1 + i / 256, i % 256);
+}
+
+/* Start the FPM with its output on a pipe, on the given port or any
+ * free one for 0, returns its port. */
+static int
+start_fpm (int port)
+{
+  char line[256], arg[16];
+  int fds[2];
+
+  if (pipe (fds) < 0)
+    fail ("pipe");
+
+  if ((fpm_pid = fork ()) == 0)
+    {
+      dup2 (fds[1], STDOUT_FILENO);
+      close (fds[0]);
+      close (fds[1]);
+      snprintf (arg, sizeof (arg), "%d", port);
+      execl (FPM_SERVER, FPM_SERVER, "-p", arg, "-i", "300", "-d", "-o",
+             (char *) NULL);
+      _exit (127);
+    }
+  close (fds[1]);
+  fpm_out = fdopen (fds[0], "r");
+
+  if (!fgets (line, sizeof (line), fpm_out)
+      || sscanf (line, "listening on port %d", &port) != 1)
+    fail ("fpm_server did not start");
+  return port;
+}
+
+/* Find a free TCP port for the vty. */
+static int
+free_port (void)
+{
+  struct sockaddr_in sin;
+  socklen_t len = sizeof (sin);
+  int sock;
+
+  sock = socket (AF_INET, SOCK_STREAM, 0);
+  memset (&sin, 0, sizeof (sin));
+  sin.sin_family = AF_INET;
+  sin.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  if (sock < 0
+      || bind (sock, (struct sockaddr *) &sin, sizeof (sin)) < 0
+      || getsockname (sock, (struct sockaddr *) &sin, &len) < 0)
+    fail ("cannot find a free port");
+  close (sock);
+  return ntohs (sin.sin_port);
+}
+
+static void
+start_zebra (const char *format, int fpm_port, int vty_port)
+{
+  char port[16];
+  FILE *f;
+  int fd;
+
+  strcpy (conf_file, CONF_FILE);
+  if ((fd = mkstemp (conf_file)) < 0 || (f = fdopen (fd, "w")) == NULL)
+    fail ("cannot write configuration");
+  fprintf (f,
+           "hostname testfpm\n"
+           "line vty\n"
+           " no login\n"
+           "fpm connection ip 127.0.0.1 port %d\n"
+           "interface eth0\n"
+           " no link-detect\n"
+           " ip address 10.0.0.1/24\n"
+           " state up\n", fpm_port);
+  fclose (f);
+
+  snprintf (port, sizeof (port), "%d", vty_port);
+  if ((zebra_pid = fork ()) == 0)
+    {
+      int null = open ("/dev/null", O_WRONLY);
+
+      dup2 (null, STDOUT_FILENO);
+      execl (TESTZEBRA, TESTZEBRA, "-f", conf_file, "-P", port,
+             "-F", format, (char *) NULL);
+      _exit (127);
+    }
+}
+
+static int
+vty_connect (int port)
+{
+  struct sockaddr_in sin;
+  int sock, i;
+
+  memset (&sin, 0, sizeof (sin));
+  sin.sin_family = AF_INET;
+  sin.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  sin.sin_port = htons (port);
+
+  for (i = 0; i < 100; i++)
+    {
+      if ((sock = socket (AF_INET, SOCK_STREAM, 0)) < 0)
+        fail ("socket");
+      if (connect (sock, (struct sockaddr *) &sin, sizeof (sin)) == 0)
+        return sock;
+      close (sock);
+      usleep (100000);
+    }
+  fail ("cannot connect to the testzebra vty");
+  return -1;
+}
+
+/* Send a command, throwing away whatever the vty has said so far. */
+static void
+vty_cmd (int sock, const char *fmt, ...)
+{
+  char buf[4096];
+  va_list args;
+  size_t len;
+
+  va_start (args, fmt);
+  len = vsnprintf (buf, sizeof (buf) - 1, fmt, args);
+  va_end (args);
+  buf[len++] = '\n';
+
+  if (write (sock, buf, len) != (ssize_t) len)
+    fail ("vty write");
+  while (recv (sock, buf, sizeof (buf), MSG_DONTWAIT) > 0)
+    ;
+}
+
+/* Wait for the FPM to report a shadow FIB of the given size, adding up
+ * what it says about the bursts on the way, then check the dump that
+ * follows: route i must be there iff present (i) says so. */
+static void
+check_fib (unsigned long expect, int (*present) (int),
+           struct fpm_bursts *bursts)
+{
+  char line[512], prefix[64], want[128];
+  unsigned long fib = 0;
+  int seen[ROUTES];
+  int i;
+
+  memset (bursts, 0, sizeof (*bursts));
+  while (fib != expect)
+    {
+      unsigned long routes, msgs;
+      long sec, usec;
+      char *p;
+
+      if (!fgets (line, sizeof (line), fpm_out))
+        fail ("fpm_server went away");
+      if (strncmp (line, "burst:", 6) != 0)
+        continue;
+
+      printf ("%s", line);
+      if (strstr (line, "errors"))
+        fail ("fpm_server saw bad updates");
+      if (sscanf (line, "burst: %lu routes", &routes) != 1
+          || (p = strstr (line, " in ")) == NULL
+          || sscanf (p, " in %lu msgs", &msgs) != 1
+          || (p = strstr (line, "fib ")) == NULL
+          || sscanf (p, "fib %lu, last at %ld.%ld", &fib, &sec, &usec) != 3)
+        fail (line);
+      bursts->routes += routes;
+      bursts->msgs += msgs;
+      bursts->last.tv_sec = sec;
+      bursts->last.tv_usec = usec;
+    }
+
+  memset (seen, 0, sizeof (seen));
+  while (fgets (line, sizeof (line), fpm_out) && strcmp (line, "end\n"))
+    {
+      int a, b;
+
+      line[strlen (line) - 1] = '\0';
+      if (strcmp (line, CONNECTED) == 0)
+        continue;
+      if (sscanf (line, "route 10.%d.%d.0/24", &a, &b) != 2)
+        fail (line);
+      i = (a - 1) * 256 + b;
+      if (i < 0 || i >= ROUTES || seen[i] || !present (i))
+        fail (line);
+      route_prefix (i, prefix, sizeof (prefix));
+      snprintf (want, sizeof (want), "route %s nexthops 1 via 10.0.0.254 dev 1",
+                prefix);
+      if (strcmp (line, want))
+        fail (line);
+      seen[i] = 1;
+    }
+
+  for (i = 0; i < ROUTES; i++)
+    if (present (i) && !seen[i])
+      fail ("route missing from the shadow FIB");
+}
+
+static int
+all_routes (int i)
+{
+  return 1;
+}
+
+static int
+odd_routes (int i)
+{
+  return i % 2;
+}
+
+static void
+alarm_handler (int sig)
+{
+  fail ("timed out");
+}
+
+static void
+print_delay (const char *what, struct timeval *start,
+             struct fpm_bursts *bursts)
+{
+  printf ("%s: %lu routes in %lu msgs, last one at the FPM after %.3f secs\n",
+          what, bursts->routes, bursts->msgs,
+          (bursts->last.tv_sec - start->tv_sec)
+          + (bursts->last.tv_usec - start->tv_usec) / 1e6);
+}
+
+static void
+run (const char *format)
+{
+  struct fpm_bursts bursts;
+  struct timeval start;
+  char prefix[64];
+  int fpm_port, vty_port, vty, i;
+
+  printf ("%s format\n", format);
+  fpm_port = start_fpm (0);
+  vty_port = free_port ();
+  start_zebra (format, fpm_port, vty_port);
+  vty = vty_connect (vty_port);
+
+  vty_cmd (vty, "enable");
+  vty_cmd (vty, "configure terminal");
+
+  /* Updates are sent one route per FPM message. */
+  gettimeofday (&start, NULL);
+  for (i = 0; i < ROUTES; i++)
+    {
+      route_prefix (i, prefix, sizeof (prefix));
+      vty_cmd (vty, "ip route %s 10.0.0.254", prefix);
+    }
+  check_fib (ROUTES + 1, all_routes, &bursts);
+  print_delay ("adds", &start, &bursts);
+
+  gettimeofday (&start, NULL);
+  for (i = 0; i < ROUTES; i += 2)
+    {
+      route_prefix (i, prefix, sizeof (prefix));
+      vty_cmd (vty, "no ip route %s 10.0.0.254", prefix);
+    }
+  check_fib (ROUTES / 2 + 1, odd_routes, &bursts);
+  print_delay ("deletes", &start, &bursts);
+
+  /* With batching, the updates zebra has queued by the time it gets to
+   * write are packed together.  Route changes are written out about as
+   * fast as they are queued, but after a reconnect zebra queues the
+   * whole table in one go, so take the FPM down and up again. */
+  vty_cmd (vty, "fpm batch-updates");
+  stop_fpm ();
+  gettimeofday (&start, NULL);
+  start_fpm (fpm_port);
+  check_fib (ROUTES / 2 + 1, odd_routes, &bursts);
+  print_delay ("resend", &start, &bursts);
+  if (bursts.msgs >= bursts.routes)
+    fail ("updates were not batched");
+
+  close (vty);
+  cleanup ();
+}
+
+int
+main (int argc, char **argv)
+{
+  signal (SIGALRM, alarm_handler);
+  signal (SIGPIPE, SIG_IGN);
+  alarm (TIMEOUT_SECS);
+
+  run ("netlink");
+#ifdef HAVE_PROTOBUF
+  run ("protobuf");
+#endif /* HAVE_PROTOBUF */
+
+  printf ("OK\n");
+  return 0;
+}
+
+#else /* HAVE_FPM && HAVE_NETLINK */
+
+int
+main (int argc, char **argv)
+{
+  printf ("FPM support with netlink not built, skipped\n");
+  printf ("OK\n");
+  return 0;
+}
+
+#endif /* HAVE_FPM && HAVE_NETLINK */
@@ -0,0 +1,291 @@
+/*
+ * Test and benchmark of the ZAPI shared memory ring: a forked producer
+ * sends a stream of ZAPI framed messages, first over a socketpair and
+ * then over a ring, and the consumer checks every one of them arrives
+ * intact and in order.
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#include <sys/wait.h>
+#include <poll.h>
+#ifdef HAVE_ZAPI_RING
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#endif
+
+#include "memory.h"
+#include "zclient.h"
+#include "zring.h"
+
+struct thread_master *master;
+
+#define MESSAGES	2000000
+#define RING_SIZE	(256 * 1024)
+#define RBUF_SIZE	(ZEBRA_MAX_PACKET_SIZ * 16)
+
+/* Vary the message size, so that messages straddle the end of the
+ * ring and partial reads happen. */
+static size_t
+msg_build (u_char *buf, u_int32_t seq)
+{
+  size_t len = ZEBRA_HEADER_SIZE + 4 + (seq % 97);
+  size_t i;
+
+  buf[0] = len >> 8;
+  buf[1] = len & 0xff;
+  buf[2] = ZEBRA_HEADER_MARKER;
+  buf[3] = ZSERV_VERSION;
+  buf[4] = buf[5] = 0;
+  buf[6] = 0;
+  buf[7] = ZEBRA_IPV4_ROUTE_ADD;
+  memcpy (buf + ZEBRA_HEADER_SIZE, &seq, 4);
+  for (i = ZEBRA_HEADER_SIZE + 4; i < len; i++)
+    buf[i] = (u_char) (seq + i);
+  return len;
+}
+
+/* Check all complete messages in buf, return number of bytes used. */
+static size_t
+msg_check (const u_char *buf, size_t len, u_int32_t *seq)
+{
+  u_char expect[ZEBRA_MAX_PACKET_SIZ];
+  size_t used = 0;
+
+  while (len - used >= ZEBRA_HEADER_SIZE)
+    {
+      size_t mlen = (buf[used] << 8) | buf[used + 1];
+
+      if (len - used < mlen)
+        break;
+      if (msg_build (expect, *seq) != mlen
+          || memcmp (expect, buf + used, mlen) != 0)
+        {
+          printf ("message %u corrupted\n", *seq);
+          exit (1);
+        }
+      (*seq)++;
+      used += mlen;
+    }
+  return used;
+}
+
+static double
+elapsed (struct timeval *start)
+{
+  struct timeval now;
+
+  gettimeofday (&now, NULL);
+  return (now.tv_sec - start->tv_sec) + (now.tv_usec - start->tv_usec) / 1e6;
+}
+
+static void
+report (const char *what, double secs)
+{
+  printf ("%-8s %u messages in %.3fs, %.0f msgs/s\n", what, MESSAGES, secs,
+          MESSAGES / secs);
+}
+
+static double
+bench_socket (void)
+{
+  u_char buf[RBUF_SIZE];
+  size_t have = 0;
+  u_int32_t seq = 0;
+  struct timeval start;
+  int sv[2];
+  pid_t pid;
+
+  if (socketpair (AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+    {
+      perror ("socketpair");
+      exit (1);
+    }
+
+  gettimeofday (&start, NULL);
+  if ((pid = fork ()) == 0)
+    {
+      u_char msg[ZEBRA_MAX_PACKET_SIZ];
+      u_int32_t i;
+
+      close (sv[0]);
+      for (i = 0; i < MESSAGES; i++)
+        {
+          size_t len = msg_build (msg, i);
+
+          if (write (sv[1], msg, len) != (ssize_t) len)
+            _exit (1);
+        }
+      _exit (0);
+    }
+  close (sv[1]);
+
+  while (seq < MESSAGES)
+    {
+      ssize_t n = read (sv[0], buf + have, sizeof (buf) - have);
+      size_t used;
+
+      if (n <= 0)
+        {
+          printf ("socket: producer went away after %u messages\n", seq);
+          exit (1);
+        }
+      have += n;
+      used = msg_check (buf, have, &seq);
+      memmove (buf, buf + used, have - used);
+      have -= used;
+    }
+  close (sv[0]);
+  waitpid (pid, NULL, 0);
+
+  return elapsed (&start);
+}
+
+#ifdef HAVE_ZAPI_RING
+static void
+ring_wait (int fd)
+{
+  struct pollfd pfd;
+
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  poll (&pfd, 1, 1000);
+  zring_eventfd_clear (fd);
+}
+
+static double
+bench_ring (void)
+{
+  u_char buf[RBUF_SIZE];
+  size_t have = 0;
+  u_int32_t seq = 0;
+  struct timeval start;
+  struct zring *zr;
+  u_int32_t wakeups = 0;
+  pid_t pid;
+
+  if ((zr = zring_create (RING_SIZE)) == NULL)
+    {
+      printf ("ring: cannot create\n");
+      exit (1);
+    }
+
+  gettimeofday (&start, NULL);
+  if ((pid = fork ()) == 0)
+    {
+      u_char msg[ZEBRA_MAX_PACKET_SIZ];
+      struct zring *pr;
+      u_int32_t i;
+
+      /* Map it once more, the way zebra does. */
+      pr = zring_attach (dup (zr->memfd), dup (zr->efd_data),
+                         dup (zr->efd_space));
+      if (pr == NULL)
+        _exit (1);
+      for (i = 0; i < MESSAGES; i++)
+        {
+          size_t len = msg_build (msg, i);
+
+          while (zring_write (pr, msg, len) < 0)
+            ring_wait (pr->efd_space);
+          zring_doorbell (pr);
+        }
+      _exit (0);
+    }
+
+  while (seq < MESSAGES)
+    {
+      size_t n = zring_read (zr, buf + have, sizeof (buf) - have);
+      size_t used;
+
+      if (n == 0)
+        {
+          int status;
+
+          if (waitpid (pid, &status, WNOHANG) == pid)
+            {
+              printf ("ring: producer went away after %u messages\n", seq);
+              exit (1);
+            }
+          if (zring_consumer_sleep (zr) == 0)
+            {
+              ring_wait (zr->efd_data);
+              wakeups++;
+            }
+          continue;
+        }
+      have += n;
+      used = msg_check (buf, have, &seq);
+      memmove (buf, buf + used, have - used);
+      have -= used;
+    }
+  waitpid (pid, NULL, 0);
+  zring_free (zr);
+
+  printf ("ring: consumer slept %u times\n", wakeups);
+  return elapsed (&start);
+}
+
+/* zebra must refuse rings it could be hurt by: too small for a
+ * message, or with a memfd the client could still resize. */
+static void
+test_attach_checks (void)
+{
+  u_int32_t hdr[2] = { 0x5a52494e, 1 };
+  struct zring *zr;
+  int memfd;
+
+  if (zring_create (1) != NULL)
+    {
+      printf ("attach: tiny ring created\n");
+      exit (1);
+    }
+
+  /* Unsealed memfd with a plausible header. */
+  memfd = memfd_create ("zapi-ring-test", MFD_CLOEXEC);
+  hdr[1] = RING_SIZE;
+  if (memfd < 0
+      || ftruncate (memfd, 3 * 64 + RING_SIZE) < 0
+      || pwrite (memfd, hdr, sizeof (hdr), 0) != sizeof (hdr))
+    {
+      printf ("attach: cannot set up memfd\n");
+      exit (1);
+    }
+  if ((zr = zring_attach (memfd, eventfd (0, 0), eventfd (0, 0))) != NULL)
+    {
+      printf ("attach: unsealed ring accepted\n");
+      exit (1);
+    }
+}
+#endif /* HAVE_ZAPI_RING */
+
+int
+main (int argc, char **argv)
+{
+  report ("socket", bench_socket ());
+#ifdef HAVE_ZAPI_RING
+  test_attach_checks ();
+  report ("ring", bench_ring ());
+#else
+  printf ("ring: not supported on this system, skipped\n");
+#endif /* HAVE_ZAPI_RING */
+  printf ("OK\n");
+  return 0;
+}
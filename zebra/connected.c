@@ -156,6 +156,9 @@ connected_update(struct interface *ifp, struct connected *ifc)
   /* Check same connected route. */
   if ((current = connected_check (ifp, (struct prefix *) ifc->address)))
     {
+      /* The kernel still has it, see connected_sweep_stale(). */
+      UNSET_FLAG(current->conf, ZEBRA_IFC_STALE);
+
       if (CHECK_FLAG(current->conf, ZEBRA_IFC_CONFIGURED))
         SET_FLAG(ifc->conf, ZEBRA_IFC_CONFIGURED);
 	
@@ -180,6 +183,41 @@ connected_update(struct interface *ifp, struct connected *ifc)
     connected_announce(ifp, ifc);
 }
 
+/* Flag all kernel addresses of the interface as stale, ahead of
+ * re-reading them from the kernel.  Those read again lose the flag in
+ * connected_update(). */
+void
+connected_mark_stale (struct interface *ifp)
+{
+  struct connected *ifc;
+  struct listnode *node;
+
+  for (ALL_LIST_ELEMENTS_RO (ifp->connected, node, ifc))
+    if (CHECK_FLAG (ifc->conf, ZEBRA_IFC_REAL))
+      SET_FLAG (ifc->conf, ZEBRA_IFC_STALE);
+}
+
+/* Withdraw the addresses which are still flagged stale, the kernel does
+ * not have them anymore. */
+void
+connected_sweep_stale (struct interface *ifp)
+{
+  struct connected *ifc;
+  struct listnode *node, *nnode;
+  int changed = 0;
+
+  for (ALL_LIST_ELEMENTS (ifp->connected, node, nnode, ifc))
+    if (CHECK_FLAG (ifc->conf, ZEBRA_IFC_STALE))
+      {
+	UNSET_FLAG (ifc->conf, ZEBRA_IFC_STALE);
+	connected_withdraw (ifc);
+	changed = 1;
+      }
+
+  if (changed)
+    rib_update (ifp->vrf_id);
+}
+
 /* Called from if_up(). */
 void
 connected_up_ipv4 (struct interface *ifp, struct connected *ifc)
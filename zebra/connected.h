@@ -38,6 +38,9 @@ connected_delete_ipv4 (struct interface *ifp, int flags, struct in_addr *addr,
 extern void connected_up_ipv4 (struct interface *, struct connected *);
 extern void connected_down_ipv4 (struct interface *, struct connected *);
 
+extern void connected_mark_stale (struct interface *);
+extern void connected_sweep_stale (struct interface *);
+
 #ifdef HAVE_IPV6
 extern void
 connected_add_ipv6 (struct interface *ifp, int flags, struct in6_addr *address,
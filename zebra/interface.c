@@ -622,7 +622,7 @@ if_delete_update (struct interface *ifp)
      while processing the deletion.  Each client daemon is responsible
      for setting ifindex to IFINDEX_INTERNAL after processing the
      interface deletion message. */
-  ifp->ifindex = IFINDEX_INTERNAL;
+  if_set_index (ifp, IFINDEX_INTERNAL);
 }
 
 /* Interface is up. */
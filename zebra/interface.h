@@ -209,6 +209,9 @@ struct zebra_if
   struct event_counter up_events;
   struct event_counter down_events;
 
+  /* Not seen yet during a re-read of the kernel's interfaces. */
+  u_char stale;
+
 #if defined(HAVE_RTADV)
   struct rtadvconf rtadv;
 #endif /* RTADV */
@@ -79,6 +79,8 @@ struct option longopts[] =
   { "vty_addr",    required_argument, NULL, 'A'},
   { "vty_port",    required_argument, NULL, 'P'},
   { "retain",      no_argument,       NULL, 'r'},
+  { "warm_restart", required_argument, NULL, 'W'},
+  { "restore",     required_argument, NULL, 'R'},
   { "dryrun",      no_argument,       NULL, 'C'},
 #ifdef HAVE_NETLINK
   { "nl-bufsize",  required_argument, NULL, 's'},
@@ -141,6 +143,12 @@ usage (char *progname, int status)
 	      "-P, --vty_port     Set vty's port number\n"\
 	      "-r, --retain       When program terminates, retain added route "\
 				  "by zebra.\n"\
+	      "-W, --warm_restart Keep routes added by zebra over a restart, "\
+				  "for up to the given\n"\
+	      "                   number of seconds, for clients to announce "\
+				  "them again.\n"\
+	      "                   Implies -r.\n"\
+	      "-R, --restore      Load the routes in a RIB snapshot at startup\n"\
 	      "-u, --user         User to run as\n"\
 	      "-g, --group	  Group to run as\n", progname);
 #ifdef HAVE_NETLINK
@@ -171,7 +179,7 @@ sigint (void)
 {
   zlog_notice ("Terminating on signal");
 
-  if (!retain_mode)
+  if (!retain_mode && !zebrad.warm_restart)
     rib_close ();
 #ifdef HAVE_IRDP
   irdp_finish();
@@ -298,6 +306,7 @@ main (int argc, char **argv)
   struct thread thread;
   char *zserv_path = NULL;
   char *fpm_format = NULL;
+  char *restore_file = NULL;
 
   /* Set umask before anything for security */
   umask (0027);
@@ -313,9 +322,9 @@ main (int argc, char **argv)
       int opt;
   
 #ifdef HAVE_NETLINK  
-      opt = getopt_long (argc, argv, "bdkf:F:i:z:hA:P:ru:g:vs:C", longopts, 0);
+      opt = getopt_long (argc, argv, "bdkf:F:i:z:hA:P:rW:R:u:g:vs:C", longopts, 0);
 #else
-      opt = getopt_long (argc, argv, "bdkf:F:i:z:hA:P:ru:g:vC", longopts, 0);
+      opt = getopt_long (argc, argv, "bdkf:F:i:z:hA:P:rW:R:u:g:vC", longopts, 0);
 #endif /* HAVE_NETLINK */
 
       if (opt == EOF)
@@ -366,6 +375,14 @@ main (int argc, char **argv)
 	case 'r':
 	  retain_mode = 1;
 	  break;
+	case 'W':
+	  zebrad.warm_restart = strtoul (optarg, NULL, 10);
+	  if (zebrad.warm_restart == 0)
+	    usage (progname, 1);
+	  break;
+	case 'R':
+	  restore_file = optarg;
+	  break;
 #ifdef HAVE_NETLINK
 	case 's':
 	  nl_rcvbufsize = atoi (optarg);
@@ -475,9 +492,21 @@ main (int argc, char **argv)
   *  will be equal to the current getpid(). To know about such routes,
   * we have to have route_read() called before.
   */
-  if (! keep_kernel_mode)
+  if (zebrad.warm_restart)
+    rib_warm_restart_start ();
+  else if (! keep_kernel_mode)
     rib_sweep_route ();
 
+  /* Routes restored from a snapshot wait for their owners, in the
+   * same way as those kept over a warm restart. */
+  if (restore_file)
+    {
+      long n = rib_snapshot_read (restore_file);
+
+      if (n > 0)
+	rib_restore_done (n);
+    }
+
   /* Needed for BSD routing socket. */
   pid = getpid ();
 
@@ -25,7 +25,6 @@
 #include "zebra/rtadv.h"
 #include "zebra/irdp.h"
 #include "zebra/interface.h"
-#include "zebra/zebra_fpm.h"
 
 #ifdef HAVE_SYS_WEAK_ALIAS_PRAGMA
 void _quagga_noop (void);
@@ -48,9 +47,3 @@ void ifstat_update_proc (void) { return; }
 void ifstat_update_sysctl (void) { return; }
 #endif
 #endif
-
-void
-zfpm_trigger_update (struct route_node *rn, const char *reason)
-{
-  return;
-}
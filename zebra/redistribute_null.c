@@ -82,3 +82,6 @@ void zebra_interface_address_delete_update (struct interface *a,
 /* Interface parameters update */
 void zebra_interface_parameters_update (struct interface *ifp)
 { return; };
+
+void zserv_batch_flush (void)
+{ return; }
@@ -80,6 +80,7 @@ struct rib
 #define RIB_ENTRY_REMOVED	(1 << 0)
 #define RIB_ENTRY_CHANGED	(1 << 1)
 #define RIB_ENTRY_SELECTED_FIB	(1 << 2)
+#define RIB_ENTRY_STALE		(1 << 3)
 
   /* Nexthop information. */
   u_char nexthop_num;
@@ -311,6 +312,18 @@ struct zebra_vrf
   struct nlsock netlink;     /* kernel messages */
   struct nlsock netlink_cmd; /* command channel */
   struct thread *t_netlink;
+
+  /* Re-read of kernel state after the listen socket overran. */
+  struct nlsock netlink_resync;
+  struct thread *t_resync;
+  int resync_phase;
+  int resync_again;
+  unsigned long resync_cnt;
+
+  /* Where marking or sweeping the kernel routes has got to. */
+  afi_t resync_afi;
+  route_table_iter_t resync_iter;
+  unsigned long resync_swept;
 #endif
 
   /* 2nd pointer type used primarily to quell a warning on
@@ -328,6 +341,9 @@ struct zebra_vrf
 
   /* Recursive Nexthop table */
   struct route_table *rnh_table[AFI_MAX];
+
+  /* Interface events asked for a rib_update() in this batch. */
+  int rib_update_pending;
 };
 
 /*
@@ -444,6 +460,22 @@ extern struct rib *rib_lookup_ipv4 (struct prefix_ipv4 *, vrf_id_t);
 extern void rib_update (vrf_id_t);
 extern void rib_weed_tables (void);
 extern void rib_sweep_route (void);
+extern void rib_mark_kernel_stale (struct route_node *);
+extern unsigned long rib_sweep_kernel_stale (struct route_node *);
+extern void rib_warm_restart_start (void);
+extern void rib_warm_restart_eor (int type);
+
+/* How long interface and address events are batched for. */
+#define RIB_UPDATE_BATCH_MSEC	20
+
+/* How long routes restored from a snapshot wait for their owners,
+ * unless a warm restart sets the grace period. */
+#define RIB_RESTORE_GRACE	120
+extern int rib_add_restored (struct route_table *, struct prefix *,
+			     struct rib *);
+extern void rib_restore_done (unsigned long);
+extern long rib_snapshot_write (const char *);
+extern long rib_snapshot_read (const char *);
 extern void rib_close_table (struct route_table *);
 extern void rib_close (void);
 extern void rib_init (void);
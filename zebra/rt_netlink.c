@@ -39,6 +39,7 @@
 #include "privs.h"
 #include "vrf.h"
 #include "nexthop.h"
+#include "network.h"
 
 #include "zebra/zserv.h"
 #include "zebra/rt.h"
@@ -48,25 +49,14 @@
 
 #include "rt_netlink.h"
 
-static const struct message nlmsg_str[] = {
-  {RTM_NEWROUTE, "RTM_NEWROUTE"},
-  {RTM_DELROUTE, "RTM_DELROUTE"},
-  {RTM_GETROUTE, "RTM_GETROUTE"},
-  {RTM_NEWLINK,  "RTM_NEWLINK"},
-  {RTM_DELLINK,  "RTM_DELLINK"},
-  {RTM_GETLINK,  "RTM_GETLINK"},
-  {RTM_NEWADDR,  "RTM_NEWADDR"},
-  {RTM_DELADDR,  "RTM_DELADDR"},
-  {RTM_GETADDR,  "RTM_GETADDR"},
-  {0, NULL}
-};
-
 extern struct zebra_t zebrad;
 
 extern struct zebra_privs_t zserv_privs;
 
 extern u_int32_t nl_rcvbufsize;
 
+static void netlink_resync_schedule (struct zebra_vrf *);
+
 static struct {
   char *p;
   size_t size;
@@ -96,7 +86,7 @@ set_ifindex(struct interface *ifp, ifindex_t ifi_index)
 	  if_delete_update(oifp);
         }
     }
-  ifp->ifindex = ifi_index;
+  if_set_index (ifp, ifi_index);
 }
 
 #ifndef SO_RCVBUFFORCE
@@ -302,6 +292,9 @@ netlink_parse_info (int (*filter) (struct sockaddr_nl *, struct nlmsghdr *,
             break;
           zlog (NULL, LOG_ERR, "%s recvmsg overrun: %s",
 	  	nl->name, safe_strerror(errno));
+          /* Notifications were lost, re-read the kernel's state. */
+          if (errno == ENOBUFS && nl == &zvrf->netlink)
+            netlink_resync_schedule (zvrf);
           continue;
         }
 
@@ -340,7 +333,7 @@ netlink_parse_info (int (*filter) (struct sockaddr_nl *, struct nlmsghdr *,
                     {
                       zlog_debug ("%s: %s ACK: type=%s(%u), seq=%u, pid=%u",
                                  __FUNCTION__, nl->name,
-                                 lookup (nlmsg_str, err->msg.nlmsg_type),
+                                 nl_msg_type_to_str (err->msg.nlmsg_type),
                                  err->msg.nlmsg_type, err->msg.nlmsg_seq,
                                  err->msg.nlmsg_pid);
                     }
@@ -369,14 +362,14 @@ netlink_parse_info (int (*filter) (struct sockaddr_nl *, struct nlmsghdr *,
 		  if (IS_ZEBRA_DEBUG_KERNEL)
 		    zlog_debug ("%s: error: %s type=%s(%u), seq=%u, pid=%u",
 				nl->name, safe_strerror (-errnum),
-				lookup (nlmsg_str, msg_type),
+				nl_msg_type_to_str (msg_type),
 				msg_type, err->msg.nlmsg_seq, err->msg.nlmsg_pid);
 		  return 0;
 		}
 
 	      zlog_err ("%s error: %s, type=%s(%u), seq=%u, pid=%u",
 			nl->name, safe_strerror (-errnum),
-			lookup (nlmsg_str, msg_type),
+			nl_msg_type_to_str (msg_type),
 			msg_type, err->msg.nlmsg_seq, err->msg.nlmsg_pid);
               return -1;
             }
@@ -385,7 +378,7 @@ netlink_parse_info (int (*filter) (struct sockaddr_nl *, struct nlmsghdr *,
           if (IS_ZEBRA_DEBUG_KERNEL)
             zlog_debug ("netlink_parse_info: %s type %s(%u), seq=%u, pid=%u",
                        nl->name,
-                       lookup (nlmsg_str, h->nlmsg_type), h->nlmsg_type,
+                       nl_msg_type_to_str (h->nlmsg_type), h->nlmsg_type,
                        h->nlmsg_seq, h->nlmsg_pid);
 
           /* skip unsolicited messages originating from command socket
@@ -633,7 +626,7 @@ netlink_interface_addr (struct sockaddr_nl *snl, struct nlmsghdr *h,
     {
       char buf[BUFSIZ];
       zlog_debug ("netlink_interface_addr %s %s vrf %u:",
-                 lookup (nlmsg_str, h->nlmsg_type), ifp->name, vrf_id);
+                 nl_msg_type_to_str (h->nlmsg_type), ifp->name, vrf_id);
       if (tb[IFA_LOCAL])
         zlog_debug ("  IFA_LOCAL     %s/%d",
 		    inet_ntop (ifa->ifa_family, RTA_DATA (tb[IFA_LOCAL]),
@@ -724,6 +717,75 @@ netlink_interface_addr (struct sockaddr_nl *snl, struct nlmsghdr *h,
   return 0;
 }
 
+/* With warm restart enabled, routes are installed with the protocol
+ * of their owner, so that after a restart they can be handed back to
+ * it.  Anything else goes in as RTPROT_ZEBRA. */
+static u_char
+netlink_rtproto (int type)
+{
+  if (! zebrad.warm_restart)
+    return RTPROT_ZEBRA;
+
+  switch (type)
+    {
+    case ZEBRA_ROUTE_BGP:
+      return RTPROT_BGP;
+    case ZEBRA_ROUTE_ISIS:
+      return RTPROT_ISIS;
+    case ZEBRA_ROUTE_OSPF:
+    case ZEBRA_ROUTE_OSPF6:
+      return RTPROT_OSPF;
+    case ZEBRA_ROUTE_RIP:
+    case ZEBRA_ROUTE_RIPNG:
+      return RTPROT_RIP;
+    default:
+      return RTPROT_ZEBRA;
+    }
+}
+
+/* Was the route installed by zebra?  Without warm restart zebra only
+ * ever uses RTPROT_ZEBRA, and the other protocol numbers belong to
+ * whoever else is running on the box. */
+static int
+netlink_rtproto_self (u_char proto)
+{
+  if (! zebrad.warm_restart)
+    return proto == RTPROT_ZEBRA;
+
+  switch (proto)
+    {
+    case RTPROT_ZEBRA:
+    case RTPROT_BGP:
+    case RTPROT_ISIS:
+    case RTPROT_OSPF:
+    case RTPROT_RIP:
+      return 1;
+    default:
+      return 0;
+    }
+}
+
+/* Route type to file a route retained over a warm restart under, the
+ * reverse of netlink_rtproto().  Routes of unknown owner stay kernel
+ * routes. */
+static int
+netlink_rtproto_owner (u_char proto, int family)
+{
+  switch (proto)
+    {
+    case RTPROT_BGP:
+      return ZEBRA_ROUTE_BGP;
+    case RTPROT_ISIS:
+      return ZEBRA_ROUTE_ISIS;
+    case RTPROT_OSPF:
+      return family == AF_INET ? ZEBRA_ROUTE_OSPF : ZEBRA_ROUTE_OSPF6;
+    case RTPROT_RIP:
+      return family == AF_INET ? ZEBRA_ROUTE_RIP : ZEBRA_ROUTE_RIPNG;
+    default:
+      return ZEBRA_ROUTE_KERNEL;
+    }
+}
+
 /* Looking up routing table by netlink interface. */
 static int
 netlink_routing_table (struct sockaddr_nl *snl, struct nlmsghdr *h,
@@ -733,6 +795,7 @@ netlink_routing_table (struct sockaddr_nl *snl, struct nlmsghdr *h,
   struct rtmsg *rtm;
   struct rtattr *tb[RTA_MAX + 1];
   u_char flags = 0;
+  int type = ZEBRA_ROUTE_KERNEL;
 
   char anyaddr[16] = { 0 };
 
@@ -774,9 +837,14 @@ netlink_routing_table (struct sockaddr_nl *snl, struct nlmsghdr *h,
   if (rtm->rtm_src_len != 0)
     return 0;
 
-  /* Route which inserted by Zebra. */
-  if (rtm->rtm_protocol == RTPROT_ZEBRA)
-    flags |= ZEBRA_FLAG_SELFROUTE;
+  /* Route which inserted by Zebra.  On a warm restart it goes back
+     to its owner. */
+  if (netlink_rtproto_self (rtm->rtm_protocol))
+    {
+      flags |= ZEBRA_FLAG_SELFROUTE;
+      if (zebrad.warm_restart)
+        type = netlink_rtproto_owner (rtm->rtm_protocol, rtm->rtm_family);
+    }
 
   index = 0;
   dest = NULL;
@@ -817,7 +885,7 @@ netlink_routing_table (struct sockaddr_nl *snl, struct nlmsghdr *h,
       p.prefixlen = rtm->rtm_dst_len;
 
       if (!tb[RTA_MULTIPATH])
-          rib_add_ipv4 (ZEBRA_ROUTE_KERNEL, flags, &p, gate, src, index,
+          rib_add_ipv4 (type, flags, &p, gate, src, index,
                         vrf_id, table, 0, mtu, 0, SAFI_UNICAST);
       else
         {
@@ -830,7 +898,7 @@ netlink_routing_table (struct sockaddr_nl *snl, struct nlmsghdr *h,
           len = RTA_PAYLOAD (tb[RTA_MULTIPATH]);
 
           rib = XCALLOC (MTYPE_RIB, sizeof (struct rib));
-          rib->type = ZEBRA_ROUTE_KERNEL;
+          rib->type = type;
           rib->distance = 0;
           rib->flags = flags;
           rib->metric = 0;
@@ -884,7 +952,7 @@ netlink_routing_table (struct sockaddr_nl *snl, struct nlmsghdr *h,
       memcpy (&p.prefix, dest, 16);
       p.prefixlen = rtm->rtm_dst_len;
 
-      rib_add_ipv6 (ZEBRA_ROUTE_KERNEL, flags, &p, gate, index, vrf_id,
+      rib_add_ipv6 (type, flags, &p, gate, index, vrf_id,
                     table, 0, mtu, 0, SAFI_UNICAST);
     }
 #endif /* HAVE_IPV6 */
@@ -892,21 +960,6 @@ netlink_routing_table (struct sockaddr_nl *snl, struct nlmsghdr *h,
   return 0;
 }
 
-static const struct message rtproto_str[] = {
-  {RTPROT_REDIRECT, "redirect"},
-  {RTPROT_KERNEL,   "kernel"},
-  {RTPROT_BOOT,     "boot"},
-  {RTPROT_STATIC,   "static"},
-  {RTPROT_GATED,    "GateD"},
-  {RTPROT_RA,       "router advertisement"},
-  {RTPROT_MRT,      "MRT"},
-  {RTPROT_ZEBRA,    "Zebra"},
-#ifdef RTPROT_BIRD
-  {RTPROT_BIRD,     "BIRD"},
-#endif /* RTPROT_BIRD */
-  {0,               NULL}
-};
-
 /* Routing information change from the kernel. */
 static int
 netlink_route_change (struct sockaddr_nl *snl, struct nlmsghdr *h,
@@ -943,7 +996,7 @@ netlink_route_change (struct sockaddr_nl *snl, struct nlmsghdr *h,
                RTM_NEWROUTE ? "RTM_NEWROUTE" : "RTM_DELROUTE",
                rtm->rtm_family == AF_INET ? "ipv4" : "ipv6",
                rtm->rtm_type == RTN_UNICAST ? "unicast" : "multicast",
-               lookup (rtproto_str, rtm->rtm_protocol),
+               nl_rtproto_to_str (rtm->rtm_protocol),
                vrf_id);
 
   if (rtm->rtm_type != RTN_UNICAST)
@@ -971,9 +1024,10 @@ netlink_route_change (struct sockaddr_nl *snl, struct nlmsghdr *h,
   if (rtm->rtm_protocol == RTPROT_KERNEL)
     return 0;
 
-  if (rtm->rtm_protocol == RTPROT_ZEBRA && h->nlmsg_type == RTM_NEWROUTE)
+  if (netlink_rtproto_self (rtm->rtm_protocol)
+      && h->nlmsg_type == RTM_NEWROUTE)
     return 0;
-  if (rtm->rtm_protocol == RTPROT_ZEBRA)
+  if (netlink_rtproto_self (rtm->rtm_protocol))
     SET_FLAG(zebra_flags, ZEBRA_FLAG_SELFROUTE);
 
   if (rtm->rtm_src_len != 0)
@@ -1215,6 +1269,9 @@ netlink_link_change (struct sockaddr_nl *snl, struct nlmsghdr *h,
                 if_up (ifp);
             }
         }
+
+      /* The kernel still has it, see netlink_resync_sweep(). */
+      ((struct zebra_if *) ifp->info)->stale = 0;
     }
   else
     {
@@ -1336,71 +1393,6 @@ netlink_route_read (struct zebra_vrf *zvrf)
   return 0;
 }
 
-/* Utility function  comes from iproute2. 
-   Authors:	Alexey Kuznetsov, <kuznet@ms2.inr.ac.ru> */
-int
-addattr_l (struct nlmsghdr *n, size_t maxlen, int type, void *data, size_t alen)
-{
-  size_t len;
-  struct rtattr *rta;
-
-  len = RTA_LENGTH (alen);
-
-  if (NLMSG_ALIGN (n->nlmsg_len) + len > maxlen)
-    return -1;
-
-  rta = (struct rtattr *) (((char *) n) + NLMSG_ALIGN (n->nlmsg_len));
-  rta->rta_type = type;
-  rta->rta_len = len;
-  memcpy (RTA_DATA (rta), data, alen);
-  n->nlmsg_len = NLMSG_ALIGN (n->nlmsg_len) + len;
-
-  return 0;
-}
-
-int
-rta_addattr_l (struct rtattr *rta, size_t maxlen, int type, void *data, 
-               size_t alen)
-{
-  size_t len;
-  struct rtattr *subrta;
-
-  len = RTA_LENGTH (alen);
-
-  if (RTA_ALIGN (rta->rta_len) + len > maxlen)
-    return -1;
-
-  subrta = (struct rtattr *) (((char *) rta) + RTA_ALIGN (rta->rta_len));
-  subrta->rta_type = type;
-  subrta->rta_len = len;
-  memcpy (RTA_DATA (subrta), data, alen);
-  rta->rta_len = NLMSG_ALIGN (rta->rta_len) + len;
-
-  return 0;
-}
-
-/* Utility function comes from iproute2. 
-   Authors:	Alexey Kuznetsov, <kuznet@ms2.inr.ac.ru> */
-int
-addattr32 (struct nlmsghdr *n, size_t maxlen, int type, int data)
-{
-  size_t len;
-  struct rtattr *rta;
-
-  len = RTA_LENGTH (4);
-
-  if (NLMSG_ALIGN (n->nlmsg_len) + len > maxlen)
-    return -1;
-
-  rta = (struct rtattr *) (((char *) n) + NLMSG_ALIGN (n->nlmsg_len));
-  rta->rta_type = type;
-  rta->rta_len = len;
-  memcpy (RTA_DATA (rta), &data, 4);
-  n->nlmsg_len = NLMSG_ALIGN (n->nlmsg_len) + len;
-
-  return 0;
-}
-
 static int
 netlink_talk_filter (struct sockaddr_nl *snl, struct nlmsghdr *h,
     vrf_id_t vrf_id)
@@ -1438,7 +1430,7 @@ netlink_talk (struct nlmsghdr *n, struct nlsock *nl, struct zebra_vrf *zvrf)
 
   if (IS_ZEBRA_DEBUG_KERNEL)
     zlog_debug ("netlink_talk: %s type %s(%u), seq=%u", nl->name,
-               lookup (nlmsg_str, n->nlmsg_type), n->nlmsg_type,
+               nl_msg_type_to_str (n->nlmsg_type), n->nlmsg_type,
                n->nlmsg_seq);
 
   /* Send message to netlink interface. */
@@ -1663,7 +1655,7 @@ _netlink_route_debug(
       char buf[PREFIX_STRLEN];
       zlog_debug ("netlink_route_multipath() (%s): %s %s vrf %u type %s",
          routedesc,
-         lookup (nlmsg_str, cmd),
+         nl_msg_type_to_str (cmd),
          prefix2str (p, buf, sizeof(buf)),
          zvrf->vrf_id,
          nexthop_type_to_str (nexthop->type));
@@ -1702,7 +1694,7 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib)
   req.r.rtm_family = family;
   req.r.rtm_table = rib->table;
   req.r.rtm_dst_len = p->prefixlen;
-  req.r.rtm_protocol = RTPROT_ZEBRA;
+  req.r.rtm_protocol = netlink_rtproto (rib->type);
   req.r.rtm_scope = RT_SCOPE_LINK;
 
   if ((rib->flags & ZEBRA_FLAG_BLACKHOLE) || (rib->flags & ZEBRA_FLAG_REJECT))
@@ -1964,6 +1956,375 @@ kernel_read (struct thread *thread)
   return 0;
 }
 
+/* Overrun recovery.
+ *
+ * When the listen socket overruns, the kernel drops notifications and
+ * our idea of links, addresses and kernel routes may no longer match
+ * the kernel's.  Rather than re-reading all of it in one blocking go,
+ * dump the kernel tables again over a socket of our own, handling a
+ * bounded amount of it per wakeup.  Whatever the dump contains is
+ * applied like any other change, and what we knew about before but did
+ * not see in the dump is removed afterwards (mark and sweep).  Marking
+ * and sweeping the kernel routes goes over the RIB, so that too is done
+ * a slice at a time, in phases of its own.
+ */
+enum netlink_resync_phase
+{
+  NL_RESYNC_LINK,
+  NL_RESYNC_ADDR4,
+  NL_RESYNC_ADDR6,
+  NL_RESYNC_MARK,
+  NL_RESYNC_ROUTE4,
+  NL_RESYNC_ROUTE6,
+  NL_RESYNC_SWEEP,
+  NL_RESYNC_DONE,
+};
+
+/* Seconds to let an event storm die down before re-reading. */
+#define NL_RESYNC_DELAY 1
+
+static int netlink_resync_start (struct thread *);
+static int netlink_resync_read (struct thread *);
+static int netlink_resync_walk (struct thread *);
+
+static void
+netlink_resync_schedule (struct zebra_vrf *zvrf)
+{
+  /* Already reading: notifications may have been lost behind the
+   * dump's back, so go once more afterwards. */
+  if (zvrf->netlink_resync.sock >= 0)
+    {
+      zvrf->resync_again = 1;
+      return;
+    }
+
+  if (! zvrf->t_resync)
+    zvrf->t_resync = thread_add_timer (zebrad.master, netlink_resync_start,
+                                       zvrf, NL_RESYNC_DELAY);
+}
+
+/* Only reconcile routes zebra did not install itself, from the tables
+ * zebra reads at startup, cf. rib_weed_tables(). */
+static int
+netlink_resync_route (struct sockaddr_nl *snl, struct nlmsghdr *h,
+                      vrf_id_t vrf_id)
+{
+  struct rtmsg *rtm = NLMSG_DATA (h);
+
+  if (h->nlmsg_type != RTM_NEWROUTE)
+    return 0;
+  if (netlink_rtproto_self (rtm->rtm_protocol))
+    return 0;
+  if (rtm->rtm_table != RT_TABLE_MAIN
+      && rtm->rtm_table != zebrad.rtm_table_default)
+    return 0;
+
+  return netlink_routing_table (snl, h, vrf_id);
+}
+
+/* Set the stale marks for what the given phase is about to re-read. */
+static void
+netlink_resync_mark (struct zebra_vrf *zvrf, int phase)
+{
+  struct listnode *node;
+  struct interface *ifp;
+
+  switch (phase)
+    {
+    case NL_RESYNC_LINK:
+      for (ALL_LIST_ELEMENTS_RO (vrf_iflist (zvrf->vrf_id), node, ifp))
+        if (CHECK_FLAG (ifp->status, ZEBRA_INTERFACE_ACTIVE))
+          ((struct zebra_if *) ifp->info)->stale = 1;
+      break;
+    case NL_RESYNC_ADDR4:
+      for (ALL_LIST_ELEMENTS_RO (vrf_iflist (zvrf->vrf_id), node, ifp))
+        connected_mark_stale (ifp);
+      break;
+    }
+}
+
+/* Remove what the phase just finished did not see. */
+static void
+netlink_resync_sweep (struct zebra_vrf *zvrf, int phase)
+{
+  struct listnode *node, *nnode;
+  struct interface *ifp;
+  struct zebra_if *zif;
+
+  switch (phase)
+    {
+    case NL_RESYNC_LINK:
+      for (ALL_LIST_ELEMENTS (vrf_iflist (zvrf->vrf_id), node, nnode, ifp))
+        {
+          zif = ifp->info;
+          if (! zif->stale)
+            continue;
+          zif->stale = 0;
+          if (CHECK_FLAG (ifp->status, ZEBRA_INTERFACE_ACTIVE))
+            {
+              zlog_info ("%s: interface %s is gone", zvrf->netlink.name,
+                         ifp->name);
+              if_delete_update (ifp);
+            }
+        }
+      break;
+#ifdef HAVE_IPV6
+    case NL_RESYNC_ADDR6:
+#else
+    case NL_RESYNC_ADDR4:
+#endif /* HAVE_IPV6 */
+      for (ALL_LIST_ELEMENTS_RO (vrf_iflist (zvrf->vrf_id), node, ifp))
+        connected_sweep_stale (ifp);
+      break;
+    }
+}
+
+/* Start marking or sweeping the kernel routes of the AFI's table. */
+static void
+netlink_resync_walk_init (struct zebra_vrf *zvrf, afi_t afi)
+{
+  zvrf->resync_afi = afi;
+  route_table_iter_init (&zvrf->resync_iter, zvrf->table[afi][SAFI_UNICAST]);
+  if (! zvrf->table[afi][SAFI_UNICAST])
+    route_table_iter_cleanup (&zvrf->resync_iter);
+}
+
+static void
+netlink_resync_finish (struct zebra_vrf *zvrf)
+{
+  THREAD_OFF (zvrf->t_resync);
+  route_table_iter_cleanup (&zvrf->resync_iter);
+  if (zvrf->netlink_resync.sock >= 0)
+    {
+      close (zvrf->netlink_resync.sock);
+      zvrf->netlink_resync.sock = -1;
+    }
+
+  if (zvrf->resync_again)
+    {
+      zvrf->resync_again = 0;
+      netlink_resync_schedule (zvrf);
+    }
+}
+
+/* Ask the kernel for the dump belonging to the current phase, moving on
+ * to the next one where there is nothing to ask for. */
+static void
+netlink_resync_request (struct zebra_vrf *zvrf)
+{
+  int family, type;
+
+  for (;;)
+    {
+      switch (zvrf->resync_phase)
+        {
+        case NL_RESYNC_LINK:
+          family = AF_PACKET, type = RTM_GETLINK;
+          break;
+        case NL_RESYNC_ADDR4:
+          family = AF_INET, type = RTM_GETADDR;
+          break;
+        case NL_RESYNC_ROUTE4:
+          family = AF_INET, type = RTM_GETROUTE;
+          break;
+#ifdef HAVE_IPV6
+        case NL_RESYNC_ADDR6:
+          family = AF_INET6, type = RTM_GETADDR;
+          break;
+        case NL_RESYNC_ROUTE6:
+          family = AF_INET6, type = RTM_GETROUTE;
+          break;
+#endif /* HAVE_IPV6 */
+        case NL_RESYNC_MARK:
+        case NL_RESYNC_SWEEP:
+          zvrf->resync_swept = 0;
+          netlink_resync_walk_init (zvrf, AFI_IP);
+          zvrf->t_resync = thread_add_background (zebrad.master,
+                                                  netlink_resync_walk, zvrf, 0);
+          return;
+        case NL_RESYNC_DONE:
+          zlog_notice ("%s: kernel state re-read", zvrf->netlink.name);
+          netlink_resync_finish (zvrf);
+          return;
+        default:
+          zvrf->resync_phase++;
+          continue;
+        }
+      break;
+    }
+
+  netlink_resync_mark (zvrf, zvrf->resync_phase);
+
+  if (netlink_request (family, type, &zvrf->netlink_resync) < 0)
+    {
+      /* Try again from the start later. */
+      zvrf->resync_again = 1;
+      netlink_resync_finish (zvrf);
+      return;
+    }
+
+  zvrf->t_resync = thread_add_read (zebrad.master, netlink_resync_read,
+                                    zvrf, zvrf->netlink_resync.sock);
+}
+
+/* Mark or sweep the kernel routes of the unicast tables, as much of
+ * them as the time slice allows. */
+static int
+netlink_resync_walk (struct thread *thread)
+{
+  struct zebra_vrf *zvrf = THREAD_ARG (thread);
+  struct route_node *rn;
+
+  zvrf->t_resync = NULL;
+
+  for (;;)
+    {
+      while ((rn = route_table_iter_next (&zvrf->resync_iter)))
+        {
+          if (zvrf->resync_phase == NL_RESYNC_MARK)
+            rib_mark_kernel_stale (rn);
+          else
+            zvrf->resync_swept += rib_sweep_kernel_stale (rn);
+
+          if (thread_should_yield (thread))
+            {
+              route_table_iter_pause (&zvrf->resync_iter);
+              zvrf->t_resync = thread_add_background (zebrad.master,
+                                                      netlink_resync_walk,
+                                                      zvrf, 0);
+              return 0;
+            }
+        }
+      route_table_iter_cleanup (&zvrf->resync_iter);
+
+      if (zvrf->resync_afi == AFI_IP6)
+        break;
+      netlink_resync_walk_init (zvrf, AFI_IP6);
+    }
+
+  if (zvrf->resync_phase == NL_RESYNC_SWEEP && zvrf->resync_swept)
+    zlog_info ("%s: %lu kernel routes are gone", zvrf->netlink.name,
+               zvrf->resync_swept);
+
+  zvrf->resync_phase++;
+  netlink_resync_request (zvrf);
+  return 0;
+}
+
+static int
+netlink_resync_start (struct thread *thread)
+{
+  struct zebra_vrf *zvrf = THREAD_ARG (thread);
+
+  zvrf->t_resync = NULL;
+
+  if (netlink_socket (&zvrf->netlink_resync, 0, zvrf->vrf_id) < 0)
+    return -1;
+  if (fcntl (zvrf->netlink_resync.sock, F_SETFL, O_NONBLOCK) < 0)
+    zlog_err ("Can't set %s socket flags: %s", zvrf->netlink_resync.name,
+              safe_strerror (errno));
+
+  zlog_notice ("%s: overrun, re-reading kernel state", zvrf->netlink.name);
+  zvrf->resync_cnt++;
+  zvrf->resync_phase = NL_RESYNC_LINK;
+  netlink_resync_request (zvrf);
+  return 0;
+}
+
+/* Handle the dump of the current phase, as much of it as the time slice
+ * allows.  The kernel produces the dump as we read it, so there is no
+ * overrunning this socket. */
+static int
+netlink_resync_read (struct thread *thread)
+{
+  struct zebra_vrf *zvrf = THREAD_ARG (thread);
+  struct nlsock *nl = &zvrf->netlink_resync;
+  int (*filter) (struct sockaddr_nl *, struct nlmsghdr *, vrf_id_t);
+  int status;
+
+  zvrf->t_resync = NULL;
+
+  switch (zvrf->resync_phase)
+    {
+    case NL_RESYNC_LINK:
+      filter = netlink_link_change;
+      break;
+    case NL_RESYNC_ADDR4:
+    case NL_RESYNC_ADDR6:
+      filter = netlink_interface_addr;
+      break;
+    default:
+      filter = netlink_resync_route;
+      break;
+    }
+
+  do
+    {
+      struct iovec iov = {
+        .iov_base = nl_rcvbuf.p,
+        .iov_len = nl_rcvbuf.size,
+      };
+      struct sockaddr_nl snl;
+      struct msghdr msg = {
+        .msg_name = (void *) &snl,
+        .msg_namelen = sizeof snl,
+        .msg_iov = &iov,
+        .msg_iovlen = 1
+      };
+      struct nlmsghdr *h;
+
+      status = recvmsg (nl->sock, &msg, 0);
+      if (status < 0)
+        {
+          if (ERRNO_IO_RETRY (errno))
+            break;
+          zlog_err ("%s recvmsg failed: %s", nl->name, safe_strerror (errno));
+          goto restart;
+        }
+      if (status == 0 || (msg.msg_flags & MSG_TRUNC))
+        {
+          zlog_err ("%s: short or truncated read", nl->name);
+          goto restart;
+        }
+
+      for (h = (struct nlmsghdr *) nl_rcvbuf.p;
+           NLMSG_OK (h, (unsigned int) status);
+           h = NLMSG_NEXT (h, status))
+        {
+          if (h->nlmsg_seq != (u_int32_t) nl->seq)
+            continue;
+
+          if (h->nlmsg_type == NLMSG_DONE)
+            {
+              netlink_resync_sweep (zvrf, zvrf->resync_phase);
+              zvrf->resync_phase++;
+              netlink_resync_request (zvrf);
+              return 0;
+            }
+
+          if (h->nlmsg_type == NLMSG_ERROR)
+            {
+              struct nlmsgerr *err = (struct nlmsgerr *) NLMSG_DATA (h);
+
+              zlog_err ("%s error: %s", nl->name, safe_strerror (-err->error));
+              goto restart;
+            }
+
+          (*filter) (&snl, h, zvrf->vrf_id);
+        }
+    }
+  while (! thread_should_yield (thread));
+
+  zvrf->t_resync = thread_add_read (zebrad.master, netlink_resync_read,
+                                    zvrf, nl->sock);
+  return 0;
+
+restart:
+  zvrf->resync_again = 1;
+  netlink_resync_finish (zvrf);
+  return -1;
+}
+
 /* Filter out messages from self that occur on listener socket,
    caused by our actions on the command socket
  */
@@ -2037,6 +2398,9 @@ kernel_terminate (struct zebra_vrf *zvrf)
 {
   THREAD_READ_OFF (zvrf->t_netlink);
 
+  zvrf->resync_again = 0;
+  netlink_resync_finish (zvrf);
+
   if (zvrf->netlink.sock >= 0)
     {
       close (zvrf->netlink.sock);
@@ -2049,21 +2413,3 @@ kernel_terminate (struct zebra_vrf *zvrf)
       zvrf->netlink_cmd.sock = -1;
     }
 }
-
-/*
- * nl_msg_type_to_str
- */
-const char *
-nl_msg_type_to_str (uint16_t msg_type)
-{
-  return lookup (nlmsg_str, msg_type);
-}
-
-/*
- * nl_rtproto_to_str
- */
-const char *
-nl_rtproto_to_str (u_char rtproto)
-{
-  return lookup (rtproto_str, rtproto);
-}
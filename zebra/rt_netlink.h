@@ -27,6 +27,21 @@
 #define NL_PKT_BUF_SIZE 8192
 #define NL_DEFAULT_ROUTE_METRIC 20
 
+/* Protocol numbers for routes installed on behalf of a routing
+ * daemon, recent kernel headers define them. */
+#ifndef RTPROT_BGP
+#define RTPROT_BGP	186
+#endif
+#ifndef RTPROT_ISIS
+#define RTPROT_ISIS	187
+#endif
+#ifndef RTPROT_OSPF
+#define RTPROT_OSPF	188
+#endif
+#ifndef RTPROT_RIP
+#define RTPROT_RIP	189
+#endif
+
 extern int
 addattr32 (struct nlmsghdr *n, size_t maxlen, int type, int data);
 extern int
@@ -36,6 +36,7 @@
 #include "zebra/debug.h"
 #include "zebra/router-id.h"
 #include "zebra/interface.h"
+#include "zebra/zebra_fpm.h"
 
 /* Zebra instance */
 struct zebra_t zebrad =
@@ -57,12 +58,14 @@ struct option longopts[] =
 {
   { "batch",       no_argument,       NULL, 'b'},
   { "daemon",      no_argument,       NULL, 'd'},
+  { "fpm_format",  required_argument, NULL, 'F'},
   { "config_file", required_argument, NULL, 'f'},
   { "help",        no_argument,       NULL, 'h'},
   { "vty_addr",    required_argument, NULL, 'A'},
   { "vty_port",    required_argument, NULL, 'P'},
   { "version",     no_argument,       NULL, 'v'},
   { "rib_hold",	   required_argument, NULL, 'r'},
+  { "restore",     required_argument, NULL, 'R'},
   { 0 }
 };
 
@@ -92,10 +95,12 @@ usage (char *progname, int status)
 	      "redistribution between different routing protocols.\n\n"\
 	      "-b, --batch        Runs in batch mode\n"\
 	      "-d, --daemon       Runs in daemon mode\n"\
+	      "-F, --fpm_format   Set fpm format to 'netlink' or 'protobuf'\n"\
 	      "-f, --config_file  Set configuration file name\n"\
 	      "-A, --vty_addr     Set vty's bind address\n"\
 	      "-P, --vty_port     Set vty's port number\n"\
 	      "-r, --rib_hold	  Set rib-queue hold time\n"\
+	      "-R, --restore      Load the routes in a RIB snapshot at startup\n"\
               "-v, --version      Print program version\n"\
 	      "-h, --help         Display this help and exit\n"\
 	      "\n"\
@@ -122,7 +127,7 @@ DEFUN (test_interface_state,
   ifp = vty->index;
   if (ifp->ifindex == IFINDEX_INTERNAL)
     {
-      ifp->ifindex = ++test_ifindex;
+      if_set_index (ifp, ++test_ifindex);
       ifp->mtu = 1500;
       ifp->flags = IFF_BROADCAST|IFF_MULTICAST;
     }
@@ -272,6 +277,8 @@ main (int argc, char **argv)
   int batch_mode = 0;
   int daemon_mode = 0;
   char *config_file = NULL;
+  char *fpm_format = NULL;
+  char *restore_file = NULL;
   char *progname;
   struct thread thread;
 
@@ -288,7 +295,7 @@ main (int argc, char **argv)
     {
       int opt;
   
-      opt = getopt_long (argc, argv, "bdf:hA:P:r:v", longopts, 0);
+      opt = getopt_long (argc, argv, "bdF:f:hA:P:r:R:v", longopts, 0);
 
       if (opt == EOF)
 	break;
@@ -302,6 +309,9 @@ main (int argc, char **argv)
 	case 'd':
 	  daemon_mode = 1;
 	  break;
+	case 'F':
+	  fpm_format = optarg;
+	  break;
 	case 'f':
 	  config_file = optarg;
 	  break;
@@ -321,6 +331,9 @@ main (int argc, char **argv)
 	case 'r':
 	  rib_process_hold_time = atoi(optarg);
 	  break;
+	case 'R':
+	  restore_file = optarg;
+	  break;
 	case 'v':
 	  print_version (progname);
 	  exit (0);
@@ -362,12 +375,26 @@ main (int argc, char **argv)
   zebra_vrf_init ();
   zebra_vty_init();
 
+#ifdef HAVE_FPM
+  zfpm_init (zebrad.master, 1, 0, fpm_format);
+#else
+  zfpm_init (zebrad.master, 0, 0, fpm_format);
+#endif
+
   /* Configuration file read*/
   vty_read_config (config_file, config_default);
 
   /* Clean up rib. */
   rib_weed_tables ();
 
+  if (restore_file)
+    {
+      long n = rib_snapshot_read (restore_file);
+
+      if (n > 0)
+	rib_restore_done (n);
+    }
+
   /* Exit when zebra is working in batch mode. */
   if (batch_mode)
     exit (0);
@@ -48,6 +48,12 @@
 #define ZFPM_OBUF_SIZE (2 * FPM_MAX_MSG_LEN)
 #define ZFPM_IBUF_SIZE (FPM_MAX_MSG_LEN)
 
+/*
+ * Number of outgoing stream buffers, all of which are handed to the
+ * kernel in a single writev() call.
+ */
+#define ZFPM_OBUF_COUNT 8
+
 /*
  * The maximum number of times the FPM socket write callback can call
  * 'write' before it yields.
@@ -84,6 +90,9 @@ typedef struct zfpm_stats_t_ {
   unsigned long max_writes_hit;
   unsigned long t_write_yields;
 
+  unsigned long msgs_written;
+  unsigned long bytes_written;
+
   unsigned long nop_deletes_skipped;
   unsigned long route_adds;
   unsigned long route_dels;
@@ -163,6 +172,12 @@ typedef struct zfpm_glob_t_
    */
   zfpm_msg_format_e message_format;
 
+  /*
+   * True if multiple route updates may be packed into one FPM
+   * message.
+   */
+  int batch;
+
   struct thread_master *master;
 
   zfpm_state_t state;
@@ -178,6 +193,12 @@ typedef struct zfpm_glob_t_
    */
   TAILQ_HEAD (zfpm_dest_q, rib_dest_t_) dest_q;
 
+  /*
+   * Current and highest number of entries on dest_q.
+   */
+  unsigned long dest_q_len;
+  unsigned long dest_q_max;
+
   /*
    * Stream socket to the FPM.
    */
@@ -185,8 +206,14 @@ typedef struct zfpm_glob_t_
 
   /*
    * Buffers for messages to/from the FPM.
+   *
+   * Outgoing messages are written into obuf[0] .. obuf[obuf_cnt - 1],
+   * obuf_cur is the first of these that still has data to be written
+   * to the socket.
    */
-  struct stream *obuf;
+  struct stream *obuf[ZFPM_OBUF_COUNT];
+  int obuf_cnt;
+  int obuf_cur;
   struct stream *ibuf;
 
   /*
@@ -647,6 +674,23 @@ zfpm_connect_check ()
   return;
 }
 
+/*
+ * zfpm_obuf_reset
+ *
+ * Discard all data in the outbound buffers.
+ */
+static void
+zfpm_obuf_reset (void)
+{
+  int i;
+
+  for (i = 0; i < zfpm_g->obuf_cnt; i++)
+    stream_reset (zfpm_g->obuf[i]);
+
+  zfpm_g->obuf_cnt = 0;
+  zfpm_g->obuf_cur = 0;
+}
+
 /*
  * zfpm_conn_down_thread_cb
  *
@@ -676,6 +720,7 @@ zfpm_conn_down_thread_cb (struct thread *thread)
 	  if (CHECK_FLAG (dest->flags, RIB_DEST_UPDATE_FPM))
 	    {
 	      TAILQ_REMOVE (&zfpm_g->dest_q, dest, fpm_q_entries);
+	      zfpm_g->dest_q_len--;
 	    }
 
 	  UNSET_FLAG (dest->flags, RIB_DEST_UPDATE_FPM);
@@ -732,7 +777,7 @@ zfpm_connection_down (const char *detail)
   zfpm_write_off ();
 
   stream_reset (zfpm_g->ibuf);
-  stream_reset (zfpm_g->obuf);
+  zfpm_obuf_reset ();
 
   if (zfpm_g->sock >= 0) {
     close (zfpm_g->sock);
@@ -852,10 +897,10 @@ zfpm_writes_pending (void)
 {
 
   /*
-   * Check if there is any data in the outbound buffer that has not
+   * Check if there is any data in the outbound buffers that has not
    * been written to the socket yet.
    */
-  if (stream_get_endp (zfpm_g->obuf) - stream_get_getp (zfpm_g->obuf))
+  if (zfpm_g->obuf_cur < zfpm_g->obuf_cnt)
     return 1;
 
   /*
@@ -938,28 +983,80 @@ zfpm_route_for_update (rib_dest_t *dest)
 }
 
 /*
- * zfpm_build_updates
+ * zfpm_dest_done
  *
- * Process the outgoing queue and write messages to the outbound
- * buffer.
+ * Take a dest whose update has been written out (or skipped) off the
+ * outbound queue.
  */
 static void
-zfpm_build_updates (void)
+zfpm_dest_done (rib_dest_t *dest, int is_add)
+{
+
+  /*
+   * Remove the dest from the queue, and reset the flag.
+   */
+  UNSET_FLAG (dest->flags, RIB_DEST_UPDATE_FPM);
+  TAILQ_REMOVE (&zfpm_g->dest_q, dest, fpm_q_entries);
+  zfpm_g->dest_q_len--;
+
+  if (is_add)
+    {
+      SET_FLAG (dest->flags, RIB_DEST_SENT_TO_FPM);
+    }
+  else
+    {
+      UNSET_FLAG (dest->flags, RIB_DEST_SENT_TO_FPM);
+    }
+
+  /*
+   * Delete the destination if necessary.
+   */
+  if (rib_gc_dest (dest->rnode))
+    zfpm_g->stats.dests_del_after_update++;
+}
+
+/*
+ * zfpm_dest_skip
+ *
+ * Returns TRUE if no message needs to be sent for the given dest, in
+ * which case it has been taken off the queue.
+ */
+static int
+zfpm_dest_skip (rib_dest_t *dest, struct rib *rib)
+{
+
+  /*
+   * If this is a route deletion, and we have not sent the route to
+   * the FPM previously, skip it.
+   */
+  if (!rib && !CHECK_FLAG (dest->flags, RIB_DEST_SENT_TO_FPM))
+    {
+      zfpm_g->stats.nop_deletes_skipped++;
+      zfpm_dest_done (dest, 0);
+      return 1;
+    }
+
+  return 0;
+}
+
+/*
+ * zfpm_build_messages
+ *
+ * Write messages, one per route, to the given buffer until it is
+ * full or the outgoing queue is empty.
+ */
+static void
+zfpm_build_messages (struct stream *s)
 {
-  struct stream *s;
   rib_dest_t *dest;
   unsigned char *buf, *data, *buf_end;
   size_t msg_len;
   size_t data_len;
   fpm_msg_hdr_t *hdr;
   struct rib *rib;
-  int is_add, write_msg;
+  int is_add;
   fpm_msg_type_e msg_type;
 
-  s = zfpm_g->obuf;
-
-  assert (stream_empty (s));
-
   do {
 
     /*
@@ -977,68 +1074,177 @@ zfpm_build_updates (void)
 
     assert (CHECK_FLAG (dest->flags, RIB_DEST_UPDATE_FPM));
 
+    rib = zfpm_route_for_update (dest);
+    is_add = rib ? 1 : 0;
+
+    if (zfpm_dest_skip (dest, rib))
+      continue;
+
     hdr = (fpm_msg_hdr_t *) buf;
     hdr->version = FPM_PROTO_VERSION;
 
     data = fpm_msg_data (hdr);
 
-    rib = zfpm_route_for_update (dest);
-    is_add = rib ? 1 : 0;
-
-    write_msg = 1;
+    data_len = zfpm_encode_route (dest, rib, (char *) data, buf_end - data,
+				  &msg_type);
 
-    /*
-     * If this is a route deletion, and we have not sent the route to
-     * the FPM previously, skip it.
-     */
-    if (!is_add && !CHECK_FLAG (dest->flags, RIB_DEST_SENT_TO_FPM))
+    assert (data_len);
+    if (data_len)
       {
-	write_msg = 0;
-	zfpm_g->stats.nop_deletes_skipped++;
+	hdr->msg_type = msg_type;
+	msg_len = fpm_data_len_to_msg_len (data_len);
+	hdr->msg_len = htons (msg_len);
+	stream_forward_endp (s, msg_len);
+	zfpm_g->stats.msgs_written++;
+
+	if (is_add)
+	  zfpm_g->stats.route_adds++;
+	else
+	  zfpm_g->stats.route_dels++;
       }
 
-    if (write_msg) {
-      data_len = zfpm_encode_route (dest, rib, (char *) data, buf_end - data,
-				    &msg_type);
+    zfpm_dest_done (dest, is_add);
 
-      assert (data_len);
-      if (data_len)
+  } while (1);
+
+}
+
+/*
+ * zfpm_build_batch
+ *
+ * Write a single message carrying updates for as many routes from the
+ * outgoing queue as will fit into it to the given buffer.
+ */
+static void
+zfpm_build_batch (struct stream *s)
+{
+  rib_dest_t *dest;
+  fpm_msg_hdr_t *hdr;
+  unsigned char *data;
+  size_t data_len, max_len;
+  struct rib *rib;
+  int is_add;
+  fpm_msg_type_e msg_type;
+#ifdef HAVE_NETLINK
+  static char scratch[FPM_MAX_MSG_LEN];
+  size_t len;
+#endif
+
+  if (STREAM_WRITEABLE (s) < FPM_MAX_MSG_LEN)
+    return;
+
+  hdr = (fpm_msg_hdr_t *) (STREAM_DATA (s) + stream_get_endp (s));
+  data = fpm_msg_data (hdr);
+  max_len = FPM_MAX_MSG_LEN - FPM_MSG_HDR_LEN;
+  data_len = 0;
+  msg_type = FPM_MSG_TYPE_NONE;
+
+#ifdef HAVE_PROTOBUF
+  if (zfpm_g->message_format == ZFPM_MSG_FORMAT_PROTOBUF)
+    zfpm_protobuf_batch_start ();
+#endif
+
+  while ((dest = TAILQ_FIRST (&zfpm_g->dest_q)))
+    {
+      assert (CHECK_FLAG (dest->flags, RIB_DEST_UPDATE_FPM));
+
+      rib = zfpm_route_for_update (dest);
+      is_add = rib ? 1 : 0;
+
+      if (zfpm_dest_skip (dest, rib))
+	continue;
+
+      switch (zfpm_g->message_format)
 	{
-	  hdr->msg_type = msg_type;
-	  msg_len = fpm_data_len_to_msg_len (data_len);
-	  hdr->msg_len = htons (msg_len);
-	  stream_forward_endp (s, msg_len);
-
-	  if (is_add)
-	    zfpm_g->stats.route_adds++;
-	  else
-	    zfpm_g->stats.route_dels++;
+
+	case ZFPM_MSG_FORMAT_PROTOBUF:
+#ifdef HAVE_PROTOBUF
+	  if (!zfpm_protobuf_batch_add (dest, rib, max_len))
+	    goto full;
+	  msg_type = FPM_MSG_TYPE_PROTOBUF_BATCH;
+#endif
+	  break;
+
+	case ZFPM_MSG_FORMAT_NETLINK:
+#ifdef HAVE_NETLINK
+
+	  /*
+	   * Encode out of line, the encoder does not cope with running
+	   * out of space.
+	   */
+	  len = zfpm_encode_route (dest, rib, scratch, sizeof (scratch),
+				   &msg_type);
+	  assert (len);
+	  if (data_len + len > max_len)
+	    goto full;
+	  memcpy (data + data_len, scratch, len);
+	  data_len += len;
+#endif /* HAVE_NETLINK */
+	  break;
+
+	default:
+	  break;
 	}
+
+      if (is_add)
+	zfpm_g->stats.route_adds++;
+      else
+	zfpm_g->stats.route_dels++;
+
+      zfpm_dest_done (dest, is_add);
     }
 
-    /*
-     * Remove the dest from the queue, and reset the flag.
-     */
-    UNSET_FLAG (dest->flags, RIB_DEST_UPDATE_FPM);
-    TAILQ_REMOVE (&zfpm_g->dest_q, dest, fpm_q_entries);
+ full:
+#ifdef HAVE_PROTOBUF
+  if (zfpm_g->message_format == ZFPM_MSG_FORMAT_PROTOBUF)
+    data_len = zfpm_protobuf_batch_finish (data, max_len);
+#endif
 
-    if (is_add)
-      {
-	SET_FLAG (dest->flags, RIB_DEST_SENT_TO_FPM);
-      }
-    else
-      {
-	UNSET_FLAG (dest->flags, RIB_DEST_SENT_TO_FPM);
-      }
+  if (!data_len)
+    return;
 
-    /*
-     * Delete the destination if necessary.
-     */
-    if (rib_gc_dest (dest->rnode))
-      zfpm_g->stats.dests_del_after_update++;
+  hdr->version = FPM_PROTO_VERSION;
+  hdr->msg_type = msg_type;
+  hdr->msg_len = htons (fpm_data_len_to_msg_len (data_len));
+  stream_forward_endp (s, fpm_data_len_to_msg_len (data_len));
+  zfpm_g->stats.msgs_written++;
+}
 
-  } while (1);
+/*
+ * zfpm_build_updates
+ *
+ * Process the outgoing queue and write messages to the outbound
+ * buffers.
+ */
+static void
+zfpm_build_updates (void)
+{
+  struct stream *s;
+
+  assert (zfpm_g->obuf_cur == zfpm_g->obuf_cnt);
+  zfpm_obuf_reset ();
+
+  while (zfpm_g->obuf_cnt < ZFPM_OBUF_COUNT)
+    {
+      if (TAILQ_EMPTY (&zfpm_g->dest_q))
+	break;
+
+      s = zfpm_g->obuf[zfpm_g->obuf_cnt];
+      assert (stream_empty (s));
+
+      if (zfpm_g->batch)
+	zfpm_build_batch (s);
+      else
+	zfpm_build_messages (s);
 
+      /*
+       * The queue may have held nothing but deletes to be skipped.
+       */
+      if (stream_empty (s))
+	break;
+
+      zfpm_g->obuf_cnt++;
+    }
 }
 
 /*
@@ -1048,6 +1254,7 @@ static int
 zfpm_write_cb (struct thread *thread)
 {
   struct stream *s;
+  struct iovec iov[ZFPM_OBUF_COUNT];
   int num_writes;
 
   zfpm_g->stats.write_cb_calls++;
@@ -1070,23 +1277,32 @@ zfpm_write_cb (struct thread *thread)
 
   do
     {
-      int bytes_to_write, bytes_written;
-
-      s = zfpm_g->obuf;
+      ssize_t bytes_to_write, bytes_written, left;
+      int i, iovcnt;
 
       /*
-       * If the stream is empty, try fill it up with data.
+       * If the buffers are empty, try fill them up with data.
        */
-      if (stream_empty (s))
+      if (zfpm_g->obuf_cur == zfpm_g->obuf_cnt)
 	{
 	  zfpm_build_updates ();
 	}
 
-      bytes_to_write = stream_get_endp (s) - stream_get_getp (s);
+      bytes_to_write = 0;
+      iovcnt = 0;
+      for (i = zfpm_g->obuf_cur; i < zfpm_g->obuf_cnt; i++)
+	{
+	  s = zfpm_g->obuf[i];
+	  iov[iovcnt].iov_base = STREAM_PNT (s);
+	  iov[iovcnt].iov_len = stream_get_endp (s) - stream_get_getp (s);
+	  bytes_to_write += iov[iovcnt].iov_len;
+	  iovcnt++;
+	}
+
       if (!bytes_to_write)
 	break;
 
-      bytes_written = write (zfpm_g->sock, STREAM_PNT (s), bytes_to_write);
+      bytes_written = writev (zfpm_g->sock, iov, iovcnt);
       zfpm_g->stats.write_calls++;
       num_writes++;
 
@@ -1099,22 +1315,35 @@ zfpm_write_cb (struct thread *thread)
 	  return 0;
 	}
 
+      zfpm_g->stats.bytes_written += bytes_written;
+
+      /*
+       * Move past the data that made it out.
+       */
+      left = bytes_written;
+      while (left && zfpm_g->obuf_cur < zfpm_g->obuf_cnt)
+	{
+	  s = zfpm_g->obuf[zfpm_g->obuf_cur];
+	  if ((size_t) left < stream_get_endp (s) - stream_get_getp (s))
+	    {
+	      stream_forward_getp (s, left);
+	      break;
+	    }
+	  left -= stream_get_endp (s) - stream_get_getp (s);
+	  stream_reset (s);
+	  zfpm_g->obuf_cur++;
+	}
+
       if (bytes_written != bytes_to_write)
 	{
 
 	  /*
 	   * Partial write.
 	   */
-	  stream_forward_getp (s, bytes_written);
 	  zfpm_g->stats.partial_writes++;
 	  break;
 	}
 
-      /*
-       * We've written out the entire contents of the stream.
-       */
-      stream_reset (s);
-
       if (num_writes >= ZFPM_MAX_WRITES_PER_RUN)
 	{
 	  zfpm_g->stats.max_writes_hit++;
@@ -1376,6 +1605,8 @@ zfpm_trigger_update (struct route_node *rn, const char *reason)
 
   SET_FLAG (dest->flags, RIB_DEST_UPDATE_FPM);
   TAILQ_INSERT_TAIL (&zfpm_g->dest_q, dest, fpm_q_entries);
+  if (++zfpm_g->dest_q_len > zfpm_g->dest_q_max)
+    zfpm_g->dest_q_max = zfpm_g->dest_q_len;
   zfpm_g->stats.updates_triggered++;
 
   /*
@@ -1459,6 +1690,7 @@ static void
 zfpm_show_stats (struct vty *vty)
 {
   zfpm_stats_t total_stats;
+  const zfpm_stats_t *last;
   time_t elapsed;
 
   vty_out (vty, "%s%-40s %10s     Last %2d secs%s%s", VTY_NEWLINE, "Counter",
@@ -1478,6 +1710,8 @@ zfpm_show_stats (struct vty *vty)
   ZFPM_SHOW_STAT (partial_writes);
   ZFPM_SHOW_STAT (max_writes_hit);
   ZFPM_SHOW_STAT (t_write_yields);
+  ZFPM_SHOW_STAT (msgs_written);
+  ZFPM_SHOW_STAT (bytes_written);
   ZFPM_SHOW_STAT (nop_deletes_skipped);
   ZFPM_SHOW_STAT (route_adds);
   ZFPM_SHOW_STAT (route_dels);
@@ -1495,6 +1729,15 @@ zfpm_show_stats (struct vty *vty)
   ZFPM_SHOW_STAT (t_conn_up_aborts);
   ZFPM_SHOW_STAT (t_conn_up_finishes);
 
+  last = &zfpm_g->last_ivl_stats;
+  vty_out (vty, "%sRates over the last %d secs: %lu msgs/s, %lu routes/s, "
+	   "%lu bytes/s%s", VTY_NEWLINE, ZFPM_STATS_IVL_SECS,
+	   last->msgs_written / ZFPM_STATS_IVL_SECS,
+	   (last->route_adds + last->route_dels) / ZFPM_STATS_IVL_SECS,
+	   last->bytes_written / ZFPM_STATS_IVL_SECS, VTY_NEWLINE);
+  vty_out (vty, "Update queue depth: %lu (max %lu)%s", zfpm_g->dest_q_len,
+	   zfpm_g->dest_q_max, VTY_NEWLINE);
+
   if (!zfpm_g->last_stats_clear_time)
     return;
 
@@ -1519,6 +1762,7 @@ zfpm_clear_stats (struct vty *vty)
   zfpm_stats_reset (&zfpm_g->stats);
   zfpm_stats_reset (&zfpm_g->last_ivl_stats);
   zfpm_stats_reset (&zfpm_g->cumulative_stats);
+  zfpm_g->dest_q_max = zfpm_g->dest_q_len;
 
   zfpm_stop_stats_timer ();
   zfpm_start_stats_timer ();
@@ -1605,6 +1849,26 @@ DEFUN ( no_fpm_remote_ip,
    return CMD_SUCCESS;
 }
 
+DEFUN (fpm_batch_updates,
+       fpm_batch_updates_cmd,
+       "fpm batch-updates",
+       "Forwarding Path Manager configuration\n"
+       "Pack multiple route updates into each message to the FPM\n")
+{
+  zfpm_g->batch = 1;
+  return CMD_SUCCESS;
+}
+
+DEFUN (no_fpm_batch_updates,
+       no_fpm_batch_updates_cmd,
+       "no fpm batch-updates",
+       NO_STR
+       "Forwarding Path Manager configuration\n"
+       "Pack multiple route updates into each message to the FPM\n")
+{
+  zfpm_g->batch = 0;
+  return CMD_SUCCESS;
+}
 
 /*
  * zfpm_init_message_format
@@ -1682,6 +1946,9 @@ int fpm_remote_srv_write (struct vty *vty )
           zfpm_g->fpm_port != FPM_DEFAULT_PORT)
       vty_out (vty,"fpm connection ip %s port %d%s", inet_ntoa (in),zfpm_g->fpm_port,VTY_NEWLINE);
 
+   if (zfpm_g->batch)
+      vty_out (vty, "fpm batch-updates%s", VTY_NEWLINE);
+
    return 0;
 }
 
@@ -1702,6 +1969,7 @@ zfpm_init (struct thread_master *master, int enable, uint16_t port,
 	   const char *format)
 {
   static int initialized = 0;
+  int i;
 
   if (initialized) {
     return 1;
@@ -1723,6 +1991,8 @@ zfpm_init (struct thread_master *master, int enable, uint16_t port,
   install_element (ENABLE_NODE, &clear_zebra_fpm_stats_cmd);
   install_element (CONFIG_NODE, &fpm_remote_ip_cmd);
   install_element (CONFIG_NODE, &no_fpm_remote_ip_cmd);
+  install_element (CONFIG_NODE, &fpm_batch_updates_cmd);
+  install_element (CONFIG_NODE, &no_fpm_batch_updates_cmd);
 
   zfpm_init_message_format(format);
 
@@ -1746,7 +2016,8 @@ zfpm_init (struct thread_master *master, int enable, uint16_t port,
 
   zfpm_g->fpm_port = port;
 
-  zfpm_g->obuf = stream_new (ZFPM_OBUF_SIZE);
+  for (i = 0; i < ZFPM_OBUF_COUNT; i++)
+    zfpm_g->obuf[i] = stream_new (ZFPM_OBUF_SIZE);
   zfpm_g->ibuf = stream_new (ZFPM_IBUF_SIZE);
 
   zfpm_start_stats_timer ();
@@ -57,5 +57,10 @@ extern int
 zfpm_protobuf_encode_route (rib_dest_t *dest, struct rib *rib,
 			    uint8_t *in_buf, size_t in_buf_len);
 
+extern void zfpm_protobuf_batch_start (void);
+extern int zfpm_protobuf_batch_add (rib_dest_t *dest, struct rib *rib,
+				    size_t max_len);
+extern size_t zfpm_protobuf_batch_finish (uint8_t *buf, size_t buf_len);
+
 extern struct rib *zfpm_route_for_update (rib_dest_t *dest);
 #endif /* _ZEBRA_FPM_PRIVATE_H */
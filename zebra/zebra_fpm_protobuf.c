@@ -309,3 +309,141 @@ zfpm_protobuf_encode_route (rib_dest_t *dest, struct rib *rib,
   QPB_RESET_STACK_ALLOCATOR (allocator);
   return len;
 }
+
+/*
+ * Batch encoding.
+ *
+ * The updates in a batch are built as parts of one fpm.MessageBatch,
+ * all of which are carved out of a single arena. The arena is set up
+ * once and simply reset after each batch has been packed.
+ */
+#define ZFPM_PB_ARENA_SIZE	(256 * 1024)
+
+/*
+ * Arena space to leave for each route: the per-message stack
+ * allocator used to be this big.
+ */
+#define ZFPM_PB_ROUTE_SPACE	4096
+
+#define ZFPM_PB_BATCH_MAX	512
+
+static struct
+{
+  int initialized;
+  qpb_allocator_t allocator;
+  linear_allocator_t lin;
+  uint64_t arena[ZFPM_PB_ARENA_SIZE / sizeof (uint64_t)];
+
+  Fpm__MessageBatch batch;
+  Fpm__Message *msgs[ZFPM_PB_BATCH_MAX];
+
+  /*
+   * Packed size of the batch so far.
+   */
+  size_t len;
+} zfpm_pb_batch;
+
+/*
+ * zfpm_protobuf_varint_len
+ */
+static inline size_t
+zfpm_protobuf_varint_len (size_t value)
+{
+  size_t len = 1;
+
+  while (value >= 0x80)
+    {
+      value >>= 7;
+      len++;
+    }
+  return len;
+}
+
+/*
+ * zfpm_protobuf_batch_start
+ *
+ * Start a new batch of updates.
+ */
+void
+zfpm_protobuf_batch_start (void)
+{
+  if (!zfpm_pb_batch.initialized)
+    {
+      linear_allocator_init (&zfpm_pb_batch.lin,
+			     (char *) zfpm_pb_batch.arena,
+			     sizeof (zfpm_pb_batch.arena));
+      qpb_allocator_init_linear (&zfpm_pb_batch.allocator,
+				 &zfpm_pb_batch.lin);
+      zfpm_pb_batch.initialized = 1;
+    }
+
+  linear_allocator_reset (&zfpm_pb_batch.lin);
+  fpm__message_batch__init (&zfpm_pb_batch.batch);
+  zfpm_pb_batch.batch.messages = zfpm_pb_batch.msgs;
+  zfpm_pb_batch.batch.n_messages = 0;
+  zfpm_pb_batch.len = 0;
+}
+
+/*
+ * zfpm_protobuf_batch_add
+ *
+ * Add an update for the given route to the current batch, provided
+ * the packed batch stays within max_len bytes.
+ *
+ * Returns TRUE if the route was added, FALSE if the batch is full.
+ */
+int
+zfpm_protobuf_batch_add (rib_dest_t *dest, struct rib *rib, size_t max_len)
+{
+  Fpm__Message *msg;
+  linear_allocator_t *lin = &zfpm_pb_batch.lin;
+  size_t msg_len, len;
+
+  if (zfpm_pb_batch.batch.n_messages >= ZFPM_PB_BATCH_MAX
+      || lin->end - lin->cur < ZFPM_PB_ROUTE_SPACE)
+    return 0;
+
+  msg = create_route_message (&zfpm_pb_batch.allocator, dest, rib);
+  if (!msg)
+    {
+      assert (0);
+      return 0;
+    }
+
+  /*
+   * Tag, length and the message itself.
+   */
+  msg_len = fpm__message__get_packed_size (msg);
+  len = 1 + zfpm_protobuf_varint_len (msg_len) + msg_len;
+  if (zfpm_pb_batch.len + len > max_len)
+    return 0;
+
+  zfpm_pb_batch.msgs[zfpm_pb_batch.batch.n_messages++] = msg;
+  zfpm_pb_batch.len += len;
+  return 1;
+}
+
+/*
+ * zfpm_protobuf_batch_finish
+ *
+ * Pack the current batch into the given buffer.
+ *
+ * Returns the number of bytes written to the buffer.
+ */
+size_t
+zfpm_protobuf_batch_finish (uint8_t *buf, size_t buf_len)
+{
+  size_t len;
+
+  if (!zfpm_pb_batch.batch.n_messages)
+    return 0;
+
+  assert (zfpm_pb_batch.len <= buf_len);
+  len = fpm__message_batch__pack (&zfpm_pb_batch.batch, buf);
+  assert (len == zfpm_pb_batch.len);
+
+  linear_allocator_reset (&zfpm_pb_batch.lin);
+  zfpm_pb_batch.batch.n_messages = 0;
+  zfpm_pb_batch.len = 0;
+  return len;
+}
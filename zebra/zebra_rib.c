@@ -876,6 +876,19 @@ rib_match_ipv6 (struct in6_addr *addr, vrf_id_t vrf_id)
 #define RIB_SYSTEM_ROUTE(R) \
         ((R)->type == ZEBRA_ROUTE_KERNEL || (R)->type == ZEBRA_ROUTE_CONNECT)
 
+/* Route zebra installed before a warm restart, still waiting for its
+ * owner to announce it again, see rib_warm_restart_start(). */
+#define RIB_RETAINED_ROUTE(R) \
+        (CHECK_FLAG ((R)->status, RIB_ENTRY_STALE) \
+         && CHECK_FLAG ((R)->flags, ZEBRA_FLAG_SELFROUTE))
+
+/* Route read back from a RIB snapshot, still waiting for its owner to
+ * announce it again, see rib_add_restored(). */
+#define RIB_RESTORED_ROUTE(R) \
+        (CHECK_FLAG ((R)->status, RIB_ENTRY_STALE) \
+         && ! CHECK_FLAG ((R)->flags, ZEBRA_FLAG_SELFROUTE) \
+         && ! RIB_SYSTEM_ROUTE (R))
+
 /* This function verifies reachability of one given nexthop, which can be
  * numbered or unnumbered, IPv4 or IPv6. The result is unconditionally stored
  * in nexthop->flags field. If the 4th parameter, 'set', is non-zero,
@@ -1193,6 +1206,95 @@ rib_choose_best (struct rib *current, struct rib *alternate)
   return current;
 }
 
+/* Compare two nexthops the way the kernel sees them. */
+static int
+nexthop_same_fib (struct nexthop *a, struct nexthop *b)
+{
+  if (a->ifindex != b->ifindex)
+    return 0;
+
+  switch (a->type)
+    {
+    case NEXTHOP_TYPE_IPV4:
+    case NEXTHOP_TYPE_IPV4_IFINDEX:
+    case NEXTHOP_TYPE_IPV4_IFNAME:
+      if (b->type != NEXTHOP_TYPE_IPV4
+          && b->type != NEXTHOP_TYPE_IPV4_IFINDEX
+          && b->type != NEXTHOP_TYPE_IPV4_IFNAME)
+        return 0;
+      return IPV4_ADDR_SAME (&a->gate.ipv4, &b->gate.ipv4)
+        && IPV4_ADDR_SAME (&a->src.ipv4, &b->src.ipv4);
+#ifdef HAVE_IPV6
+    case NEXTHOP_TYPE_IPV6:
+    case NEXTHOP_TYPE_IPV6_IFINDEX:
+    case NEXTHOP_TYPE_IPV6_IFNAME:
+      if (b->type != NEXTHOP_TYPE_IPV6
+          && b->type != NEXTHOP_TYPE_IPV6_IFINDEX
+          && b->type != NEXTHOP_TYPE_IPV6_IFNAME)
+        return 0;
+      return IPV6_ADDR_SAME (&a->gate.ipv6, &b->gate.ipv6);
+#endif /* HAVE_IPV6 */
+    case NEXTHOP_TYPE_IFINDEX:
+    case NEXTHOP_TYPE_IFNAME:
+      return b->type == NEXTHOP_TYPE_IFINDEX || b->type == NEXTHOP_TYPE_IFNAME;
+    default:
+      return 0;
+    }
+}
+
+/* Would installing 'new' in place of the retained route 'old' leave
+ * the kernel route as it is?  Then 'new' can take it over as it is.
+ * The owner has to be the same too, as it is recorded in the kernel.
+ */
+static int
+rib_fib_same (struct rib *old, struct rib *new)
+{
+  struct nexthop *nexthop, *tnexthop, *oldhop;
+  int recursing;
+  u_int32_t mtu;
+  int n = 0;
+
+  if (old->type != new->type
+      || CHECK_FLAG (new->flags, ZEBRA_FLAG_BLACKHOLE | ZEBRA_FLAG_REJECT))
+    return 0;
+
+  mtu = new->mtu;
+  if (! mtu || (new->nexthop_mtu && new->nexthop_mtu < mtu))
+    mtu = new->nexthop_mtu;
+  if (mtu != old->mtu)
+    return 0;
+
+  for (ALL_NEXTHOPS_RO(new->nexthop, nexthop, tnexthop, recursing))
+    {
+      if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE)
+          || ! CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE))
+        continue;
+
+      for (oldhop = old->nexthop; oldhop; oldhop = oldhop->next)
+        if (nexthop_same_fib (oldhop, nexthop))
+          break;
+      if (! oldhop)
+        return 0;
+      n++;
+    }
+
+  return n == old->nexthop_num;
+}
+
+/* Mark 'rib' as installed without telling the kernel, which already
+ * has it. */
+static void
+rib_fib_adopt (struct route_node *rn, struct rib *rib)
+{
+  struct nexthop *nexthop, *tnexthop;
+  int recursing;
+
+  for (ALL_NEXTHOPS_RO(rib->nexthop, nexthop, tnexthop, recursing))
+    if (! CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE)
+        && CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE))
+      SET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+}
+
 /* Core function for processing routing information base. */
 static void
 rib_process (struct route_node *rn)
@@ -1272,16 +1374,24 @@ rib_process (struct route_node *rn)
     {
         if (old_fib && old_fib != new_fib)
           {
-            if (! RIB_SYSTEM_ROUTE (old_fib) && (! new_fib || RIB_SYSTEM_ROUTE (new_fib)))
+            if ((! RIB_SYSTEM_ROUTE (old_fib) || RIB_RETAINED_ROUTE (old_fib))
+                && (! new_fib || RIB_SYSTEM_ROUTE (new_fib)))
               rib_update_kernel (rn, old_fib, NULL);
             UNSET_FLAG (old_fib->status, RIB_ENTRY_SELECTED_FIB);
           }
 
         if (new_fib)
           {
-            /* Install new or replace existing FIB entry */
+            /* Install new or replace existing FIB entry.  Routes kept
+             * over a warm restart are in the kernel already, as are
+             * their unchanged replacements. */
             SET_FLAG (new_fib->status, RIB_ENTRY_SELECTED_FIB);
-            if (! RIB_SYSTEM_ROUTE (new_fib))
+            if (RIB_RETAINED_ROUTE (new_fib)
+                || (old_fib && old_fib != new_fib
+                    && RIB_RETAINED_ROUTE (old_fib)
+                    && rib_fib_same (old_fib, new_fib)))
+              rib_fib_adopt (rn, new_fib);
+            else if (! RIB_SYSTEM_ROUTE (new_fib))
               rib_update_kernel (rn, old_fib, new_fib);
           }
 
@@ -1689,6 +1799,41 @@ rib_delnode (struct route_node *rn, struct rib *rib)
   rib_queue_add (&zebrad, rn);
 }
 
+/* A kernel resync (see rib_mark_kernel_stale()) brought in a route we
+ * already have as a stale entry, or an owner announced again a route
+ * restored from a snapshot.  If nothing changed, keep the old
+ * entry, dropping the stale mark, and free the new one, instead of
+ * replacing the route with an identical copy.  Returns 1 if so.
+ */
+static int
+rib_refresh_stale (struct rib *same, struct rib *rib)
+{
+  struct nexthop *nh1, *nh2;
+
+  if (! same || ! CHECK_FLAG (same->status, RIB_ENTRY_STALE))
+    return 0;
+
+  if (same->flags != rib->flags
+      || same->distance != rib->distance
+      || same->metric != rib->metric
+      || same->mtu != rib->mtu
+      || same->table != rib->table
+      || same->nexthop_num != rib->nexthop_num)
+    return 0;
+
+  for (nh1 = same->nexthop, nh2 = rib->nexthop; nh1 && nh2;
+       nh1 = nh1->next, nh2 = nh2->next)
+    if (! nexthop_same_no_recurse (nh1, nh2))
+      return 0;
+  if (nh1 || nh2)
+    return 0;
+
+  UNSET_FLAG (same->status, RIB_ENTRY_STALE);
+  nexthops_free (rib->nexthop);
+  XFREE (MTYPE_RIB, rib);
+  return 1;
+}
+
 int
 rib_add_ipv4 (int type, int flags, struct prefix_ipv4 *p, 
 	      struct in_addr *gate, struct in_addr *src,
@@ -1778,6 +1923,12 @@ rib_add_ipv4 (int type, int flags, struct prefix_ipv4 *p,
     for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
       SET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
 
+  if (rib_refresh_stale (same, rib))
+    {
+      route_unlock_node (rn);
+      return 0;
+    }
+
   /* Link new rib to node.*/
   if (IS_ZEBRA_DEBUG_RIB)
     zlog_debug ("%s: calling rib_addnode (%p, %p)",
@@ -1943,7 +2094,8 @@ rib_add_ipv4_multipath (struct prefix_ipv4 *p, struct rib *rib, safi_t safi)
       if (CHECK_FLAG (same->status, RIB_ENTRY_REMOVED))
         continue;
       
-      if (same->type == rib->type && same->table == rib->table
+      if (same->type == rib->type
+	  && (same->table == rib->table || RIB_RETAINED_ROUTE (same))
 	  && same->type != ZEBRA_ROUTE_CONNECT)
         break;
     }
@@ -1953,6 +2105,12 @@ rib_add_ipv4_multipath (struct prefix_ipv4 *p, struct rib *rib, safi_t safi)
     for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
       SET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
 
+  if (rib_refresh_stale (same, rib))
+    {
+      route_unlock_node (rn);
+      return 0;
+    }
+
   /* Link new rib to node.*/
   rib_addnode (rn, rib);
   ret = 1;
@@ -2561,6 +2719,12 @@ rib_add_ipv6 (int type, int flags, struct prefix_ipv6 *p,
     for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
       SET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
 
+  if (rib_refresh_stale (same, rib))
+    {
+      route_unlock_node (rn);
+      return 0;
+    }
+
   /* Link new rib to node.*/
   rib_addnode (rn, rib);
   if (IS_ZEBRA_DEBUG_RIB)
@@ -2631,7 +2795,7 @@ rib_add_ipv6_multipath (struct prefix_ipv6 *p, struct rib *rib, safi_t safi)
        continue;
      }
 
-     if (same->table != rib->table) {
+     if (same->table != rib->table && ! RIB_RETAINED_ROUTE (same)) {
        continue;
      }
      if (same->type != ZEBRA_ROUTE_CONNECT) {
@@ -2953,9 +3117,8 @@ static_delete_ipv6 (struct prefix *p, u_char type, struct in6_addr *gate,
   return 1;
 }
 
-/* RIB update function. */
-void
-rib_update (vrf_id_t vrf_id)
+static void
+rib_update_vrf (vrf_id_t vrf_id)
 {
   struct route_node *rn;
   struct route_table *table;
@@ -2973,6 +3136,45 @@ rib_update (vrf_id_t vrf_id)
         rib_queue_add (&zebrad, rn);
 }
 
+static int
+rib_update_timer (struct thread *thread)
+{
+  vrf_iter_t iter;
+  struct zebra_vrf *zvrf;
+
+  zebrad.t_if_batch = NULL;
+  for (iter = vrf_first (); iter != VRF_ITER_INVALID; iter = vrf_next (iter))
+    if ((zvrf = vrf_iter2info (iter)) != NULL && zvrf->rib_update_pending)
+      {
+        zvrf->rib_update_pending = 0;
+        rib_update_vrf (zvrf->vrf_id);
+      }
+
+  zserv_batch_flush ();
+  return 0;
+}
+
+/* Re-evaluate all routes of a VRF after an interface or address event.
+ * Events come in bursts, e.g. thousands of VLAN interfaces coming up at
+ * boot, so this only flags the VRF and starts a batch, at the end of
+ * which each flagged VRF is walked once.  While the batch is open the
+ * interface messages to clients are held back too, see zserv_batch_flush().
+ */
+void
+rib_update (vrf_id_t vrf_id)
+{
+  struct zebra_vrf *zvrf = vrf_info_lookup (vrf_id);
+
+  if (! zvrf)
+    return;
+
+  zvrf->rib_update_pending = 1;
+  if (! zebrad.t_if_batch)
+    zebrad.t_if_batch = thread_add_timer_msec (zebrad.master,
+                                               rib_update_timer, NULL,
+                                               RIB_UPDATE_BATCH_MSEC);
+}
+
 
 /* Remove all routes which comes from non main table.  */
 static void
@@ -3053,6 +3255,217 @@ rib_sweep_route (void)
       }
 }
 
+/* Flag the kernel routes of a route node, other than those zebra
+ * installed itself, as stale ahead of a re-read of the kernel routing
+ * table.  Routes the kernel still has lose the flag when they are read
+ * again, see rib_refresh_stale(), and rib_sweep_kernel_stale() removes
+ * the rest.  The resync goes over the table a slice at a time, see
+ * netlink_resync_walk().
+ */
+void
+rib_mark_kernel_stale (struct route_node *rn)
+{
+  struct rib *rib;
+
+  RNODE_FOREACH_RIB (rn, rib)
+    {
+      if (CHECK_FLAG (rib->status, RIB_ENTRY_REMOVED))
+	continue;
+
+      if (rib->type == ZEBRA_ROUTE_KERNEL
+	  && ! CHECK_FLAG (rib->flags, ZEBRA_FLAG_SELFROUTE))
+	SET_FLAG (rib->status, RIB_ENTRY_STALE);
+    }
+}
+
+/* Remove the kernel routes of a route node still flagged by
+ * rib_mark_kernel_stale(), returns how many there were. */
+unsigned long
+rib_sweep_kernel_stale (struct route_node *rn)
+{
+  struct rib *rib;
+  struct rib *next;
+  unsigned long n = 0;
+
+  RNODE_FOREACH_RIB_SAFE (rn, rib, next)
+    {
+      if (! CHECK_FLAG (rib->status, RIB_ENTRY_STALE)
+	  || RIB_RETAINED_ROUTE (rib) || RIB_RESTORED_ROUTE (rib))
+	continue;
+
+      UNSET_FLAG (rib->status, RIB_ENTRY_STALE);
+      if (CHECK_FLAG (rib->status, RIB_ENTRY_REMOVED))
+	continue;
+
+      rib_delnode (rn, rib);
+      n++;
+    }
+
+  return n;
+}
+
+/* Drop the routes retained over a warm restart, or restored from a
+ * snapshot, which belong to 'type', or all of them for
+ * ZEBRA_ROUTE_MAX.  Returns the number dropped, and
+ * sets *left to the number still retained.  The kernel copy goes away
+ * in rib_process(), unless another route takes its place.
+ */
+static unsigned long
+rib_sweep_retained (int type, unsigned long *left)
+{
+  vrf_iter_t iter;
+  struct zebra_vrf *zvrf;
+  struct route_node *rn;
+  struct rib *rib;
+  unsigned long n = 0;
+  afi_t afi;
+
+  *left = 0;
+  for (iter = vrf_first (); iter != VRF_ITER_INVALID; iter = vrf_next (iter))
+    if ((zvrf = vrf_iter2info (iter)) != NULL)
+      for (afi = AFI_IP; afi <= AFI_IP6; afi++)
+	if (zvrf->table[afi][SAFI_UNICAST])
+	  for (rn = route_top (zvrf->table[afi][SAFI_UNICAST]); rn;
+	       rn = route_next (rn))
+	    RNODE_FOREACH_RIB (rn, rib)
+	      {
+		if (CHECK_FLAG (rib->status, RIB_ENTRY_REMOVED)
+		    || ! (RIB_RETAINED_ROUTE (rib) || RIB_RESTORED_ROUTE (rib)))
+		  continue;
+
+		if (type != ZEBRA_ROUTE_MAX && rib->type != type)
+		  {
+		    (*left)++;
+		    continue;
+		  }
+		rib_delnode (rn, rib);
+		n++;
+	      }
+
+  return n;
+}
+
+static int
+rib_warm_restart_timer (struct thread *thread)
+{
+  unsigned long n, left;
+
+  zebrad.t_warm_restart = NULL;
+  n = rib_sweep_retained (ZEBRA_ROUTE_MAX, &left);
+  zlog_info ("warm restart: grace period over, %lu stale routes removed", n);
+  return 0;
+}
+
+/* Zebra was started with routes it installed earlier still in the
+ * kernel.  Keep them, flagged as stale, until their owners have
+ * connected and announced them again: a route which comes back the
+ * same takes the kernel entry over as it is, see rib_fib_same(), and
+ * what is left when the owner signals end-of-RIB, or when the grace
+ * period ends, is removed.
+ */
+void
+rib_warm_restart_start (void)
+{
+  vrf_iter_t iter;
+  struct zebra_vrf *zvrf;
+  struct route_node *rn;
+  struct rib *rib;
+  unsigned long n = 0;
+  afi_t afi;
+
+  for (iter = vrf_first (); iter != VRF_ITER_INVALID; iter = vrf_next (iter))
+    if ((zvrf = vrf_iter2info (iter)) != NULL)
+      for (afi = AFI_IP; afi <= AFI_IP6; afi++)
+	if (zvrf->table[afi][SAFI_UNICAST])
+	  for (rn = route_top (zvrf->table[afi][SAFI_UNICAST]); rn;
+	       rn = route_next (rn))
+	    RNODE_FOREACH_RIB (rn, rib)
+	      {
+		if (CHECK_FLAG (rib->status, RIB_ENTRY_REMOVED)
+		    || ! CHECK_FLAG (rib->flags, ZEBRA_FLAG_SELFROUTE))
+		  continue;
+
+		SET_FLAG (rib->status, RIB_ENTRY_STALE);
+		n++;
+	      }
+
+  zlog_info ("warm restart: retaining %lu routes for up to %u seconds",
+	     n, zebrad.warm_restart);
+  if (n)
+    zebrad.t_warm_restart = thread_add_timer (zebrad.master,
+					      rib_warm_restart_timer, NULL,
+					      zebrad.warm_restart);
+}
+
+/* Link a route read back from a snapshot, see rib_snapshot_read().  It
+ * is flagged stale, and dealt with like the routes retained over a warm
+ * restart: replaced when its owner announces it again, and removed if
+ * the owner has not by its end-of-RIB or the end of the grace period,
+ * see rib_restore_done().  A route the owner already has there, e.g.
+ * one kept in the kernel, wins over the snapshot.  Returns 1 if the
+ * route was linked.
+ */
+int
+rib_add_restored (struct route_table *table, struct prefix *p,
+		  struct rib *rib)
+{
+  struct route_node *rn;
+  struct rib *same;
+
+  rn = route_node_get (table, p);
+  RNODE_FOREACH_RIB (rn, same)
+    if (! CHECK_FLAG (same->status, RIB_ENTRY_REMOVED)
+	&& same->type == rib->type)
+      {
+	route_unlock_node (rn);
+	return 0;
+      }
+
+  SET_FLAG (rib->status, RIB_ENTRY_STALE);
+  rib_addnode (rn, rib);
+  route_unlock_node (rn);
+  return 1;
+}
+
+/* 'n' routes were restored from a snapshot, start the grace period for
+ * their owners, unless that of a warm restart is already running. */
+void
+rib_restore_done (unsigned long n)
+{
+  u_int32_t grace = zebrad.warm_restart ? zebrad.warm_restart
+					: RIB_RESTORE_GRACE;
+
+  if (! n || zebrad.t_warm_restart)
+    return;
+
+  zlog_info ("RIB snapshot: keeping %lu routes for up to %u seconds",
+	     n, grace);
+  zebrad.t_warm_restart = thread_add_timer (zebrad.master,
+					    rib_warm_restart_timer, NULL,
+					    grace);
+}
+
+/* A client has announced all its routes, remove those of its retained
+ * routes which it did not announce again. */
+void
+rib_warm_restart_eor (int type)
+{
+  unsigned long n, left;
+
+  if (! zebrad.t_warm_restart)
+    return;
+
+  n = rib_sweep_retained (type, &left);
+  zlog_info ("warm restart: end-of-RIB from %s, %lu stale routes removed",
+	     zebra_route_string (type), n);
+
+  if (left == 0)
+    {
+      THREAD_OFF (zebrad.t_warm_restart);
+      zlog_info ("warm restart: all retained routes reconciled");
+    }
+}
+
 /* Remove specific by protocol routes from 'table'. */
 static unsigned long
 rib_score_proto_table (u_char proto, struct route_table *table)
@@ -3310,6 +3723,10 @@ zebra_vrf_alloc (vrf_id_t vrf_id)
   snprintf (nl_name, 64, "netlink-cmd (vrf %u)", vrf_id);
   zvrf->netlink_cmd.sock = -1;
   zvrf->netlink_cmd.name = XSTRDUP (MTYPE_NETLINK_NAME, nl_name);
+
+  snprintf (nl_name, 64, "netlink-resync (vrf %u)", vrf_id);
+  zvrf->netlink_resync.sock = -1;
+  zvrf->netlink_resync.name = XSTRDUP (MTYPE_NETLINK_NAME, nl_name);
 #endif
 
   return zvrf;
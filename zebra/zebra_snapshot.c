@@ -0,0 +1,444 @@
+/*
+ * Binary snapshot of the zebra RIB.
+ *
+ * This file is part of GNU Zebra.
+ *
+ * GNU Zebra is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * GNU Zebra is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Zebra; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#include "prefix.h"
+#include "table.h"
+#include "memory.h"
+#include "log.h"
+#include "if.h"
+#include "vrf.h"
+#include "nexthop.h"
+
+#include "zebra/rib.h"
+
+/*
+ * A snapshot is a header followed by a sequence of records, all
+ * integers in network byte order:
+ *
+ *   header:  magic (4), version (2), reserved (2)
+ *   table:   SNAP_REC_TABLE (1), vrf id (2), afi (1), safi (1)
+ *   route:   SNAP_REC_ROUTE (1), type (1), flags (1), distance (1),
+ *            metric (4), mtu (4), tag (4), table (4),
+ *            prefix length (1), prefix (PSIZE of the length),
+ *            number of nexthops (1), nexthops
+ *   end:     SNAP_REC_END (1), number of routes (4)
+ *
+ * A route belongs to the table record before it.  A nexthop is its
+ * type (1), flags (1) and ifindex (4), then by type the gateway and
+ * source (4 + 4 for IPv4, 16 for IPv6) and the interface name (length
+ * (1) and name).  Only the nexthops a route was given are kept, not
+ * what they resolved to, which is worked out again once loaded.
+ *
+ * Connected, kernel and static routes are left out, they come back
+ * from the kernel and the configuration on their own.
+ */
+#define SNAP_MAGIC	0x5a524942	/* "ZRIB" */
+#define SNAP_VERSION	1
+
+#define SNAP_REC_END	0
+#define SNAP_REC_TABLE	1
+#define SNAP_REC_ROUTE	2
+
+#define SNAP_BUFSIZ	65536
+
+static int
+snap_route_saved (struct rib *rib)
+{
+  return ! CHECK_FLAG (rib->status, RIB_ENTRY_REMOVED)
+	 && rib->type != ZEBRA_ROUTE_KERNEL
+	 && rib->type != ZEBRA_ROUTE_CONNECT
+	 && rib->type != ZEBRA_ROUTE_STATIC;
+}
+
+static void
+snap_put (FILE *fp, const void *buf, size_t len)
+{
+  fwrite (buf, len, 1, fp);
+}
+
+static void
+snap_putc (FILE *fp, u_char c)
+{
+  putc (c, fp);
+}
+
+static void
+snap_putw (FILE *fp, u_int16_t w)
+{
+  w = htons (w);
+  snap_put (fp, &w, sizeof (w));
+}
+
+static void
+snap_putl (FILE *fp, u_int32_t l)
+{
+  l = htonl (l);
+  snap_put (fp, &l, sizeof (l));
+}
+
+static void
+snap_put_nexthop (FILE *fp, struct nexthop *nexthop)
+{
+  snap_putc (fp, nexthop->type);
+  snap_putc (fp, nexthop->flags & NEXTHOP_FLAG_ONLINK);
+  snap_putl (fp, nexthop->ifindex);
+
+  switch (nexthop->type)
+    {
+    case NEXTHOP_TYPE_IPV4:
+    case NEXTHOP_TYPE_IPV4_IFINDEX:
+    case NEXTHOP_TYPE_IPV4_IFNAME:
+      snap_put (fp, &nexthop->gate.ipv4, 4);
+      snap_put (fp, &nexthop->src.ipv4, 4);
+      break;
+    case NEXTHOP_TYPE_IPV6:
+    case NEXTHOP_TYPE_IPV6_IFINDEX:
+    case NEXTHOP_TYPE_IPV6_IFNAME:
+      snap_put (fp, &nexthop->gate.ipv6, 16);
+      break;
+    default:
+      break;
+    }
+
+  if (nexthop->type == NEXTHOP_TYPE_IFNAME
+      || nexthop->type == NEXTHOP_TYPE_IPV4_IFNAME
+      || nexthop->type == NEXTHOP_TYPE_IPV6_IFNAME)
+    {
+      size_t len = nexthop->ifname ? strlen (nexthop->ifname) : 0;
+
+      len = MIN (len, INTERFACE_NAMSIZ);
+      snap_putc (fp, len);
+      snap_put (fp, nexthop->ifname, len);
+    }
+}
+
+static void
+snap_put_route (FILE *fp, struct prefix *p, struct rib *rib)
+{
+  struct nexthop *nexthop;
+
+  snap_putc (fp, SNAP_REC_ROUTE);
+  snap_putc (fp, rib->type);
+  snap_putc (fp, rib->flags & ~(ZEBRA_FLAG_SELFROUTE | ZEBRA_FLAG_SELECTED));
+  snap_putc (fp, rib->distance);
+  snap_putl (fp, rib->metric);
+  snap_putl (fp, rib->mtu);
+  snap_putl (fp, rib->tag);
+  snap_putl (fp, rib->table);
+  snap_putc (fp, p->prefixlen);
+  snap_put (fp, &p->u.prefix, PSIZE (p->prefixlen));
+
+  snap_putc (fp, rib->nexthop_num);
+  for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+    snap_put_nexthop (fp, nexthop);
+}
+
+/* Write a snapshot of all RIB tables to 'path', going through a
+ * temporary file so that an existing snapshot is only replaced by a
+ * complete one.  Returns the number of routes written, or -1. */
+long
+rib_snapshot_write (const char *path)
+{
+  rib_tables_iter_t iter;
+  struct route_table *table;
+  struct route_node *rn;
+  struct rib *rib;
+  char tmp[MAXPATHLEN];
+  char *buf;
+  FILE *fp;
+  long n = 0;
+  int ret;
+
+  snprintf (tmp, sizeof (tmp), "%s.tmp", path);
+  if ((fp = fopen (tmp, "w")) == NULL)
+    {
+      zlog_warn ("RIB snapshot: cannot open %s: %s", tmp,
+		 safe_strerror (errno));
+      return -1;
+    }
+  buf = XMALLOC (MTYPE_TMP, SNAP_BUFSIZ);
+  setvbuf (fp, buf, _IOFBF, SNAP_BUFSIZ);
+
+  snap_putl (fp, SNAP_MAGIC);
+  snap_putw (fp, SNAP_VERSION);
+  snap_putw (fp, 0);
+
+  rib_tables_iter_init (&iter);
+  while ((table = rib_tables_iter_next (&iter)))
+    {
+      rib_table_info_t *info = rib_table_info (table);
+      int started = 0;
+
+      for (rn = route_top (table); rn; rn = route_next (rn))
+	RNODE_FOREACH_RIB (rn, rib)
+	  {
+	    if (! snap_route_saved (rib))
+	      continue;
+
+	    if (! started)
+	      {
+		snap_putc (fp, SNAP_REC_TABLE);
+		snap_putw (fp, info->zvrf->vrf_id);
+		snap_putc (fp, info->afi);
+		snap_putc (fp, info->safi);
+		started = 1;
+	      }
+	    snap_put_route (fp, &rn->p, rib);
+	    n++;
+	  }
+    }
+  rib_tables_iter_cleanup (&iter);
+
+  snap_putc (fp, SNAP_REC_END);
+  snap_putl (fp, n);
+
+  ret = fflush (fp) == 0 && ! ferror (fp) && fsync (fileno (fp)) == 0;
+  fclose (fp);
+  XFREE (MTYPE_TMP, buf);
+
+  if (! ret || rename (tmp, path) < 0)
+    {
+      zlog_warn ("RIB snapshot: cannot write %s: %s", path,
+		 safe_strerror (errno));
+      unlink (tmp);
+      return -1;
+    }
+  return n;
+}
+
+/* Reading back.  Any short read leaves fp at EOF, and is caught once
+ * the record it was part of is complete. */
+static void
+snap_get (FILE *fp, void *buf, size_t len)
+{
+  if (len && fread (buf, len, 1, fp) != 1)
+    memset (buf, 0, len);
+}
+
+static u_char
+snap_getc (FILE *fp)
+{
+  int c = getc (fp);
+
+  return c == EOF ? 0 : c;
+}
+
+static u_int16_t
+snap_getw (FILE *fp)
+{
+  u_int16_t w;
+
+  snap_get (fp, &w, sizeof (w));
+  return ntohs (w);
+}
+
+static u_int32_t
+snap_getl (FILE *fp)
+{
+  u_int32_t l;
+
+  snap_get (fp, &l, sizeof (l));
+  return ntohl (l);
+}
+
+static struct nexthop *
+snap_get_nexthop (FILE *fp)
+{
+  struct nexthop *nexthop;
+  char ifname[INTERFACE_NAMSIZ + 1];
+  size_t len;
+
+  nexthop = nexthop_new ();
+  nexthop->type = snap_getc (fp);
+  nexthop->flags = snap_getc (fp) & NEXTHOP_FLAG_ONLINK;
+  nexthop->ifindex = snap_getl (fp);
+
+  switch (nexthop->type)
+    {
+    case NEXTHOP_TYPE_IPV4:
+    case NEXTHOP_TYPE_IPV4_IFINDEX:
+    case NEXTHOP_TYPE_IPV4_IFNAME:
+      snap_get (fp, &nexthop->gate.ipv4, 4);
+      snap_get (fp, &nexthop->src.ipv4, 4);
+      break;
+    case NEXTHOP_TYPE_IPV6:
+    case NEXTHOP_TYPE_IPV6_IFINDEX:
+    case NEXTHOP_TYPE_IPV6_IFNAME:
+      snap_get (fp, &nexthop->gate.ipv6, 16);
+      break;
+    case NEXTHOP_TYPE_IFINDEX:
+    case NEXTHOP_TYPE_IFNAME:
+    case NEXTHOP_TYPE_BLACKHOLE:
+      break;
+    default:
+      nexthop_free (nexthop);
+      return NULL;
+    }
+
+  if (nexthop->type == NEXTHOP_TYPE_IFNAME
+      || nexthop->type == NEXTHOP_TYPE_IPV4_IFNAME
+      || nexthop->type == NEXTHOP_TYPE_IPV6_IFNAME)
+    {
+      len = MIN (snap_getc (fp), INTERFACE_NAMSIZ);
+      snap_get (fp, ifname, len);
+      ifname[len] = '\0';
+      nexthop->ifname = XSTRDUP (MTYPE_TMP, ifname);
+    }
+  return nexthop;
+}
+
+/* Read one route record into a new rib, NULL if it is malformed. */
+static struct rib *
+snap_get_route (FILE *fp, struct prefix *p, afi_t afi, vrf_id_t vrf_id)
+{
+  struct rib *rib;
+  struct nexthop *nexthop;
+  int i, num;
+
+  rib = XCALLOC (MTYPE_RIB, sizeof (struct rib));
+  rib->type = snap_getc (fp);
+  rib->flags = snap_getc (fp);
+  rib->distance = snap_getc (fp);
+  rib->metric = snap_getl (fp);
+  rib->mtu = snap_getl (fp);
+  rib->tag = snap_getl (fp);
+  rib->table = snap_getl (fp);
+  rib->vrf_id = vrf_id;
+  rib->uptime = time (NULL);
+
+  memset (p, 0, sizeof (*p));
+  p->family = afi2family (afi);
+  p->prefixlen = snap_getc (fp);
+  if (p->prefixlen > prefix_blen (p) * 8)
+    goto bad;
+  snap_get (fp, &p->u.prefix, PSIZE (p->prefixlen));
+  apply_mask (p);
+
+  num = snap_getc (fp);
+  for (i = 0; i < num; i++)
+    {
+      if ((nexthop = snap_get_nexthop (fp)) == NULL)
+	goto bad;
+      rib_nexthop_add (rib, nexthop);
+    }
+
+  if (rib->type >= ZEBRA_ROUTE_MAX || num == 0 || feof (fp))
+    goto bad;
+  return rib;
+
+bad:
+  nexthops_free (rib->nexthop);
+  XFREE (MTYPE_RIB, rib);
+  return NULL;
+}
+
+/* Load the snapshot in 'path' into the RIB.  The routes are flagged
+ * stale until their owners announce them again, see rib_add_restored().
+ * Returns the number of routes restored, or -1 if the snapshot could
+ * not be read; whatever came before a bad record is kept. */
+long
+rib_snapshot_read (const char *path)
+{
+  struct route_table *table = NULL;
+  struct prefix p;
+  struct rib *rib;
+  afi_t afi = AFI_IP;
+  vrf_id_t vrf_id = VRF_DEFAULT;
+  unsigned long seen = 0, n = 0;
+  char *buf;
+  FILE *fp;
+  long ret = -1;
+
+  if ((fp = fopen (path, "r")) == NULL)
+    {
+      zlog_warn ("RIB snapshot: cannot open %s: %s", path,
+		 safe_strerror (errno));
+      return -1;
+    }
+  buf = XMALLOC (MTYPE_TMP, SNAP_BUFSIZ);
+  setvbuf (fp, buf, _IOFBF, SNAP_BUFSIZ);
+
+  if (snap_getl (fp) != SNAP_MAGIC)
+    {
+      zlog_warn ("RIB snapshot: %s is not a RIB snapshot", path);
+      goto out;
+    }
+  if (snap_getw (fp) != SNAP_VERSION)
+    {
+      zlog_warn ("RIB snapshot: %s has an unknown version", path);
+      goto out;
+    }
+  snap_getw (fp);
+
+  while (1)
+    {
+      int rec = getc (fp);
+
+      if (rec == SNAP_REC_END)
+	{
+	  if (snap_getl (fp) != seen || feof (fp))
+	    break;
+	  zlog_info ("RIB snapshot: restored %lu of %lu routes from %s",
+		     n, seen, path);
+	  ret = n;
+	  goto out;
+	}
+      else if (rec == SNAP_REC_TABLE)
+	{
+	  safi_t safi;
+
+	  vrf_id = snap_getw (fp);
+	  afi = snap_getc (fp);
+	  safi = snap_getc (fp);
+	  if (afi != AFI_IP && afi != AFI_IP6)
+	    break;
+
+	  /* A table of a VRF which is gone is skipped. */
+	  table = zebra_vrf_table (afi, safi, vrf_id);
+	}
+      else if (rec == SNAP_REC_ROUTE)
+	{
+	  if ((rib = snap_get_route (fp, &p, afi, vrf_id)) == NULL)
+	    break;
+	  seen++;
+	  if (table && rib_add_restored (table, &p, rib))
+	    n++;
+	  else
+	    {
+	      nexthops_free (rib->nexthop);
+	      XFREE (MTYPE_RIB, rib);
+	    }
+	}
+      else
+	break;
+    }
+
+  zlog_warn ("RIB snapshot: %s is truncated or corrupt after %lu routes",
+	     path, seen);
+  ret = n ? (long) n : -1;
+
+out:
+  fclose (fp);
+  XFREE (MTYPE_TMP, buf);
+  return ret;
+}
@@ -5272,6 +5272,26 @@ static int config_write_vty(struct vty *vty)
 static struct cmd_node protocol_node = { PROTOCOL_NODE, "", 1 };
 
 /* IP node for static routes. */
+DEFUN (write_rib_snapshot,
+       write_rib_snapshot_cmd,
+       "write rib-snapshot FILE",
+       "Write running configuration to memory, network, or terminal\n"
+       "Write a binary snapshot of the RIB, see the --restore option\n"
+       "File to write it to\n")
+{
+  long n;
+
+  n = rib_snapshot_write (argv[0]);
+  if (n < 0)
+    {
+      vty_out (vty, "%% Can't write RIB snapshot %s: %s%s", argv[0],
+	       safe_strerror (errno), VTY_NEWLINE);
+      return CMD_WARNING;
+    }
+  vty_out (vty, "Wrote %ld routes to %s%s", n, argv[0], VTY_NEWLINE);
+  return CMD_SUCCESS;
+}
+
 static struct cmd_node ip_node = { IP_NODE,  "",  1 };
 
 /* Route VTY.  */
@@ -5361,6 +5381,7 @@ zebra_vty_init (void)
   install_element (CONFIG_NODE, &no_ip_route_mask_flags_tag_distance2_cmd);
   install_element (CONFIG_NODE, &no_ip_route_mask_flags_tag_distance2_vrf_cmd);
 
+  install_element (ENABLE_NODE, &write_rib_snapshot_cmd);
   install_element (VIEW_NODE, &show_ip_route_cmd);
   install_element (VIEW_NODE, &show_ip_route_tag_cmd);
   install_element (VIEW_NODE, &show_ip_route_tag_vrf_cmd);
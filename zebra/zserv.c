@@ -38,6 +38,7 @@
 #include "buffer.h"
 #include "vrf.h"
 #include "nexthop.h"
+#include "zring.h"
 
 #include "zebra/zserv.h"
 #include "zebra/router-id.h"
@@ -47,7 +48,7 @@
 #include "zebra/zebra_rnh.h"
 
 /* Event list of zebra. */
-enum event { ZEBRA_SERV, ZEBRA_READ, ZEBRA_WRITE };
+enum event { ZEBRA_SERV, ZEBRA_READ, ZEBRA_PROCESS, ZEBRA_WRITE };
 
 extern struct zebra_t zebrad;
 
@@ -140,6 +141,34 @@ zebra_server_send_message(struct zserv *client)
   return 0;
 }
 
+/* Send an interface message.  While interface events are batched the
+ * message is only queued, and goes out with the rest of the batch. */
+static int
+zebra_server_send_interface (struct zserv *client)
+{
+  if (! zebrad.t_if_batch || client->t_suicide)
+    return zebra_server_send_message (client);
+
+  client->last_write_cmd = stream_getw_from (client->obuf, 4);
+  buffer_put (client->wb, STREAM_DATA (client->obuf),
+	      stream_get_endp (client->obuf));
+  return 0;
+}
+
+/* The interface event batch is over, start writing out what was queued
+ * for each client. */
+void
+zserv_batch_flush (void)
+{
+  struct listnode *node;
+  struct zserv *client;
+
+  for (ALL_LIST_ELEMENTS_RO (zebrad.client_list, node, client))
+    if (! client->t_suicide && ! buffer_empty (client->wb))
+      THREAD_WRITE_ON (zebrad.master, client->t_write,
+		       zserv_flush_data, client, client->sock);
+}
+
 void
 zserv_create_header (struct stream *s, uint16_t cmd, vrf_id_t vrf_id)
 {
@@ -209,7 +238,7 @@ zsend_interface_add (struct zserv *client, struct interface *ifp)
   zserv_encode_interface (s, ifp);
 
   client->ifadd_cnt++;
-  return zebra_server_send_message(client);
+  return zebra_server_send_interface (client);
 }
 
 /* Interface deletion from zebra daemon. */
@@ -229,7 +258,7 @@ zsend_interface_delete (struct zserv *client, struct interface *ifp)
   zserv_encode_interface (s, ifp);
 
   client->ifdel_cnt++;
-  return zebra_server_send_message (client);
+  return zebra_server_send_interface (client);
 }
 
 int
@@ -258,7 +287,7 @@ zsend_interface_link_params (struct zserv *client, struct interface *ifp)
   /* Write packet size. */
   stream_putw_at (s, 0, stream_get_endp (s));
   
-  return zebra_server_send_message (client);
+  return zebra_server_send_interface (client);
 }
 
 /* Interface address is added/deleted. Send ZEBRA_INTERFACE_ADDRESS_ADD or
@@ -344,7 +373,7 @@ zsend_interface_address (int cmd, struct zserv *client,
   stream_putw_at (s, 0, stream_get_endp (s));
 
   client->connected_rt_add_cnt++;
-  return zebra_server_send_message(client);
+  return zebra_server_send_interface (client);
 }
 
 /*
@@ -377,7 +406,7 @@ zsend_interface_update (int cmd, struct zserv *client, struct interface *ifp)
   else
     client->ifdown_cnt++;
 
-  return zebra_server_send_message(client);
+  return zebra_server_send_interface (client);
 }
 
 /*
@@ -892,48 +921,18 @@ zread_interface_delete (struct zserv *client, u_short length, vrf_id_t vrf_id)
   return 0;
 }
 
-/* This function support multiple nexthop. */
-/* 
- * Parse the ZEBRA_IPV4_ROUTE_ADD sent from client. Update rib and
- * add kernel route. 
+/* Parse the nexthop, distance, metric, MTU and tag part of an IPv4
+ * route message into rib.
  */
-static int
-zread_ipv4_add (struct zserv *client, u_short length, vrf_id_t vrf_id)
+static void
+zread_ipv4_route_attr (struct stream *s, struct rib *rib, u_char message)
 {
   int i;
-  struct rib *rib;
-  struct prefix_ipv4 p;
-  u_char message;
   struct in_addr nexthop;
   u_char nexthop_num;
   u_char nexthop_type;
-  struct stream *s;
   ifindex_t ifindex;
   u_char ifname_len;
-  safi_t safi;	
-  int ret;
-
-  /* Get input stream.  */
-  s = client->ibuf;
-
-  /* Allocate new rib. */
-  rib = XCALLOC (MTYPE_RIB, sizeof (struct rib));
-  
-  /* Type, flags, message. */
-  rib->type = stream_getc (s);
-  rib->flags = stream_getc (s);
-  message = stream_getc (s); 
-  safi = stream_getw (s);
-  rib->uptime = time (NULL);
-
-  /* IPv4 prefix. */
-  memset (&p, 0, sizeof (struct prefix_ipv4));
-  p.family = AF_INET;
-  p.prefixlen = stream_getc (s);
-  stream_get (&p.prefix, s, PSIZE (p.prefixlen));
-
-  /* VRF ID */
-  rib->vrf_id = vrf_id;
 
   /* Nexthop parse. */
   if (CHECK_FLAG (message, ZAPI_MESSAGE_NEXTHOP))
@@ -988,6 +987,47 @@ zread_ipv4_add (struct zserv *client, u_short length, vrf_id_t vrf_id)
     rib->tag = stream_getl (s);
   else
     rib->tag = 0;
+}
+
+/* This function support multiple nexthop. */
+/* 
+ * Parse the ZEBRA_IPV4_ROUTE_ADD sent from client. Update rib and
+ * add kernel route. 
+ */
+static int
+zread_ipv4_add (struct zserv *client, u_short length, vrf_id_t vrf_id)
+{
+  struct rib *rib;
+  struct prefix_ipv4 p;
+  u_char message;
+  struct stream *s;
+  safi_t safi;	
+  int ret;
+
+  /* Get input stream.  */
+  s = client->ibuf;
+
+  /* Allocate new rib. */
+  rib = XCALLOC (MTYPE_RIB, sizeof (struct rib));
+  
+  /* Type, flags, message. */
+  rib->type = stream_getc (s);
+  rib->flags = stream_getc (s);
+  message = stream_getc (s); 
+  safi = stream_getw (s);
+  rib->uptime = time (NULL);
+
+  /* IPv4 prefix. */
+  memset (&p, 0, sizeof (struct prefix_ipv4));
+  p.family = AF_INET;
+  p.prefixlen = stream_getc (s);
+  stream_get (&p.prefix, s, PSIZE (p.prefixlen));
+
+  /* VRF ID */
+  rib->vrf_id = vrf_id;
+
+  /* Nexthops, distance, metric, MTU, tag. */
+  zread_ipv4_route_attr (s, rib, message);
   
   /* Table */
   rib->table=zebrad.rtm_table_default;
@@ -1001,6 +1041,104 @@ zread_ipv4_add (struct zserv *client, u_short length, vrf_id_t vrf_id)
   return 0;
 }
 
+/* Make a new rib for one prefix of a batched route message, copying
+ * everything but the prefix from the template decoded once per message.
+ */
+static struct rib *
+zserv_rib_from_template (struct rib *tmpl)
+{
+  struct rib *rib;
+  struct nexthop *nh, *nexthop;
+
+  rib = XCALLOC (MTYPE_RIB, sizeof (struct rib));
+  rib->type = tmpl->type;
+  rib->flags = tmpl->flags;
+  rib->uptime = tmpl->uptime;
+  rib->vrf_id = tmpl->vrf_id;
+  rib->distance = tmpl->distance;
+  rib->metric = tmpl->metric;
+  rib->mtu = tmpl->mtu;
+  rib->tag = tmpl->tag;
+  rib->table = tmpl->table;
+
+  /* Nexthops decoded from ZAPI carry neither ifname nor resolved
+   * nexthops, so a flat copy suffices. */
+  for (nh = tmpl->nexthop; nh; nh = nh->next)
+    {
+      nexthop = nexthop_new ();
+      nexthop->type = nh->type;
+      nexthop->flags = nh->flags;
+      nexthop->ifindex = nh->ifindex;
+      nexthop->gate = nh->gate;
+      nexthop->src = nh->src;
+      rib_nexthop_add (rib, nexthop);
+    }
+
+  return rib;
+}
+
+/*
+ * Parse ZEBRA_IPV4_ROUTE_ADD_MULTI: the route attributes and nexthops
+ * are encoded once, followed by a count and the list of prefixes which
+ * share them.  See zapi_ipv4_route_batch().
+ */
+static int
+zread_ipv4_add_multi (struct zserv *client, u_short length, vrf_id_t vrf_id)
+{
+  struct rib tmpl;
+  struct rib *rib;
+  struct prefix_ipv4 p;
+  u_char message;
+  struct stream *s;
+  safi_t safi;
+  u_int16_t count;
+  int ret;
+
+  s = client->ibuf;
+  memset (&tmpl, 0, sizeof (struct rib));
+
+  /* Type, flags, message. */
+  tmpl.type = stream_getc (s);
+  tmpl.flags = stream_getc (s);
+  message = stream_getc (s);
+  safi = stream_getw (s);
+  tmpl.uptime = time (NULL);
+  tmpl.vrf_id = vrf_id;
+  tmpl.table = zebrad.rtm_table_default;
+
+  /* Nexthops, distance, metric, MTU, tag. */
+  zread_ipv4_route_attr (s, &tmpl, message);
+
+  /* Prefixes. */
+  count = stream_getw (s);
+  while (count--)
+    {
+      memset (&p, 0, sizeof (struct prefix_ipv4));
+      p.family = AF_INET;
+      p.prefixlen = stream_getc (s);
+      if (p.prefixlen > IPV4_MAX_BITLEN
+          || STREAM_READABLE (s) < (size_t) PSIZE (p.prefixlen))
+        {
+          zlog_warn ("%s: malformed prefix list from client %d",
+                     __func__, client->sock);
+          break;
+        }
+      stream_get (&p.prefix, s, PSIZE (p.prefixlen));
+
+      rib = zserv_rib_from_template (&tmpl);
+      ret = rib_add_ipv4_multipath (&p, rib, safi);
+
+      /* Stats */
+      if (ret > 0)
+        client->v4_route_add_cnt++;
+      else if (ret < 0)
+        client->v4_route_upd8_cnt++;
+    }
+
+  nexthops_free (tmpl.nexthop);
+  return 0;
+}
+
 /* Zebra server IPv4 prefix delete function. */
 static int
 zread_ipv4_delete (struct zserv *client, u_short length, vrf_id_t vrf_id)
@@ -1121,44 +1259,21 @@ zread_ipv4_import_lookup (struct zserv *client, u_short length,
 }
 
 #ifdef HAVE_IPV6
-/* Zebra server IPv6 prefix add function. */
-static int
-zread_ipv6_add (struct zserv *client, u_short length, vrf_id_t vrf_id)
+/* Parse the nexthop, distance, metric, MTU and tag part of an IPv6
+ * route message into rib.
+ */
+static void
+zread_ipv6_route_attr (struct stream *s, struct rib *rib, u_char message)
 {
   int i;
-  struct stream *s;
   struct in6_addr nexthop;
-  struct rib *rib;
-  u_char message;
   u_char gateway_num;
   u_char nexthop_type;
-  struct prefix_ipv6 p;
-  safi_t safi;
   static struct in6_addr nexthops[MULTIPATH_NUM];
   static unsigned int ifindices[MULTIPATH_NUM];
-  int ret;
-
-  /* Get input stream.  */
-  s = client->ibuf;
 
   memset (&nexthop, 0, sizeof (struct in6_addr));
 
-  /* Allocate new rib. */
-  rib = XCALLOC (MTYPE_RIB, sizeof (struct rib));
-
-  /* Type, flags, message. */
-  rib->type = stream_getc (s);
-  rib->flags = stream_getc (s);
-  message = stream_getc (s);
-  safi = stream_getw (s);
-  rib->uptime = time (NULL);
-
-  /* IPv6 prefix. */
-  memset (&p, 0, sizeof (struct prefix_ipv6));
-  p.family = AF_INET6;
-  p.prefixlen = stream_getc (s);
-  stream_get (&p.prefix, s, PSIZE (p.prefixlen));
-
   /* We need to give nh-addr, nh-ifindex with the same next-hop object
    * to the rib to ensure that IPv6 multipathing works; need to coalesce
    * these. Clients should send the same number of paired set of
@@ -1226,6 +1341,40 @@ zread_ipv6_add (struct zserv *client, u_short length, vrf_id_t vrf_id)
     rib->tag = stream_getl (s);
   else
     rib->tag = 0;
+}
+
+/* Zebra server IPv6 prefix add function. */
+static int
+zread_ipv6_add (struct zserv *client, u_short length, vrf_id_t vrf_id)
+{
+  struct stream *s;
+  struct rib *rib;
+  u_char message;
+  struct prefix_ipv6 p;
+  safi_t safi;
+  int ret;
+
+  /* Get input stream.  */
+  s = client->ibuf;
+
+  /* Allocate new rib. */
+  rib = XCALLOC (MTYPE_RIB, sizeof (struct rib));
+
+  /* Type, flags, message. */
+  rib->type = stream_getc (s);
+  rib->flags = stream_getc (s);
+  message = stream_getc (s);
+  safi = stream_getw (s);
+  rib->uptime = time (NULL);
+
+  /* IPv6 prefix. */
+  memset (&p, 0, sizeof (struct prefix_ipv6));
+  p.family = AF_INET6;
+  p.prefixlen = stream_getc (s);
+  stream_get (&p.prefix, s, PSIZE (p.prefixlen));
+
+  /* Nexthops, distance, metric, MTU, tag. */
+  zread_ipv6_route_attr (s, rib, message);
   
   /* Table */
   rib->table=zebrad.rtm_table_default;
@@ -1239,6 +1388,64 @@ zread_ipv6_add (struct zserv *client, u_short length, vrf_id_t vrf_id)
   return 0;
 }
 
+/* IPv6 counterpart of zread_ipv4_add_multi(). */
+static int
+zread_ipv6_add_multi (struct zserv *client, u_short length, vrf_id_t vrf_id)
+{
+  struct rib tmpl;
+  struct rib *rib;
+  struct prefix_ipv6 p;
+  u_char message;
+  struct stream *s;
+  safi_t safi;
+  u_int16_t count;
+  int ret;
+
+  s = client->ibuf;
+  memset (&tmpl, 0, sizeof (struct rib));
+
+  /* Type, flags, message. */
+  tmpl.type = stream_getc (s);
+  tmpl.flags = stream_getc (s);
+  message = stream_getc (s);
+  safi = stream_getw (s);
+  tmpl.uptime = time (NULL);
+  tmpl.vrf_id = vrf_id;
+  tmpl.table = zebrad.rtm_table_default;
+
+  /* Nexthops, distance, metric, MTU, tag. */
+  zread_ipv6_route_attr (s, &tmpl, message);
+
+  /* Prefixes. */
+  count = stream_getw (s);
+  while (count--)
+    {
+      memset (&p, 0, sizeof (struct prefix_ipv6));
+      p.family = AF_INET6;
+      p.prefixlen = stream_getc (s);
+      if (p.prefixlen > IPV6_MAX_BITLEN
+          || STREAM_READABLE (s) < (size_t) PSIZE (p.prefixlen))
+        {
+          zlog_warn ("%s: malformed prefix list from client %d",
+                     __func__, client->sock);
+          break;
+        }
+      stream_get (&p.prefix, s, PSIZE (p.prefixlen));
+
+      rib = zserv_rib_from_template (&tmpl);
+      ret = rib_add_ipv6_multipath (&p, rib, safi);
+
+      /* Stats */
+      if (ret > 0)
+        client->v6_route_add_cnt++;
+      else if (ret < 0)
+        client->v6_route_upd8_cnt++;
+    }
+
+  nexthops_free (tmpl.nexthop);
+  return 0;
+}
+
 /* Zebra server IPv6 prefix delete function. */
 static int
 zread_ipv6_delete (struct zserv *client, u_short length, vrf_id_t vrf_id)
@@ -1355,6 +1562,25 @@ zread_router_id_delete (struct zserv *client, u_short length, vrf_id_t vrf_id)
   return 0;
 }
 
+/* Answer a client's hello with the set of optional ZAPI features this
+ * zebra supports.  Clients which do not know about the reply ignore it.
+ */
+static int
+zsend_hello (struct zserv *client)
+{
+  struct stream *s;
+
+  s = client->obuf;
+  stream_reset (s);
+
+  zserv_create_header (s, ZEBRA_HELLO, VRF_DEFAULT);
+  stream_putc (s, ZAPI_CAPA_ROUTE_MULTI
+		  | (zebrad.zapi_ring ? ZAPI_CAPA_SHM_RING : 0));
+  stream_putw_at (s, 0, stream_get_endp (s));
+
+  return zebra_server_send_message (client);
+}
+
 /* Tie up route-type and client->sock */
 static void
 zread_hello (struct zserv *client)
@@ -1363,6 +1589,8 @@ zread_hello (struct zserv *client)
   u_char proto;
   proto = stream_getc (client->ibuf);
 
+  zsend_hello (client);
+
   /* accept only dynamic routing protocols */
   if ((proto < ZEBRA_ROUTE_MAX)
   &&  (proto > ZEBRA_ROUTE_STATIC))
@@ -1381,6 +1609,61 @@ zread_hello (struct zserv *client)
     }
 }
 
+/* The client has sent all its routes. */
+static void
+zread_end_of_rib (struct zserv *client)
+{
+  if (! client->proto)
+    {
+      zlog_warn ("client %d: end-of-RIB before hello, ignored",
+		 client->sock);
+      return;
+    }
+
+  rib_warm_restart_eor (client->proto);
+}
+
+static int zebra_client_ring_read (struct thread *);
+
+/* Switch the client over to the shared memory ring whose descriptors
+ * came with this message.  From here on the client writes its messages
+ * to the ring only, so if we cannot take it the connection is of no
+ * further use: close it and let the client come back without a ring.
+ */
+static void
+zread_ring_setup (struct zserv *client)
+{
+  if (client->ring)
+    {
+      zlog_warn ("client %d: shared memory ring already set up",
+		 client->sock);
+      return;
+    }
+
+  if (zebrad.zapi_ring && client->ring_nfd == 3)
+    {
+      client->ring = zring_attach (client->ring_fd[0], client->ring_fd[1],
+				   client->ring_fd[2]);
+      client->ring_nfd = 0;
+    }
+
+  if (! client->ring)
+    {
+      zlog_warn ("client %d: cannot set up shared memory ring, closing",
+		 client->sock);
+      client->t_suicide = thread_add_event (zebrad.master,
+					    zserv_delayed_close, client, 0);
+      return;
+    }
+
+  if (IS_ZEBRA_DEBUG_EVENT)
+    zlog_debug ("client %d: reading messages from %u byte ring",
+		client->sock, client->ring->size);
+
+  client->t_ring = thread_add_event (zebrad.master, zebra_client_ring_read,
+				     client, 0);
+}
+
 /* Unregister all information in a VRF. */
 static int
 zread_vrf_unregister (struct zserv *client, u_short length, vrf_id_t vrf_id)
@@ -1434,6 +1717,8 @@ zebra_client_close (struct zserv *client)
     stream_free (client->ibuf);
   if (client->obuf)
     stream_free (client->obuf);
+  if (client->rbuf)
+    stream_free (client->rbuf);
   if (client->wb)
     buffer_free(client->wb);
 
@@ -1444,6 +1729,14 @@ zebra_client_close (struct zserv *client)
     thread_cancel (client->t_write);
   if (client->t_suicide)
     thread_cancel (client->t_suicide);
+  if (client->t_ring)
+    thread_cancel (client->t_ring);
+
+  /* Unmap the shared memory ring. */
+  if (client->ring)
+    zring_free (client->ring);
+  while (client->ring_nfd > 0)
+    close (client->ring_fd[--client->ring_nfd]);
 
   /* Free client structure. */
   listnode_delete (zebrad.client_list, client);
@@ -1463,6 +1756,7 @@ zebra_client_create (int sock)
   client->sock = sock;
   client->ibuf = stream_new (ZEBRA_MAX_PACKET_SIZ);
   client->obuf = stream_new (ZEBRA_MAX_PACKET_SIZ);
+  client->rbuf = stream_new (ZEBRA_CLIENT_RBUF_SIZE);
   client->wb = buffer_new(0);
 
   /* Set table number. */
@@ -1483,103 +1777,21 @@ zebra_client_create (int sock)
   zebra_event (ZEBRA_READ, sock, client);
 }
 
-/* Handler of zebra service request. */
-static int
-zebra_client_read (struct thread *thread)
+/* Dispatch a single, complete ZAPI message sitting in client->ibuf. */
+static void
+zebra_client_dispatch (struct zserv *client)
 {
-  int sock;
-  struct zserv *client;
-  size_t already;
+  int sock = client->sock;
   uint16_t length, command;
-  uint8_t marker, version;
   vrf_id_t vrf_id;
 
-  /* Get thread data.  Reset reading thread because I'm running. */
-  sock = THREAD_FD (thread);
-  client = THREAD_ARG (thread);
-  client->t_read = NULL;
-
-  if (client->t_suicide)
-    {
-      zebra_client_close(client);
-      return -1;
-    }
-
-  /* Read length and command (if we don't have it already). */
-  if ((already = stream_get_endp(client->ibuf)) < ZEBRA_HEADER_SIZE)
-    {
-      ssize_t nbyte;
-      if (((nbyte = stream_read_try (client->ibuf, sock,
-				     ZEBRA_HEADER_SIZE-already)) == 0) ||
-	  (nbyte == -1))
-	{
-	  if (IS_ZEBRA_DEBUG_EVENT)
-	    zlog_debug ("connection closed socket [%d]", sock);
-	  zebra_client_close (client);
-	  return -1;
-	}
-      if (nbyte != (ssize_t)(ZEBRA_HEADER_SIZE-already))
-	{
-	  /* Try again later. */
-	  zebra_event (ZEBRA_READ, sock, client);
-	  return 0;
-	}
-      already = ZEBRA_HEADER_SIZE;
-    }
-
-  /* Reset to read from the beginning of the incoming packet. */
-  stream_set_getp(client->ibuf, 0);
-
-  /* Fetch header values */
+  /* Fetch header values, already validated by the caller. */
+  stream_set_getp (client->ibuf, 0);
   length = stream_getw (client->ibuf);
-  marker = stream_getc (client->ibuf);
-  version = stream_getc (client->ibuf);
+  stream_forward_getp (client->ibuf, 2);	/* marker, version */
   vrf_id = stream_getw (client->ibuf);
   command = stream_getw (client->ibuf);
 
-  if (marker != ZEBRA_HEADER_MARKER || version != ZSERV_VERSION)
-    {
-      zlog_err("%s: socket %d version mismatch, marker %d, version %d",
-               __func__, sock, marker, version);
-      zebra_client_close (client);
-      return -1;
-    }
-  if (length < ZEBRA_HEADER_SIZE) 
-    {
-      zlog_warn("%s: socket %d message length %u is less than header size %d",
-	        __func__, sock, length, ZEBRA_HEADER_SIZE);
-      zebra_client_close (client);
-      return -1;
-    }
-  if (length > STREAM_SIZE(client->ibuf))
-    {
-      zlog_warn("%s: socket %d message length %u exceeds buffer size %lu",
-	        __func__, sock, length, (u_long)STREAM_SIZE(client->ibuf));
-      zebra_client_close (client);
-      return -1;
-    }
-
-  /* Read rest of data. */
-  if (already < length)
-    {
-      ssize_t nbyte;
-      if (((nbyte = stream_read_try (client->ibuf, sock,
-				     length-already)) == 0) ||
-	  (nbyte == -1))
-	{
-	  if (IS_ZEBRA_DEBUG_EVENT)
-	    zlog_debug ("connection closed [%d] when reading zebra data", sock);
-	  zebra_client_close (client);
-	  return -1;
-	}
-      if (nbyte != (ssize_t)(length-already))
-        {
-	  /* Try again later. */
-	  zebra_event (ZEBRA_READ, sock, client);
-	  return 0;
-	}
-    }
-
   length -= ZEBRA_HEADER_SIZE;
 
   /* Debug packet information. */
@@ -1613,10 +1825,16 @@ zebra_client_read (struct thread *thread)
     case ZEBRA_IPV4_ROUTE_DELETE:
       zread_ipv4_delete (client, length, vrf_id);
       break;
+    case ZEBRA_IPV4_ROUTE_ADD_MULTI:
+      zread_ipv4_add_multi (client, length, vrf_id);
+      break;
 #ifdef HAVE_IPV6
     case ZEBRA_IPV6_ROUTE_ADD:
       zread_ipv6_add (client, length, vrf_id);
       break;
+    case ZEBRA_IPV6_ROUTE_ADD_MULTI:
+      zread_ipv6_add_multi (client, length, vrf_id);
+      break;
     case ZEBRA_IPV6_ROUTE_DELETE:
       zread_ipv6_delete (client, length, vrf_id);
       break;
@@ -1648,6 +1866,12 @@ zebra_client_read (struct thread *thread)
     case ZEBRA_HELLO:
       zread_hello (client);
       break;
+    case ZEBRA_SHM_RING_SETUP:
+      zread_ring_setup (client);
+      break;
+    case ZEBRA_END_OF_RIB:
+      zread_end_of_rib (client);
+      break;
     case ZEBRA_VRF_UNREGISTER:
       zread_vrf_unregister (client, length, vrf_id);
     case ZEBRA_NEXTHOP_REGISTER:
@@ -1660,19 +1884,271 @@ zebra_client_read (struct thread *thread)
       zlog_info ("Zebra received unknown command %d", command);
       break;
     }
+}
+
+/* Process as many complete messages from client->rbuf as the budget
+ * allows.  Returns -1 if the client was closed, 1 if complete messages
+ * remain buffered, 0 otherwise.
+ */
+static int
+zebra_client_process (struct thread *thread, struct zserv *client)
+{
+  int sock = client->sock;
+  struct stream *rbuf = client->rbuf;
+  u_int32_t processed = 0;
+  uint16_t length;
+  uint8_t marker, version;
+  int more = 0;
+
+  client->rx_wakeup_cnt++;
+
+  while (STREAM_READABLE (rbuf) >= ZEBRA_HEADER_SIZE)
+    {
+      size_t getp = stream_get_getp (rbuf);
+
+      length = stream_getw_from (rbuf, getp);
+      marker = stream_getc_from (rbuf, getp + 2);
+      version = stream_getc_from (rbuf, getp + 3);
+
+      if (marker != ZEBRA_HEADER_MARKER || version != ZSERV_VERSION)
+	{
+	  zlog_err("%s: socket %d version mismatch, marker %d, version %d",
+		   __func__, sock, marker, version);
+	  zebra_client_close (client);
+	  return -1;
+	}
+      if (length < ZEBRA_HEADER_SIZE) 
+	{
+	  zlog_warn("%s: socket %d message length %u is less than header size %d",
+		    __func__, sock, length, ZEBRA_HEADER_SIZE);
+	  zebra_client_close (client);
+	  return -1;
+	}
+      if (length > STREAM_SIZE(client->ibuf))
+	{
+	  zlog_warn("%s: socket %d message length %u exceeds buffer size %lu",
+		    __func__, sock, length, (u_long)STREAM_SIZE(client->ibuf));
+	  zebra_client_close (client);
+	  return -1;
+	}
+
+      /* Incomplete message, wait for the rest of it. */
+      if (STREAM_READABLE (rbuf) < length)
+	break;
+
+      /* Out of budget: leave the rest for the next go round, so other
+       * clients get a look in. */
+      if (processed >= zebrad.zapi_packets || thread_should_yield (thread))
+	{
+	  more = 1;
+	  break;
+	}
+
+      stream_reset (client->ibuf);
+      stream_put (client->ibuf, STREAM_PNT (rbuf), length);
+      stream_forward_getp (rbuf, length);
+
+      zebra_client_dispatch (client);
+      processed++;
+
+      if (client->t_suicide)
+	{
+	  /* No need to wait for thread callback, just kill immediately. */
+	  zebra_client_close(client);
+	  return -1;
+	}
+    }
+
+  client->rx_msg_cnt += processed;
+  if (processed > client->rx_msg_max_batch)
+    client->rx_msg_max_batch = processed;
+
+  /* Make room at the end of the buffer for the next read. */
+  stream_discard (rbuf);
+  stream_reset (client->ibuf);
+
+  return more;
+}
+
+/* Continue processing messages left over from a previous wakeup. */
+static int
+zebra_client_read_buffered (struct thread *thread)
+{
+  struct zserv *client = THREAD_ARG (thread);
+  int ret;
+
+  client->t_read = NULL;
 
   if (client->t_suicide)
     {
-      /* No need to wait for thread callback, just kill immediately. */
       zebra_client_close(client);
       return -1;
     }
 
-  stream_reset (client->ibuf);
-  zebra_event (ZEBRA_READ, sock, client);
+  if ((ret = zebra_client_process (thread, client)) < 0)
+    return -1;
+
+  zebra_event (ret ? ZEBRA_PROCESS : ZEBRA_READ, client->sock, client);
   return 0;
 }
 
+/* Read from the client socket into client->rbuf, like stream_read_try(),
+ * also picking up any descriptors passed along for
+ * ZEBRA_SHM_RING_SETUP.
+ */
+static ssize_t
+zebra_client_recvmsg (struct zserv *client, int sock)
+{
+  struct stream *rbuf = client->rbuf;
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  union
+  {
+    char buf[CMSG_SPACE (3 * sizeof (int))];
+    struct cmsghdr align;
+  } u;
+  ssize_t nbytes;
+
+  memset (&msg, 0, sizeof (msg));
+  iov.iov_base = STREAM_DATA (rbuf) + stream_get_endp (rbuf);
+  iov.iov_len = STREAM_WRITEABLE (rbuf);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = u.buf;
+  msg.msg_controllen = sizeof (u.buf);
+
+  nbytes = recvmsg (sock, &msg, 0);
+  if (nbytes < 0)
+    {
+      if (ERRNO_IO_RETRY (errno))
+	return -2;
+      zlog_warn ("%s: recvmsg failed on fd %d: %s", __func__, sock,
+		 safe_strerror (errno));
+      return -1;
+    }
+  stream_forward_endp (rbuf, nbytes);
+
+  for (cmsg = CMSG_FIRSTHDR (&msg); cmsg; cmsg = CMSG_NXTHDR (&msg, cmsg))
+    {
+      int *fds = (int *) CMSG_DATA (cmsg);
+      int i, n;
+
+      if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+	continue;
+
+      n = (cmsg->cmsg_len - CMSG_LEN (0)) / sizeof (int);
+      for (i = 0; i < n; i++)
+	{
+	  if (client->ring_nfd < 3)
+	    client->ring_fd[client->ring_nfd++] = fds[i];
+	  else
+	    close (fds[i]);
+	}
+    }
+
+  return nbytes;
+}
+
+/* Handler of zebra service request. */
+static int
+zebra_client_read (struct thread *thread)
+{
+  int sock;
+  struct zserv *client;
+  ssize_t nbyte;
+  int ret;
+
+  /* Get thread data.  Reset reading thread because I'm running. */
+  sock = THREAD_FD (thread);
+  client = THREAD_ARG (thread);
+  client->t_read = NULL;
+
+  if (client->t_suicide)
+    {
+      zebra_client_close(client);
+      return -1;
+    }
+
+  /* Read whatever the socket has for us, up to the free space left in
+   * the buffer.  Once the client has moved to a shared memory ring,
+   * nothing but the connection closing is expected here. */
+  if (client->ring)
+    {
+      char dummy;
+
+      nbyte = read (sock, &dummy, sizeof (dummy));
+      if (nbyte > 0)
+	{
+	  zlog_warn ("%s: socket %d sent data outside its ring, closing",
+		     __func__, sock);
+	  zebra_client_close (client);
+	  return -1;
+	}
+      if (nbyte < 0)
+	nbyte = ERRNO_IO_RETRY (errno) ? -2 : -1;
+    }
+  else if (zebrad.zapi_ring)
+    nbyte = zebra_client_recvmsg (client, sock);
+  else
+    nbyte = stream_read_try (client->rbuf, sock,
+			     STREAM_WRITEABLE (client->rbuf));
+  if (nbyte == 0 || nbyte == -1)
+    {
+      if (IS_ZEBRA_DEBUG_EVENT)
+	zlog_debug ("connection closed socket [%d]", sock);
+      zebra_client_close (client);
+      return -1;
+    }
+
+  if ((ret = zebra_client_process (thread, client)) < 0)
+    return -1;
+
+  zebra_event (ret ? ZEBRA_PROCESS : ZEBRA_READ, sock, client);
+  return 0;
+}
+
+
+/* Pull messages out of the client's shared memory ring.  They go through
+ * client->rbuf and the usual per wakeup budget, exactly as if they had
+ * been read from the socket.
+ */
+static int
+zebra_client_ring_read (struct thread *thread)
+{
+  struct zserv *client = THREAD_ARG (thread);
+  struct stream *rbuf = client->rbuf;
+  size_t nbytes;
+  int ret;
+
+  client->t_ring = NULL;
+
+  if (client->t_suicide)
+    {
+      zebra_client_close(client);
+      return -1;
+    }
+
+  zring_eventfd_clear (client->ring->efd_data);
+
+  nbytes = zring_read (client->ring,
+		       STREAM_DATA (rbuf) + stream_get_endp (rbuf),
+		       STREAM_WRITEABLE (rbuf));
+  stream_forward_endp (rbuf, nbytes);
+
+  if ((ret = zebra_client_process (thread, client)) < 0)
+    return -1;
+
+  /* Sleep on the doorbell only when we have caught up with the client. */
+  if (ret || zring_readable (client->ring)
+      || zring_consumer_sleep (client->ring) < 0)
+    client->t_ring = thread_add_event (zebrad.master, zebra_client_ring_read,
+				       client, 0);
+  else
+    client->t_ring = thread_add_read (zebrad.master, zebra_client_ring_read,
+				      client, client->ring->efd_data);
+  return 0;
+}
 
 /* Accept code of zebra server socket. */
 static int
@@ -1847,6 +2323,10 @@ zebra_event (enum event event, int sock, struct zserv *client)
       client->t_read = 
 	thread_add_read (zebrad.master, zebra_client_read, client, sock);
       break;
+    case ZEBRA_PROCESS:
+      client->t_read =
+	thread_add_event (zebrad.master, zebra_client_read_buffered, client, 0);
+      break;
     case ZEBRA_WRITE:
       /**/
       break;
@@ -1950,6 +2430,17 @@ zebra_show_client_detail (struct vty *vty, struct zserv *client)
 	   VTY_NEWLINE);
   vty_out (vty, "Interface Down Notifications: %d%s", client->ifdown_cnt,
 	   VTY_NEWLINE);
+  vty_out (vty, "Read Wakeups: %u, Msgs: %u, Avg/Max Msgs per Wakeup: %u/%u%s",
+	   client->rx_wakeup_cnt, client->rx_msg_cnt,
+	   client->rx_wakeup_cnt ?
+	     client->rx_msg_cnt / client->rx_wakeup_cnt : 0,
+	   client->rx_msg_max_batch, VTY_NEWLINE);
+  if (client->ring)
+    vty_out (vty, "Transport: shared memory ring, %u bytes, %lu pending%s",
+	     client->ring->size, (u_long) zring_readable (client->ring),
+	     VTY_NEWLINE);
+  else
+    vty_out (vty, "Transport: socket%s", VTY_NEWLINE);
 
   vty_out (vty, "%s", VTY_NEWLINE);
   return;
@@ -2079,6 +2570,60 @@ DEFUN (show_zebra_client_summary,
   return CMD_SUCCESS;
 }
 
+DEFUN (zebra_zapi_packets,
+       zebra_zapi_packets_cmd,
+       "zebra zapi-packets <1-10000>",
+       "Zebra information\n"
+       "Set max number of ZAPI messages processed per client read wakeup\n"
+       "Number of messages\n")
+{
+  VTY_GET_INTEGER_RANGE ("zapi-packets", zebrad.zapi_packets, argv[0],
+			 1, 10000);
+  return CMD_SUCCESS;
+}
+
+DEFUN (no_zebra_zapi_packets,
+       no_zebra_zapi_packets_cmd,
+       "no zebra zapi-packets",
+       NO_STR
+       "Zebra information\n"
+       "Set max number of ZAPI messages processed per client read wakeup\n")
+{
+  zebrad.zapi_packets = ZEBRA_ZAPI_PACKETS_DEFAULT;
+  return CMD_SUCCESS;
+}
+
+ALIAS (no_zebra_zapi_packets,
+       no_zebra_zapi_packets_val_cmd,
+       "no zebra zapi-packets <1-10000>",
+       NO_STR
+       "Zebra information\n"
+       "Set max number of ZAPI messages processed per client read wakeup\n"
+       "Number of messages\n")
+
+#if defined (HAVE_ZAPI_RING) && !defined (HAVE_TCP_ZEBRA)
+DEFUN (zebra_zapi_ring,
+       zebra_zapi_ring_cmd,
+       "zebra zapi-ring",
+       "Zebra information\n"
+       "Let clients send their messages through a shared memory ring\n")
+{
+  zebrad.zapi_ring = 1;
+  return CMD_SUCCESS;
+}
+
+DEFUN (no_zebra_zapi_ring,
+       no_zebra_zapi_ring_cmd,
+       "no zebra zapi-ring",
+       NO_STR
+       "Zebra information\n"
+       "Let clients send their messages through a shared memory ring\n")
+{
+  zebrad.zapi_ring = 0;
+  return CMD_SUCCESS;
+}
+#endif /* HAVE_ZAPI_RING && !HAVE_TCP_ZEBRA */
+
 /* Table configuration write function. */
 static int
 config_write_table (struct vty *vty)
@@ -2086,6 +2631,11 @@ config_write_table (struct vty *vty)
   if (zebrad.rtm_table_default)
     vty_out (vty, "table %d%s", zebrad.rtm_table_default,
 	     VTY_NEWLINE);
+  if (zebrad.zapi_packets != ZEBRA_ZAPI_PACKETS_DEFAULT)
+    vty_out (vty, "zebra zapi-packets %u%s", zebrad.zapi_packets,
+	     VTY_NEWLINE);
+  if (zebrad.zapi_ring)
+    vty_out (vty, "zebra zapi-ring%s", VTY_NEWLINE);
   return 0;
 }
 
@@ -2242,6 +2792,7 @@ zebra_init (void)
 {
   /* Client list init. */
   zebrad.client_list = list_new ();
+  zebrad.zapi_packets = ZEBRA_ZAPI_PACKETS_DEFAULT;
 
   /* Install configuration write function. */
   install_node (&table_node, config_write_table);
@@ -2255,6 +2806,13 @@ zebra_init (void)
   install_element (CONFIG_NODE, &no_ip_forwarding_cmd);
   install_element (ENABLE_NODE, &show_zebra_client_cmd);
   install_element (ENABLE_NODE, &show_zebra_client_summary_cmd);
+  install_element (CONFIG_NODE, &zebra_zapi_packets_cmd);
+  install_element (CONFIG_NODE, &no_zebra_zapi_packets_cmd);
+  install_element (CONFIG_NODE, &no_zebra_zapi_packets_val_cmd);
+#if defined (HAVE_ZAPI_RING) && !defined (HAVE_TCP_ZEBRA)
+  install_element (CONFIG_NODE, &zebra_zapi_ring_cmd);
+  install_element (CONFIG_NODE, &no_zebra_zapi_ring_cmd);
+#endif /* HAVE_ZAPI_RING && !HAVE_TCP_ZEBRA */
 
 #ifdef HAVE_NETLINK
   install_element (VIEW_NODE, &show_table_cmd);
@@ -33,6 +33,13 @@
 /* Default configuration filename. */
 #define DEFAULT_CONFIG_FILE "zebra.conf"
 
+/* Size of the per-client raw read buffer, enough to hold a good number
+ * of complete ZAPI messages per read(). */
+#define ZEBRA_CLIENT_RBUF_SIZE        (ZEBRA_MAX_PACKET_SIZ * 16)
+
+/* Default number of ZAPI messages processed per client read wakeup. */
+#define ZEBRA_ZAPI_PACKETS_DEFAULT    1000
+
 /* Client structure. */
 struct zserv
 {
@@ -43,6 +50,9 @@ struct zserv
   struct stream *ibuf;
   struct stream *obuf;
 
+  /* Raw data read from the socket, possibly several messages. */
+  struct stream *rbuf;
+
   /* Buffer of data waiting to be written to client. */
   struct buffer *wb;
 
@@ -53,6 +63,14 @@ struct zserv
   /* Thread for delayed close. */
   struct thread *t_suicide;
 
+  /* Shared memory ring the client sends its messages through, see
+   * lib/zring.h, and descriptors received ahead of the
+   * ZEBRA_SHM_RING_SETUP message which hands it over. */
+  struct zring *ring;
+  struct thread *t_ring;
+  int ring_fd[3];
+  int ring_nfd;
+
   /* default routing table this client munges */
   int rtm_table;
 
@@ -89,6 +107,11 @@ struct zserv
   u_int32_t ifadd_cnt;
   u_int32_t ifdel_cnt;
 
+  /* Read batching statistics */
+  u_int32_t rx_wakeup_cnt;
+  u_int32_t rx_msg_cnt;
+  u_int32_t rx_msg_max_batch;
+
   time_t connect_time;
   time_t last_read_time;
   time_t last_write_time;
@@ -110,6 +133,19 @@ struct zebra_t
   /* default table */
   int rtm_table_default;
 
+  /* Max ZAPI messages to process per client read wakeup */
+  u_int32_t zapi_packets;
+
+  /* Offer clients a shared memory ring for their messages */
+  int zapi_ring;
+
+  /* Interface and address events are being batched, see rib_update() */
+  struct thread *t_if_batch;
+
+  /* Warm restart grace period in seconds, 0 if disabled */
+  u_int32_t warm_restart;
+  struct thread *t_warm_restart;
+
   /* rib work queue */
   struct work_queue *ribq;
   struct meta_queue *mq;
@@ -140,6 +176,7 @@ extern int zsend_router_id_update (struct zserv *, struct prefix *,
                                    vrf_id_t);
 
 extern int zsend_interface_link_params (struct zserv *, struct interface *);
+extern void zserv_batch_flush (void);
 
 extern pid_t pid;
 